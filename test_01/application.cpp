@@ -4,6 +4,7 @@
 #include <cstring>
 #include <string>
 #include <algorithm>
+#include <iterator>
 #include <exception>
 
 #include <iostream>
@@ -14,7 +15,8 @@
 
 namespace SPH
 {
-	Application::Application()
+	Application::Application(const Settings& settings)
+		: settings(settings)
 	{
 		InitializeWindow();
 		InitializeVulkan();
@@ -22,27 +24,45 @@ namespace SPH
 
 	Application::~Application()
 	{
-
+		// the window loop threw, stop stepping before the device goes away
+		if (simulationThread.joinable())
+		{
+			simulationRunning = false;
+			simulationThread.join();
+		}
+		memoryTracker.Print("shutdown");
 		destroyVulkan();
 		destroyWindow();
 	}
 
 	void Application::destroyWindow()
 	{
+		if (!window)
+		{
+			return;
+		}
 		glfwDestroyWindow(window);
 		glfwTerminate();
 	}
 
 	void Application::destroyVulkan()
 	{
-		vkDestroySwapchainKHR(logicalDeviceHandle, swapchainHandle, NULL);
+		gpuPrimitives.reset();
+		uploads.reset();
+		capture.reset();
+		exporter.reset();
+		vkDestroySwapchainKHR(logicalDeviceHandle, swapchainHandle, allocator);
 		vkDestroySurfaceKHR(instanceHandle, surfaceHandle, NULL);
-		vkDestroyDevice(logicalDeviceHandle, NULL);
-		vkDestroyInstance(instanceHandle, NULL);
+		vkDestroyDevice(logicalDeviceHandle, allocator);
+		vkDestroyInstance(instanceHandle, allocator);
 	}
 
 	void Application::InitializeWindow()
 	{
+		if (settings.headless)
+		{
+			return;
+		}
 		if (!glfwInit())
 		{
 			throw std::runtime_error("glfw initialization failed");
@@ -73,6 +93,10 @@ namespace SPH
 			{
 				app_ptr->paused = !app_ptr->paused;
 			}
+			if (key == GLFW_KEY_M && action == GLFW_PRESS)
+			{
+				app_ptr->memoryReportRequested = true;
+			}
 			if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
 			{
 				glfwSetWindowShouldClose(window, GLFW_TRUE);
@@ -85,32 +109,72 @@ namespace SPH
 	void Application::InitializeVulkan()
 	{
 		CreateInstance();
-		CreateSurface();
+		if (!settings.headless)
+		{
+			CreateSurface();
+		}
 		SelectPhysicalDevice();
 		CreateLogicalDevice();
 		GetDeviceQueues();
-		CreateSwapchain();
-		GetSwapchainImages();
-		CreateSwapchainImageViews();
+		if (settings.headless)
+		{
+			// the offscreen target takes the format the swapchain would have
+			surfaceFormat = { VK_FORMAT_B8G8R8A8_SRGB, VK_COLOR_SPACE_SRGB_NONLINEAR_KHR };
+		}
+		else
+		{
+			CreateSwapchain();
+			GetSwapchainImages();
+			CreateSwapchainImageViews();
+		}
 		CreateRenderPass();
-		CreateSwapchainFrameBuffers();
+		if (!settings.headless)
+		{
+			CreateSwapchainFrameBuffers();
+		}
 		CreatePipelineCache();
 		CreateDescriptorPool();
+		CreateGpuPrimitives();
 		CreateBuffers();
+		CreateUploadManager();
+		// the vertex shader reads the particle buffer through the compute descriptor set
+		CreateComputeDescriptorSetLayout();
+		UpdateComputeDescriptorSets();
 
+		if (settings.renderer == Renderer::Splat)
+		{
+			CreateSplatTarget();
+		}
 		CreateGraphicsPipelineLayout();
 		CreateGraphicsPipeline();
+		// the frames time their render pass for traces
+		CreateTimestampQueryPool();
 		CreateGraphicsCommandPool();
 		CreateGraphicsCommandBuffers();
 		CreateSemaphores();
-		CreateComputeDescriptorSetLayout();
-		UpdateComputeDescriptorSets();
+		CreateRenderTimestampCommandBuffers();
+		if (!settings.capturePath.empty())
+		{
+			CreateCaptureTarget();
+			CreateCaptureCommandBuffers();
+		}
 		CreateComputePipelineLayout();
 		CreateComputePipelines();
 		CreateComputeCommandPool();
 		CreateComputeCommandBuffer();
+		CreateReorderCommandBuffer();
+		CreateEmissionCommandBuffer();
+		CreateCompactionCommandBuffer();
+		CreateAdaptCommandBuffer();
+		CreateSnapshotCommandBuffers();
+		CreateTimestampReadback();
+		if (!settings.exportName.empty())
+		{
+			CreateStateExport();
+		}
 
 		SetInitialParticleData();
+		memoryTracker.Print("startup");
 	}
 
 	void Application::CreateInstance()
@@ -150,9 +214,9 @@ namespace SPH
 				<< VK_VERSION_PATCH(extension.specVersion) << std::endl;
 		}
 
+		// a headless run needs no surface extensions
 		uint32_t glfwExtensionCount = 0;
-		const char** glfwExtensions;
-		glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+		const char** glfwExtensions = settings.headless ? nullptr : glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 		std::vector<const char*> instanceExtensions(glfwExtensionCount);
 		std::memcpy(instanceExtensions.data(), glfwExtensions, sizeof(char*) * glfwExtensionCount);
 
@@ -161,7 +225,7 @@ namespace SPH
 		instanceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(instanceExtensions.size());
 		instanceCreateInfo.ppEnabledExtensionNames = instanceExtensions.data();
 
-		if (vkCreateInstance(&instanceCreateInfo, NULL, &instanceHandle) != VK_SUCCESS)
+		if (vkCreateInstance(&instanceCreateInfo, allocator, &instanceHandle) != VK_SUCCESS)
 		{
 			throw std::runtime_error("vulkan instance creation failed");
 		}
@@ -179,8 +243,13 @@ namespace SPH
 	void Application::SelectPhysicalDevice()
 	{
 		auto physicalDevices = CsySmallVk::Query::physicalDevices(instanceHandle);
-		// select first device and set it as the device used throughout the program
-		physicalDeviceHandle = physicalDevices[0];
+		// select the requested device, the first one by default, and use it throughout the program
+		if (settings.deviceIndex >= physicalDevices.size())
+		{
+			throw std::runtime_error("device index " + std::to_string(settings.deviceIndex) + " out of range, "
+				+ std::to_string(physicalDevices.size()) + " devices available");
+		}
+		physicalDeviceHandle = physicalDevices[settings.deviceIndex];
 
 		// get this device properties
 		vkGetPhysicalDeviceProperties(physicalDeviceHandle, &physicalDeviceProperties);
@@ -233,6 +302,17 @@ namespace SPH
 
 		// get memory properties
 		vkGetPhysicalDeviceMemoryProperties(physicalDeviceHandle, &physicalDeviceMemoryProperties);
+		VkPhysicalDeviceMaintenance3Properties maintenance3Properties{};
+		maintenance3Properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_3_PROPERTIES;
+		VkPhysicalDeviceProperties2 properties2{};
+		properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+		properties2.pNext = &maintenance3Properties;
+		vkGetPhysicalDeviceProperties2(physicalDeviceHandle, &properties2);
+		maxAllocationSize = maintenance3Properties.maxMemoryAllocationSize;
+		if (SPH_MAX_ALLOCATION_SIZE > 0)
+		{
+			maxAllocationSize = std::min<VkDeviceSize>(maxAllocationSize, SPH_MAX_ALLOCATION_SIZE);
+		}
 	}
 
 	void Application::CreateLogicalDevice()
@@ -263,8 +343,11 @@ namespace SPH
 
 			// try to search a queue family that contain graphics queue, compute queue, and presentation queue
 			// note: queue family index must be unique in the device queue create info
-			VkBool32 presentationSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(physicalDeviceHandle, index, surfaceHandle, &presentationSupport);
+			VkBool32 presentationSupport = settings.headless;
+			if (!settings.headless)
+			{
+				vkGetPhysicalDeviceSurfaceSupportKHR(physicalDeviceHandle, index, surfaceHandle, &presentationSupport);
+			}
 			if (queueFamilies[index].queueCount > 0 && queueFamilies[index].queueFlags & VK_QUEUE_GRAPHICS_BIT && presentationSupport && queueFamilies[index].queueFlags & VK_QUEUE_COMPUTE_BIT)
 			{
 				graphicsPresentationComputeQueueFamilyIndex = index;
@@ -274,25 +357,227 @@ namespace SPH
 		{
 			throw std::runtime_error("unable to find a family queue with graphics, presentation, and compute queue");
 		}
+		// the uploads go to a transfer-only family (the copy engines) when there is one
+		for (uint32_t index = 0; index < queueFamilies.size(); index++)
+		{
+			if (queueFamilies[index].queueCount > 0 && queueFamilies[index].queueFlags & VK_QUEUE_TRANSFER_BIT
+				&& !(queueFamilies[index].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+			{
+				transferQueueFamilyIndex = index;
+				break;
+			}
+		}
 		const float queuePriorities[3]{ 1, 1, 1 };
-		VkDeviceQueueCreateInfo queueCreateInfo = CsySmallVk::deviceQueueCreateInfo();
+		VkDeviceQueueCreateInfo queueCreateInfos[2]{ CsySmallVk::deviceQueueCreateInfo(), CsySmallVk::deviceQueueCreateInfo() };
+		VkDeviceQueueCreateInfo& queueCreateInfo = queueCreateInfos[0];
 		queueCreateInfo.queueCount = 3;
 		queueCreateInfo.pQueuePriorities = queuePriorities;
 		queueCreateInfo.queueFamilyIndex = graphicsPresentationComputeQueueFamilyIndex;
+		queueCreateInfos[1].queueCount = 1;
+		queueCreateInfos[1].pQueuePriorities = queuePriorities;
+		queueCreateInfos[1].queueFamilyIndex = transferQueueFamilyIndex;
+		if (transferQueueFamilyIndex != UINT32_MAX)
+		{
+			std::cout << "[INFO] uploads: transfer queue family " << transferQueueFamilyIndex << std::endl;
+		}
+		else
+		{
+			std::cout << "[INFO] uploads: no transfer-only queue family, sharing the compute queue" << std::endl;
+		}
 	
-		const char* enabledExtensions = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+		std::vector<const char*> enabledExtensions;
+		if (!settings.headless)
+		{
+			enabledExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+		}
+
+		// float atomics let the symmetric force kernel scatter every pair's contribution to both particles
+		VkPhysicalDeviceShaderAtomicFloatFeaturesEXT atomicFloatFeatures{};
+		atomicFloatFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_FLOAT_FEATURES_EXT;
+		auto physicalDeviceExtensions = CsySmallVk::Query::deviceExtensionProperties(physicalDeviceHandle);
+		if (std::any_of(physicalDeviceExtensions.begin(), physicalDeviceExtensions.end(),
+			[](const VkExtensionProperties& extension) { return std::strcmp(extension.extensionName, VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME) == 0; }))
+		{
+			VkPhysicalDeviceFeatures2 features2{};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features2.pNext = &atomicFloatFeatures;
+			vkGetPhysicalDeviceFeatures2(physicalDeviceHandle, &features2);
+		}
+		atomicFloatSupported = atomicFloatFeatures.shaderBufferFloat32AtomicAdd == VK_TRUE;
+		VkPhysicalDeviceShaderAtomicFloatFeaturesEXT enabledAtomicFloatFeatures{};
+		enabledAtomicFloatFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SHADER_ATOMIC_FLOAT_FEATURES_EXT;
+		enabledAtomicFloatFeatures.shaderBufferFloat32AtomicAdd = VK_TRUE;
+		if (atomicFloatSupported)
+		{
+			enabledExtensions.push_back(VK_EXT_SHADER_ATOMIC_FLOAT_EXTENSION_NAME);
+		}
+
+		// heap budgets and the process' usage of them for the memory report
+		const bool memoryBudgetSupported = std::any_of(physicalDeviceExtensions.begin(), physicalDeviceExtensions.end(),
+			[](const VkExtensionProperties& extension) { return std::strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0; });
+		if (memoryBudgetSupported)
+		{
+			enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		}
+		memoryTracker.SetPhysicalDevice(physicalDeviceHandle, memoryBudgetSupported);
+
+		// traces line the gpu timestamps up with the cpu clock through a sample of both at once, when the device has
+		// the extension and can sample the host clock the tracer uses
+		if (!settings.tracePath.empty() && std::any_of(physicalDeviceExtensions.begin(), physicalDeviceExtensions.end(),
+			[](const VkExtensionProperties& extension) { return std::strcmp(extension.extensionName, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME) == 0; }))
+		{
+			auto getTimeDomains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+				vkGetInstanceProcAddr(instanceHandle, "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+			uint32_t timeDomainCount = 0;
+			std::vector<VkTimeDomainEXT> timeDomains;
+			if (getTimeDomains && getTimeDomains(physicalDeviceHandle, &timeDomainCount, NULL) == VK_SUCCESS)
+			{
+				timeDomains.resize(timeDomainCount);
+				getTimeDomains(physicalDeviceHandle, &timeDomainCount, timeDomains.data());
+			}
+			calibratedTimestampsSupported = std::count(timeDomains.begin(), timeDomains.end(), VK_TIME_DOMAIN_DEVICE_EXT) > 0
+				&& std::count(timeDomains.begin(), timeDomains.end(), SPH_TRACE_HOST_TIME_DOMAIN) > 0;
+			if (calibratedTimestampsSupported)
+			{
+				enabledExtensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+			}
+		}
+
+		// fp16 particle storage only converts on load and store, so 16-bit storage buffer access is all it needs
+		VkPhysicalDevice16BitStorageFeatures storage16BitFeatures{};
+		storage16BitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES;
+		{
+			VkPhysicalDeviceFeatures2 features2{};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features2.pNext = &storage16BitFeatures;
+			vkGetPhysicalDeviceFeatures2(physicalDeviceHandle, &features2);
+		}
+		halfStorageSupported = storage16BitFeatures.storageBuffer16BitAccess == VK_TRUE;
+		VkPhysicalDevice16BitStorageFeatures enabledStorage16BitFeatures{};
+		enabledStorage16BitFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_16BIT_STORAGE_FEATURES;
+		enabledStorage16BitFeatures.pNext = atomicFloatSupported ? &enabledAtomicFloatFeatures : nullptr;
+		enabledStorage16BitFeatures.storageBuffer16BitAccess = VK_TRUE;
+
+		halfStorage = settings.halfStorage;
+		if (halfStorage && !halfStorageSupported)
+		{
+			std::cout << "[WARNING] storageBuffer16BitAccess is not supported, storing particles as fp32" << std::endl;
+			halfStorage = false;
+		}
+		particleLayout = settings.particleLayout;
+		std::cout << "[INFO] particle storage: " << (halfStorage ? "fp16" : "fp32") << ", " << Settings::ParticleLayoutName(particleLayout) << " layout" << std::endl;
+
+		forceKernel = settings.forceKernel;
+		if (forceKernel == ForceKernel::Symmetric && !atomicFloatSupported)
+		{
+			std::cout << "[WARNING] shaderBufferFloat32AtomicAdd is not supported, using the gather force kernel" << std::endl;
+			forceKernel = ForceKernel::Gather;
+		}
+		std::cout << "[INFO] force kernel: " << Settings::ForceKernelName(forceKernel) << std::endl;
+
 		VkDeviceCreateInfo deviceCreateInfo = CsySmallVk::deviceCreateInfo();
-		deviceCreateInfo.enabledExtensionCount = 1;
-		deviceCreateInfo.ppEnabledExtensionNames = &enabledExtensions;
+		if (halfStorageSupported)
+		{
+			deviceCreateInfo.pNext = &enabledStorage16BitFeatures;
+		}
+		else
+		{
+			deviceCreateInfo.pNext = atomicFloatSupported ? &enabledAtomicFloatFeatures : nullptr;
+		}
+
+		// the simulation thread marks its completed steps on a timeline semaphore, the renderer waits on it
+		VkPhysicalDeviceTimelineSemaphoreFeatures timelineSemaphoreFeatures{};
+		timelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		{
+			VkPhysicalDeviceFeatures2 features2{};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features2.pNext = &timelineSemaphoreFeatures;
+			vkGetPhysicalDeviceFeatures2(physicalDeviceHandle, &features2);
+		}
+		if (timelineSemaphoreFeatures.timelineSemaphore != VK_TRUE)
+		{
+			throw std::runtime_error("timelineSemaphore is not supported");
+		}
+		VkPhysicalDeviceTimelineSemaphoreFeatures enabledTimelineSemaphoreFeatures{};
+		enabledTimelineSemaphoreFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+		enabledTimelineSemaphoreFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+		enabledTimelineSemaphoreFeatures.timelineSemaphore = VK_TRUE;
+		deviceCreateInfo.pNext = &enabledTimelineSemaphoreFeatures;
+
+		// --device-address hands the shaders the particle state as buffer device addresses in push constants
+		VkPhysicalDeviceBufferDeviceAddressFeatures bufferDeviceAddressFeatures{};
+		bufferDeviceAddressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+		{
+			VkPhysicalDeviceFeatures2 features2{};
+			features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+			features2.pNext = &bufferDeviceAddressFeatures;
+			vkGetPhysicalDeviceFeatures2(physicalDeviceHandle, &features2);
+		}
+		deviceAddress = settings.deviceAddress;
+		if (deviceAddress && bufferDeviceAddressFeatures.bufferDeviceAddress != VK_TRUE)
+		{
+			std::cout << "[WARNING] bufferDeviceAddress is not supported, binding the particle state with descriptors" << std::endl;
+			deviceAddress = false;
+		}
+
+		// a large SPH_PARTICLE_CAPACITY runs into the device limits. The particle data past maxStorageBufferRange is
+		// reached through buffer device addresses, which have no range, buffers past maxMemoryAllocationSize are bound
+		// in chunks, and dispatches past SPH_MAX_WORK_GROUPS_X work groups go 2-D
+		const VkPhysicalDeviceLimits& limits = physicalDeviceProperties.limits;
+		std::cout << "[INFO] device limits: maxStorageBufferRange " << (limits.maxStorageBufferRange >> 20) << " MiB, maxMemoryAllocationSize "
+			<< (maxAllocationSize >> 20) << " MiB, maxComputeWorkGroupCount " << limits.maxComputeWorkGroupCount[0] << " x " << limits.maxComputeWorkGroupCount[1]
+			<< ", particle data " << (particleDataSize >> 20) << " MiB at a capacity of " << SPH_PARTICLE_CAPACITY << std::endl;
+		if (particleDataSize > limits.maxStorageBufferRange && !deviceAddress)
+		{
+			if (bufferDeviceAddressFeatures.bufferDeviceAddress != VK_TRUE)
+			{
+				throw std::runtime_error("the particle data exceeds maxStorageBufferRange and bufferDeviceAddress is not supported, lower SPH_PARTICLE_CAPACITY");
+			}
+			std::cout << "[WARNING] the particle data exceeds maxStorageBufferRange, reaching the particle state through buffer device addresses" << std::endl;
+			deviceAddress = true;
+		}
+		// the halo exchange has the largest per-particle arrays bound with descriptors either way
+		if (haloSsboSize > limits.maxStorageBufferRange)
+		{
+			throw std::runtime_error("the halo buffers exceed maxStorageBufferRange, lower SPH_PARTICLE_CAPACITY");
+		}
+		// the primitives stay 1-D, every work group covers PRIMITIVES_BLOCK_SIZE elements
+		const uint64_t particleGroupCount = (SPH_PARTICLE_CAPACITY + SPH_MIN_WORK_GROUP_SIZE - 1) / SPH_MIN_WORK_GROUP_SIZE;
+		if ((particleGroupCount + SPH_MAX_WORK_GROUPS_X - 1) / SPH_MAX_WORK_GROUPS_X > limits.maxComputeWorkGroupCount[1]
+			|| (SPH_PARTICLE_CAPACITY + PRIMITIVES_BLOCK_SIZE - 1) / PRIMITIVES_BLOCK_SIZE > limits.maxComputeWorkGroupCount[0])
+		{
+			throw std::runtime_error("SPH_PARTICLE_CAPACITY needs more work groups than maxComputeWorkGroupCount allows");
+		}
+		sparseBindingEnabled = physicalDeviceFeatures.sparseBinding == VK_TRUE
+			&& (queueFamilies[graphicsPresentationComputeQueueFamilyIndex].queueFlags & VK_QUEUE_SPARSE_BINDING_BIT);
+		VkPhysicalDeviceFeatures enabledFeatures{};
+		enabledFeatures.sparseBinding = sparseBindingEnabled ? VK_TRUE : VK_FALSE;
+
+		VkPhysicalDeviceBufferDeviceAddressFeatures enabledBufferDeviceAddressFeatures{};
+		enabledBufferDeviceAddressFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_BUFFER_DEVICE_ADDRESS_FEATURES;
+		enabledBufferDeviceAddressFeatures.pNext = const_cast<void*>(deviceCreateInfo.pNext);
+		enabledBufferDeviceAddressFeatures.bufferDeviceAddress = VK_TRUE;
+		if (deviceAddress)
+		{
+			deviceCreateInfo.pNext = &enabledBufferDeviceAddressFeatures;
+		}
+		std::cout << "[INFO] particle state: " << (deviceAddress ? "buffer device addresses in push constants" : "descriptor bindings") << std::endl;
+		deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+		deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
 		deviceCreateInfo.enabledLayerCount = 0;
 		deviceCreateInfo.ppEnabledLayerNames = nullptr;
-		deviceCreateInfo.pEnabledFeatures = nullptr;
-		deviceCreateInfo.queueCreateInfoCount = 1;
-		deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
-		if (vkCreateDevice(physicalDeviceHandle, &deviceCreateInfo, NULL, &logicalDeviceHandle) != VK_SUCCESS)
+		deviceCreateInfo.pEnabledFeatures = &enabledFeatures;
+		deviceCreateInfo.queueCreateInfoCount = transferQueueFamilyIndex != UINT32_MAX ? 2 : 1;
+		deviceCreateInfo.pQueueCreateInfos = queueCreateInfos;
+		if (vkCreateDevice(physicalDeviceHandle, &deviceCreateInfo, allocator, &logicalDeviceHandle) != VK_SUCCESS)
 		{
 			throw std::runtime_error("logical device creation failed");
 		}
+		if (calibratedTimestampsSupported)
+		{
+			vkGetCalibratedTimestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(vkGetDeviceProcAddr(logicalDeviceHandle, "vkGetCalibratedTimestampsEXT"));
+			calibratedTimestampsSupported = vkGetCalibratedTimestamps != nullptr;
+		}
 	}
 
 	void Application::GetDeviceQueues()
@@ -300,6 +585,15 @@ namespace SPH
 		vkGetDeviceQueue(logicalDeviceHandle, graphicsPresentationComputeQueueFamilyIndex, 0, &graphicsQueueHandle);
 		vkGetDeviceQueue(logicalDeviceHandle, graphicsPresentationComputeQueueFamilyIndex, 1, &computeQueueHandle);
 		vkGetDeviceQueue(logicalDeviceHandle, graphicsPresentationComputeQueueFamilyIndex, 2, &presentationQueueHandle);
+		if (transferQueueFamilyIndex != UINT32_MAX)
+		{
+			vkGetDeviceQueue(logicalDeviceHandle, transferQueueFamilyIndex, 0, &transferQueueHandle);
+		}
+		else
+		{
+			transferQueueFamilyIndex = graphicsPresentationComputeQueueFamilyIndex;
+			transferQueueHandle = computeQueueHandle;
+		}
 	}
 
 	void Application::CreateSwapchain()
@@ -358,7 +652,7 @@ namespace SPH
 			create_info.oldSwapchain = VK_NULL_HANDLE;
 		}
 
-		if (vkCreateSwapchainKHR(logicalDeviceHandle, &create_info, nullptr, &swapchainHandle) != VK_SUCCESS) {
+		if (vkCreateSwapchainKHR(logicalDeviceHandle, &create_info, allocator, &swapchainHandle) != VK_SUCCESS) {
 			throw std::runtime_error("failed to create swap chain!");
 		}
 		std::cout << "Successfully created swapchain" << std::endl;
@@ -400,7 +694,7 @@ namespace SPH
 					1, // layerCount
 				}
 			};
-			if (vkCreateImageView(logicalDeviceHandle, &imageViewCreateInfo, NULL, &swapchainImageViewHandles[i]) != VK_SUCCESS)
+			if (vkCreateImageView(logicalDeviceHandle, &imageViewCreateInfo, allocator, &swapchainImageViewHandles[i]) != VK_SUCCESS)
 			{
 				throw std::runtime_error("image views creation failed");
 			}
@@ -443,6 +737,30 @@ namespace SPH
 			NULL
 		};
 
+		// the previous frame's copy out of the capture image is done before the clear, and the capture copy waits for
+		// the drawing, both render passes carry the same dependencies to stay compatible
+		VkSubpassDependency subpassDependencies[2]
+		{
+			{
+				VK_SUBPASS_EXTERNAL,
+				0,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				0,
+				VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				0
+			},
+			{
+				0,
+				VK_SUBPASS_EXTERNAL,
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				VK_PIPELINE_STAGE_TRANSFER_BIT,
+				VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_ACCESS_TRANSFER_READ_BIT,
+				0
+			}
+		};
+
 		VkRenderPassCreateInfo renderPassCreateInfo
 		{
 			VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
@@ -452,13 +770,22 @@ namespace SPH
 			&attachmentDescription,
 			1,
 			&subpassDescription,
-			0,
-			NULL
+			2,
+			subpassDependencies
 		};
-		if (vkCreateRenderPass(logicalDeviceHandle, &renderPassCreateInfo, NULL, &renderPassHandle) != VK_SUCCESS)
+		if (vkCreateRenderPass(logicalDeviceHandle, &renderPassCreateInfo, allocator, &renderPassHandle) != VK_SUCCESS)
 		{
 			throw std::runtime_error("render pass creation failed");
 		}
+		// the capture's render pass only differs in the final layout, so the graphics pipeline works with either
+		if (!settings.capturePath.empty())
+		{
+			attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			if (vkCreateRenderPass(logicalDeviceHandle, &renderPassCreateInfo, allocator, &captureRenderPassHandle) != VK_SUCCESS)
+			{
+				throw std::runtime_error("capture render pass creation failed");
+			}
+		}
 		std::cout << "Successfully create render pass" << std::endl;
 	}
 
@@ -479,7 +806,7 @@ namespace SPH
 				windowHeight,
 				1
 			};
-			if (vkCreateFramebuffer(logicalDeviceHandle, &framebufferCreateInfo, NULL, &swapchainFrameBufferHandles[index]) != VK_SUCCESS)
+			if (vkCreateFramebuffer(logicalDeviceHandle, &framebufferCreateInfo, allocator, &swapchainFrameBufferHandles[index]) != VK_SUCCESS)
 			{
 				throw std::runtime_error("frame buffer creation failed");
 			}
@@ -497,7 +824,7 @@ namespace SPH
 			0,
 			NULL
 		};
-		if (vkCreatePipelineCache(logicalDeviceHandle, &pipelineCacheCreateInfo, NULL, &globalPipelineCacheHandle) != VK_SUCCESS)
+		if (vkCreatePipelineCache(logicalDeviceHandle, &pipelineCacheCreateInfo, allocator, &globalPipelineCacheHandle) != VK_SUCCESS)
 		{
 			throw std::runtime_error("pipeline cache creation failed");
 		}
@@ -506,10 +833,11 @@ namespace SPH
 
 	void Application::CreateDescriptorPool()
 	{
+		// the compute descriptor set and one per render snapshot, and the two splat descriptor sets
 		VkDescriptorPoolSize descriptorPoolSize
 		{
 			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			5
+			3 * SPH_NUM_COMPUTE_BINDINGS + 4
 		};
 
 		VkDescriptorPoolCreateInfo descriptorPoolCreateInfo
@@ -517,11 +845,11 @@ namespace SPH
 			VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
 			NULL,
 			0,
-			1,
+			5,
 			1,
 			& descriptorPoolSize
 		};
-		if (vkCreateDescriptorPool(logicalDeviceHandle, &descriptorPoolCreateInfo, NULL, &globalDescriptorPoolHandle) != VK_SUCCESS)
+		if (vkCreateDescriptorPool(logicalDeviceHandle, &descriptorPoolCreateInfo, allocator, &globalDescriptorPoolHandle) != VK_SUCCESS)
 		{
 			throw std::runtime_error("descriptor pool creation failed");
 		}
@@ -544,42 +872,406 @@ namespace SPH
 
 	void Application::CreateBuffers()
 	{
+		// the buffers holding particle state the shaders may reach by address
+		const VkBufferUsageFlags addressUsage = deviceAddress ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0;
+		// an integrated gpu shares the memory with the host, --export then reads the particle state where it lives
+		const VkMemoryPropertyFlags unifiedMemory = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+		exportZeroCopy = false;
+		if (!settings.exportName.empty() && physicalDeviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU && !ChunkedBuffer(packedBufferSize))
+		{
+			for (uint32_t i = 0; i < physicalDeviceMemoryProperties.memoryTypeCount; i++)
+			{
+				exportZeroCopy = exportZeroCopy || (physicalDeviceMemoryProperties.memoryTypes[i].propertyFlags & unifiedMemory) == unifiedMemory;
+			}
+		}
+		const VkMemoryPropertyFlags particleMemory = exportZeroCopy ? unifiedMemory : static_cast<VkMemoryPropertyFlags>(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 		VkBufferCreateInfo particlesBufferCreateInfo = CsySmallVk::bufferCreateInfo();
 		particlesBufferCreateInfo.size = packedBufferSize;
-		particlesBufferCreateInfo.usage = VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-		particlesBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		particlesBufferCreateInfo.queueFamilyIndexCount = 0;
-		particlesBufferCreateInfo.pQueueFamilyIndices = nullptr;
-		vkCreateBuffer(logicalDeviceHandle, &particlesBufferCreateInfo, NULL, &packedParticlesBufferHandle);
-		
-		VkMemoryRequirements positionBufferMemoryRequirements = CsySmallVk::Query::memoryRequirements(logicalDeviceHandle, packedParticlesBufferHandle);
-		VkMemoryAllocateInfo particleBufferMemoryAllocationInfo = CsySmallVk::memoryAllocateInfo();
-		particleBufferMemoryAllocationInfo.allocationSize = positionBufferMemoryRequirements.size;
-		particleBufferMemoryAllocationInfo.memoryTypeIndex = findMemoryType(positionBufferMemoryRequirements,
-			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		particlesBufferCreateInfo.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | addressUsage;
+		// uploads write it from the transfer family
+		const uint32_t sharedQueueFamilies[2]{ graphicsPresentationComputeQueueFamilyIndex, transferQueueFamilyIndex };
+		const bool sharedWithTransfer = transferQueueFamilyIndex != graphicsPresentationComputeQueueFamilyIndex;
+		particlesBufferCreateInfo.sharingMode = sharedWithTransfer ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+		particlesBufferCreateInfo.queueFamilyIndexCount = sharedWithTransfer ? 2 : 0;
+		particlesBufferCreateInfo.pQueueFamilyIndices = sharedWithTransfer ? sharedQueueFamilies : nullptr;
+		particlesBufferCreateInfo.flags = ChunkedBuffer(packedBufferSize) ? VK_BUFFER_CREATE_SPARSE_BINDING_BIT : 0;
+		if (vkCreateBuffer(logicalDeviceHandle, &particlesBufferCreateInfo, allocator, &packedParticlesBufferHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("buffer creation failed");
+		}
+		AllocateBufferMemory(packedParticlesBufferHandle, particleMemory, deviceAddress, MemoryPurpose::Particles, packedParticlesMemoryHandle);
+
+		// scratch buffer of the reorder pass, the gathered state is copied back into the particle buffer
+		sortScratchSize = std::max(gpuPrimitives->SortScratchSize(SPH_PARTICLE_CAPACITY), gpuPrimitives->CompactScratchSize(SPH_PARTICLE_CAPACITY));
+		sortKeySsboOffset = 0;
+		sortValueSsboOffset = AlignStorageBufferOffset(sortKeySsboOffset + sortKeySsboSize);
+		sortedParticleDataSsboOffset = AlignStorageBufferOffset(sortValueSsboOffset + sortValueSsboSize);
+		sortedVelocitySsboOffset = sortedParticleDataSsboOffset + velocitySsboOffset;
+		sortedParticleIdSsboOffset = AlignStorageBufferOffset(sortedParticleDataSsboOffset + particleDataSize);
+		sortedMassSsboOffset = AlignStorageBufferOffset(sortedParticleIdSsboOffset + particleIdSsboSize);
+		sortScratchOffset = AlignStorageBufferOffset(sortedMassSsboOffset + massSsboSize);
+		reorderBufferSize = sortScratchOffset + sortScratchSize;
+		CreateBuffer(reorderBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | addressUsage,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, reorderBufferHandle, reorderMemoryHandle, MemoryPurpose::Simulation);
+
+		// neighbour grid cell ranges
+		cellStartSsboOffset = 0;
+		cellEndSsboOffset = AlignStorageBufferOffset(cellStartSsboOffset + cellStartSsboSize);
+		gridBufferSize = cellEndSsboOffset + cellEndSsboSize;
+		CreateBuffer(gridBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, gridBufferHandle, gridMemoryHandle, MemoryPurpose::Simulation);
 
-		if (vkAllocateMemory(logicalDeviceHandle, &particleBufferMemoryAllocationInfo, NULL, &packedParticlesMemoryHandle) != VK_SUCCESS)
+		// active tile schedule, filled with the identity active list by Upload
+		activeStateSsboOffset = 0;
+		tileSsboOffset = AlignStorageBufferOffset(activeStateSsboOffset + sizeof(ActiveState));
+		activeFlagSsboOffset = AlignStorageBufferOffset(tileSsboOffset + tileSsboSize);
+		activeIndexSsboOffset = AlignStorageBufferOffset(activeFlagSsboOffset + activeFlagSsboSize);
+		awakeSsboOffset = AlignStorageBufferOffset(activeIndexSsboOffset + activeIndexSsboSize);
+		tileBufferSize = awakeSsboOffset + awakeSsboSize;
+		CreateBuffer(tileBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, tileBufferHandle, tileMemoryHandle, MemoryPurpose::Simulation);
+
+		// halo exchange of split runs, small enough to always exist
+		splitStateSsboOffset = 0;
+		splitInboxSsboOffset = AlignStorageBufferOffset(splitStateSsboOffset + sizeof(SplitState));
+		splitOutboxSsboOffset = AlignStorageBufferOffset(splitInboxSsboOffset + haloSsboSize);
+		splitBufferSize = splitOutboxSsboOffset + haloSsboSize;
+		CreateBuffer(splitBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			splitBufferHandle, splitMemoryHandle, MemoryPurpose::Simulation);
+		if (vkMapMemory(logicalDeviceHandle, splitMemoryHandle, 0, splitBufferSize, 0, reinterpret_cast<void**>(&splitMapped)) != VK_SUCCESS)
 		{
-			throw std::runtime_error("memory allocation failed");
+			throw std::runtime_error("split buffer mapping failed");
+		}
+		std::memset(splitMapped, 0, splitBufferSize);
+
+		// split and merge decisions of adaptive runs, the counters are read back by PrintAdaptiveReport
+		adaptStateSsboOffset = 0;
+		adaptSsboOffset = AlignStorageBufferOffset(adaptStateSsboOffset + sizeof(AdaptState));
+		adaptBufferSize = adaptSsboOffset + adaptSsboSize;
+		CreateBuffer(adaptBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, adaptBufferHandle, adaptMemoryHandle, MemoryPurpose::Simulation);
+
+		// substep and per particle levels of block time steps, zeroed by Upload
+		blockStateSsboOffset = 0;
+		particleLevelSsboOffset = AlignStorageBufferOffset(blockStateSsboOffset + sizeof(BlockState));
+		blockBufferSize = particleLevelSsboOffset + levelSsboSize;
+		CreateBuffer(blockBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, blockBufferHandle, blockMemoryHandle, MemoryPurpose::Simulation);
+
+		// walls, filled once by UploadBoundary
+		CreateBuffer(boundarySsboSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			boundaryBufferHandle, boundaryMemoryHandle, MemoryPurpose::Boundary);
+
+		// alive count and indirect arguments, written by the compute shaders only
+		CreateBuffer(sizeof(SimulationState), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			particleMemory, simulationStateBufferHandle, simulationStateMemoryHandle, MemoryPurpose::Simulation);
+
+		// what the renderer draws: particle data, mass and simulation state as of a completed step
+		snapshotMassOffset = AlignStorageBufferOffset(particleDataSize);
+		snapshotStateOffset = AlignStorageBufferOffset(snapshotMassOffset + massSsboSize);
+		snapshotBufferSize = snapshotStateOffset + sizeof(SimulationState);
+		for (uint32_t snapshot = 0; snapshot < 2; snapshot++)
+		{
+			CreateBuffer(snapshotBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | addressUsage,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, snapshotBufferHandles[snapshot], snapshotMemoryHandles[snapshot], MemoryPurpose::Snapshots);
+		}
+
+		stepRanges.particleData = { packedParticlesBufferHandle, positionSsboOffset, particleDataSize };
+		stepRanges.force = { packedParticlesBufferHandle, forceSsboOffset, forceSsboSize };
+		stepRanges.particleId = { packedParticlesBufferHandle, particleIdSsboOffset, particleIdSsboSize };
+		stepRanges.mass = { packedParticlesBufferHandle, massSsboOffset, massSsboSize };
+		stepRanges.sortKeys = { reorderBufferHandle, sortKeySsboOffset, sortKeySsboSize };
+		stepRanges.sortValues = { reorderBufferHandle, sortValueSsboOffset, sortValueSsboSize };
+		stepRanges.sortScratch = { reorderBufferHandle, sortScratchOffset, sortScratchSize };
+		stepRanges.grid = { gridBufferHandle, 0, gridBufferSize };
+		stepRanges.simulationState = { simulationStateBufferHandle, 0, sizeof(SimulationState) };
+		stepRanges.activeState = { tileBufferHandle, activeStateSsboOffset, sizeof(ActiveState) };
+		stepRanges.compactResult = { tileBufferHandle, activeStateSsboOffset, sizeof(CompactResult) };
+		stepRanges.activeIndex = { tileBufferHandle, activeIndexSsboOffset, activeIndexSsboSize };
+		stepRanges.tiles = { tileBufferHandle, tileSsboOffset, tileSsboSize };
+		stepRanges.activeFlags = { tileBufferHandle, activeFlagSsboOffset, activeFlagSsboSize };
+		stepRanges.awake = { tileBufferHandle, awakeSsboOffset, awakeSsboSize };
+		stepRanges.boundary = { boundaryBufferHandle, 0, boundarySsboSize };
+		stepRanges.blockState = { blockBufferHandle, blockStateSsboOffset, sizeof(BlockState) };
+		stepRanges.particleLevels = { blockBufferHandle, particleLevelSsboOffset, levelSsboSize };
+
+		if (deviceAddress)
+		{
+			particleStateAddresses = ParticleStateAt(packedParticlesBufferHandle, positionSsboOffset, massSsboOffset);
+			particleStateAddresses.force = BufferAddress(packedParticlesBufferHandle) + forceSsboOffset;
+			particleStateAddresses.particleId = BufferAddress(packedParticlesBufferHandle) + particleIdSsboOffset;
+			const ParticleStateAddresses sorted = ParticleStateAt(reorderBufferHandle, sortedParticleDataSsboOffset, sortedMassSsboOffset);
+			for (uint32_t field = 0; field < sizeof(ParticleSortedField) / sizeof(ParticleSortedField[0]); field++)
+			{
+				particleStateAddresses.sortedFields[field] = sorted.fields[static_cast<uint32_t>(ParticleSortedField[field])];
+			}
+			particleStateAddresses.sortedParticleId = BufferAddress(reorderBufferHandle) + sortedParticleIdSsboOffset;
+			particleStateAddresses.sortedMass = sorted.mass;
+			for (uint32_t snapshot = 0; snapshot < 2; snapshot++)
+			{
+				snapshotStateAddresses[snapshot] = ParticleStateAt(snapshotBufferHandles[snapshot], 0, snapshotMassOffset);
+			}
 		}
-		// bind the memory to the buffer object
-		vkBindBufferMemory(logicalDeviceHandle, packedParticlesBufferHandle, packedParticlesMemoryHandle, 0);
 		std::cout << "Successfully create buffers" << std::endl;
 	}
 
+	void Application::CreateGpuPrimitives()
+	{
+		gpuPrimitives.reset(new GpuPrimitives(logicalDeviceHandle, globalPipelineCacheHandle, SPH_SHADER_PATH,
+			physicalDeviceProperties.limits.minStorageBufferOffsetAlignment));
+	}
+
+	void Application::CreateUploadManager()
+	{
+		// fixed whatever the capacity, Upload and UploadBoundary stream through it
+		const VkDeviceSize ringSize = SPH_UPLOAD_RING_SIZE;
+		CreateBuffer(ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			uploadRingBufferHandle, uploadRingMemoryHandle, MemoryPurpose::Staging);
+		// mapped for as long as the device lives
+		void* ring = nullptr;
+		if (vkMapMemory(logicalDeviceHandle, uploadRingMemoryHandle, 0, ringSize, 0, &ring) != VK_SUCCESS)
+		{
+			throw std::runtime_error("upload ring mapping failed");
+		}
+		uploads = std::make_unique<UploadManager>(logicalDeviceHandle, allocator, transferQueueFamilyIndex, transferQueueHandle, uploadRingBufferHandle,
+			ring, ringSize, std::max<VkDeviceSize>(physicalDeviceProperties.limits.optimalBufferCopyOffsetAlignment, 4));
+		std::cout << "Successfully create upload manager" << std::endl;
+	}
+
+	void Application::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory,
+		MemoryPurpose purpose)
+	{
+		VkBufferCreateInfo bufferCreateInfo = CsySmallVk::bufferCreateInfo();
+		bufferCreateInfo.size = size;
+		bufferCreateInfo.usage = usage;
+		// concurrent with a separate transfer family, which saves the ownership transfers of the uploads
+		const uint32_t sharedQueueFamilies[2]{ graphicsPresentationComputeQueueFamilyIndex, transferQueueFamilyIndex };
+		const bool sharedWithTransfer = transferQueueFamilyIndex != graphicsPresentationComputeQueueFamilyIndex;
+		bufferCreateInfo.sharingMode = sharedWithTransfer ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+		bufferCreateInfo.queueFamilyIndexCount = sharedWithTransfer ? 2 : 0;
+		bufferCreateInfo.pQueueFamilyIndices = sharedWithTransfer ? sharedQueueFamilies : nullptr;
+		bufferCreateInfo.flags = ChunkedBuffer(size) ? VK_BUFFER_CREATE_SPARSE_BINDING_BIT : 0;
+		if (vkCreateBuffer(logicalDeviceHandle, &bufferCreateInfo, allocator, &buffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("buffer creation failed");
+		}
+		AllocateBufferMemory(buffer, properties, (usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) != 0, purpose, memory);
+	}
+
+	void Application::AllocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags properties, bool addressable, MemoryPurpose purpose, VkDeviceMemory& memory)
+	{
+		VkMemoryRequirements memoryRequirements = CsySmallVk::Query::memoryRequirements(logicalDeviceHandle, buffer);
+		VkMemoryAllocateInfo allocInfo = CsySmallVk::memoryAllocateInfo();
+		allocInfo.allocationSize = memoryRequirements.size;
+		allocInfo.memoryTypeIndex = findMemoryType(memoryRequirements, properties);
+		VkMemoryAllocateFlagsInfo allocateFlags{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO, NULL, VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT, 0 };
+		if (addressable)
+		{
+			allocInfo.pNext = &allocateFlags;
+		}
+		if (!ChunkedBuffer(memoryRequirements.size))
+		{
+			AllocateMemory(allocInfo, purpose, memory);
+			vkBindBufferMemory(logicalDeviceHandle, buffer, memory, 0);
+			return;
+		}
+
+		// a mapping covers one allocation, so only device memory can be chunked
+		if (!sparseBindingEnabled || (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT))
+		{
+			throw std::runtime_error("a buffer of " + std::to_string(memoryRequirements.size >> 20) + " MiB exceeds maxMemoryAllocationSize"
+				+ (sparseBindingEnabled ? " and is mapped" : " and sparseBinding is not supported") + ", lower SPH_PARTICLE_CAPACITY");
+		}
+		// every chunk but the last a whole number of sparse blocks
+		const VkDeviceSize chunkSize = maxAllocationSize / memoryRequirements.alignment * memoryRequirements.alignment;
+		std::vector<VkSparseMemoryBind> binds;
+		for (VkDeviceSize offset = 0; offset < memoryRequirements.size; offset += chunkSize)
+		{
+			allocInfo.allocationSize = std::min(chunkSize, memoryRequirements.size - offset);
+			VkDeviceMemory chunk = VK_NULL_HANDLE;
+			AllocateMemory(allocInfo, purpose, chunk);
+			binds.push_back({ offset, allocInfo.allocationSize, chunk, 0, 0 });
+			if (offset == 0)
+			{
+				memory = chunk;
+			}
+			else
+			{
+				chunkMemoryHandles.push_back(chunk);
+			}
+		}
+		VkSparseBufferMemoryBindInfo bufferBind{ buffer, static_cast<uint32_t>(binds.size()), binds.data() };
+		VkBindSparseInfo bindSparseInfo{};
+		bindSparseInfo.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+		bindSparseInfo.bufferBindCount = 1;
+		bindSparseInfo.pBufferBinds = &bufferBind;
+		if (vkQueueBindSparse(computeQueueHandle, 1, &bindSparseInfo, VK_NULL_HANDLE) != VK_SUCCESS || vkQueueWaitIdle(computeQueueHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("sparse buffer binding failed");
+		}
+		std::cout << "[INFO] " << (memoryRequirements.size >> 20) << " MiB buffer bound in " << binds.size() << " chunks" << std::endl;
+	}
+
+	void Application::AllocateMemory(const VkMemoryAllocateInfo& allocateInfo, MemoryPurpose purpose, VkDeviceMemory& memory)
+	{
+		if (vkAllocateMemory(logicalDeviceHandle, &allocateInfo, allocator, &memory) != VK_SUCCESS)
+		{
+			throw std::runtime_error("memory allocation failed");
+		}
+		memoryTracker.DeviceAllocated(memory, purpose, allocateInfo);
+	}
+
+	void Application::FreeMemory(VkDeviceMemory memory)
+	{
+		vkFreeMemory(logicalDeviceHandle, memory, allocator);
+		memoryTracker.DeviceFreed(memory);
+	}
+
+	VkDeviceAddress Application::BufferAddress(VkBuffer buffer) const
+	{
+		VkBufferDeviceAddressInfo addressInfo{ VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, NULL, buffer };
+		return vkGetBufferDeviceAddress(logicalDeviceHandle, &addressInfo);
+	}
+
+	ParticleStateAddresses Application::ParticleStateAt(VkBuffer buffer, VkDeviceSize particleDataOffset, VkDeviceSize massOffset) const
+	{
+		// the field arrays sit where ParticleFieldOffset puts them, the records of AoS and AoSoA start at the first
+		const VkDeviceAddress address = BufferAddress(buffer);
+		ParticleStateAddresses state{};
+		for (uint32_t field = 0; field < sizeof(state.fields) / sizeof(state.fields[0]); field++)
+		{
+			state.fields[field] = address + particleDataOffset + ParticleFieldOffset(static_cast<ParticleField>(field), 0) - positionSsboOffset;
+		}
+		state.mass = address + massOffset;
+		return state;
+	}
+
+	VkDeviceSize Application::AlignStorageBufferOffset(VkDeviceSize offset) const
+	{
+		const VkDeviceSize alignment = std::max<VkDeviceSize>(physicalDeviceProperties.limits.minStorageBufferOffsetAlignment, 1);
+		return (offset + alignment - 1) / alignment * alignment;
+	}
+
+	VkCommandBuffer Application::BeginSingleTimeCommands()
+	{
+		VkCommandBuffer commandBufferHandle = VK_NULL_HANDLE;
+		VkCommandBufferAllocateInfo allocInfo = CsySmallVk::commandBufferAllocateInfo();
+		allocInfo.commandBufferCount = 1;
+		allocInfo.commandPool = computeCommandPoolHandle;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		if (vkAllocateCommandBuffers(logicalDeviceHandle, &allocInfo, &commandBufferHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("command buffer creation failed");
+		}
+		VkCommandBufferBeginInfo beginInfo = CsySmallVk::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(commandBufferHandle, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("command buffer begin failed");
+		}
+		return commandBufferHandle;
+	}
+
+	void Application::EndSingleTimeCommands(VkCommandBuffer commandBuffer)
+	{
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("command buffer end failed");
+		}
+		VkSubmitInfo submitInfo = CsySmallVk::submitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		if (vkQueueSubmit(computeQueueHandle, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("command buffer submission failed");
+		}
+		if (vkQueueWaitIdle(computeQueueHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("vkQueueWaitIdle failed");
+		}
+		vkFreeCommandBuffers(logicalDeviceHandle, computeCommandPoolHandle, 1, &commandBuffer);
+	}
+
+	void Application::CreateSplatTarget()
+	{
+		// two fixed point sums per pixel, cleared by every frame before splat.comp adds to them
+		CreateBuffer(static_cast<VkDeviceSize>(windowWidth) * windowHeight * 2 * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, splatAccumulationBufferHandle, splatAccumulationMemoryHandle, MemoryPurpose::Render);
+
+		VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[2]
+		{
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT, nullptr }
+		};
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = CsySmallVk::descriptorSetLayoutCreateInfo();
+		descriptorSetLayoutCreateInfo.bindingCount = 2;
+		descriptorSetLayoutCreateInfo.pBindings = descriptorSetLayoutBindings;
+		if (vkCreateDescriptorSetLayout(logicalDeviceHandle, &descriptorSetLayoutCreateInfo, allocator, &splatDescriptorSetLayoutHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("splat descriptor layout creation failed");
+		}
+
+		VkDescriptorSetLayout setLayouts[2]{ splatDescriptorSetLayoutHandle, splatDescriptorSetLayoutHandle };
+		VkDescriptorSetAllocateInfo allocInfo = CsySmallVk::descriptorSetAllocateInfo();
+		allocInfo.descriptorPool = globalDescriptorPoolHandle;
+		allocInfo.descriptorSetCount = 2;
+		allocInfo.pSetLayouts = setLayouts;
+		if (vkAllocateDescriptorSets(logicalDeviceHandle, &allocInfo, splatDescriptorSetHandles) != VK_SUCCESS)
+		{
+			throw std::runtime_error("splat descriptor set allocation failed");
+		}
+		VkDescriptorBufferInfo accumulationInfo{ splatAccumulationBufferHandle, 0, VK_WHOLE_SIZE };
+		for (uint32_t snapshot = 0; snapshot < 2; snapshot++)
+		{
+			VkDescriptorBufferInfo stateInfo{ snapshotBufferHandles[snapshot], snapshotStateOffset, sizeof(SimulationState) };
+			VkWriteDescriptorSet writeDescriptorSets[2];
+			for (uint32_t index = 0; index < 2; index++)
+			{
+				writeDescriptorSets[index] = CsySmallVk::writeDescriptorSet();
+				writeDescriptorSets[index].dstSet = splatDescriptorSetHandles[snapshot];
+				writeDescriptorSets[index].dstBinding = index;
+				writeDescriptorSets[index].dstArrayElement = 0;
+				writeDescriptorSets[index].descriptorCount = 1;
+				writeDescriptorSets[index].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			}
+			writeDescriptorSets[0].pBufferInfo = &accumulationInfo;
+			writeDescriptorSets[1].pBufferInfo = &stateInfo;
+			vkUpdateDescriptorSets(logicalDeviceHandle, 2, writeDescriptorSets, 0, NULL);
+		}
+
+		// splat.comp reads the snapshot like particle.vert, through set 0 or the pushed addresses
+		VkDescriptorSetLayout pipelineSetLayouts[2]{ computeDescriptorSetLayoutHandle, splatDescriptorSetLayoutHandle };
+		const VkPushConstantRange stateRange{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ParticleStateAddresses) };
+		VkPipelineLayoutCreateInfo layoutCreateInfo = CsySmallVk::pipelineLayoutCreateInfo();
+		layoutCreateInfo.setLayoutCount = 2;
+		layoutCreateInfo.pSetLayouts = pipelineSetLayouts;
+		layoutCreateInfo.pushConstantRangeCount = deviceAddress ? 1 : 0;
+		layoutCreateInfo.pPushConstantRanges = deviceAddress ? &stateRange : nullptr;
+		if (vkCreatePipelineLayout(logicalDeviceHandle, &layoutCreateInfo, allocator, &splatPipelineLayoutHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("splat pipeline layout creation failed");
+		}
+		std::cout << "Successfully create splat target" << std::endl;
+	}
+
 	void Application::CreateGraphicsPipelineLayout()
 	{
+		// the vertex shader reads the snapshot it draws through the addresses pushed with --device-address, the
+		// resolve of the splats reads the accumulation buffer through set 1
+		const VkPushConstantRange stateRange{ VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ParticleStateAddresses) };
+		const bool splat = settings.renderer == Renderer::Splat;
+		VkDescriptorSetLayout setLayouts[2]{ computeDescriptorSetLayoutHandle, splatDescriptorSetLayoutHandle };
 		VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo
 		{
 			VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
 			NULL,
 			0,
-			0,
-			NULL,
-			0,
-			NULL
+			splat ? 2u : 1u,
+			setLayouts,
+			deviceAddress && !splat ? 1u : 0u,
+			deviceAddress && !splat ? &stateRange : NULL
 		};
-		if (vkCreatePipelineLayout(logicalDeviceHandle, &pipelineLayoutCreateInfo, NULL, &graphicsPipelineLayoutHandle) != VK_SUCCESS)
+		if (vkCreatePipelineLayout(logicalDeviceHandle, &pipelineLayoutCreateInfo, allocator, &graphicsPipelineLayoutHandle) != VK_SUCCESS)
 		{
 			throw std::runtime_error("pipeline layout creation failed");
 		}
@@ -592,18 +1284,45 @@ namespace SPH
 		VkShaderModuleCreateInfo createInfo = CsySmallVk::shaderModuleCreateInfo();
 		createInfo.codeSize = code.size();
 		createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
-		if (vkCreateShaderModule(logicalDeviceHandle, &createInfo, nullptr, &shaderModule) != VK_SUCCESS)
+		if (vkCreateShaderModule(logicalDeviceHandle, &createInfo, allocator, &shaderModule) != VK_SUCCESS)
 			throw std::runtime_error("fail to create shader module");
 		return shaderModule;
 	}
 
 	void Application::CreateGraphicsPipeline()
 	{
-		std::vector<VkPipelineShaderStageCreateInfo> shaderStageCreateInfos;
-		// create shader stage infos
-		auto vertexShaderCode = CsySmallVk::readFile(MU_SHADER_PATH "particle.vert.spv");
-		VkShaderModule vertexShaderModule =  CreateShaderModule(vertexShaderCode);
-		auto fragmentShaderCode = CsySmallVk::readFile(MU_SHADER_PATH "particle.frag.spv");
+		const bool splat = settings.renderer == Renderer::Splat;
+		// constant 0 is the local size of splat.comp, constant 1 its per-particle resolution, constants 3 and 4 the
+		// size of the render target
+		const uint32_t specializationData[5]{ SPH_WORK_GROUP_SIZE, settings.adaptive ? VK_TRUE : VK_FALSE, 0, windowWidth, windowHeight };
+		VkSpecializationMapEntry specializationEntries[4]{ { 0, 0, sizeof(uint32_t) }, { 1, sizeof(uint32_t), sizeof(VkBool32) },
+			{ 3, 3 * sizeof(uint32_t), sizeof(uint32_t) }, { 4, 4 * sizeof(uint32_t), sizeof(uint32_t) } };
+		VkSpecializationInfo specializationInfo{ 4, specializationEntries, sizeof(specializationData), specializationData };
+		if (splat)
+		{
+			auto splatShaderCode = CsySmallVk::readFile(SPH_SHADER_PATH + StorageShader("splat", "comp"));
+			VkShaderModule splatShaderModule = CreateShaderModule(splatShaderCode);
+			VkComputePipelineCreateInfo splatCreateInfo = CsySmallVk::computePipelineCreateInfo();
+			splatCreateInfo.stage = CsySmallVk::pipelineShaderStageCreateInfo();
+			splatCreateInfo.stage.module = splatShaderModule;
+			splatCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+			splatCreateInfo.stage.pName = "main";
+			splatCreateInfo.stage.pSpecializationInfo = &specializationInfo;
+			splatCreateInfo.layout = splatPipelineLayoutHandle;
+			splatCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+			if (vkCreateComputePipelines(logicalDeviceHandle, globalPipelineCacheHandle, 1, &splatCreateInfo, allocator, &splatPipelineHandle) != VK_SUCCESS)
+			{
+				throw std::runtime_error("splat pipeline creation failed");
+			}
+			vkDestroyShaderModule(logicalDeviceHandle, splatShaderModule, allocator);
+			pipelineWorkGroupSizes[splatPipelineHandle] = SPH_WORK_GROUP_SIZE;
+		}
+
+		std::vector<VkPipelineShaderStageCreateInfo> shaderStageCreateInfos;
+		// create shader stage infos, the splats are resolved by a full-screen triangle
+		auto vertexShaderCode = CsySmallVk::readFile(SPH_SHADER_PATH + (splat ? std::string("splat_resolve.vert.spv") : StorageShader("particle", "vert")));
+		VkShaderModule vertexShaderModule =  CreateShaderModule(vertexShaderCode);
+		auto fragmentShaderCode = CsySmallVk::readFile(splat ? SPH_SHADER_PATH "splat_resolve.frag.spv" : SPH_SHADER_PATH "particle.frag.spv");
 		VkShaderModule fragmentShaderModule = CreateShaderModule(fragmentShaderCode);
 
 		VkPipelineShaderStageCreateInfo vertexShaderStageCreateInfo = CsySmallVk::pipelineShaderStageCreateInfo();
@@ -615,35 +1334,21 @@ namespace SPH
 		fragmentShaderStageCreateInfo.module = fragmentShaderModule;
 		fragmentShaderStageCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
 		fragmentShaderStageCreateInfo.pName = "main";
+		fragmentShaderStageCreateInfo.pSpecializationInfo = &specializationInfo;
 
 		shaderStageCreateInfos.push_back(vertexShaderStageCreateInfo);
 		shaderStageCreateInfos.push_back(fragmentShaderStageCreateInfo);
 
-		VkVertexInputBindingDescription vertexInputBindingDescription
-		{
-			0,
-			sizeof(glm::vec2),
-			VK_VERTEX_INPUT_RATE_VERTEX
-		};
-
-		// layout(location = 0) in vec2 position;
-		VkVertexInputAttributeDescription vertexInputAttributeDescription
-		{
-			0,
-			0,
-			VK_FORMAT_R32G32_SFLOAT,
-			0
-		};
-
+		// no vertex input, particle.vert loads the position of gl_VertexIndex in the particle layout
 		VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo
 		{
 			VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
 			NULL,
 			0,
-			1,
-			& vertexInputBindingDescription,
-			1,
-			& vertexInputAttributeDescription
+			0,
+			NULL,
+			0,
+			NULL
 		};
 
 		VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo
@@ -651,7 +1356,7 @@ namespace SPH
 			VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
 			NULL,
 			0,
-			VK_PRIMITIVE_TOPOLOGY_POINT_LIST,
+			splat ? VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST : VK_PRIMITIVE_TOPOLOGY_POINT_LIST,
 			VK_FALSE
 		};
 
@@ -759,7 +1464,7 @@ namespace SPH
 			-1
 		};
 
-		if (vkCreateGraphicsPipelines(logicalDeviceHandle, globalPipelineCacheHandle, 1, &graphicsPipelineCreateInfo, NULL, &graphicsPipelineHandle) != VK_SUCCESS)
+		if (vkCreateGraphicsPipelines(logicalDeviceHandle, globalPipelineCacheHandle, 1, &graphicsPipelineCreateInfo, allocator, &graphicsPipelineHandle) != VK_SUCCESS)
 		{
 			throw std::runtime_error("graphics pipeline creation failed");
 		}
@@ -770,7 +1475,7 @@ namespace SPH
 	{
 		VkCommandPoolCreateInfo graphicsCommandPoolCreateInfo = CsySmallVk::commandPoolCreateInfo();
 		graphicsCommandPoolCreateInfo.queueFamilyIndex = graphicsPresentationComputeQueueFamilyIndex;
-		if (vkCreateCommandPool(logicalDeviceHandle, &graphicsCommandPoolCreateInfo, NULL, &graphicsCommandPoolHandle) != VK_SUCCESS)
+		if (vkCreateCommandPool(logicalDeviceHandle, &graphicsCommandPoolCreateInfo, allocator, &graphicsCommandPoolHandle) != VK_SUCCESS)
 		{
 			throw std::runtime_error("command pool creation failed");
 		}
@@ -779,7 +1484,12 @@ namespace SPH
 
 	void Application::CreateGraphicsCommandBuffers()
 	{
-		graphicsCommandBufferHandles.resize(swapchainFrameBufferHandles.size());
+		// one per swapchain image for each render snapshot, snapshot s of image i is s * image count + i
+		if (swapchainFrameBufferHandles.empty())
+		{
+			return;
+		}
+		graphicsCommandBufferHandles.resize(2 * swapchainFrameBufferHandles.size());
 		VkCommandBufferAllocateInfo graphicsCommandBufferAllocationInfo
 		{
 			VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
@@ -794,6 +1504,8 @@ namespace SPH
 		}
 		for (size_t i = 0; i < graphicsCommandBufferHandles.size(); i++)
 		{
+			const size_t snapshot = i / swapchainFrameBufferHandles.size();
+			const size_t image = i % swapchainFrameBufferHandles.size();
 			VkCommandBufferBeginInfo commandBufferBeginInfo
 			{
 				VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -808,7 +1520,7 @@ namespace SPH
 				VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 				NULL,
 				renderPassHandle,
-				swapchainFrameBufferHandles[i],
+				swapchainFrameBufferHandles[image],
 				{
 					{ 0, 0 },
 					{ windowWidth, windowHeight }
@@ -816,30 +1528,9 @@ namespace SPH
 				1,
 				&clear_value
 			};
+			RecordParticleSplat(graphicsCommandBufferHandles[i], static_cast<uint32_t>(snapshot));
 			vkCmdBeginRenderPass(graphicsCommandBufferHandles[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-			VkViewport viewport
-			{
-				0,
-				0,
-				static_cast<float>(windowWidth),
-				static_cast<float>(windowHeight),
-				0,
-				1
-			};
-
-			VkRect2D scissor
-			{
-				{ 0, 0 },
-				{ windowWidth, windowHeight }
-			};
-
-			vkCmdSetViewport(graphicsCommandBufferHandles[i], 0, 1, &viewport);
-			vkCmdSetScissor(graphicsCommandBufferHandles[i], 0, 1, &scissor);
-			vkCmdBindPipeline(graphicsCommandBufferHandles[i], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineHandle);
-			
-			VkDeviceSize offsets = 0;
-			vkCmdBindVertexBuffers(graphicsCommandBufferHandles[i], 0, 1, &packedParticlesBufferHandle, &offsets);
-			vkCmdDraw(graphicsCommandBufferHandles[i], SPH_NUM_PARTICLES, 1, 0, 0);
+			RecordParticleDraw(graphicsCommandBufferHandles[i], static_cast<uint32_t>(snapshot));
 			vkCmdEndRenderPass(graphicsCommandBufferHandles[i]);
 
 			if (vkEndCommandBuffer(graphicsCommandBufferHandles[i]) != VK_SUCCESS)
@@ -850,6 +1541,212 @@ namespace SPH
 		std::cout << "Successfully create graphics command buffers" << std::endl;
 	}
 
+	void Application::RecordParticleDraw(VkCommandBuffer commandBuffer, uint32_t snapshot)
+	{
+		VkViewport viewport
+		{
+			0,
+			0,
+			static_cast<float>(windowWidth),
+			static_cast<float>(windowHeight),
+			0,
+			1
+		};
+
+		VkRect2D scissor
+		{
+			{ 0, 0 },
+			{ windowWidth, windowHeight }
+		};
+
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineHandle);
+
+		if (settings.renderer == Renderer::Splat)
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayoutHandle, 1, 1, &splatDescriptorSetHandles[snapshot], 0, NULL);
+			vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+			return;
+		}
+		if (deviceAddress)
+		{
+			vkCmdPushConstants(commandBuffer, graphicsPipelineLayoutHandle, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(ParticleStateAddresses),
+				&snapshotStateAddresses[snapshot]);
+		}
+		else
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelineLayoutHandle, 0, 1, &snapshotDescriptorSetHandles[snapshot], 0, NULL);
+		}
+		vkCmdDrawIndirect(commandBuffer, snapshotBufferHandles[snapshot], snapshotStateOffset + offsetof(SimulationState, draw), 1, sizeof(VkDrawIndirectCommand));
+	}
+
+	void Application::RecordParticleSplat(VkCommandBuffer commandBuffer, uint32_t snapshot)
+	{
+		if (settings.renderer != Renderer::Splat)
+		{
+			return;
+		}
+		// the resolve of the frame before, possibly another submission, is done reading the sums
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 0, NULL);
+		vkCmdFillBuffer(commandBuffer, splatAccumulationBufferHandle, 0, VK_WHOLE_SIZE, 0);
+		VkMemoryBarrier clearBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clearBarrier, 0, NULL, 0, NULL);
+
+		if (deviceAddress)
+		{
+			vkCmdPushConstants(commandBuffer, splatPipelineLayoutHandle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ParticleStateAddresses), &snapshotStateAddresses[snapshot]);
+		}
+		else
+		{
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, splatPipelineLayoutHandle, 0, 1, &snapshotDescriptorSetHandles[snapshot], 0, NULL);
+		}
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, splatPipelineLayoutHandle, 1, 1, &splatDescriptorSetHandles[snapshot], 0, NULL);
+		// one invocation per alive particle of the snapshot
+		RecordDispatchIndirect(commandBuffer, splatPipelineHandle, snapshotBufferHandles[snapshot], snapshotStateOffset + offsetof(SimulationState, sizedDispatch));
+
+		VkMemoryBarrier splatBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, NULL, VK_ACCESS_SHADER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT };
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &splatBarrier, 0, NULL, 0, NULL);
+	}
+
+	void Application::CreateCaptureTarget()
+	{
+		VkImageCreateInfo imageCreateInfo{};
+		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageCreateInfo.format = surfaceFormat.format;
+		imageCreateInfo.extent = { windowWidth, windowHeight, 1 };
+		imageCreateInfo.mipLevels = 1;
+		imageCreateInfo.arrayLayers = 1;
+		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		if (vkCreateImage(logicalDeviceHandle, &imageCreateInfo, allocator, &captureImageHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("capture image creation failed");
+		}
+		VkMemoryRequirements imageMemoryRequirements;
+		vkGetImageMemoryRequirements(logicalDeviceHandle, captureImageHandle, &imageMemoryRequirements);
+		VkMemoryAllocateInfo imageAllocateInfo = CsySmallVk::memoryAllocateInfo();
+		imageAllocateInfo.allocationSize = imageMemoryRequirements.size;
+		imageAllocateInfo.memoryTypeIndex = findMemoryType(imageMemoryRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		AllocateMemory(imageAllocateInfo, MemoryPurpose::Capture, captureImageMemoryHandle);
+		vkBindImageMemory(logicalDeviceHandle, captureImageHandle, captureImageMemoryHandle, 0);
+
+		VkImageViewCreateInfo imageViewCreateInfo
+		{
+			VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+			NULL,
+			0,
+			captureImageHandle,
+			VK_IMAGE_VIEW_TYPE_2D,
+			surfaceFormat.format,
+			{ VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY },
+			{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+		};
+		if (vkCreateImageView(logicalDeviceHandle, &imageViewCreateInfo, allocator, &captureImageViewHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("capture image view creation failed");
+		}
+		VkFramebufferCreateInfo framebufferCreateInfo
+		{
+			VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+			NULL,
+			0,
+			captureRenderPassHandle,
+			1,
+			&captureImageViewHandle,
+			windowWidth,
+			windowHeight,
+			1
+		};
+		if (vkCreateFramebuffer(logicalDeviceHandle, &framebufferCreateInfo, allocator, &captureFramebufferHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("capture frame buffer creation failed");
+		}
+
+		// the readback ring stays mapped, the writer thread reads the slots straight from it
+		const VkDeviceSize frameSize = static_cast<VkDeviceSize>(windowWidth) * windowHeight * 4;
+		CreateBuffer(SPH_CAPTURE_SLOTS * frameSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			captureReadbackBufferHandle, captureReadbackMemoryHandle, MemoryPurpose::Capture);
+		void* ring = nullptr;
+		if (vkMapMemory(logicalDeviceHandle, captureReadbackMemoryHandle, 0, SPH_CAPTURE_SLOTS * frameSize, 0, &ring) != VK_SUCCESS)
+		{
+			throw std::runtime_error("capture readback mapping failed");
+		}
+
+		VkSemaphoreTypeCreateInfo timelineCreateInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO, NULL, VK_SEMAPHORE_TYPE_TIMELINE, 0 };
+		VkSemaphoreCreateInfo semaphoreCreateInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, &timelineCreateInfo, 0 };
+		if (vkCreateSemaphore(logicalDeviceHandle, &semaphoreCreateInfo, allocator, &captureTimelineHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("capture timeline semaphore creation failed");
+		}
+		const bool bgra = surfaceFormat.format == VK_FORMAT_B8G8R8A8_SRGB || surfaceFormat.format == VK_FORMAT_B8G8R8A8_UNORM;
+		capture = std::make_unique<FrameCapture>(logicalDeviceHandle, captureTimelineHandle, settings.capturePath, windowWidth, windowHeight, bgra,
+			static_cast<const char*>(ring));
+		std::cout << "Successfully create capture target" << std::endl;
+	}
+
+	void Application::CreateCaptureCommandBuffers()
+	{
+		captureCommandBufferHandles.resize(2 * SPH_CAPTURE_SLOTS);
+		VkCommandBufferAllocateInfo allocateInfo
+		{
+			VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			NULL,
+			graphicsCommandPoolHandle,
+			VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			static_cast<uint32_t>(captureCommandBufferHandles.size())
+		};
+		if (vkAllocateCommandBuffers(logicalDeviceHandle, &allocateInfo, captureCommandBufferHandles.data()) != VK_SUCCESS)
+		{
+			throw std::runtime_error("capture command buffers allocation failed");
+		}
+		// the copied pixels are read by the writer thread
+		VkMemoryBarrier transferToHostBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT };
+		for (uint32_t i = 0; i < captureCommandBufferHandles.size(); i++)
+		{
+			const uint32_t snapshot = i / SPH_CAPTURE_SLOTS;
+			const uint32_t slot = i % SPH_CAPTURE_SLOTS;
+			VkCommandBuffer commandBuffer = captureCommandBufferHandles[i];
+			VkCommandBufferBeginInfo beginInfo = CsySmallVk::commandBufferBeginInfo();
+			vkBeginCommandBuffer(commandBuffer, &beginInfo);
+			VkClearValue clearValue{ 0.92f, 0.92f, 0.92f, 1.0f };
+			VkRenderPassBeginInfo renderPassBeginInfo
+			{
+				VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+				NULL,
+				captureRenderPassHandle,
+				captureFramebufferHandle,
+				{ { 0, 0 }, { windowWidth, windowHeight } },
+				1,
+				&clearValue
+			};
+			RecordParticleSplat(commandBuffer, snapshot);
+			vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+			RecordParticleDraw(commandBuffer, snapshot);
+			vkCmdEndRenderPass(commandBuffer);
+			VkBufferImageCopy region
+			{
+				slot * capture->FrameSize(),
+				0,
+				0,
+				{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
+				{ 0, 0, 0 },
+				{ windowWidth, windowHeight, 1 }
+			};
+			vkCmdCopyImageToBuffer(commandBuffer, captureImageHandle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, captureReadbackBufferHandle, 1, &region);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &transferToHostBarrier, 0, NULL, 0, NULL);
+			if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+			{
+				throw std::runtime_error("capture command buffer creation failed");
+			}
+		}
+		std::cout << "Successfully create capture command buffers" << std::endl;
+	}
+
 	void Application::CreateSemaphores()
 	{
 		VkSemaphoreCreateInfo semaphoreCreateInfo
@@ -858,50 +1755,106 @@ namespace SPH
 			NULL,
 			0
 		};
-		if (vkCreateSemaphore(logicalDeviceHandle, &semaphoreCreateInfo, NULL, &imageAvailableSemaphoreHandle) != VK_SUCCESS)
+		// the fences start signaled, a frame that was never submitted has nothing to wait for
+		VkFenceCreateInfo fenceCreateInfo
+		{
+			VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			NULL,
+			VK_FENCE_CREATE_SIGNALED_BIT
+		};
+		for (uint32_t frame = 0; frame < SPH_FRAMES_IN_FLIGHT; frame++)
 		{
-			throw std::runtime_error("semaphore creation failed");
+			if (vkCreateSemaphore(logicalDeviceHandle, &semaphoreCreateInfo, allocator, &imageAvailableSemaphoreHandles[frame]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("semaphore creation failed");
+			}
+			if (vkCreateSemaphore(logicalDeviceHandle, &semaphoreCreateInfo, allocator, &renderFinishedSemaphoreHandles[frame]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("semaphore creation failed");
+			}
+			if (vkCreateFence(logicalDeviceHandle, &fenceCreateInfo, allocator, &frameFenceHandles[frame]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("fence creation failed");
+			}
 		}
-		if (vkCreateSemaphore(logicalDeviceHandle, &semaphoreCreateInfo, NULL, &renderFinishedSemaphoreHandle) != VK_SUCCESS)
+		VkSemaphoreTypeCreateInfo timelineCreateInfo
+		{
+			VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+			NULL,
+			VK_SEMAPHORE_TYPE_TIMELINE,
+			0
+		};
+		semaphoreCreateInfo.pNext = &timelineCreateInfo;
+		if (vkCreateSemaphore(logicalDeviceHandle, &semaphoreCreateInfo, allocator, &simulationTimelineHandle) != VK_SUCCESS)
 		{
-			throw std::runtime_error("semaphore creation failed");
+			throw std::runtime_error("timeline semaphore creation failed");
 		}
 		std::cout << "Successfully create semaphores" << std::endl;
 	}
 
+	void Application::CreateRenderTimestampCommandBuffers()
+	{
+		if (settings.headless || !timestampsSupported || settings.tracePath.empty())
+		{
+			return;
+		}
+		VkCommandBufferAllocateInfo allocInfo = CsySmallVk::commandBufferAllocateInfo();
+		allocInfo.commandBufferCount = SPH_FRAMES_IN_FLIGHT * 2;
+		allocInfo.commandPool = graphicsCommandPoolHandle;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		if (vkAllocateCommandBuffers(logicalDeviceHandle, &allocInfo, &renderTimestampCommandBufferHandles[0][0]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("buffer allocation failed");
+		}
+		// the graphics command buffers are shared by the frames, the queries of a frame are its own
+		for (uint32_t frame = 0; frame < SPH_FRAMES_IN_FLIGHT; frame++)
+		{
+			const uint32_t query = SPH_STEP_QUERY_COUNT + 2 * frame;
+			for (uint32_t end = 0; end < 2; end++)
+			{
+				VkCommandBuffer commandBuffer = renderTimestampCommandBufferHandles[frame][end];
+				VkCommandBufferBeginInfo beginInfo = CsySmallVk::commandBufferBeginInfo();
+				if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+				{
+					throw std::runtime_error("command buffer begin failed");
+				}
+				if (end)
+				{
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPoolHandle, query + 1);
+				}
+				else
+				{
+					vkCmdResetQueryPool(commandBuffer, timestampQueryPoolHandle, query, 2);
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPoolHandle, query);
+				}
+				if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+				{
+					throw std::runtime_error("command buffer end failed");
+				}
+			}
+		}
+		std::cout << "Successfully create render timestamp command buffers" << std::endl;
+	}
+
 	void Application::CreateComputeDescriptorSetLayout()
 	{
-		VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[5];
-		descriptorSetLayoutBindings[0].binding = 0;
-		descriptorSetLayoutBindings[0].descriptorCount = 1;
-		descriptorSetLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		descriptorSetLayoutBindings[0].pImmutableSamplers = nullptr;
-		descriptorSetLayoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-		descriptorSetLayoutBindings[1].binding = 1;
-		descriptorSetLayoutBindings[1].descriptorCount = 1;
-		descriptorSetLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		descriptorSetLayoutBindings[1].pImmutableSamplers = nullptr;
-		descriptorSetLayoutBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-		descriptorSetLayoutBindings[2].binding = 2;
-		descriptorSetLayoutBindings[2].descriptorCount = 1;
-		descriptorSetLayoutBindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		descriptorSetLayoutBindings[2].pImmutableSamplers = nullptr;
-		descriptorSetLayoutBindings[2].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-		descriptorSetLayoutBindings[3].binding = 3;
-		descriptorSetLayoutBindings[3].descriptorCount = 1;
-		descriptorSetLayoutBindings[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		descriptorSetLayoutBindings[3].pImmutableSamplers = nullptr;
-		descriptorSetLayoutBindings[3].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-		descriptorSetLayoutBindings[4].binding = 4;
-		descriptorSetLayoutBindings[4].descriptorCount = 1;
-		descriptorSetLayoutBindings[4].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-		descriptorSetLayoutBindings[4].pImmutableSamplers = nullptr;
-		descriptorSetLayoutBindings[4].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
-		
+		VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[SPH_NUM_COMPUTE_BINDINGS];
+		for (uint32_t index = 0; index < SPH_NUM_COMPUTE_BINDINGS; index++)
+		{
+			descriptorSetLayoutBindings[index].binding = index;
+			descriptorSetLayoutBindings[index].descriptorCount = 1;
+			descriptorSetLayoutBindings[index].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorSetLayoutBindings[index].pImmutableSamplers = nullptr;
+			descriptorSetLayoutBindings[index].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+		// particle.vert reads the positions and sizes the points by mass
+		descriptorSetLayoutBindings[0].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+		descriptorSetLayoutBindings[23].stageFlags |= VK_SHADER_STAGE_VERTEX_BIT;
+
 		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = CsySmallVk::descriptorSetLayoutCreateInfo();
-		descriptorSetLayoutCreateInfo.bindingCount = 5;
+		descriptorSetLayoutCreateInfo.bindingCount = SPH_NUM_COMPUTE_BINDINGS;
 		descriptorSetLayoutCreateInfo.pBindings = descriptorSetLayoutBindings;
-		if (vkCreateDescriptorSetLayout(logicalDeviceHandle, &descriptorSetLayoutCreateInfo, NULL, &computeDescriptorSetLayoutHandle) != VK_SUCCESS)
+		if (vkCreateDescriptorSetLayout(logicalDeviceHandle, &descriptorSetLayoutCreateInfo, allocator, &computeDescriptorSetLayoutHandle) != VK_SUCCESS)
 		{
 			throw std::runtime_error("compute descriptor layout creation failed");
 		}
@@ -920,10 +1873,11 @@ namespace SPH
 			throw std::runtime_error("compute descriptor set allocation failed");
 		}
 
-		VkDescriptorBufferInfo descriptorBufferInfos[5];
+		VkDescriptorBufferInfo descriptorBufferInfos[SPH_NUM_COMPUTE_BINDINGS];
 		descriptorBufferInfos[0].buffer = packedParticlesBufferHandle;
+		// binding 0 covers the whole particle data, it holds the records of the AoS and AoSoA layouts
 		descriptorBufferInfos[0].offset = positionSsboOffset;
-		descriptorBufferInfos[0].range = positionSsboSize;
+		descriptorBufferInfos[0].range = particleDataSize;
 		descriptorBufferInfos[1].buffer = packedParticlesBufferHandle;
 		descriptorBufferInfos[1].offset = velocitySsboOffset;
 		descriptorBufferInfos[1].range = velocitySsboSize;
@@ -936,10 +1890,90 @@ namespace SPH
 		descriptorBufferInfos[4].buffer = packedParticlesBufferHandle;
 		descriptorBufferInfos[4].offset = pressureSsboOffset;
 		descriptorBufferInfos[4].range = pressureSsboSize;
+		descriptorBufferInfos[5].buffer = packedParticlesBufferHandle;
+		descriptorBufferInfos[5].offset = particleIdSsboOffset;
+		descriptorBufferInfos[5].range = particleIdSsboSize;
+		descriptorBufferInfos[6].buffer = reorderBufferHandle;
+		descriptorBufferInfos[6].offset = sortKeySsboOffset;
+		descriptorBufferInfos[6].range = sortKeySsboSize;
+		descriptorBufferInfos[7].buffer = reorderBufferHandle;
+		descriptorBufferInfos[7].offset = sortValueSsboOffset;
+		descriptorBufferInfos[7].range = sortValueSsboSize;
+		descriptorBufferInfos[8].buffer = reorderBufferHandle;
+		descriptorBufferInfos[8].offset = sortedParticleDataSsboOffset;
+		descriptorBufferInfos[8].range = particleDataSize;
+		descriptorBufferInfos[9].buffer = reorderBufferHandle;
+		descriptorBufferInfos[9].offset = sortedVelocitySsboOffset;
+		descriptorBufferInfos[9].range = velocitySsboSize;
+		descriptorBufferInfos[10].buffer = reorderBufferHandle;
+		descriptorBufferInfos[10].offset = sortedParticleIdSsboOffset;
+		descriptorBufferInfos[10].range = particleIdSsboSize;
+		descriptorBufferInfos[11].buffer = simulationStateBufferHandle;
+		descriptorBufferInfos[11].offset = 0;
+		descriptorBufferInfos[11].range = sizeof(SimulationState);
+		descriptorBufferInfos[12].buffer = gridBufferHandle;
+		descriptorBufferInfos[12].offset = cellStartSsboOffset;
+		descriptorBufferInfos[12].range = cellStartSsboSize;
+		descriptorBufferInfos[13].buffer = gridBufferHandle;
+		descriptorBufferInfos[13].offset = cellEndSsboOffset;
+		descriptorBufferInfos[13].range = cellEndSsboSize;
+		descriptorBufferInfos[14].buffer = tileBufferHandle;
+		descriptorBufferInfos[14].offset = activeStateSsboOffset;
+		descriptorBufferInfos[14].range = sizeof(ActiveState);
+		descriptorBufferInfos[15].buffer = tileBufferHandle;
+		descriptorBufferInfos[15].offset = activeIndexSsboOffset;
+		descriptorBufferInfos[15].range = activeIndexSsboSize;
+		descriptorBufferInfos[16].buffer = tileBufferHandle;
+		descriptorBufferInfos[16].offset = tileSsboOffset;
+		descriptorBufferInfos[16].range = tileSsboSize;
+		descriptorBufferInfos[17].buffer = tileBufferHandle;
+		descriptorBufferInfos[17].offset = activeFlagSsboOffset;
+		descriptorBufferInfos[17].range = activeFlagSsboSize;
+		descriptorBufferInfos[18].buffer = tileBufferHandle;
+		descriptorBufferInfos[18].offset = awakeSsboOffset;
+		descriptorBufferInfos[18].range = awakeSsboSize;
+		descriptorBufferInfos[19].buffer = splitBufferHandle;
+		descriptorBufferInfos[19].offset = splitStateSsboOffset;
+		descriptorBufferInfos[19].range = sizeof(SplitState);
+		descriptorBufferInfos[20].buffer = splitBufferHandle;
+		descriptorBufferInfos[20].offset = splitInboxSsboOffset;
+		descriptorBufferInfos[20].range = haloSsboSize;
+		descriptorBufferInfos[21].buffer = splitBufferHandle;
+		descriptorBufferInfos[21].offset = splitOutboxSsboOffset;
+		descriptorBufferInfos[21].range = haloSsboSize;
+		descriptorBufferInfos[22].buffer = boundaryBufferHandle;
+		descriptorBufferInfos[22].offset = 0;
+		descriptorBufferInfos[22].range = boundarySsboSize;
+		descriptorBufferInfos[23].buffer = packedParticlesBufferHandle;
+		descriptorBufferInfos[23].offset = massSsboOffset;
+		descriptorBufferInfos[23].range = massSsboSize;
+		descriptorBufferInfos[24].buffer = reorderBufferHandle;
+		descriptorBufferInfos[24].offset = sortedMassSsboOffset;
+		descriptorBufferInfos[24].range = massSsboSize;
+		descriptorBufferInfos[25].buffer = adaptBufferHandle;
+		descriptorBufferInfos[25].offset = adaptStateSsboOffset;
+		descriptorBufferInfos[25].range = sizeof(AdaptState);
+		descriptorBufferInfos[26].buffer = adaptBufferHandle;
+		descriptorBufferInfos[26].offset = adaptSsboOffset;
+		descriptorBufferInfos[26].range = adaptSsboSize;
+		descriptorBufferInfos[27].buffer = blockBufferHandle;
+		descriptorBufferInfos[27].offset = blockStateSsboOffset;
+		descriptorBufferInfos[27].range = sizeof(BlockState);
+		descriptorBufferInfos[28].buffer = blockBufferHandle;
+		descriptorBufferInfos[28].offset = particleLevelSsboOffset;
+		descriptorBufferInfos[28].range = levelSsboSize;
+		// the shaders reach the particle state by address then, the bindings past maxStorageBufferRange are only cut to it
+		if (deviceAddress)
+		{
+			for (VkDescriptorBufferInfo& info : descriptorBufferInfos)
+			{
+				info.range = std::min<VkDeviceSize>(info.range, physicalDeviceProperties.limits.maxStorageBufferRange);
+			}
+		}
 
 		// write descriptor sets
-		VkWriteDescriptorSet writeDescriptorSets[5];
-		for (int index = 0; index < 5; index++)
+		VkWriteDescriptorSet writeDescriptorSets[SPH_NUM_COMPUTE_BINDINGS];
+		for (int index = 0; index < SPH_NUM_COMPUTE_BINDINGS; index++)
 		{
 			VkWriteDescriptorSet write = CsySmallVk::writeDescriptorSet();
 			write.descriptorCount = 1;
@@ -951,7 +1985,34 @@ namespace SPH
 			writeDescriptorSets[index] = write;
 		}
 
-		vkUpdateDescriptorSets(logicalDeviceHandle, 5, writeDescriptorSets, 0, NULL);
+		vkUpdateDescriptorSets(logicalDeviceHandle, SPH_NUM_COMPUTE_BINDINGS, writeDescriptorSets, 0, NULL);
+		if (deviceAddress)
+		{
+			// the snapshots are drawn from snapshotStateAddresses
+			std::cout << "Successfully update compute descriptorsets" << std::endl;
+			return;
+		}
+
+		// the render snapshots only swap the bindings particle.vert reads
+		VkDescriptorSetLayout snapshotSetLayouts[2]{ computeDescriptorSetLayoutHandle, computeDescriptorSetLayoutHandle };
+		allocInfo.descriptorSetCount = 2;
+		allocInfo.pSetLayouts = snapshotSetLayouts;
+		if (vkAllocateDescriptorSets(logicalDeviceHandle, &allocInfo, snapshotDescriptorSetHandles) != VK_SUCCESS)
+		{
+			throw std::runtime_error("snapshot descriptor set allocation failed");
+		}
+		for (uint32_t snapshot = 0; snapshot < 2; snapshot++)
+		{
+			VkDescriptorBufferInfo snapshotParticleDataInfo{ snapshotBufferHandles[snapshot], 0, particleDataSize };
+			VkDescriptorBufferInfo snapshotMassInfo{ snapshotBufferHandles[snapshot], snapshotMassOffset, massSsboSize };
+			for (int index = 0; index < SPH_NUM_COMPUTE_BINDINGS; index++)
+			{
+				writeDescriptorSets[index].dstSet = snapshotDescriptorSetHandles[snapshot];
+			}
+			writeDescriptorSets[0].pBufferInfo = &snapshotParticleDataInfo;
+			writeDescriptorSets[23].pBufferInfo = &snapshotMassInfo;
+			vkUpdateDescriptorSets(logicalDeviceHandle, SPH_NUM_COMPUTE_BINDINGS, writeDescriptorSets, 0, NULL);
+		}
 		std::cout << "Successfully update compute descriptorsets" << std::endl;
 	}
 
@@ -960,53 +2021,242 @@ namespace SPH
 		VkPipelineLayoutCreateInfo layoutCreateInfo = CsySmallVk::pipelineLayoutCreateInfo();
 		layoutCreateInfo.setLayoutCount = 1;
 		layoutCreateInfo.pSetLayouts = &computeDescriptorSetLayoutHandle;
-		layoutCreateInfo.pushConstantRangeCount = 0;
-		layoutCreateInfo.pPushConstantRanges = nullptr;
-		if (vkCreatePipelineLayout(logicalDeviceHandle, &layoutCreateInfo, nullptr, &computePipelineLayoutHandle)!= VK_SUCCESS)
+		const VkPushConstantRange stateRange{ VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ParticleStateAddresses) };
+		layoutCreateInfo.pushConstantRangeCount = deviceAddress ? 1 : 0;
+		layoutCreateInfo.pPushConstantRanges = deviceAddress ? &stateRange : nullptr;
+		if (vkCreatePipelineLayout(logicalDeviceHandle, &layoutCreateInfo, allocator, &computePipelineLayoutHandle)!= VK_SUCCESS)
 			throw std::runtime_error("failed to create pipeline layout!");
 		std::cout << "Successfully create compute pipeline layout" << std::endl;
 	}
 
 	void Application::CreateComputePipelines()
 	{
-		// first
-		auto computeDensityPressureShaderCode = CsySmallVk::readFile(MU_SHADER_PATH "compute_density_pressure.comp.spv");
-		VkShaderModule computeDensityPressureShaderModule = CreateShaderModule(computeDensityPressureShaderCode);
+		// the first creation picks up the results of an earlier --autotune run on this device, the tuner itself starts from the defaults
+		if (!tuningLoaded)
+		{
+			tuningLoaded = true;
+			if (!settings.autotune && tuning.Load(physicalDeviceProperties) && tuning.hasForceKernel && !settings.forceKernelGiven
+				&& (tuning.forceKernel != ForceKernel::Symmetric || atomicFloatSupported))
+			{
+				forceKernel = tuning.forceKernel;
+				std::cout << "[INFO] force kernel from the tuning file: " << Settings::ForceKernelName(forceKernel) << std::endl;
+			}
+		}
+
+		// brute force density and pressure, force and integrate
+		computePipelineHandles[0] = CreateComputePipeline(StorageShader("compute_density_pressure").c_str());
+		computePipelineHandles[1] = CreateComputePipeline(StorageShader("compute_force").c_str());
+		computePipelineHandles[2] = CreateComputePipeline(StorageShader("integrate").c_str());
+
+		// reorder pass
+		reorderPipelineHandles[0] = CreateComputePipeline(StorageShader("reorder_morton").c_str());
+		reorderPipelineHandles[1] = CreateComputePipeline(StorageShader("reorder_gather").c_str());
+		// particle emission and compaction
+		particleCountPipelineHandles[0] = CreateComputePipeline(StorageShader("emit_particles").c_str());
+		particleCountPipelineHandles[1] = CreateComputePipeline("compact_flags.comp.spv");
+		particleCountPipelineHandles[2] = CreateComputePipeline("update_indirect.comp.spv");
+		// neighbour grid
+		gridPipelineHandles[0] = CreateComputePipeline(StorageShader("grid_hash").c_str());
+		gridPipelineHandles[1] = CreateComputePipeline("grid_cell_range.comp.spv");
+		neighbourPipelineHandles[0] = CreateComputePipeline(StorageShader("compute_density_pressure_grid").c_str());
+		neighbourPipelineHandles[1] = CreateComputePipeline(StorageShader("compute_force_grid").c_str());
+		// the symmetric kernel's SPIR-V needs the float atomic feature enabled
+		if (atomicFloatSupported)
+		{
+			neighbourPipelineHandles[2] = CreateComputePipeline(StorageShader("compute_force_symmetric").c_str());
+		}
+		// active tile schedule
+		tilePipelineHandles[0] = CreateComputePipeline(StorageShader("tile_mark").c_str());
+		tilePipelineHandles[1] = CreateComputePipeline("tile_update.comp.spv");
+		tilePipelineHandles[2] = CreateComputePipeline(StorageShader("active_flags").c_str());
+		tilePipelineHandles[3] = CreateComputePipeline("tile_stats.comp.spv");
+		// halo exchange of split runs
+		splitPipelineHandles[0] = CreateComputePipeline("split_drop_ghosts.comp.spv");
+		splitPipelineHandles[1] = CreateComputePipeline("split_append.comp.spv");
+		splitPipelineHandles[2] = CreateComputePipeline(StorageShader("split_insert").c_str());
+		splitPipelineHandles[3] = CreateComputePipeline(StorageShader("split_band").c_str());
+		// splits and merges of adaptive runs
+		adaptPipelineHandles[0] = CreateComputePipeline(StorageShader("adapt_mark").c_str());
+		adaptPipelineHandles[1] = CreateComputePipeline(StorageShader("adapt_pair").c_str());
+		adaptPipelineHandles[2] = CreateComputePipeline(StorageShader("adapt_apply").c_str());
+		// levels due in each substep of block time steps
+		blockPipelineHandles[0] = CreateComputePipeline("block_substep.comp.spv");
+		blockPipelineHandles[1] = CreateComputePipeline("block_flags.comp.spv");
+		std::cout << "Successfully create compute pipelines" << std::endl;
+	}
+
+	std::string Application::StorageShader(const char* shaderName, const char* stage) const
+	{
+		// shaders including particle_layout.glsl come in every layout, storage precision and particle state binding
+		return std::string(shaderName) + ParticleLayoutSuffix(particleLayout) + (halfStorage ? ".half" : "") + (deviceAddress ? ".address." : ".") + stage + ".spv";
+	}
+
+	void Application::BindComputeState(VkCommandBuffer commandBuffer)
+	{
+		BindComputeState(commandBuffer, particleStateAddresses);
+	}
+
+	void Application::BindComputeState(VkCommandBuffer commandBuffer, const ParticleStateAddresses& state)
+	{
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayoutHandle, 0, 1, &computeDescriptorSetHandle, 0, NULL);
+		if (deviceAddress)
+		{
+			vkCmdPushConstants(commandBuffer, computePipelineLayoutHandle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ParticleStateAddresses), &state);
+		}
+	}
+
+	uint64_t Application::ParticleFieldOffset(ParticleField field, uint32_t i) const
+	{
+		return positionSsboOffset + SPH::ParticleFieldOffset(particleLayout, halfStorage, field, SPH_PARTICLE_CAPACITY, i);
+	}
+
+	uint32_t Application::GatheredCopyRegions(VkBufferCopy* regions) const
+	{
+		// what reorder_gather wrote to the reorder buffer, to copy back over the particle buffer. The SoA gather leaves
+		// density and pressure behind, the AoS and AoSoA records move as a whole
+		uint32_t regionCount = 0;
+		if (particleLayout == ParticleLayout::SoA)
+		{
+			regions[regionCount++] = { sortedParticleDataSsboOffset, positionSsboOffset, positionSsboSize };
+			regions[regionCount++] = { sortedVelocitySsboOffset, velocitySsboOffset, velocitySsboSize };
+		}
+		else
+		{
+			regions[regionCount++] = { sortedParticleDataSsboOffset, positionSsboOffset, particleDataSize };
+		}
+		regions[regionCount++] = { sortedParticleIdSsboOffset, particleIdSsboOffset, particleIdSsboSize };
+		regions[regionCount++] = { sortedMassSsboOffset, massSsboOffset, massSsboSize };
+		return regionCount;
+	}
+
+	void Application::SetParticleStorage(ParticleLayout layout, bool half)
+	{
+		// swaps every pipeline touching the particle data for the variant of the other layout or precision and rerecords
+		// the command buffers using them. The particles are left as they were, so Upload before the next step
+		if (half && !halfStorageSupported)
+		{
+			throw std::runtime_error("storageBuffer16BitAccess is not supported");
+		}
+		if (layout == particleLayout && half == halfStorage)
+		{
+			return;
+		}
+		particleLayout = layout;
+		halfStorage = half;
+		RecreatePipelines();
+		std::cout << "[INFO] particle storage: " << (halfStorage ? "fp16" : "fp32") << ", " << Settings::ParticleLayoutName(particleLayout) << " layout" << std::endl;
+	}
+
+	void Application::RecreatePipelines()
+	{
+		// after a storage or tuning change, every pipeline and the command buffers using them
+		vkDeviceWaitIdle(logicalDeviceHandle);
+		auto destroyPipelines = [&](VkPipeline* pipelines, size_t count)
+		{
+			for (size_t i = 0; i < count; i++)
+			{
+				DestroyComputePipeline(pipelines[i]);
+			}
+		};
+		destroyPipelines(computePipelineHandles, 3);
+		destroyPipelines(reorderPipelineHandles, 2);
+		destroyPipelines(particleCountPipelineHandles, 3);
+		destroyPipelines(gridPipelineHandles, 2);
+		destroyPipelines(neighbourPipelineHandles, 3);
+		destroyPipelines(tilePipelineHandles, 4);
+		destroyPipelines(splitPipelineHandles, 4);
+		destroyPipelines(adaptPipelineHandles, 3);
+		destroyPipelines(blockPipelineHandles, 2);
+		destroyPipelines(&splatPipelineHandle, 1);
+		vkDestroyPipeline(logicalDeviceHandle, graphicsPipelineHandle, allocator);
+		graphicsPipelineHandle = VK_NULL_HANDLE;
+		CreateComputePipelines();
+		CreateGraphicsPipeline();
+
+		VkCommandBuffer commandBuffers[5]{ computeCommandBufferHandle, reorderCommandBufferHandle, emissionCommandBufferHandle, compactionCommandBufferHandle, adaptCommandBufferHandle };
+		vkFreeCommandBuffers(logicalDeviceHandle, computeCommandPoolHandle, 5, commandBuffers);
+		CreateComputeCommandBuffer();
+		CreateReorderCommandBuffer();
+		CreateEmissionCommandBuffer();
+		CreateCompactionCommandBuffer();
+		CreateAdaptCommandBuffer();
+		vkFreeCommandBuffers(logicalDeviceHandle, graphicsCommandPoolHandle, static_cast<uint32_t>(graphicsCommandBufferHandles.size()), graphicsCommandBufferHandles.data());
+		CreateGraphicsCommandBuffers();
+	}
+
+	VkPipeline Application::CreateComputePipeline(const char* shaderFileName, uint32_t workGroupSize)
+	{
+		// the tuning file knows the passes by their shader name, without the layout and precision suffixes
+		const std::string passName = std::string(shaderFileName).substr(0, std::string(shaderFileName).find('.'));
+		if (workGroupSize == 0)
+		{
+			workGroupSize = tuning.WorkGroupSize(passName);
+		}
+		if (workGroupSize == 0)
+		{
+			workGroupSize = SPH_WORK_GROUP_SIZE;
+		}
+		const uint32_t maxWorkGroupSize = std::min(physicalDeviceProperties.limits.maxComputeWorkGroupSize[0], physicalDeviceProperties.limits.maxComputeWorkGroupInvocations);
+		const uint32_t index = WorkGroupSizeIndex(workGroupSize);
+		if (index >= SPH_WORK_GROUP_SIZE_COUNT || (SPH_MIN_WORK_GROUP_SIZE << index) != workGroupSize || workGroupSize > maxWorkGroupSize)
+		{
+			std::cout << "[WARNING] local size " << workGroupSize << " of " << passName << " is not a candidate on this device, using " << SPH_WORK_GROUP_SIZE << std::endl;
+			workGroupSize = SPH_WORK_GROUP_SIZE;
+		}
+
+		auto shaderCode = CsySmallVk::readFile(std::string(SPH_SHADER_PATH) + shaderFileName);
+		VkShaderModule shaderModule = CreateShaderModule(shaderCode);
+		// constant 0 is the local size, constant 1 switches on the per-particle resolution of resolution.glsl, constants 2
+		// and 3 the block time steps and the sink of integrate.comp, shaders without them ignore them
+		const uint32_t specializationData[4]{ workGroupSize, settings.adaptive ? VK_TRUE : VK_FALSE, settings.blockSteps ? VK_TRUE : VK_FALSE,
+			EmitInterval() > 0 ? VK_TRUE : VK_FALSE };
+		VkSpecializationMapEntry specializationEntries[4]{ { 0, 0, sizeof(uint32_t) }, { 1, sizeof(uint32_t), sizeof(VkBool32) }, { 2, 2 * sizeof(uint32_t), sizeof(VkBool32) },
+			{ 3, 3 * sizeof(uint32_t), sizeof(VkBool32) } };
+		VkSpecializationInfo specializationInfo{ 4, specializationEntries, sizeof(specializationData), specializationData };
 		VkPipelineShaderStageCreateInfo shaderStageCreateInfo = CsySmallVk::pipelineShaderStageCreateInfo();
-		shaderStageCreateInfo.module = computeDensityPressureShaderModule;
+		shaderStageCreateInfo.module = shaderModule;
 		shaderStageCreateInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
 		shaderStageCreateInfo.pName = "main";
+		shaderStageCreateInfo.pSpecializationInfo = &specializationInfo;
 
 		VkComputePipelineCreateInfo createInfo = CsySmallVk::computePipelineCreateInfo();
 		createInfo.basePipelineHandle = VK_NULL_HANDLE;
 		createInfo.basePipelineIndex = 0;
 		createInfo.stage = shaderStageCreateInfo;
-		createInfo.layout = computePipelineLayoutHandle; 
-		if (vkCreateComputePipelines(logicalDeviceHandle, globalPipelineCacheHandle, 1, &createInfo, NULL, &computePipelineHandles[0]) != VK_SUCCESS)
-		{
-			throw std::runtime_error("first compute pipeline creation failed");
-		}
-		
-		//second
-		auto computeForceShaderCode = CsySmallVk::readFile(MU_SHADER_PATH "compute_force.comp.spv");
-		VkShaderModule computeForceShaderModule = CreateShaderModule(computeForceShaderCode);
-		shaderStageCreateInfo.module = computeForceShaderModule;
-		createInfo.stage = shaderStageCreateInfo;
-		if (vkCreateComputePipelines(logicalDeviceHandle, globalPipelineCacheHandle, 1, &createInfo, NULL, &computePipelineHandles[1]) != VK_SUCCESS)
+		createInfo.layout = computePipelineLayoutHandle;
+		VkPipeline pipelineHandle = VK_NULL_HANDLE;
+		if (vkCreateComputePipelines(logicalDeviceHandle, globalPipelineCacheHandle, 1, &createInfo, allocator, &pipelineHandle) != VK_SUCCESS)
 		{
-			throw std::runtime_error("first compute pipeline creation failed");
+			throw std::runtime_error(std::string("compute pipeline creation failed: ") + shaderFileName);
 		}
+		vkDestroyShaderModule(logicalDeviceHandle, shaderModule, allocator);
+		pipelineWorkGroupSizes[pipelineHandle] = workGroupSize;
+		return pipelineHandle;
+	}
 
-		//third
-		auto integrateShaderCode = CsySmallVk::readFile(MU_SHADER_PATH "integrate.comp.spv");
-		VkShaderModule integrateShaderModule = CreateShaderModule(integrateShaderCode);
-		shaderStageCreateInfo.module = integrateShaderModule;
-		createInfo.stage = shaderStageCreateInfo;
-		if (vkCreateComputePipelines(logicalDeviceHandle, globalPipelineCacheHandle, 1, &createInfo, NULL, &computePipelineHandles[2]) != VK_SUCCESS)
+	void Application::DestroyComputePipeline(VkPipeline& pipeline)
+	{
+		if (pipeline != VK_NULL_HANDLE)
 		{
-			throw std::runtime_error("first compute pipeline creation failed");
+			pipelineWorkGroupSizes.erase(pipeline);
+			vkDestroyPipeline(logicalDeviceHandle, pipeline, allocator);
+			pipeline = VK_NULL_HANDLE;
 		}
-		std::cout << "Successfully create compute pipelines" << std::endl;
+	}
+
+	void Application::RecordDispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, uint32_t invocationCount)
+	{
+		const uint32_t workGroupSize = pipelineWorkGroupSizes.at(pipeline);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		const VkDispatchIndirectCommand size = DispatchSize((invocationCount + workGroupSize - 1) / workGroupSize);
+		vkCmdDispatch(commandBuffer, size.x, size.y, size.z);
+	}
+
+	void Application::RecordDispatchIndirect(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkBuffer buffer, VkDeviceSize sizedDispatchOffset)
+	{
+		const uint32_t workGroupSize = pipelineWorkGroupSizes.at(pipeline);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdDispatchIndirect(commandBuffer, buffer, sizedDispatchOffset + sizeof(VkDispatchIndirectCommand) * WorkGroupSizeIndex(workGroupSize));
 	}
 
 	void Application::CreateComputeCommandPool()
@@ -1014,7 +2264,7 @@ namespace SPH
 		VkCommandPoolCreateInfo createInfo = CsySmallVk::commandPoolCreateInfo();
 		createInfo.queueFamilyIndex = graphicsPresentationComputeQueueFamilyIndex;
 		createInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-		if (vkCreateCommandPool(logicalDeviceHandle, &createInfo, NULL, &computeCommandPoolHandle) != VK_SUCCESS)
+		if (vkCreateCommandPool(logicalDeviceHandle, &createInfo, allocator, &computeCommandPoolHandle) != VK_SUCCESS)
 		{
 			throw std::runtime_error("command pool creation failed");
 		}
@@ -1038,154 +2288,1894 @@ namespace SPH
 		{
 			throw std::runtime_error("command buffer begin failed");
 		}
-		vkCmdBindDescriptorSets(computeCommandBufferHandle, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineLayoutHandle, 0, 1, &computeDescriptorSetHandle, 0, NULL);
-		// First dispatch
-		vkCmdBindPipeline(computeCommandBufferHandle, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineHandles[0]);
-		vkCmdDispatch(computeCommandBufferHandle, SPH_NUM_WORK_GROUPS, 1, 1);
-
-		// Barrier: compute to compute dependencies
-		// First dispatch writes to a storage buffer, second dispatch reads from that storage buffer
-		vkCmdPipelineBarrier(computeCommandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 0, NULL);
-	
-		// Second dispatch
-		vkCmdBindPipeline(computeCommandBufferHandle, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineHandles[1]);
-		vkCmdDispatch(computeCommandBufferHandle, SPH_NUM_WORK_GROUPS, 1, 1);
-
-		// Barrier: compute to compute dependencies
-		// Second dispatch writes to a storage buffer, third dispatch reads from that storage buffer
-		vkCmdPipelineBarrier(computeCommandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 0, NULL);
-	
-		// Third dispatch
-		// Third dispatch writes to the storage buffer. Later, vkCmdDraw reads that buffer as a vertex buffer with vkCmdBindVertexBuffers.
-		vkCmdBindPipeline(computeCommandBufferHandle, VK_PIPELINE_BIND_POINT_COMPUTE, computePipelineHandles[2]);
-		vkCmdDispatch(computeCommandBufferHandle, SPH_NUM_WORK_GROUPS, 1, 1);
-	
-		vkCmdPipelineBarrier(computeCommandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0, NULL, 0, NULL);
-		vkEndCommandBuffer(computeCommandBufferHandle);
+		if (timestampsSupported)
+		{
+			vkCmdResetQueryPool(computeCommandBufferHandle, timestampQueryPoolHandle, 0, 2);
+			vkCmdResetQueryPool(computeCommandBufferHandle, timestampQueryPoolHandle, 4, 4);
+			vkCmdWriteTimestamp(computeCommandBufferHandle, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPoolHandle, 0);
+		}
+		const FrameGraph::Statistics statistics = RecordSimulationStep(computeCommandBufferHandle, forceKernel, timestampsSupported);
+		if (timestampsSupported)
+		{
+			vkCmdWriteTimestamp(computeCommandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestampQueryPoolHandle, 1);
+		}
+		vkEndCommandBuffer(computeCommandBufferHandle);
+		std::cout << "[INFO] step frame graph: " << statistics.passCount << " passes in " << statistics.levelCount << " levels, " << statistics.barrierCount
+			<< " barriers with " << statistics.bufferBarrierCount << " buffer barriers: " << statistics.schedule << std::endl;
 		std::cout << "Successfully create compute command buffer" << std::endl;
 	}
 
-	void Application::SetInitialParticleData()
+	FrameGraph::Statistics Application::RecordSimulationStep(VkCommandBuffer commandBuffer, ForceKernel kernel, bool passTimestamps)
+	{
+		// block time steps record a whole block, every substep advances the clock by SPH_TIME_STEP
+		FrameGraph graph;
+		const uint32_t substepCount = settings.blockSteps ? SPH_BLOCK_SUBSTEPS : 1;
+		for (uint32_t substep = 0; substep < substepCount; substep++)
+		{
+			if (kernel != ForceKernel::BruteForce)
+			{
+				AddNeighbourGridPasses(graph);
+			}
+			if (settings.activeTiles)
+			{
+				AddActiveTilePasses(graph);
+			}
+			if (settings.blockSteps)
+			{
+				AddBlockLevelPasses(graph);
+			}
+			AddParticlePasses(graph, kernel, passTimestamps && substep == 0);
+		}
+		return graph.Record(commandBuffer);
+	}
+
+	void Application::AddNeighbourGridPasses(FrameGraph& graph)
+	{
+		// empty cells keep start == end == 0, the previous step's kernels may still read the cell ranges
+		graph.AddPass("clear grid", { BufferAccess::TransferWrite(stepRanges.grid) },
+			[this](VkCommandBuffer commandBuffer)
+			{
+				vkCmdFillBuffer(commandBuffer, gridBufferHandle, 0, VK_WHOLE_SIZE, 0);
+			});
+
+		// cell key of every slot
+		graph.AddPass("grid hash",
+			{
+				BufferAccess::ShaderRead(stepRanges.particleData),
+				BufferAccess::ShaderRead(stepRanges.particleId),
+				BufferAccess::ShaderRead(stepRanges.simulationState),
+				BufferAccess::ShaderWrite(stepRanges.sortKeys),
+				BufferAccess::ShaderWrite(stepRanges.sortValues)
+			},
+			[this](VkCommandBuffer commandBuffer)
+			{
+				BindComputeState(commandBuffer);
+				RecordDispatch(commandBuffer, gridPipelineHandles[0], SPH_PARTICLE_CAPACITY);
+			});
+
+		// sort the slots by cell, the particle state itself stays where it is
+		graph.AddPass("sort",
+			{
+				BufferAccess::ShaderReadWrite(stepRanges.sortKeys),
+				BufferAccess::ShaderReadWrite(stepRanges.sortValues),
+				BufferAccess::ShaderReadWrite(stepRanges.sortScratch)
+			},
+			[this](VkCommandBuffer commandBuffer)
+			{
+				gpuPrimitives->RecordSort(commandBuffer, stepRanges.sortKeys, stepRanges.sortValues, SPH_PARTICLE_CAPACITY, stepRanges.sortScratch, SPH_GRID_KEY_BITS);
+			});
+
+		// first and last sorted index of every occupied cell
+		graph.AddPass("cell range",
+			{
+				BufferAccess::ShaderRead(stepRanges.sortKeys),
+				BufferAccess::ShaderRead(stepRanges.simulationState),
+				BufferAccess::IndirectRead(stepRanges.simulationState),
+				BufferAccess::ShaderWrite(stepRanges.grid)
+			},
+			[this](VkCommandBuffer commandBuffer)
+			{
+				BindComputeState(commandBuffer);
+				RecordDispatchIndirect(commandBuffer, gridPipelineHandles[1], simulationStateBufferHandle, offsetof(SimulationState, sizedDispatch));
+			});
+	}
+
+	void Application::AddActiveTilePasses(FrameGraph& graph)
+	{
+		// tiles holding a particle faster than the rest speed
+		graph.AddPass("tile mark",
+			{
+				BufferAccess::ShaderRead(stepRanges.particleData),
+				BufferAccess::ShaderRead(stepRanges.particleId),
+				BufferAccess::ShaderRead(stepRanges.simulationState),
+				BufferAccess::IndirectRead(stepRanges.simulationState),
+				BufferAccess::ShaderReadWrite(stepRanges.tiles)
+			},
+			[this](VkCommandBuffer commandBuffer)
+			{
+				BindComputeState(commandBuffer);
+				RecordDispatchIndirect(commandBuffer, tilePipelineHandles[0], simulationStateBufferHandle, offsetof(SimulationState, sizedDispatch));
+			});
+
+		// wake the moving tiles, count down the sleep timer of the others
+		graph.AddPass("tile update", { BufferAccess::ShaderReadWrite(stepRanges.tiles), BufferAccess::ShaderReadWrite(stepRanges.activeState) },
+			[this](VkCommandBuffer commandBuffer)
+			{
+				BindComputeState(commandBuffer);
+				RecordDispatch(commandBuffer, tilePipelineHandles[1], SPH_TILE_COUNT);
+			});
+
+		// particles within one tile of an awake tile are awake, those within two are active
+		graph.AddPass("active flags",
+			{
+				BufferAccess::ShaderRead(stepRanges.particleData),
+				BufferAccess::ShaderRead(stepRanges.particleId),
+				BufferAccess::ShaderRead(stepRanges.simulationState),
+				BufferAccess::ShaderRead(stepRanges.tiles),
+				BufferAccess::ShaderReadWrite(stepRanges.activeState),
+				BufferAccess::ShaderWrite(stepRanges.activeFlags),
+				BufferAccess::ShaderWrite(stepRanges.awake)
+			},
+			[this](VkCommandBuffer commandBuffer)
+			{
+				BindComputeState(commandBuffer);
+				RecordDispatch(commandBuffer, tilePipelineHandles[2], SPH_PARTICLE_CAPACITY);
+			});
+		AddActiveCompactionPasses(graph);
+	}
+
+	void Application::AddBlockLevelPasses(FrameGraph& graph)
+	{
+		// advance the substep and find the coarsest level due in it
+		graph.AddPass("block substep", { BufferAccess::ShaderReadWrite(stepRanges.blockState), BufferAccess::ShaderReadWrite(stepRanges.activeState) },
+			[this](VkCommandBuffer commandBuffer)
+			{
+				BindComputeState(commandBuffer);
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, blockPipelineHandles[0]);
+				vkCmdDispatch(commandBuffer, 1, 1, 1);
+			});
+
+		// the particles due are active and awake
+		graph.AddPass("block flags",
+			{
+				BufferAccess::ShaderRead(stepRanges.particleId),
+				BufferAccess::ShaderRead(stepRanges.simulationState),
+				BufferAccess::ShaderRead(stepRanges.blockState),
+				BufferAccess::ShaderRead(stepRanges.particleLevels),
+				BufferAccess::ShaderReadWrite(stepRanges.activeState),
+				BufferAccess::ShaderWrite(stepRanges.activeFlags),
+				BufferAccess::ShaderWrite(stepRanges.awake)
+			},
+			[this](VkCommandBuffer commandBuffer)
+			{
+				BindComputeState(commandBuffer);
+				RecordDispatch(commandBuffer, blockPipelineHandles[1], SPH_PARTICLE_CAPACITY);
+			});
+		AddActiveCompactionPasses(graph);
+	}
+
+	void Application::AddActiveCompactionPasses(FrameGraph& graph)
+	{
+		// the flagged particles make the active list, the sort scratch is free once the neighbour grid is done
+		graph.AddPass("compact active",
+			{
+				BufferAccess::ShaderRead(stepRanges.activeFlags),
+				BufferAccess::ShaderWrite(stepRanges.activeIndex),
+				BufferAccess::ShaderWrite(stepRanges.compactResult),
+				BufferAccess::ShaderReadWrite(stepRanges.sortScratch)
+			},
+			[this](VkCommandBuffer commandBuffer)
+			{
+				gpuPrimitives->RecordCompact(commandBuffer, stepRanges.activeFlags, { VK_NULL_HANDLE, 0, 0 }, stepRanges.activeIndex, stepRanges.compactResult,
+					SPH_PARTICLE_CAPACITY, SPH_WORK_GROUP_SIZE, stepRanges.sortScratch);
+			});
+
+		// dispatch sizes of every candidate local size and the particle-step counters of the report
+		graph.AddPass("tile stats", { BufferAccess::ShaderRead(stepRanges.simulationState), BufferAccess::ShaderReadWrite(stepRanges.activeState) },
+			[this](VkCommandBuffer commandBuffer)
+			{
+				BindComputeState(commandBuffer);
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, tilePipelineHandles[3]);
+				vkCmdDispatch(commandBuffer, 1, 1, 1);
+			});
+	}
+
+	std::vector<BufferAccess> Application::ParticleReads(ForceKernel kernel) const
+	{
+		// what the density and force kernels read besides the particle data
+		std::vector<BufferAccess> reads
+		{
+			BufferAccess::ShaderRead(stepRanges.mass),
+			BufferAccess::ShaderRead(stepRanges.particleId),
+			BufferAccess::ShaderRead(stepRanges.simulationState),
+			BufferAccess::ShaderRead(stepRanges.activeState),
+			BufferAccess::ShaderRead(stepRanges.activeIndex),
+			BufferAccess::ShaderRead(stepRanges.boundary)
+		};
+		if (kernel != ForceKernel::BruteForce)
+		{
+			reads.push_back(BufferAccess::ShaderRead(stepRanges.sortKeys));
+			reads.push_back(BufferAccess::ShaderRead(stepRanges.sortValues));
+			reads.push_back(BufferAccess::ShaderRead(stepRanges.grid));
+		}
+		return reads;
+	}
+
+	void Application::AddParticlePasses(FrameGraph& graph, ForceKernel kernel, bool passTimestamps)
+	{
+		// density, force and integrate only run on the active list, except where noted
+		std::vector<BufferAccess> densityAccesses = ParticleReads(kernel);
+		densityAccesses.push_back(BufferAccess::ShaderReadWrite(stepRanges.particleData));
+		densityAccesses.push_back(BufferAccess::IndirectRead(stepRanges.activeState));
+		graph.AddPass("density", densityAccesses,
+			[this, kernel, passTimestamps](VkCommandBuffer commandBuffer)
+			{
+				if (passTimestamps)
+				{
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestampQueryPoolHandle, 4);
+				}
+				BindComputeState(commandBuffer);
+				RecordDispatchIndirect(commandBuffer, kernel == ForceKernel::BruteForce ? computePipelineHandles[0] : neighbourPipelineHandles[0], tileBufferHandle,
+					activeStateSsboOffset + offsetof(ActiveState, sizedDispatch));
+				if (passTimestamps)
+				{
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestampQueryPoolHandle, 5);
+				}
+			});
+
+		AddForcePasses(graph, kernel, passTimestamps);
+
+		// moves the particles, under block time steps every alive one and not just the active ones. The render snapshot
+		// copies the positions after it
+		graph.AddPass("integrate",
+			{
+				BufferAccess::ShaderRead(stepRanges.force),
+				BufferAccess::ShaderReadWrite(stepRanges.particleData),
+				BufferAccess::ShaderReadWrite(stepRanges.particleId),
+				BufferAccess::ShaderRead(stepRanges.simulationState),
+				BufferAccess::ShaderRead(stepRanges.activeState),
+				BufferAccess::ShaderRead(stepRanges.activeIndex),
+				BufferAccess::ShaderRead(stepRanges.awake),
+				BufferAccess::ShaderRead(stepRanges.boundary),
+				BufferAccess::ShaderRead(stepRanges.blockState),
+				BufferAccess::ShaderReadWrite(stepRanges.particleLevels),
+				BufferAccess::IndirectRead(settings.blockSteps ? stepRanges.simulationState : stepRanges.activeState)
+			},
+			[this, passTimestamps](VkCommandBuffer commandBuffer)
+			{
+				BindComputeState(commandBuffer);
+				if (settings.blockSteps)
+				{
+					RecordDispatchIndirect(commandBuffer, computePipelineHandles[2], simulationStateBufferHandle, offsetof(SimulationState, sizedDispatch));
+				}
+				else
+				{
+					RecordDispatchIndirect(commandBuffer, computePipelineHandles[2], tileBufferHandle, activeStateSsboOffset + offsetof(ActiveState, sizedDispatch));
+				}
+				if (passTimestamps)
+				{
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestampQueryPoolHandle, 7);
+				}
+			});
+	}
+
+	void Application::AddForcePasses(FrameGraph& graph, ForceKernel kernel, bool passTimestamps)
+	{
+		// both particles of a pair accumulate into the force buffer, so it starts from zero. Nothing before the force
+		// pass reads it, so the fill overlaps the grid and density passes
+		if (kernel == ForceKernel::Symmetric)
+		{
+			graph.AddPass("clear forces", { BufferAccess::TransferWrite(stepRanges.force) },
+				[this](VkCommandBuffer commandBuffer)
+				{
+					vkCmdFillBuffer(commandBuffer, packedParticlesBufferHandle, forceSsboOffset, forceSsboSize, 0);
+				});
+		}
+
+		// the symmetric kernel walks the pairs of every sorted particle, a frozen particle may owe its pair to an active one
+		std::vector<BufferAccess> forceAccesses = ParticleReads(kernel);
+		forceAccesses.push_back(BufferAccess::ShaderRead(stepRanges.particleData));
+		forceAccesses.push_back(BufferAccess::ShaderRead(stepRanges.awake));
+		forceAccesses.push_back(kernel == ForceKernel::Symmetric ? BufferAccess::ShaderReadWrite(stepRanges.force) : BufferAccess::ShaderWrite(stepRanges.force));
+		forceAccesses.push_back(BufferAccess::IndirectRead(kernel == ForceKernel::Symmetric ? stepRanges.simulationState : stepRanges.activeState));
+		graph.AddPass("force", forceAccesses,
+			[this, kernel, passTimestamps](VkCommandBuffer commandBuffer)
+			{
+				VkPipeline pipeline = computePipelineHandles[1];
+				if (kernel == ForceKernel::Gather)
+				{
+					pipeline = neighbourPipelineHandles[1];
+				}
+				else if (kernel == ForceKernel::Symmetric)
+				{
+					pipeline = neighbourPipelineHandles[2];
+				}
+				BindComputeState(commandBuffer);
+				if (kernel == ForceKernel::Symmetric)
+				{
+					RecordDispatchIndirect(commandBuffer, pipeline, simulationStateBufferHandle, offsetof(SimulationState, sizedDispatch));
+				}
+				else
+				{
+					RecordDispatchIndirect(commandBuffer, pipeline, tileBufferHandle, activeStateSsboOffset + offsetof(ActiveState, sizedDispatch));
+				}
+				if (passTimestamps)
+				{
+					vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, timestampQueryPoolHandle, 6);
+				}
+			});
+	}
+
+	void Application::RecordNeighbourGrid(VkCommandBuffer commandBuffer)
+	{
+		FrameGraph graph;
+		AddNeighbourGridPasses(graph);
+		graph.Record(commandBuffer);
+	}
+
+	void Application::RecordForcePass(VkCommandBuffer commandBuffer, ForceKernel kernel)
+	{
+		// the force pass alone, on the densities of an earlier command buffer
+		FrameGraph graph;
+		AddForcePasses(graph, kernel, false);
+		graph.Record(commandBuffer);
+	}
+
+	void Application::CreateTimestampQueryPool()
+	{
+		uint32_t timestampValidBits = CsySmallVk::Query::physicalDeviceQueueFamilyProperties(physicalDeviceHandle)[graphicsPresentationComputeQueueFamilyIndex].timestampValidBits;
+		timestampsSupported = (SPH_REORDER_PROFILE || !settings.tracePath.empty()) && timestampValidBits > 0;
+		if (!timestampsSupported)
+		{
+			return;
+		}
+		VkQueryPoolCreateInfo createInfo
+		{
+			VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			NULL,
+			0,
+			VK_QUERY_TYPE_TIMESTAMP,
+			SPH_CALIBRATION_QUERY + 1,
+			0
+		};
+		if (vkCreateQueryPool(logicalDeviceHandle, &createInfo, allocator, &timestampQueryPoolHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("timestamp query pool creation failed");
+		}
+		std::cout << "Successfully create timestamp query pool" << std::endl;
+	}
+
+	void Application::CreateReorderCommandBuffer()
+	{
+		VkCommandBufferAllocateInfo allocInfo = CsySmallVk::commandBufferAllocateInfo();
+		allocInfo.commandBufferCount = 1;
+		allocInfo.commandPool = computeCommandPoolHandle;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		if (vkAllocateCommandBuffers(logicalDeviceHandle, &allocInfo, &reorderCommandBufferHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("buffer allocation failed");
+		}
+		VkCommandBufferBeginInfo beginInfo = CsySmallVk::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		if (vkBeginCommandBuffer(reorderCommandBufferHandle, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("command buffer begin failed");
+		}
+
+		VkMemoryBarrier computeToComputeBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+		VkMemoryBarrier computeToTransferBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_TRANSFER_READ_BIT
+		};
+		VkMemoryBarrier transferToComputeBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+
+		if (timestampsSupported)
+		{
+			vkCmdResetQueryPool(reorderCommandBufferHandle, timestampQueryPoolHandle, 2, 2);
+			vkCmdWriteTimestamp(reorderCommandBufferHandle, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPoolHandle, 2);
+		}
+		// the previous step's integrate pass writes the positions the keys are computed from
+		vkCmdPipelineBarrier(reorderCommandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+		BindComputeState(reorderCommandBufferHandle);
+
+		// Z-order key of every particle, the empty slots behind the alive ones keep their place at the end
+		RecordDispatch(reorderCommandBufferHandle, reorderPipelineHandles[0], SPH_PARTICLE_CAPACITY);
+		vkCmdPipelineBarrier(reorderCommandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+
+		// radix sort of the (key, index) pairs
+		gpuPrimitives->RecordSort(reorderCommandBufferHandle,
+			{ reorderBufferHandle, sortKeySsboOffset, sortKeySsboSize },
+			{ reorderBufferHandle, sortValueSsboOffset, sortValueSsboSize },
+			SPH_PARTICLE_CAPACITY,
+			{ reorderBufferHandle, sortScratchOffset, sortScratchSize });
+		vkCmdPipelineBarrier(reorderCommandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+
+		// gather the persistent particle state in sorted order, the primitives bound their own descriptor set
+		BindComputeState(reorderCommandBufferHandle);
+		RecordDispatchIndirect(reorderCommandBufferHandle, reorderPipelineHandles[1], simulationStateBufferHandle, offsetof(SimulationState, sizedDispatch));
+		vkCmdPipelineBarrier(reorderCommandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &computeToTransferBarrier, 0, NULL, 0, NULL);
+
+		// copy it back over the particle buffer
+		VkBufferCopy copyRegions[4];
+		const uint32_t copyRegionCount = GatheredCopyRegions(copyRegions);
+		vkCmdCopyBuffer(reorderCommandBufferHandle, reorderBufferHandle, packedParticlesBufferHandle, copyRegionCount, copyRegions);
+		vkCmdPipelineBarrier(reorderCommandBufferHandle, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &transferToComputeBarrier, 0, NULL, 0, NULL);
+
+		if (timestampsSupported)
+		{
+			vkCmdWriteTimestamp(reorderCommandBufferHandle, VK_PIPELINE_STAGE_TRANSFER_BIT, timestampQueryPoolHandle, 3);
+		}
+		if (vkEndCommandBuffer(reorderCommandBufferHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("command buffer end failed");
+		}
+		std::cout << "Successfully create reorder command buffer" << std::endl;
+	}
+
+	void Application::CreateTimestampReadback()
+	{
+		if (!timestampsSupported)
+		{
+			return;
+		}
+		const VkDeviceSize slotSize = sizeof(uint64_t) * SPH_STEP_QUERY_COUNT;
+		CreateBuffer(SPH_SUBMISSIONS_IN_FLIGHT * slotSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			timestampReadbackBufferHandle, timestampReadbackMemoryHandle, MemoryPurpose::Benchmark);
+		void* readback = nullptr;
+		if (vkMapMemory(logicalDeviceHandle, timestampReadbackMemoryHandle, 0, SPH_SUBMISSIONS_IN_FLIGHT * slotSize, 0, &readback) != VK_SUCCESS)
+		{
+			throw std::runtime_error("timestamp readback mapping failed");
+		}
+		timestampReadbackMapped = static_cast<const uint64_t*>(readback);
+
+		VkCommandBufferAllocateInfo allocInfo = CsySmallVk::commandBufferAllocateInfo();
+		allocInfo.commandBufferCount = SPH_SUBMISSIONS_IN_FLIGHT * 2;
+		allocInfo.commandPool = computeCommandPoolHandle;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		if (vkAllocateCommandBuffers(logicalDeviceHandle, &allocInfo, &timestampCopyCommandBufferHandles[0][0]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("buffer allocation failed");
+		}
+		// the copies wait on the gpu for the step's queries, the host only reads a slot once the timeline passed it
+		VkMemoryBarrier transferToHostBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER, NULL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_HOST_READ_BIT };
+		for (uint32_t slot = 0; slot < SPH_SUBMISSIONS_IN_FLIGHT; slot++)
+		{
+			for (uint32_t reorder = 0; reorder < 2; reorder++)
+			{
+				VkCommandBuffer commandBuffer = timestampCopyCommandBufferHandles[slot][reorder];
+				VkCommandBufferBeginInfo beginInfo = CsySmallVk::commandBufferBeginInfo();
+				if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+				{
+					throw std::runtime_error("command buffer begin failed");
+				}
+				// queries 2 and 3 are only written by a submission with a reorder pass
+				if (reorder)
+				{
+					vkCmdCopyQueryPoolResults(commandBuffer, timestampQueryPoolHandle, 0, SPH_STEP_QUERY_COUNT, timestampReadbackBufferHandle, slot * slotSize,
+						sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+				}
+				else
+				{
+					vkCmdCopyQueryPoolResults(commandBuffer, timestampQueryPoolHandle, 0, 2, timestampReadbackBufferHandle, slot * slotSize,
+						sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+					vkCmdCopyQueryPoolResults(commandBuffer, timestampQueryPoolHandle, 4, 4, timestampReadbackBufferHandle, slot * slotSize + 4 * sizeof(uint64_t),
+						sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+				}
+				// the next submission resets the queries only after the copies
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1,
+					&transferToHostBarrier, 0, NULL, 0, NULL);
+				if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+				{
+					throw std::runtime_error("command buffer end failed");
+				}
+			}
+		}
+		std::cout << "Successfully create timestamp readback" << std::endl;
+	}
+
+	void Application::CreateEmissionCommandBuffer()
+	{
+		VkCommandBufferAllocateInfo allocInfo = CsySmallVk::commandBufferAllocateInfo();
+		allocInfo.commandBufferCount = 1;
+		allocInfo.commandPool = computeCommandPoolHandle;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		if (vkAllocateCommandBuffers(logicalDeviceHandle, &allocInfo, &emissionCommandBufferHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("buffer allocation failed");
+		}
+		VkCommandBufferBeginInfo beginInfo = CsySmallVk::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		if (vkBeginCommandBuffer(emissionCommandBufferHandle, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("command buffer begin failed");
+		}
+
+		VkMemoryBarrier computeToComputeBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+		VkMemoryBarrier computeToIndirectBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+
+		// the previous step's integrate pass may still read the alive count
+		vkCmdPipelineBarrier(emissionCommandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+		BindComputeState(emissionCommandBufferHandle);
+
+		// append a row of inlet particles behind the alive ones
+		vkCmdBindPipeline(emissionCommandBufferHandle, VK_PIPELINE_BIND_POINT_COMPUTE, particleCountPipelineHandles[0]);
+		vkCmdDispatch(emissionCommandBufferHandle, 1, 1, 1);
+		vkCmdPipelineBarrier(emissionCommandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+
+		// clamp the count to the capacity and derive the dispatch and draw sizes from it
+		vkCmdBindPipeline(emissionCommandBufferHandle, VK_PIPELINE_BIND_POINT_COMPUTE, particleCountPipelineHandles[2]);
+		vkCmdDispatch(emissionCommandBufferHandle, 1, 1, 1);
+		vkCmdPipelineBarrier(emissionCommandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToIndirectBarrier, 0, NULL, 0, NULL);
+
+		if (vkEndCommandBuffer(emissionCommandBufferHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("command buffer end failed");
+		}
+		std::cout << "Successfully create emission command buffer" << std::endl;
+	}
+
+	void Application::CreateCompactionCommandBuffer()
+	{
+		VkCommandBufferAllocateInfo allocInfo = CsySmallVk::commandBufferAllocateInfo();
+		allocInfo.commandBufferCount = 1;
+		allocInfo.commandPool = computeCommandPoolHandle;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		if (vkAllocateCommandBuffers(logicalDeviceHandle, &allocInfo, &compactionCommandBufferHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("buffer allocation failed");
+		}
+		VkCommandBufferBeginInfo beginInfo = CsySmallVk::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		if (vkBeginCommandBuffer(compactionCommandBufferHandle, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("command buffer begin failed");
+		}
+
+		RecordCompaction(compactionCommandBufferHandle);
+
+		if (vkEndCommandBuffer(compactionCommandBufferHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("command buffer end failed");
+		}
+		std::cout << "Successfully create compaction command buffer" << std::endl;
+	}
+
+	void Application::RecordCompaction(VkCommandBuffer commandBuffer)
+	{
+		VkMemoryBarrier computeToComputeBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+		VkMemoryBarrier computeToIndirectBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+		VkMemoryBarrier computeToTransferBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_TRANSFER_READ_BIT
+		};
+		VkMemoryBarrier transferToComputeBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+		BindComputeState(commandBuffer);
+
+		// flag the alive slots into the sort keys
+		RecordDispatch(commandBuffer, particleCountPipelineHandles[1], SPH_PARTICLE_CAPACITY);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+
+		// kept slot indices go to the sort values, the new count and dispatch size straight into the simulation state
+		gpuPrimitives->RecordCompact(commandBuffer,
+			{ reorderBufferHandle, sortKeySsboOffset, sortKeySsboSize },
+			{ VK_NULL_HANDLE, 0, 0 },
+			{ reorderBufferHandle, sortValueSsboOffset, sortValueSsboSize },
+			{ simulationStateBufferHandle, 0, sizeof(CompactResult) },
+			SPH_PARTICLE_CAPACITY,
+			SPH_WORK_GROUP_SIZE,
+			{ reorderBufferHandle, sortScratchOffset, sortScratchSize });
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToIndirectBarrier, 0, NULL, 0, NULL);
+
+		// gather the kept particles to the front with the reorder pass' gather and copy them back
+		BindComputeState(commandBuffer);
+		RecordDispatchIndirect(commandBuffer, reorderPipelineHandles[1], simulationStateBufferHandle, offsetof(SimulationState, sizedDispatch));
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &computeToTransferBarrier, 0, NULL, 0, NULL);
+		VkBufferCopy copyRegions[4];
+		const uint32_t copyRegionCount = GatheredCopyRegions(copyRegions);
+		vkCmdCopyBuffer(commandBuffer, reorderBufferHandle, packedParticlesBufferHandle, copyRegionCount, copyRegions);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &transferToComputeBarrier, 0, NULL, 0, NULL);
+
+		// the draw count follows the compacted count
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleCountPipelineHandles[2]);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToIndirectBarrier, 0, NULL, 0, NULL);
+	}
+
+	void Application::CreateAdaptCommandBuffer()
+	{
+		VkCommandBufferAllocateInfo allocInfo = CsySmallVk::commandBufferAllocateInfo();
+		allocInfo.commandBufferCount = 1;
+		allocInfo.commandPool = computeCommandPoolHandle;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		if (vkAllocateCommandBuffers(logicalDeviceHandle, &allocInfo, &adaptCommandBufferHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("buffer allocation failed");
+		}
+		VkCommandBufferBeginInfo beginInfo = CsySmallVk::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		if (vkBeginCommandBuffer(adaptCommandBufferHandle, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("command buffer begin failed");
+		}
+
+		RecordAdaptation(adaptCommandBufferHandle);
+
+		if (vkEndCommandBuffer(adaptCommandBufferHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("command buffer end failed");
+		}
+		std::cout << "Successfully create adapt command buffer" << std::endl;
+	}
+
+	void Application::CreateSnapshotCommandBuffers()
+	{
+		VkCommandBufferAllocateInfo allocInfo = CsySmallVk::commandBufferAllocateInfo();
+		allocInfo.commandBufferCount = 2;
+		allocInfo.commandPool = computeCommandPoolHandle;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		if (vkAllocateCommandBuffers(logicalDeviceHandle, &allocInfo, snapshotCommandBufferHandles) != VK_SUCCESS)
+		{
+			throw std::runtime_error("buffer allocation failed");
+		}
+		for (uint32_t snapshot = 0; snapshot < 2; snapshot++)
+		{
+			VkCommandBufferBeginInfo beginInfo = CsySmallVk::commandBufferBeginInfo();
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+			if (vkBeginCommandBuffer(snapshotCommandBufferHandles[snapshot], &beginInfo) != VK_SUCCESS)
+			{
+				throw std::runtime_error("command buffer begin failed");
+			}
+			// the step ahead of it in the same submission writes what is copied, the timeline signal publishes it to the renderer
+			FrameGraph graph;
+			const VkBuffer snapshotBuffer = snapshotBufferHandles[snapshot];
+			graph.AddPass("copy snapshot",
+				{
+					BufferAccess::TransferRead(stepRanges.particleData),
+					BufferAccess::TransferRead(stepRanges.mass),
+					BufferAccess::TransferRead(stepRanges.simulationState),
+					BufferAccess::TransferWrite({ snapshotBuffer, 0, VK_WHOLE_SIZE })
+				},
+				[this, snapshotBuffer](VkCommandBuffer commandBuffer)
+				{
+					VkBufferCopy particleRegions[2]{ { positionSsboOffset, 0, particleDataSize }, { massSsboOffset, snapshotMassOffset, massSsboSize } };
+					VkBufferCopy stateRegion{ 0, snapshotStateOffset, sizeof(SimulationState) };
+					vkCmdCopyBuffer(commandBuffer, packedParticlesBufferHandle, snapshotBuffer, 2, particleRegions);
+					vkCmdCopyBuffer(commandBuffer, simulationStateBufferHandle, snapshotBuffer, 1, &stateRegion);
+				});
+			graph.Record(snapshotCommandBufferHandles[snapshot]);
+			if (vkEndCommandBuffer(snapshotCommandBufferHandles[snapshot]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("command buffer end failed");
+			}
+		}
+		std::cout << "Successfully create snapshot command buffers" << std::endl;
+	}
+
+	void Application::CreateStateExport()
+	{
+		exporter = std::make_unique<StateExporter>(settings.exportName, SPH_PARTICLE_CAPACITY, settings.exportFields);
+		if (exportZeroCopy)
+		{
+			void* particles = nullptr;
+			void* state = nullptr;
+			if (vkMapMemory(logicalDeviceHandle, packedParticlesMemoryHandle, 0, VK_WHOLE_SIZE, 0, &particles) != VK_SUCCESS
+				|| vkMapMemory(logicalDeviceHandle, simulationStateMemoryHandle, 0, VK_WHOLE_SIZE, 0, &state) != VK_SUCCESS)
+			{
+				throw std::runtime_error("export mapping failed");
+			}
+			exportParticlesMapped = static_cast<const char*>(particles);
+			exportStateMapped = static_cast<const char*>(state);
+		}
+		else
+		{
+			// the slots stay mapped, PublishExports reads them straight from the readback buffer
+			exportIdOffset = particleDataSize;
+			exportStateOffset = AlignStorageBufferOffset(exportIdOffset + particleIdSsboSize);
+			exportSlotSize = AlignStorageBufferOffset(exportStateOffset + sizeof(SimulationState));
+			CreateBuffer(SPH_EXPORT_READBACK_SLOTS * exportSlotSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				exportReadbackBufferHandle, exportReadbackMemoryHandle, MemoryPurpose::Export);
+			void* readback = nullptr;
+			if (vkMapMemory(logicalDeviceHandle, exportReadbackMemoryHandle, 0, SPH_EXPORT_READBACK_SLOTS * exportSlotSize, 0, &readback) != VK_SUCCESS)
+			{
+				throw std::runtime_error("export readback mapping failed");
+			}
+			exportReadbackMapped = static_cast<const char*>(readback);
+		}
+
+		const uint32_t commandBufferCount = exportZeroCopy ? 1 : SPH_EXPORT_READBACK_SLOTS;
+		VkCommandBufferAllocateInfo allocInfo = CsySmallVk::commandBufferAllocateInfo();
+		allocInfo.commandBufferCount = commandBufferCount;
+		allocInfo.commandPool = computeCommandPoolHandle;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		if (vkAllocateCommandBuffers(logicalDeviceHandle, &allocInfo, exportCommandBufferHandles) != VK_SUCCESS)
+		{
+			throw std::runtime_error("buffer allocation failed");
+		}
+		for (uint32_t slot = 0; slot < commandBufferCount; slot++)
+		{
+			VkCommandBufferBeginInfo beginInfo = CsySmallVk::commandBufferBeginInfo();
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+			if (vkBeginCommandBuffer(exportCommandBufferHandles[slot], &beginInfo) != VK_SUCCESS)
+			{
+				throw std::runtime_error("command buffer begin failed");
+			}
+			VkMemoryBarrier hostReadBarrier
+			{
+				VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				NULL,
+				VK_ACCESS_TRANSFER_WRITE_BIT,
+				VK_ACCESS_HOST_READ_BIT
+			};
+			VkPipelineStageFlags writeStages = VK_PIPELINE_STAGE_TRANSFER_BIT;
+			if (exportZeroCopy)
+			{
+				// the step wrote the state in place, the host only has to see it
+				hostReadBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+				writeStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+			}
+			else
+			{
+				FrameGraph graph;
+				const VkDeviceSize slotOffset = slot * exportSlotSize;
+				graph.AddPass("copy export",
+					{
+						BufferAccess::TransferRead(stepRanges.particleData),
+						BufferAccess::TransferRead(stepRanges.particleId),
+						BufferAccess::TransferRead(stepRanges.simulationState),
+						BufferAccess::TransferWrite({ exportReadbackBufferHandle, slotOffset, exportSlotSize })
+					},
+					[this, slotOffset](VkCommandBuffer commandBuffer)
+					{
+						VkBufferCopy particleRegion{ positionSsboOffset, slotOffset, particleDataSize };
+						VkBufferCopy idRegion{ particleIdSsboOffset, slotOffset + exportIdOffset, particleIdSsboSize };
+						VkBufferCopy stateRegion{ 0, slotOffset + exportStateOffset, sizeof(SimulationState) };
+						vkCmdCopyBuffer(commandBuffer, packedParticlesBufferHandle, exportReadbackBufferHandle, 1, &particleRegion);
+						vkCmdCopyBuffer(commandBuffer, packedParticlesBufferHandle, exportReadbackBufferHandle, 1, &idRegion);
+						vkCmdCopyBuffer(commandBuffer, simulationStateBufferHandle, exportReadbackBufferHandle, 1, &stateRegion);
+					});
+				graph.Record(exportCommandBufferHandles[slot]);
+			}
+			vkCmdPipelineBarrier(exportCommandBufferHandles[slot], writeStages, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostReadBarrier, 0, NULL, 0, NULL);
+			if (vkEndCommandBuffer(exportCommandBufferHandles[slot]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("command buffer end failed");
+			}
+		}
+		std::cout << "[INFO] export: every " << settings.exportInterval << " steps, "
+			<< (exportZeroCopy ? "read in place from unified memory" : "copied through " + std::to_string(SPH_EXPORT_READBACK_SLOTS) + " readback slots") << std::endl;
+		std::cout << "Successfully create state export" << std::endl;
+	}
+
+	void Application::PublishExports(bool wait)
+	{
+		while (!pendingExports.empty())
+		{
+			const std::pair<uint32_t, uint64_t> next = pendingExports.front();
+			if (wait)
+			{
+				VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, NULL, 0, 1, &simulationTimelineHandle, &next.second };
+				if (vkWaitSemaphores(logicalDeviceHandle, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+				{
+					throw std::runtime_error("vkWaitSemaphores failed");
+				}
+			}
+			else
+			{
+				uint64_t completedValue = 0;
+				vkGetSemaphoreCounterValue(logicalDeviceHandle, simulationTimelineHandle, &completedValue);
+				if (completedValue < next.second)
+				{
+					return;
+				}
+			}
+			const char* slot = exportReadbackMapped + next.first * exportSlotSize;
+			SimulationState simulationState;
+			std::memcpy(&simulationState, slot + exportStateOffset, sizeof(simulationState));
+			ExportParticles(slot, reinterpret_cast<const uint32_t*>(slot + exportIdOffset), simulationState.aliveCount, next.second);
+			pendingExports.pop_front();
+		}
+	}
+
+	void Application::ExportParticles(const char* particleData, const uint32_t* ids, uint32_t count, uint64_t step)
+	{
+		// particleData starts at the position field, the offsets are relative to the particle region
+		const auto field = [&](ParticleField particleField, uint32_t i) { return particleData + SPH::ParticleFieldOffset(particleLayout, halfStorage, particleField, SPH_PARTICLE_CAPACITY, i); };
+		// the slots the sink emptied stay dead up to the next compaction, only the alive ones are published
+		exportAliveSlots.clear();
+		const uint32_t slotCount = std::min(count, exporter->Capacity());
+		for (uint32_t i = 0; i < slotCount; i++)
+		{
+			if (ids[i] != SPH_DEAD_PARTICLE)
+			{
+				exportAliveSlots.push_back(i);
+			}
+		}
+		count = static_cast<uint32_t>(exportAliveSlots.size());
+		exporter->Begin(step, count);
+		uint32_t* exportIds = exporter->Ids();
+		for (uint32_t n = 0; n < count; n++)
+		{
+			exportIds[n] = ids[exportAliveSlots[n]];
+		}
+		if (float* position = exporter->Field(ExportPosition))
+		{
+			for (uint32_t n = 0; n < count; n++)
+			{
+				const uint32_t i = exportAliveSlots[n];
+				std::memcpy(&position[2 * n], field(ParticleField::Position, i), sizeof(glm::vec2));
+			}
+		}
+		if (float* velocity = exporter->Field(ExportVelocity))
+		{
+			for (uint32_t n = 0; n < count; n++)
+			{
+				const uint32_t i = exportAliveSlots[n];
+				if (halfStorage)
+				{
+					uint16_t halfVelocity[2];
+					std::memcpy(halfVelocity, field(ParticleField::Velocity, i), sizeof(halfVelocity));
+					velocity[2 * n] = HalfToFloat(halfVelocity[0]);
+					velocity[2 * n + 1] = HalfToFloat(halfVelocity[1]);
+				}
+				else
+				{
+					std::memcpy(&velocity[2 * n], field(ParticleField::Velocity, i), sizeof(glm::vec2));
+				}
+			}
+		}
+		if (float* density = exporter->Field(ExportDensity))
+		{
+			for (uint32_t n = 0; n < count; n++)
+			{
+				const uint32_t i = exportAliveSlots[n];
+				if (halfStorage)
+				{
+					uint16_t halfDensity;
+					std::memcpy(&halfDensity, field(ParticleField::Density, i), sizeof(halfDensity));
+					density[n] = HalfToFloat(halfDensity) / SPH_HALF_DENSITY_SCALE;
+				}
+				else
+				{
+					std::memcpy(&density[n], field(ParticleField::Density, i), sizeof(float));
+				}
+			}
+		}
+		if (float* pressure = exporter->Field(ExportPressure))
+		{
+			for (uint32_t n = 0; n < count; n++)
+			{
+				const uint32_t i = exportAliveSlots[n];
+				if (halfStorage)
+				{
+					uint16_t halfPressure;
+					std::memcpy(&halfPressure, field(ParticleField::Pressure, i), sizeof(halfPressure));
+					pressure[n] = HalfToFloat(halfPressure) / SPH_HALF_PRESSURE_SCALE;
+				}
+				else
+				{
+					std::memcpy(&pressure[n], field(ParticleField::Pressure, i), sizeof(float));
+				}
+			}
+		}
+		exporter->Publish();
+	}
+
+	void Application::RecordAdaptation(VkCommandBuffer commandBuffer)
+	{
+		VkMemoryBarrier computeToComputeBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+		VkMemoryBarrier computeToIndirectBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+
+		// the decisions need the neighbours of the last step's positions
+		RecordNeighbourGrid(commandBuffer);
+
+		// decide per slot, every slot past the alive ones is reset to keep for the splits to append to
+		RecordDispatch(commandBuffer, adaptPipelineHandles[0], SPH_PARTICLE_CAPACITY);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+
+		// merge candidates pick their partner
+		RecordDispatchIndirect(commandBuffer, adaptPipelineHandles[1], simulationStateBufferHandle, offsetof(SimulationState, sizedDispatch));
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+
+		// split into appended slots and merge the mutual pairs, the merged away particles wait for the next compaction
+		RecordDispatchIndirect(commandBuffer, adaptPipelineHandles[2], simulationStateBufferHandle, offsetof(SimulationState, sizedDispatch));
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+
+		// clamp the count to the capacity and derive the dispatch and draw sizes from it
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleCountPipelineHandles[2]);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToIndirectBarrier, 0, NULL, 0, NULL);
+	}
+
+	void Application::SetInitialParticleData()
+	{
+		UploadBoundary();
+		Upload(InitialDamBreak());
+		std::cout << "Successfully set initial particle data" << std::endl;
+	}
+
+	void Application::UploadBoundary()
+	{
+		const BoundaryField& boundary = Boundary();
+		const size_t texelSize = sizeof(glm::vec4) * boundary.texels.size();
+		{
+			std::unique_lock<std::mutex> lock = uploads->Lock();
+			StreamCopy(boundaryBufferHandle, 0, boundary.texels.data(), texelSize);
+			StreamCopy(boundaryBufferHandle, texelSize, boundary.table.data(), sizeof(glm::vec2) * boundary.table.size());
+		}
+		uploads->Wait(uploads->Submit(simulationTimelineHandle, submittedStepValue));
+	}
+
+	void* Application::StreamCopy(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size)
+	{
+		// each batch waits for the steps submitted so far, like the last one of the edit, which RunSimulation's next step waits for
+		if (uploads->PendingSize() + size > uploads->RingSize() / 2)
+		{
+			uploads->Flush(simulationTimelineHandle, submittedStepValue);
+		}
+		return uploads->Copy(buffer, offset, size);
+	}
+
+	void Application::StreamCopy(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size)
+	{
+		for (VkDeviceSize done = 0; done < size; done += UploadChunkSize())
+		{
+			const VkDeviceSize pieceSize = std::min(UploadChunkSize(), size - done);
+			std::memcpy(StreamCopy(buffer, offset + done, pieceSize), static_cast<const char*>(data) + done, pieceSize);
+		}
+	}
+
+	const char* Application::Name() const
+	{
+		return physicalDeviceProperties.deviceName;
+	}
+
+	void Application::Upload(const ParticleState& state)
+	{
+		const uint32_t count = static_cast<uint32_t>(state.Size());
+		if (count == 0 || count > SPH_PARTICLE_CAPACITY)
+		{
+			throw std::runtime_error("uploaded particle count must be between 1 and SPH_PARTICLE_CAPACITY");
+		}
+
+		// the edit streams through the staging ring in pieces, RunSimulation's next step waits for the last of them
+		std::unique_lock<std::mutex> lock = uploads->Lock();
+
+		// end of the bytes that hold field for the particles below n, whole blocks for AoSoA, 4-byte aligned for the fills
+		const auto fieldEnd = [this](ParticleField field, uint32_t n)
+		{
+			if (particleLayout == ParticleLayout::AoSoA)
+			{
+				n = (n + SPH_PARTICLE_BLOCK_SIZE - 1) / SPH_PARTICLE_BLOCK_SIZE * SPH_PARTICLE_BLOCK_SIZE;
+			}
+			return (ParticleFieldOffset(field, n) + 3) / 4 * 4;
+		};
+		const auto writeField = [&](char* staging, ParticleField field, uint32_t i)
+		{
+			switch (field)
+			{
+			case ParticleField::Position:
+				std::memcpy(staging, &state.position[i], sizeof(glm::vec2));
+				break;
+			case ParticleField::Velocity:
+				if (halfStorage)
+				{
+					const uint16_t velocity[2]{ FloatToHalf(state.velocity[i].x), FloatToHalf(state.velocity[i].y) };
+					std::memcpy(staging, velocity, sizeof(velocity));
+				}
+				else
+				{
+					std::memcpy(staging, &state.velocity[i], sizeof(glm::vec2));
+				}
+				break;
+			case ParticleField::Density:
+				if (halfStorage)
+				{
+					const uint16_t density = FloatToHalf(state.density[i] * SPH_HALF_DENSITY_SCALE);
+					std::memcpy(staging, &density, sizeof(density));
+				}
+				else
+				{
+					std::memcpy(staging, &state.density[i], sizeof(float));
+				}
+				break;
+			case ParticleField::Pressure:
+				if (halfStorage)
+				{
+					const uint16_t pressure = FloatToHalf(state.pressure[i] * SPH_HALF_PRESSURE_SCALE);
+					std::memcpy(staging, &pressure, sizeof(pressure));
+				}
+				else
+				{
+					std::memcpy(staging, &state.pressure[i], sizeof(float));
+				}
+				break;
+			}
+		};
+
+		// only the uploaded particles are copied, a span per field for SoA and one of whole records otherwise. A piece is
+		// written out before the next is asked for, which may submit it
+		const ParticleField fields[4]{ ParticleField::Position, ParticleField::Velocity, ParticleField::Density, ParticleField::Pressure };
+		const uint32_t spanCount = particleLayout == ParticleLayout::SoA ? 4 : 1;
+		const uint32_t chunkParticles = std::max<uint32_t>(SPH_PARTICLE_BLOCK_SIZE,
+			static_cast<uint32_t>(UploadChunkSize() / SPH_PARTICLE_DATA_STRIDE / SPH_PARTICLE_BLOCK_SIZE * SPH_PARTICLE_BLOCK_SIZE));
+		for (uint32_t first = 0; first < count; first += chunkParticles)
+		{
+			const uint32_t last = std::min(count, first + chunkParticles);
+			for (uint32_t s = 0; s < spanCount; s++)
+			{
+				const uint64_t spanOffset = fieldEnd(fields[s], first);
+				const uint64_t spanSize = fieldEnd(fields[s], last) - spanOffset;
+				char* staging = static_cast<char*>(StreamCopy(packedParticlesBufferHandle, spanOffset, spanSize));
+				// the padding of the last AoSoA block and of the fills' alignment
+				std::memset(staging, 0, spanSize);
+				for (uint32_t i = first; i < last; i++)
+				{
+					for (uint32_t f = s; f < (spanCount == 4 ? s + 1 : 4); f++)
+					{
+						writeField(staging + ParticleFieldOffset(fields[f], i) - spanOffset, fields[f], i);
+					}
+				}
+			}
+			StreamCopy(packedParticlesBufferHandle, particleIdSsboOffset + sizeof(uint32_t) * first, state.id.data() + first, sizeof(uint32_t) * (last - first));
+			StreamCopy(packedParticlesBufferHandle, massSsboOffset + sizeof(float) * first, state.mass.data() + first, sizeof(float) * (last - first));
+		}
+
+		// zero the forces and every slot past the uploaded particles, the fills never overlap the copies of their batch
+		for (uint32_t s = 0; s < spanCount; s++)
+		{
+			const uint64_t tailOffset = fieldEnd(fields[s], count);
+			const uint64_t tailEnd = s + 1 < spanCount ? ParticleFieldOffset(fields[s + 1], 0) : positionSsboOffset + particleDataSize;
+			if (tailEnd > tailOffset)
+			{
+				uploads->Fill(packedParticlesBufferHandle, tailOffset, tailEnd - tailOffset, 0);
+			}
+		}
+		uploads->Fill(packedParticlesBufferHandle, forceSsboOffset, forceSsboSize, 0);
+		if (count < SPH_PARTICLE_CAPACITY)
+		{
+			uploads->Fill(packedParticlesBufferHandle, particleIdSsboOffset + sizeof(uint32_t) * count, sizeof(uint32_t) * (SPH_PARTICLE_CAPACITY - count), 0);
+			uploads->Fill(packedParticlesBufferHandle, massSsboOffset + sizeof(float) * count, sizeof(float) * (SPH_PARTICLE_CAPACITY - count), 0);
+		}
+
+		// the active list is the identity and every particle is awake while the active tile schedule is off, every tile starts awake
+		ActiveState initialActiveState{};
+		initialActiveState.dispatch = DispatchSize((count + SPH_WORK_GROUP_SIZE - 1) / SPH_WORK_GROUP_SIZE);
+		initialActiveState.activeCount = count;
+		for (uint32_t k = 0; k < SPH_WORK_GROUP_SIZE_COUNT; k++)
+		{
+			const uint32_t workGroupSize = SPH_MIN_WORK_GROUP_SIZE << k;
+			initialActiveState.sizedDispatch[k] = DispatchSize((count + workGroupSize - 1) / workGroupSize);
+		}
+		std::vector<uint32_t> initialTiles(2 * SPH_TILE_COUNT);
+		for (uint32_t i = 0; i < SPH_TILE_COUNT; i++)
+		{
+			initialTiles[2 * i] = 0;
+			initialTiles[2 * i + 1] = SPH_TILE_SLEEP_STEPS;
+		}
+		StreamCopy(tileBufferHandle, activeStateSsboOffset, &initialActiveState, sizeof(initialActiveState));
+		StreamCopy(tileBufferHandle, tileSsboOffset, initialTiles.data(), tileSsboSize);
+		uploads->Fill(tileBufferHandle, activeFlagSsboOffset, activeFlagSsboSize, 0);
+		// the identity over the whole capacity, the emitted particles join the active list in place
+		const uint32_t chunkIndices = static_cast<uint32_t>(UploadChunkSize() / sizeof(uint32_t));
+		for (uint32_t first = 0; first < SPH_PARTICLE_CAPACITY; first += chunkIndices)
+		{
+			const uint32_t last = std::min<uint32_t>(SPH_PARTICLE_CAPACITY, first + chunkIndices);
+			uint32_t* activeIndex = static_cast<uint32_t*>(StreamCopy(tileBufferHandle, activeIndexSsboOffset + sizeof(uint32_t) * first, sizeof(uint32_t) * (last - first)));
+			for (uint32_t i = first; i < last; i++)
+			{
+				activeIndex[i - first] = i;
+			}
+		}
+		uploads->Fill(tileBufferHandle, awakeSsboOffset, awakeSsboSize, 1);
+
+		// the uploaded particles are alive, later counts are only known on the gpu
+		SimulationState initialState{};
+		initialState.dispatch = DispatchSize((count + SPH_WORK_GROUP_SIZE - 1) / SPH_WORK_GROUP_SIZE);
+		initialState.aliveCount = count;
+		initialState.draw = { count, 1, 0, 0 };
+		std::copy(std::begin(initialActiveState.sizedDispatch), std::end(initialActiveState.sizedDispatch), initialState.sizedDispatch);
+		initialState.nextParticleId = 0;
+		for (uint32_t id : state.id)
+		{
+			if (id != SPH_DEAD_PARTICLE && id >= initialState.nextParticleId)
+			{
+				initialState.nextParticleId = id + 1;
+			}
+		}
+
+		StreamCopy(simulationStateBufferHandle, 0, &initialState, sizeof(initialState));
+		// the split and merge counters start over with the uploaded particles
+		uploads->Fill(adaptBufferHandle, adaptStateSsboOffset, sizeof(AdaptState), 0);
+		// a new block starts on the finest level, every particle picks its level in the first substep
+		uploads->Fill(blockBufferHandle, 0, VK_WHOLE_SIZE, 0);
+		lock.unlock();
+
+		// a running simulation thread submits the batch in front of its next step, otherwise it is sent here and
+		// waited for before the next Step
+		if (!simulationRunning)
+		{
+			uploads->Wait(uploads->Submit(simulationTimelineHandle, submittedStepValue));
+		}
+	}
+
+	void Application::Step(uint32_t stepCount)
+	{
+		// the prerecorded step only, emission, reordering and compaction stay with RunSimulation
+		if (stepCount == 0)
+		{
+			return;
+		}
+		std::vector<VkCommandBuffer> commandBuffers(stepCount, computeCommandBufferHandle);
+		VkSubmitInfo submitInfo = CsySmallVk::submitInfo();
+		submitInfo.commandBufferCount = stepCount;
+		submitInfo.pCommandBuffers = commandBuffers.data();
+		if (vkQueueSubmit(computeQueueHandle, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("command buffer submission failed");
+		}
+		if (vkQueueWaitIdle(computeQueueHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("vkQueueWaitIdle failed");
+		}
+	}
+
+	void Application::Download(ParticleState& state)
+	{
+		VkMemoryBarrier computeToTransferBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_TRANSFER_READ_BIT
+		};
+		VkBuffer stagingBufferHandle;
+		VkDeviceMemory stagingMemoryHandle;
+		const VkDeviceSize stagingSize = packedBufferSize + sizeof(SimulationState);
+		CreateBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBufferHandle, stagingMemoryHandle, MemoryPurpose::Staging);
+		VkCommandBuffer commandBufferHandle = BeginSingleTimeCommands();
+		vkCmdPipelineBarrier(commandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &computeToTransferBarrier, 0, NULL, 0, NULL);
+		VkBufferCopy particleCopyRegion{ 0, 0, packedBufferSize };
+		VkBufferCopy stateCopyRegion{ 0, packedBufferSize, sizeof(SimulationState) };
+		vkCmdCopyBuffer(commandBufferHandle, packedParticlesBufferHandle, stagingBufferHandle, 1, &particleCopyRegion);
+		vkCmdCopyBuffer(commandBufferHandle, simulationStateBufferHandle, stagingBufferHandle, 1, &stateCopyRegion);
+		EndSingleTimeCommands(commandBufferHandle);
+
+		char* staging = nullptr;
+		vkMapMemory(logicalDeviceHandle, stagingMemoryHandle, 0, stagingSize, 0, reinterpret_cast<void**>(&staging));
+		SimulationState simulationState;
+		std::memcpy(&simulationState, staging + packedBufferSize, sizeof(simulationState));
+		const uint32_t count = simulationState.aliveCount;
+		state.Resize(count);
+		for (uint32_t i = 0; i < count; i++)
+		{
+			std::memcpy(&state.position[i], staging + ParticleFieldOffset(ParticleField::Position, i), sizeof(glm::vec2));
+			if (halfStorage)
+			{
+				uint16_t velocity[2];
+				uint16_t density;
+				uint16_t pressure;
+				std::memcpy(velocity, staging + ParticleFieldOffset(ParticleField::Velocity, i), sizeof(velocity));
+				std::memcpy(&density, staging + ParticleFieldOffset(ParticleField::Density, i), sizeof(density));
+				std::memcpy(&pressure, staging + ParticleFieldOffset(ParticleField::Pressure, i), sizeof(pressure));
+				state.velocity[i] = glm::vec2(HalfToFloat(velocity[0]), HalfToFloat(velocity[1]));
+				state.density[i] = HalfToFloat(density) / SPH_HALF_DENSITY_SCALE;
+				state.pressure[i] = HalfToFloat(pressure) / SPH_HALF_PRESSURE_SCALE;
+			}
+			else
+			{
+				std::memcpy(&state.velocity[i], staging + ParticleFieldOffset(ParticleField::Velocity, i), sizeof(glm::vec2));
+				std::memcpy(&state.density[i], staging + ParticleFieldOffset(ParticleField::Density, i), sizeof(float));
+				std::memcpy(&state.pressure[i], staging + ParticleFieldOffset(ParticleField::Pressure, i), sizeof(float));
+			}
+		}
+		std::memcpy(state.id.data(), staging + particleIdSsboOffset, sizeof(uint32_t) * count);
+		std::memcpy(state.mass.data(), staging + massSsboOffset, sizeof(float) * count);
+		vkUnmapMemory(logicalDeviceHandle, stagingMemoryHandle);
+		FreeMemory(stagingMemoryHandle);
+		vkDestroyBuffer(logicalDeviceHandle, stagingBufferHandle, allocator);
+	}
+
+	void Application::RunSimulation()
 	{
-		// staging buffer
-		VkBuffer stagingBufferHandle = VK_NULL_HANDLE;
-		VkDeviceMemory stagingBufferMemoryDeviceHandle = VK_NULL_HANDLE;
-		VkBufferCreateInfo stagingBufferCreateInfo = CsySmallVk::bufferCreateInfo();
-		stagingBufferCreateInfo.size = packedBufferSize;
-		stagingBufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		stagingBufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		stagingBufferCreateInfo.queueFamilyIndexCount = 0;
-		stagingBufferCreateInfo.pQueueFamilyIndices = nullptr;
+		// a submission of block time steps is a whole block, the intervals below still count steps
+		const uint32_t submittedSteps = settings.blockSteps ? SPH_BLOCK_SUBSTEPS : 1;
+		// stay at most SPH_SUBMISSIONS_IN_FLIGHT submissions ahead of the gpu
+		if (submittedStepValue >= SPH_SUBMISSIONS_IN_FLIGHT * submittedSteps)
+		{
+			TraceScope scope(tracer.get(), "wait for gpu");
+			const uint64_t waitValue = submittedStepValue - (SPH_SUBMISSIONS_IN_FLIGHT - 1) * submittedSteps;
+			VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, NULL, 0, 1, &simulationTimelineHandle, &waitValue };
+			if (vkWaitSemaphores(logicalDeviceHandle, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+			{
+				throw std::runtime_error("vkWaitSemaphores failed");
+			}
+		}
+		{
+			TraceScope scope(tracer.get(), "collect timestamps");
+			CollectStepTimestamps();
+		}
+		if (exporter && !exportZeroCopy)
+		{
+			TraceScope scope(tracer.get(), "publish exports");
+			PublishExports(false);
+		}
+		TraceScope submitScope(tracer.get(), "submit");
+		const auto submitStart = std::chrono::high_resolution_clock::now();
 
-		vkCreateBuffer(logicalDeviceHandle, &stagingBufferCreateInfo, NULL, &stagingBufferHandle);
+		// the uploads queued since the last submission go out first, after the steps that still use the buffers they
+		// write, and the whole submission below waits for them on the gpu
+		// the lock is held until submittedStepValue is updated, so that a streamed Upload never reads a value older than
+		// a step that did not wait for its batches
+		std::unique_lock<std::mutex> uploadLock = uploads->Lock();
+		const uint64_t uploadValue = uploads->Flush(simulationTimelineHandle, submittedStepValue);
 
-		VkMemoryRequirements stagingBufferMemoryRequirements;
-		vkGetBufferMemoryRequirements(logicalDeviceHandle, stagingBufferHandle, &stagingBufferMemoryRequirements);
-		
-		VkMemoryAllocateInfo allocInfo = CsySmallVk::memoryAllocateInfo();
-		allocInfo.allocationSize = stagingBufferMemoryRequirements.size;
-		allocInfo.memoryTypeIndex = findMemoryType(stagingBufferMemoryRequirements,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		if (vkAllocateMemory(logicalDeviceHandle, &allocInfo, NULL, &stagingBufferMemoryDeviceHandle) != VK_SUCCESS)
+		// one batch in submission order: reorder, compaction, emission, adaptation, the step and its snapshot
+		VkCommandBuffer commandBuffers[8];
+		uint32_t commandBufferCount = 0;
+
+		// sort the particles before the step so its neighbour loops see the new order
+		bool reorderSubmitted = false;
+		if (SPH_REORDER_INTERVAL > 0 && stepsSinceReorder >= SPH_REORDER_INTERVAL)
 		{
-			throw std::runtime_error("memory allocation failed");
+			commandBuffers[commandBufferCount++] = reorderCommandBufferHandle;
+			stepsSinceReorder = 0;
+			reorderSubmitted = true;
 		}
 
-		// bind the memory to the buffer object
-		vkBindBufferMemory(logicalDeviceHandle, stagingBufferHandle, stagingBufferMemoryDeviceHandle, 0);
-		
-		void* mappedMemory = NULL;
-		vkMapMemory(logicalDeviceHandle, stagingBufferMemoryDeviceHandle, 0, stagingBufferMemoryRequirements.size, 0, &mappedMemory);
-		
-		// set the initial particles data
-		std::vector<glm::vec2> initialParticlePosition(SPH_NUM_PARTICLES);
-		for (auto i = 0, x = 0, y = 0; i < SPH_NUM_PARTICLES; i++)
+		// drop the particles the sink removed and add the inlet's, both only touch the gpu side counts
+		if (SPH_COMPACT_INTERVAL > 0 && (stepsSinceCompaction += submittedSteps) >= SPH_COMPACT_INTERVAL)
+		{
+			commandBuffers[commandBufferCount++] = compactionCommandBufferHandle;
+			stepsSinceCompaction = 0;
+		}
+		if (EmitInterval() > 0 && (stepsSinceEmission += submittedSteps) >= EmitInterval())
+		{
+			commandBuffers[commandBufferCount++] = emissionCommandBufferHandle;
+			stepsSinceEmission = 0;
+		}
+		// split and merge where the flow asks for it, after the compaction so that the appended slots are dense
+		if (settings.adaptive && ++stepsSinceAdapt >= SPH_ADAPT_INTERVAL)
+		{
+			commandBuffers[commandBufferCount++] = adaptCommandBufferHandle;
+			stepsSinceAdapt = 0;
+		}
+
+		// the step signals the number of completed steps, and copies itself into a render snapshot when one is free
+		const bool takeSnapshot = !snapshotPending.load();
+		const uint32_t snapshot = 1 - displayedSnapshot.load();
+		commandBuffers[commandBufferCount++] = computeCommandBufferHandle;
+		if (timestampsSupported)
+		{
+			commandBuffers[commandBufferCount++] = timestampCopyCommandBufferHandles[nextTimestampSlot][reorderSubmitted ? 1 : 0];
+		}
+		if (takeSnapshot)
+		{
+			commandBuffers[commandBufferCount++] = snapshotCommandBufferHandles[snapshot];
+		}
+		const uint64_t signalValue = submittedStepValue + submittedSteps;
+		// every settings.exportInterval steps the step is also copied out for --export, into a free readback slot
+		const bool exportStep = exporter && (stepsSinceExport += submittedSteps) >= settings.exportInterval;
+		if (exportStep)
+		{
+			if (!exportZeroCopy && pendingExports.size() == SPH_EXPORT_READBACK_SLOTS)
+			{
+				TraceScope scope(tracer.get(), "wait for export slot");
+				PublishExports(true);
+			}
+			commandBuffers[commandBufferCount++] = exportCommandBufferHandles[exportZeroCopy ? 0 : nextExportSlot];
+			stepsSinceExport = 0;
+		}
+		const VkSemaphore uploadTimeline = uploads->Timeline();
+		const VkPipelineStageFlags uploadWaitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+		VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, NULL, 1, &uploadValue, 1, &signalValue };
+		VkSubmitInfo stepSubmitInfo = computeSubmitInfo;
+		stepSubmitInfo.pNext = &timelineSubmitInfo;
+		stepSubmitInfo.waitSemaphoreCount = 1;
+		stepSubmitInfo.pWaitSemaphores = &uploadTimeline;
+		stepSubmitInfo.pWaitDstStageMask = &uploadWaitStage;
+		stepSubmitInfo.commandBufferCount = commandBufferCount;
+		stepSubmitInfo.pCommandBuffers = commandBuffers;
+		stepSubmitInfo.signalSemaphoreCount = 1;
+		stepSubmitInfo.pSignalSemaphores = &simulationTimelineHandle;
+		if (vkQueueSubmit(computeQueueHandle, 1, &stepSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("compute queue submission failed");
+		}
+		submittedStepValue = signalValue;
+		uploadLock.unlock();
+		// only the window run has telemetry, the benchmarks step without it
+		if (telemetry)
+		{
+			telemetry->Record(TelemetryMetric::SubmitTime, 1e-6 * std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - submitStart).count());
+		}
+		if (takeSnapshot)
+		{
+			snapshotValue = signalValue;
+			snapshotPending = true;
+		}
+		if (exportStep && exportZeroCopy)
+		{
+			// the next submission would overwrite the state, so it waits until the step is published
+			TraceScope scope(tracer.get(), "export");
+			VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, NULL, 0, 1, &simulationTimelineHandle, &signalValue };
+			if (vkWaitSemaphores(logicalDeviceHandle, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+			{
+				throw std::runtime_error("vkWaitSemaphores failed");
+			}
+			SimulationState simulationState;
+			std::memcpy(&simulationState, exportStateMapped, sizeof(simulationState));
+			ExportParticles(exportParticlesMapped + positionSsboOffset, reinterpret_cast<const uint32_t*>(exportParticlesMapped + particleIdSsboOffset),
+				simulationState.aliveCount, signalValue);
+		}
+		else if (exportStep)
+		{
+			pendingExports.push_back({ nextExportSlot, signalValue });
+			nextExportSlot = (nextExportSlot + 1) % SPH_EXPORT_READBACK_SLOTS;
+		}
+		if (timestampsSupported)
+		{
+			pendingTimestamps.push_back({ nextTimestampSlot, signalValue, stepsSinceReorder, reorderSubmitted });
+			nextTimestampSlot = (nextTimestampSlot + 1) % SPH_SUBMISSIONS_IN_FLIGHT;
+		}
+		stepsSinceReorder += submittedSteps;
+		submittedBlocks++;
+	}
+
+	void Application::CollectStepTimestamps()
+	{
+		// only the slots of the submissions the timeline has passed, without waiting for the rest
+		if (!timestampsSupported || pendingTimestamps.empty())
+		{
+			return;
+		}
+		uint64_t completedValue = 0;
+		if (vkGetSemaphoreCounterValue(logicalDeviceHandle, simulationTimelineHandle, &completedValue) != VK_SUCCESS)
+		{
+			throw std::runtime_error("vkGetSemaphoreCounterValue failed");
+		}
+		const double nanosecondsPerTick = physicalDeviceProperties.limits.timestampPeriod;
+		while (!pendingTimestamps.empty() && pendingTimestamps.front().timelineValue <= completedValue)
+		{
+			const PendingTimestamps pending = pendingTimestamps.front();
+			pendingTimestamps.pop_front();
+			const uint64_t* timestamps = timestampReadbackMapped + pending.slot * SPH_STEP_QUERY_COUNT;
+			if (pending.stepsSinceReorder < stepTimeSums.size())
+			{
+				const double stepTime = 1e-6 * nanosecondsPerTick * (timestamps[1] - timestamps[0]);
+				stepTimeSums[pending.stepsSinceReorder] += stepTime;
+				stepTimeCounts[pending.stepsSinceReorder]++;
+				if (telemetry)
+				{
+					telemetry->Record(TelemetryMetric::StepGpuTime, stepTime);
+				}
+
+				// the passes in between, starting from the top of the step
+				const uint64_t passTimestamps[5]{ timestamps[0], timestamps[4], timestamps[5], timestamps[6], timestamps[7] };
+				const TelemetryMetric passes[4]{ TelemetryMetric::GridGpuTime, TelemetryMetric::DensityGpuTime, TelemetryMetric::ForceGpuTime, TelemetryMetric::IntegrateGpuTime };
+				for (uint32_t pass = 0; pass < 4 && telemetry; pass++)
+				{
+					telemetry->Record(passes[pass], 1e-6 * nanosecondsPerTick * (passTimestamps[pass + 1] - passTimestamps[pass]));
+				}
+				if (tracer)
+				{
+					const char* passNames[4]{ "grid", "density", "force", "integrate" };
+					for (uint32_t pass = 0; pass < 4; pass++)
+					{
+						tracer->Span(passNames[pass], TraceTrack::ComputeQueue, GpuTicksToTrace(passTimestamps[pass]), GpuTicksToTrace(passTimestamps[pass + 1]));
+					}
+					tracer->Span("step", TraceTrack::ComputeQueue, GpuTicksToTrace(timestamps[0]), GpuTicksToTrace(timestamps[1]));
+				}
+			}
+			if (pending.reorder)
+			{
+				const double reorderTime = 1e-6 * nanosecondsPerTick * (timestamps[3] - timestamps[2]);
+				reorderTimeSum += reorderTime;
+				reorderTimeCount++;
+				if (telemetry)
+				{
+					telemetry->Record(TelemetryMetric::ReorderGpuTime, reorderTime);
+				}
+				if (tracer)
+				{
+					tracer->Span("reorder", TraceTrack::ComputeQueue, GpuTicksToTrace(timestamps[2]), GpuTicksToTrace(timestamps[3]));
+				}
+			}
+		}
+	}
+
+	void Application::CalibrateGpuClock()
+	{
+		if (!timestampsSupported)
+		{
+			std::cout << "[WARNING] the queue family has no timestamps, the trace only holds cpu spans" << std::endl;
+			return;
+		}
+		if (calibratedTimestampsSupported)
 		{
-			initialParticlePosition[i].x = -0.625f + SPH_PARTICLE_RADIUS * 2 * x;
-			initialParticlePosition[i].y = -1 + SPH_PARTICLE_RADIUS * 2 * y;
-			x++;
-			if (x >= 125)
+			const VkCalibratedTimestampInfoEXT timestampInfos[2]
+			{
+				{ VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, NULL, VK_TIME_DOMAIN_DEVICE_EXT },
+				{ VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, NULL, SPH_TRACE_HOST_TIME_DOMAIN }
+			};
+			uint64_t timestamps[2];
+			uint64_t maxDeviation = 0;
+			if (vkGetCalibratedTimestamps(logicalDeviceHandle, 2, timestampInfos, timestamps, &maxDeviation) != VK_SUCCESS)
 			{
-				x = 0;
-				y++;
+				throw std::runtime_error("vkGetCalibratedTimestampsEXT failed");
 			}
+			gpuCalibrationTicks = timestamps[0];
+			gpuCalibrationTime = Tracer::HostCounterToNow(timestamps[1]);
+			std::cout << "[INFO] trace: gpu clock calibrated with VK_EXT_calibrated_timestamps, max deviation " << maxDeviation << " ns" << std::endl;
+			return;
+		}
+		// without the extension a timestamp at the top of an empty submission is taken to be halfway through it
+		VkCommandBuffer commandBufferHandle = BeginSingleTimeCommands();
+		vkCmdResetQueryPool(commandBufferHandle, timestampQueryPoolHandle, SPH_CALIBRATION_QUERY, 1);
+		vkCmdWriteTimestamp(commandBufferHandle, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPoolHandle, SPH_CALIBRATION_QUERY);
+		const int64_t submitStart = Tracer::Now();
+		EndSingleTimeCommands(commandBufferHandle);
+		const int64_t submitEnd = Tracer::Now();
+		if (vkGetQueryPoolResults(logicalDeviceHandle, timestampQueryPoolHandle, SPH_CALIBRATION_QUERY, 1, sizeof(uint64_t), &gpuCalibrationTicks, sizeof(uint64_t),
+			VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS)
+		{
+			throw std::runtime_error("calibration timestamp query failed");
 		}
-		// zero all 
-		std::memset(mappedMemory, 0, packedBufferSize);
-		std::memcpy(mappedMemory, initialParticlePosition.data(), positionSsboSize);
-		vkUnmapMemory(logicalDeviceHandle, stagingBufferMemoryDeviceHandle);
+		gpuCalibrationTime = submitStart + (submitEnd - submitStart) / 2;
+		std::cout << "[WARNING] VK_EXT_calibrated_timestamps is not available, the gpu spans of the trace may be off by up to "
+			<< 1e-3 * (submitEnd - submitStart) / 2 << " us" << std::endl;
+	}
 
-		// submit a command buffer to copy staging buffer to the particle buffer 
-		VkCommandBuffer copyCommandBufferHandle;
-		VkCommandBufferAllocateInfo copyCommandBufferAllocationInfo = CsySmallVk::commandBufferAllocateInfo();
-		copyCommandBufferAllocationInfo.commandBufferCount = 1;
-		copyCommandBufferAllocationInfo.commandPool = computeCommandPoolHandle;
-		copyCommandBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	int64_t Application::GpuTicksToTrace(uint64_t ticks) const
+	{
+		// signed, timestamps from before the calibration land before it
+		const int64_t elapsedTicks = static_cast<int64_t>(ticks - gpuCalibrationTicks);
+		return gpuCalibrationTime + static_cast<int64_t>(elapsedTicks * static_cast<double>(physicalDeviceProperties.limits.timestampPeriod));
+	}
 
-		if (vkAllocateCommandBuffers(logicalDeviceHandle, &copyCommandBufferAllocationInfo, &copyCommandBufferHandle) != VK_SUCCESS)
+	ActiveState Application::ReadActiveState()
+	{
+		VkMemoryBarrier computeToTransferBarrier
 		{
-			throw std::runtime_error("command buffer creation failed");
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_TRANSFER_READ_BIT
+		};
+		VkBuffer stagingBufferHandle;
+		VkDeviceMemory stagingMemoryHandle;
+		CreateBuffer(sizeof(ActiveState), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBufferHandle, stagingMemoryHandle, MemoryPurpose::Staging);
+		VkCommandBuffer commandBufferHandle = BeginSingleTimeCommands();
+		vkCmdPipelineBarrier(commandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &computeToTransferBarrier, 0, NULL, 0, NULL);
+		VkBufferCopy region{ activeStateSsboOffset, 0, sizeof(ActiveState) };
+		vkCmdCopyBuffer(commandBufferHandle, tileBufferHandle, stagingBufferHandle, 1, &region);
+		EndSingleTimeCommands(commandBufferHandle);
+
+		ActiveState state;
+		void* mappedMemory = NULL;
+		vkMapMemory(logicalDeviceHandle, stagingMemoryHandle, 0, sizeof(ActiveState), 0, &mappedMemory);
+		std::memcpy(&state, mappedMemory, sizeof(state));
+		vkUnmapMemory(logicalDeviceHandle, stagingMemoryHandle);
+		FreeMemory(stagingMemoryHandle);
+		vkDestroyBuffer(logicalDeviceHandle, stagingBufferHandle, allocator);
+		return state;
+	}
+
+	void Application::PrintActiveTileReport()
+	{
+		if (!settings.activeTiles)
+		{
+			return;
 		}
+		const ActiveState state = ReadActiveState();
+		const uint64_t activeSteps = (uint64_t(state.activeParticleStepsHigh) << 32) | state.activeParticleStepsLow;
+		const uint64_t awakeSteps = (uint64_t(state.awakeParticleStepsHigh) << 32) | state.awakeParticleStepsLow;
+		const uint64_t aliveSteps = (uint64_t(state.aliveParticleStepsHigh) << 32) | state.aliveParticleStepsLow;
+		if (aliveSteps == 0)
+		{
+			return;
+		}
+		std::cout << "[INFO] active tiles: " << aliveSteps << " particle-steps, integrated " << awakeSteps << ", density only "
+			<< activeSteps - awakeSteps << ", skipped " << 100.0 * (aliveSteps - activeSteps) / aliveSteps << "% entirely and "
+			<< 100.0 * (aliveSteps - awakeSteps) / aliveSteps << "% of the force and integrate passes" << std::endl;
+		std::cout << "[INFO] last step: " << state.awakeCount << " awake, " << state.activeCount << " active particles" << std::endl;
+	}
 
-		VkCommandBufferBeginInfo commandBufferBeginInfo = CsySmallVk::commandBufferBeginInfo();
-		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-		if (vkBeginCommandBuffer(copyCommandBufferHandle, &commandBufferBeginInfo) != VK_SUCCESS)
+	void Application::PrintBlockStepReport()
+	{
+		if (!settings.blockSteps || submittedBlocks == 0)
 		{
-			throw std::runtime_error("command buffer begin failed");
+			return;
+		}
+		// the active list of a substep holds the particles due in it, the alive counter what uniform steps would update
+		const ActiveState state = ReadActiveState();
+		const uint64_t updates = (uint64_t(state.activeParticleStepsHigh) << 32) | state.activeParticleStepsLow;
+		const uint64_t aliveSteps = (uint64_t(state.aliveParticleStepsHigh) << 32) | state.aliveParticleStepsLow;
+		if (aliveSteps == 0)
+		{
+			return;
 		}
+		const double simulatedTime = double(submittedBlocks) * SPH_BLOCK_SUBSTEPS * SPH_TIME_STEP;
+		std::cout << "[INFO] block time steps: " << updates / simulatedTime << " particle updates per simulated second, uniform steps "
+			<< aliveSteps / simulatedTime << ", " << 100.0 * (aliveSteps - updates) / aliveSteps << "% fewer" << std::endl;
+	}
 
-		VkBufferCopy bufferCopyRegion
+	void Application::PrintAdaptiveReport()
+	{
+		if (!settings.adaptive)
 		{
-			0,
-			0,
-			stagingBufferMemoryRequirements.size
+			return;
+		}
+		VkMemoryBarrier computeToTransferBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_TRANSFER_READ_BIT
 		};
+		VkBuffer stagingBufferHandle;
+		VkDeviceMemory stagingMemoryHandle;
+		CreateBuffer(sizeof(AdaptState), VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBufferHandle, stagingMemoryHandle, MemoryPurpose::Staging);
+		VkCommandBuffer commandBufferHandle = BeginSingleTimeCommands();
+		vkCmdPipelineBarrier(commandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &computeToTransferBarrier, 0, NULL, 0, NULL);
+		VkBufferCopy region{ adaptStateSsboOffset, 0, sizeof(AdaptState) };
+		vkCmdCopyBuffer(commandBufferHandle, adaptBufferHandle, stagingBufferHandle, 1, &region);
+		EndSingleTimeCommands(commandBufferHandle);
+
+		AdaptState adaptState;
+		void* mappedMemory = NULL;
+		vkMapMemory(logicalDeviceHandle, stagingMemoryHandle, 0, sizeof(AdaptState), 0, &mappedMemory);
+		std::memcpy(&adaptState, mappedMemory, sizeof(adaptState));
+		vkUnmapMemory(logicalDeviceHandle, stagingMemoryHandle);
+		FreeMemory(stagingMemoryHandle);
+		vkDestroyBuffer(logicalDeviceHandle, stagingBufferHandle, allocator);
 
-		vkCmdCopyBuffer(copyCommandBufferHandle, stagingBufferHandle, packedParticlesBufferHandle, 1, &bufferCopyRegion);
-		if (vkEndCommandBuffer(copyCommandBufferHandle) != VK_SUCCESS)
+		// what the same fluid would take at the base resolution everywhere
+		ParticleState state;
+		Download(state);
+		uint32_t particleCount = 0;
+		double baseEquivalent = 0.0;
+		uint32_t levelCounts[3]{};
+		for (size_t i = 0; i < state.Size(); i++)
 		{
-			throw std::runtime_error("command buffer end failed");
+			if (state.id[i] == SPH_DEAD_PARTICLE)
+			{
+				continue;
+			}
+			particleCount++;
+			baseEquivalent += state.mass[i] / SPH_PARTICLE_MASS;
+			levelCounts[std::min(2, static_cast<int>(std::lround(std::log2(state.mass[i] / SPH_PARTICLE_MASS))))]++;
 		}
-		VkSubmitInfo submitInfo = CsySmallVk::submitInfo();
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &copyCommandBufferHandle;
-		submitInfo.waitSemaphoreCount = 0;
-		submitInfo.signalSemaphoreCount = 0;
-		if (vkQueueSubmit(computeQueueHandle, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		if (particleCount == 0)
 		{
-			throw std::runtime_error("command buffer submission failed");
+			return;
 		}
-		if (vkQueueWaitIdle(computeQueueHandle) != VK_SUCCESS)
+		std::cout << "[INFO] adaptive resolution: " << adaptState.splitCount << " splits, " << adaptState.mergeCount << " merges" << std::endl;
+		std::cout << "[INFO] " << particleCount << " particles (" << levelCounts[0] << " base, " << levelCounts[1] << " double, " << levelCounts[2]
+			<< " quadruple mass) stand in for " << static_cast<uint64_t>(std::lround(baseEquivalent)) << " at the base resolution, "
+			<< baseEquivalent / particleCount << "x fewer" << std::endl;
+	}
+
+	void Application::PrintReorderProfile()
+	{
+		if (!timestampsSupported || SPH_REORDER_INTERVAL == 0 || reorderTimeCount == 0)
 		{
-			throw std::runtime_error("vkQueueWaitIdle failed");
+			return;
 		}
-		vkFreeCommandBuffers(logicalDeviceHandle, computeCommandPoolHandle, 1, &copyCommandBufferHandle);
-		vkFreeMemory(logicalDeviceHandle, stagingBufferMemoryDeviceHandle, NULL);
-		vkDestroyBuffer(logicalDeviceHandle, stagingBufferHandle, NULL);
-		std::cout << "Successfully set initial particle data" << std::endl;
+		const double reorderTime = reorderTimeSum / reorderTimeCount;
+		std::cout << "[INFO] reorder pass: " << reorderTime << " ms average over " << reorderTimeCount << " passes" << std::endl;
+		std::cout << "[INFO] step time by steps since the last reorder:" << std::endl;
+
+		// amortized cost of reordering every n steps: (reorder + sum of the first n step times) / n
+		double cumulativeStepTime = 0.0;
+		double bestCost = 0.0;
+		uint32_t bestInterval = 0;
+		for (uint32_t n = 0; n < stepTimeSums.size(); n++)
+		{
+			if (stepTimeCounts[n] == 0)
+			{
+				break;
+			}
+			const double stepTime = stepTimeSums[n] / stepTimeCounts[n];
+			cumulativeStepTime += stepTime;
+			const double cost = (reorderTime + cumulativeStepTime) / (n + 1);
+			std::cout << "[INFO]     " << n << ": " << stepTime << " ms, amortized cost at N = " << n + 1 << ": " << cost << " ms/step" << std::endl;
+			if (bestInterval == 0 || cost < bestCost)
+			{
+				bestCost = cost;
+				bestInterval = n + 1;
+			}
+		}
+		std::cout << "[INFO] cheapest reorder interval: " << bestInterval << " (" << bestCost << " ms/step)";
+		if (bestInterval == SPH_REORDER_INTERVAL)
+		{
+			std::cout << ", at the measured limit, try a larger SPH_REORDER_INTERVAL";
+		}
+		std::cout << std::endl;
 	}
 
-	void Application::RunSimulation()
+	void Application::SimulationLoop()
 	{
-		if (vkQueueSubmit(computeQueueHandle, 1, &computeSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		if (tracer)
 		{
-			throw std::runtime_error("compute queue submission failed");
+			tracer->NameThread("simulation");
+		}
+		try
+		{
+			while (simulationRunning)
+			{
+				if (paused)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					continue;
+				}
+				RunSimulation();
+			}
+		}
+		catch (...)
+		{
+			// rethrown by Run on the main thread
+			simulationError = std::current_exception();
+			simulationRunning = false;
+		}
+	}
+
+	bool Application::ShowPendingSnapshot()
+	{
+		// the simulation thread overwrites the snapshot shown before once it is handed back, which waits for the frames
+		// and captures still drawing it without blocking the next frame
+		if (snapshotRetiring)
+		{
+			if (SnapshotInFlight(1 - displayedSnapshot))
+			{
+				return false;
+			}
+			snapshotRetiring = false;
+			snapshotPending = false;
+			return false;
+		}
+		// switch to the snapshot the simulation thread finished last
+		if (!snapshotPending)
+		{
+			return false;
+		}
+		displayedSnapshotValue = snapshotValue;
+		displayedSnapshot = 1 - displayedSnapshot;
+		retiredCaptureValue = capturedFrameValue;
+		snapshotRetiring = SnapshotInFlight(1 - displayedSnapshot);
+		if (!snapshotRetiring)
+		{
+			snapshotPending = false;
+		}
+		return true;
+	}
+
+	bool Application::SnapshotInFlight(uint32_t snapshot)
+	{
+		for (uint32_t frame = 0; frame < SPH_FRAMES_IN_FLIGHT; frame++)
+		{
+			if (frameSnapshots[frame] == snapshot && vkGetFenceStatus(logicalDeviceHandle, frameFenceHandles[frame]) == VK_NOT_READY)
+			{
+				return true;
+			}
+		}
+		uint64_t completedCaptureValue = retiredCaptureValue;
+		if (capture && vkGetSemaphoreCounterValue(logicalDeviceHandle, captureTimelineHandle, &completedCaptureValue) != VK_SUCCESS)
+		{
+			throw std::runtime_error("vkGetSemaphoreCounterValue failed");
+		}
+		return completedCaptureValue < retiredCaptureValue;
+	}
+
+	void Application::CaptureFrame(bool wait)
+	{
+		const int32_t slot = capture->AcquireSlot(wait);
+		if (slot < 0)
+		{
+			return;
+		}
+		// draws the displayed snapshot into the capture image and copies it into the slot
+		const uint64_t signalValue = ++capturedFrameValue;
+		const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+		const uint64_t waitValue = displayedSnapshotValue;
+		VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, NULL, 1, &waitValue, 1, &signalValue };
+		VkSubmitInfo submitInfo = CsySmallVk::submitInfo();
+		submitInfo.pNext = &timelineSubmitInfo;
+		submitInfo.waitSemaphoreCount = 1;
+		submitInfo.pWaitSemaphores = &simulationTimelineHandle;
+		submitInfo.pWaitDstStageMask = &waitStage;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &captureCommandBufferHandles[displayedSnapshot * SPH_CAPTURE_SLOTS + slot];
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &captureTimelineHandle;
+		{
+			TraceScope scope(tracer.get(), "capture");
+			if (vkQueueSubmit(graphicsQueueHandle, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+			{
+				throw std::runtime_error("capture queue submission failed");
+			}
+		}
+		capture->Submit(static_cast<uint32_t>(slot), signalValue);
+	}
+
+	void Application::HeadlessLoop()
+	{
+		uint64_t completedSteps = 0;
+		while (simulationRunning && completedSteps < settings.stepCount)
+		{
+			// the simulation thread overwrites the shown snapshot once the switch hands it back, the captures
+			// submitted so far must be done reading it
+			if (capture && snapshotPending)
+			{
+				VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, NULL, 0, 1, &captureTimelineHandle, &capturedFrameValue };
+				if (vkWaitSemaphores(logicalDeviceHandle, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+				{
+					throw std::runtime_error("vkWaitSemaphores failed");
+				}
+			}
+			if (ShowPendingSnapshot() && capture)
+			{
+				// every snapshot is captured, the frame waits for a slot rather than being dropped
+				CaptureFrame(true);
+				frameNumber++;
+			}
+			else
+			{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+			vkGetSemaphoreCounterValue(logicalDeviceHandle, simulationTimelineHandle, &completedSteps);
 		}
+		std::cout << "[INFO] headless run: " << completedSteps << " steps, " << frameNumber << " frames captured" << std::endl;
 	}
 
 	void Application::Render()
 	{
-		// submit graphics command buffer
-		vkAcquireNextImageKHR(logicalDeviceHandle, swapchainHandle, UINT64_MAX, imageAvailableSemaphoreHandle, VK_NULL_HANDLE, &imageIndex);
-		graphicsSubmitInfo.pCommandBuffers = graphicsCommandBufferHandles.data() + imageIndex;
-		if (vkQueueSubmit(graphicsQueueHandle, 1, &graphicsSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		// the frame SPH_FRAMES_IN_FLIGHT frames back used the same semaphores and render queries
+		const auto frameWaitStart = std::chrono::high_resolution_clock::now();
+		{
+			TraceScope scope(tracer.get(), "vkWaitForFences");
+			if (vkWaitForFences(logicalDeviceHandle, 1, &frameFenceHandles[currentFrame], VK_TRUE, UINT64_MAX) != VK_SUCCESS)
+			{
+				throw std::runtime_error("vkWaitForFences failed");
+			}
+		}
+		uint64_t renderTimestamps[2];
+		if (frameTimestamped[currentFrame] && vkGetQueryPoolResults(logicalDeviceHandle, timestampQueryPoolHandle, SPH_STEP_QUERY_COUNT + 2 * currentFrame, 2,
+			sizeof(renderTimestamps), renderTimestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS)
 		{
-			throw std::runtime_error("graphics queue submission failed");
+			tracer->Span("render pass", TraceTrack::GraphicsQueue, GpuTicksToTrace(renderTimestamps[0]), GpuTicksToTrace(renderTimestamps[1]));
 		}
-		// queue the image for presentation
-		vkQueuePresentKHR(presentationQueueHandle, &presentInfo);
+		frameTimestamped[currentFrame] = false;
+		const auto frameWait = std::chrono::high_resolution_clock::now() - frameWaitStart;
 
-		vkQueueWaitIdle(presentationQueueHandle);
+		ShowPendingSnapshot();
+
+		// submit graphics command buffer, it waits on the gpu until the snapshot's step has completed
+		const auto acquireStart = std::chrono::high_resolution_clock::now();
+		{
+			TraceScope scope(tracer.get(), "vkAcquireNextImageKHR");
+			vkAcquireNextImageKHR(logicalDeviceHandle, swapchainHandle, UINT64_MAX, imageAvailableSemaphoreHandles[currentFrame], VK_NULL_HANDLE, &imageIndex);
+		}
+		const auto acquireEnd = std::chrono::high_resolution_clock::now();
+		telemetry->Record(TelemetryMetric::AcquireWait, 1e-6 * std::chrono::duration_cast<std::chrono::nanoseconds>(acquireEnd - acquireStart).count());
+		VkSemaphore waitSemaphores[2]{ imageAvailableSemaphoreHandles[currentFrame], simulationTimelineHandle };
+		// the splat renderer reads the snapshot in a compute pass before the render pass
+		VkPipelineStageFlags waitStages[2]{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+		const uint64_t waitValues[2]{ 0, displayedSnapshotValue };
+		VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, NULL, 2, waitValues, 0, NULL };
+		// the render queries bracket the graphics command buffer when tracing
+		VkCommandBuffer commandBuffers[3];
+		uint32_t commandBufferCount = 0;
+		const bool timestamped = renderTimestampCommandBufferHandles[currentFrame][0] != VK_NULL_HANDLE;
+		if (timestamped)
+		{
+			commandBuffers[commandBufferCount++] = renderTimestampCommandBufferHandles[currentFrame][0];
+		}
+		commandBuffers[commandBufferCount++] = graphicsCommandBufferHandles[displayedSnapshot * swapchainFrameBufferHandles.size() + imageIndex];
+		if (timestamped)
+		{
+			commandBuffers[commandBufferCount++] = renderTimestampCommandBufferHandles[currentFrame][1];
+		}
+		VkSubmitInfo submitInfo = graphicsSubmitInfo;
+		submitInfo.pNext = &timelineSubmitInfo;
+		submitInfo.waitSemaphoreCount = 2;
+		submitInfo.pWaitSemaphores = waitSemaphores;
+		submitInfo.pWaitDstStageMask = waitStages;
+		submitInfo.commandBufferCount = commandBufferCount;
+		submitInfo.pCommandBuffers = commandBuffers;
+		submitInfo.pSignalSemaphores = &renderFinishedSemaphoreHandles[currentFrame];
+		if (vkResetFences(logicalDeviceHandle, 1, &frameFenceHandles[currentFrame]) != VK_SUCCESS)
+		{
+			throw std::runtime_error("vkResetFences failed");
+		}
+		{
+			TraceScope scope(tracer.get(), "vkQueueSubmit");
+			if (vkQueueSubmit(graphicsQueueHandle, 1, &submitInfo, frameFenceHandles[currentFrame]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("graphics queue submission failed");
+			}
+		}
+		frameSnapshots[currentFrame] = displayedSnapshot;
+		frameTimestamped[currentFrame] = timestamped;
+		// a frame is dropped from the capture rather than stalling the window when the writer falls behind
+		if (capture)
+		{
+			CaptureFrame(false);
+		}
+		// queue the image for presentation, the next frame only waits for the frame that used its semaphores
+		const auto presentStart = std::chrono::high_resolution_clock::now();
+		presentInfo.pWaitSemaphores = &renderFinishedSemaphoreHandles[currentFrame];
+		{
+			TraceScope scope(tracer.get(), "vkQueuePresentKHR");
+			vkQueuePresentKHR(presentationQueueHandle, &presentInfo);
+		}
+		telemetry->Record(TelemetryMetric::PresentWait, 1e-6 * std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - presentStart + frameWait).count());
+		currentFrame = (currentFrame + 1) % SPH_FRAMES_IN_FLIGHT;
 	}
 
 	void Application::MainLoop()
@@ -1193,49 +4183,168 @@ namespace SPH
 		static std::chrono::high_resolution_clock::time_point frame_start;
 		static std::chrono::high_resolution_clock::time_point frame_end;
 		static int64_t total_frame_time_ns;
+		// the counters in the title average over about half a second
+		static std::chrono::high_resolution_clock::time_point rate_start = std::chrono::high_resolution_clock::now();
+		static uint64_t rate_start_frame = frameNumber;
+		static uint64_t rate_start_step = 0;
+		static double frames_per_second = 0.0;
+		static double steps_per_second = 0.0;
 
 		frame_start = std::chrono::high_resolution_clock::now();
+		TraceScope frameScope(tracer.get(), "frame");
 
 		// process user inputs
-		glfwPollEvents();
-
-		// step through the simulation if not paused
-		if (!paused)
 		{
-			RunSimulation();
-			frameNumber++;
+			TraceScope scope(tracer.get(), "glfwPollEvents");
+			glfwPollEvents();
 		}
 
+		// the simulation thread steps on its own, the frame shows whatever it completed last
 		Render();
+		frameNumber++;
 		frame_end = std::chrono::high_resolution_clock::now();
 		// measure performance
 		total_frame_time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(frame_end - frame_start).count();
-		std::stringstream title;
-		title.precision(3);
-		title.setf(std::ios_base::fixed, std::ios_base::floatfield);
-		title << "SPH (Vulkan) | "
-			<< SPH_NUM_PARTICLES << " particles | "
-			"frame #" << frameNumber << " | "
-			"render latency: " << 1e-6 * total_frame_time_ns << " ms | "
-			"FPS: " << 1.0 / (1e-9 * total_frame_time_ns);
-		glfwSetWindowTitle(window, title.str().c_str());
+		telemetry->Record(TelemetryMetric::FrameTime, 1e-6 * total_frame_time_ns);
+		// the title is only rewritten with the rates, the histograms carry the per-frame detail
+		const double rate_seconds = 1e-9 * std::chrono::duration_cast<std::chrono::nanoseconds>(frame_end - rate_start).count();
+		if (rate_seconds >= 0.5)
+		{
+			uint64_t completedSteps = 0;
+			vkGetSemaphoreCounterValue(logicalDeviceHandle, simulationTimelineHandle, &completedSteps);
+			frames_per_second = (frameNumber - rate_start_frame) / rate_seconds;
+			steps_per_second = (completedSteps - rate_start_step) / rate_seconds;
+			telemetry->Record(TelemetryMetric::StepsPerSecond, steps_per_second);
+			rate_start = frame_end;
+			rate_start_frame = frameNumber;
+			rate_start_step = completedSteps;
+
+			std::stringstream title;
+			title.precision(3);
+			title.setf(std::ios_base::fixed, std::ios_base::floatfield);
+			title << "SPH (Vulkan) | "
+				<< SPH_PARTICLE_CAPACITY << " particle capacity | "
+				"frame #" << frameNumber << " | "
+				"step #" << completedSteps << " | "
+				"render latency: " << 1e-6 * total_frame_time_ns << " ms | "
+				"FPS: " << frames_per_second << " | "
+				"steps/s: " << steps_per_second;
+			glfwSetWindowTitle(window, title.str().c_str());
+		}
+
+		if (memoryReportRequested.exchange(false))
+		{
+			memoryTracker.Print("on request");
+		}
+
+		// hold the target frame rate, the simulation thread keeps stepping meanwhile
+		if (settings.targetFps > 0)
+		{
+			TraceScope scope(tracer.get(), "frame pacing");
+			std::this_thread::sleep_until(frame_start + std::chrono::nanoseconds(1000000000 / settings.targetFps));
+		}
 	}
 
 	void Application::Run()
 	{
+		if (settings.benchmarkPrimitives)
+		{
+			BenchmarkPrimitives();
+			return;
+		}
+		if (settings.benchmarkForce)
+		{
+			BenchmarkForceKernels();
+			return;
+		}
+		if (settings.compareCpu)
+		{
+			CompareWithCpu();
+			return;
+		}
+		if (settings.split)
+		{
+			RunSplit();
+			return;
+		}
+		if (settings.benchmarkStorage)
+		{
+			BenchmarkStorage();
+			return;
+		}
+		if (settings.benchmarkLayout)
+		{
+			BenchmarkLayouts();
+			return;
+		}
+		if (settings.benchmarkScaling)
+		{
+			BenchmarkScaling();
+			return;
+		}
+		if (settings.autotune)
+		{
+			Autotune();
+			return;
+		}
+
 		// to measure performance
 		std::thread
 		(
 			[this]()
 			{
 				std::this_thread::sleep_for(std::chrono::seconds(20));
-				std::cout << "[INFO] frame count after 20 seconds after setup (do not pause or move the window): " << frameNumber << std::endl;
+				uint64_t completedSteps = 0;
+				vkGetSemaphoreCounterValue(logicalDeviceHandle, simulationTimelineHandle, &completedSteps);
+				std::cout << "[INFO] frame count after 20 seconds after setup (do not pause or move the window): " << frameNumber
+					<< ", step count: " << completedSteps << std::endl;
 			}
 		).detach();
 
-		while (!glfwWindowShouldClose(window))
+		telemetry.reset(new Telemetry(settings));
+		if (!settings.tracePath.empty())
+		{
+			tracer.reset(new Tracer());
+			tracer->NameThread("main");
+			CalibrateGpuClock();
+		}
+		simulationRunning = true;
+		simulationThread = std::thread(&Application::SimulationLoop, this);
+		if (settings.headless)
+		{
+			HeadlessLoop();
+		}
+		else
+		{
+			while (simulationRunning && !glfwWindowShouldClose(window))
+			{
+				MainLoop();
+			}
+		}
+		simulationRunning = false;
+		simulationThread.join();
+		if (simulationError)
+		{
+			std::rethrow_exception(simulationError);
+		}
+		vkDeviceWaitIdle(logicalDeviceHandle);
+		// the writer finishes the frames still in the ring
+		capture.reset();
+		if (exporter)
+		{
+			PublishExports(true);
+			std::cout << "[INFO] export: " << exporter->PublishedCount() << " steps published to " << settings.exportName << std::endl;
+		}
+		PrintReorderProfile();
+		PrintActiveTileReport();
+		PrintAdaptiveReport();
+		PrintBlockStepReport();
+		// the dump thread writes once more on the way out
+		telemetry.reset();
+		if (tracer)
 		{
-			MainLoop();
+			tracer->Write(settings.tracePath);
+			tracer.reset();
 		}
 	}
 }
\ No newline at end of file
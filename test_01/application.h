@@ -2,30 +2,249 @@
 #include <vulkan/vulkan.h>
 #include <glfw/glfw3.h>
 #include <glm/glm.hpp>
+#include <algorithm>
 #include <chrono>
+#include <cstddef>
+#include <deque>
 #include <cstdint>
+#include <functional>
 #include <vector>
 #include <atomic>
+#include <exception>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include "settings.h"
+#include "particle_layout.h"
+#include "gpu_primitives.h"
+#include "solver.h"
+#include "tuning.h"
+#include "boundary.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "memory.h"
+#include "frame_graph.h"
+#include "upload.h"
+#include "capture.h"
+#include "state_export.h"
 
 #ifndef MU_SHADER_PATH
 #define MU_SHADER_PATH "D:/cg/vulkan/temp/csy_cpp_vulkan/csySph/test_01/shader/"
 #endif
-#define SPH_NUM_PARTICLES 20000
-#define SPH_PARTICLE_RADIUS 0.005f
+// local size of the compute passes the tuning file has no entry for
 #define SPH_WORK_GROUP_SIZE 128
+// candidate local sizes of the tuned passes are SPH_MIN_WORK_GROUP_SIZE << k for k < SPH_WORK_GROUP_SIZE_COUNT, the
+// simulation and the active state hold an indirect dispatch for each of them
+#define SPH_MIN_WORK_GROUP_SIZE 32u
+#define SPH_WORK_GROUP_SIZE_COUNT 6
 // work group count is the ceiling of particle count divided by work group size
 #define SPH_NUM_WORK_GROUPS ((SPH_NUM_PARTICLES + SPH_WORK_GROUP_SIZE - 1) / SPH_WORK_GROUP_SIZE)
+// dispatches of more work groups are spread over y in rows of this many, the smallest maxComputeWorkGroupCount[0] a
+// device may have. Must match MAX_WORK_GROUPS_X of dispatch.glsl
+#define SPH_MAX_WORK_GROUPS_X 65535u
+// the particle buffers hold up to SPH_PARTICLE_CAPACITY particles, SPH_NUM_PARTICLES of them are alive at start. A
+// build with another capacity compiles the shaders with shader/compile.py --capacity=SPH_PARTICLE_CAPACITY, which puts
+// them in their own directory, see the Scaling configuration of the project
+#define SPH_STRING(x) #x
+#define SPH_MACRO_STRING(x) SPH_STRING(x)
+#ifndef SPH_PARTICLE_CAPACITY
+#define SPH_PARTICLE_CAPACITY 32768
+#define SPH_SHADER_PATH MU_SHADER_PATH
+#else
+#define SPH_SHADER_PATH MU_SHADER_PATH "capacity_" SPH_MACRO_STRING(SPH_PARTICLE_CAPACITY) "/"
+#endif
+static_assert(SPH_PARTICLE_CAPACITY >= SPH_NUM_PARTICLES, "particle capacity must hold the initial particles");
+static_assert(SPH_PARTICLE_CAPACITY % SPH_PARTICLE_BLOCK_SIZE == 0, "the AoSoA layout needs whole blocks");
+
+// the inlet emits a row of particles every SPH_EMIT_INTERVAL steps, 0 disables the emitter. Off by default so that the
+// particle count of the scene stays fixed, --inflow turns the inlet and the sink on at SPH_INFLOW_INTERVAL
+#ifndef SPH_EMIT_INTERVAL
+#define SPH_EMIT_INTERVAL 0
+#endif
+#ifndef SPH_INFLOW_INTERVAL
+#define SPH_INFLOW_INTERVAL 16
+#endif
+// particles removed by the sink are compacted away every SPH_COMPACT_INTERVAL steps, 0 disables the compaction
+#ifndef SPH_COMPACT_INTERVAL
+#define SPH_COMPACT_INTERVAL 128
+#endif
+
+// uniform neighbour grid over the [-1,1] domain with cells one smoothing length wide, rebuilt every step
+// by sorting the particles by cell. Dead particles and empty slots get the key SPH_GRID_CELL_COUNT
+#define SPH_GRID_RESOLUTION 100
+#define SPH_GRID_CELL_COUNT (SPH_GRID_RESOLUTION * SPH_GRID_RESOLUTION)
+#define SPH_GRID_KEY_BITS 14
+static_assert(SPH_GRID_CELL_COUNT < (1 << SPH_GRID_KEY_BITS), "grid keys and the empty key must fit in SPH_GRID_KEY_BITS");
+
+// coarse tiles of the active tile schedule (--active-tiles). A tile falls asleep once none of its particles moved faster
+// than the rest speed for SPH_TILE_SLEEP_STEPS steps. Particles in or next to an awake tile are integrated, the ring
+// around them only updates density and pressure, because the reorder and compaction passes do not carry those along
+#define SPH_TILE_RESOLUTION 10
+#define SPH_TILE_COUNT (SPH_TILE_RESOLUTION * SPH_TILE_RESOLUTION)
+#define SPH_TILE_SLEEP_STEPS 64
+static_assert(2.f / SPH_TILE_RESOLUTION >= SPH_SMOOTHING_LENGTH, "a tile must be at least as wide as the smoothing length");
+
+// particles are sorted along a Z-order (Morton) curve every SPH_REORDER_INTERVAL steps, 0 disables the pass
+#ifndef SPH_REORDER_INTERVAL
+#define SPH_REORDER_INTERVAL 64
+#endif
+// time every step on the gpu and print step time against steps since the last reorder on exit
+#ifndef SPH_REORDER_PROFILE
+#define SPH_REORDER_PROFILE 1
+#endif
+// fp16 storage (--half-storage) keeps density and pressure relative to these scales, so that the compressed dam-break's
+// values stay well inside the fp16 range. Must match DENSITY_SCALE and PRESSURE_SCALE of the .half shader variants
+#define SPH_HALF_DENSITY_SCALE (1.f / SPH_RESTING_DENSITY)
+#define SPH_HALF_PRESSURE_SCALE (1.f / (SPH_STIFFNESS * SPH_RESTING_DENSITY))
+
+// split runs (--split) move the line between the gpu and the cpu half every SPH_SPLIT_BALANCE_INTERVAL steps, by
+// up to one smoothing length towards the side that finished its steps first
+#ifndef SPH_SPLIT_BALANCE_INTERVAL
+#define SPH_SPLIT_BALANCE_INTERVAL 10
+#endif
+// the line stays this far inside the walls, so that neither half runs out of particles
+#define SPH_SPLIT_MARGIN 0.1f
+// adaptive runs (--adaptive) split and merge particles every SPH_ADAPT_INTERVAL steps, see adapt_mark.comp
+#ifndef SPH_ADAPT_INTERVAL
+#define SPH_ADAPT_INTERVAL 10
+#endif
+// block time steps (--block-steps) put every particle on a level l that steps by 2^l SPH_TIME_STEP, a block of
+// SPH_BLOCK_SUBSTEPS substeps of SPH_TIME_STEP brings every level back in sync, see block_substep.comp
+#ifndef SPH_BLOCK_LEVELS
+#define SPH_BLOCK_LEVELS 4
+#endif
+#define SPH_BLOCK_SUBSTEPS (1u << (SPH_BLOCK_LEVELS - 1))
+// the simulation thread queues at most this many step submissions ahead of the gpu
+#ifndef SPH_SUBMISSIONS_IN_FLIGHT
+#define SPH_SUBMISSIONS_IN_FLIGHT 2
+#endif
+// the window queues at most this many frames ahead of the gpu, each with its own semaphores, fence and render queries
+#ifndef SPH_FRAMES_IN_FLIGHT
+#define SPH_FRAMES_IN_FLIGHT 2
+#endif
+// the timestamp queries of a step submission, see timestampQueryPoolHandle
+#define SPH_STEP_QUERY_COUNT 8
+#define SPH_CALIBRATION_QUERY (SPH_STEP_QUERY_COUNT + 2 * SPH_FRAMES_IN_FLIGHT)
+// size of the staging ring of the uploads, larger uploads are streamed through it in quarter ring pieces
+#ifndef SPH_UPLOAD_RING_SIZE
+#define SPH_UPLOAD_RING_SIZE (16ull << 20)
+#endif
+// buffers larger than this, or than the device's maxMemoryAllocationSize, are bound in chunks through sparse binding,
+// 0 leaves it to the device
+#ifndef SPH_MAX_ALLOCATION_SIZE
+#define SPH_MAX_ALLOCATION_SIZE 0
+#endif
+// least time --benchmark-scaling steps every particle count for
+#ifndef SPH_SCALING_BENCHMARK_SECONDS
+#define SPH_SCALING_BENCHMARK_SECONDS 2
+#endif
+// readback slots of --export, the most exports in flight between the gpu copy and the publication
+#ifndef SPH_EXPORT_READBACK_SLOTS
+#define SPH_EXPORT_READBACK_SLOTS 2
+#endif
+// position, velocity, force, density, pressure, particle id, sort key, sort value, sorted position, sorted velocity, sorted particle id,
+// simulation state, cell start, cell end, active state, active index, tiles, active flag, awake, split state, split inbox, split outbox,
+// boundary field, mass, sorted mass, adapt state, adapt decisions, block state, particle level
+#define SPH_NUM_COMPUTE_BINDINGS 29
 
 namespace SPH
 {
-	class Application
+	// the indirect dispatch of groupCount work groups, in rows of SPH_MAX_WORK_GROUPS_X past that many, the way
+	// dispatch_size of dispatch.glsl lays it out
+	inline VkDispatchIndirectCommand DispatchSize(uint32_t groupCount)
+	{
+		const uint32_t x = std::min(groupCount, SPH_MAX_WORK_GROUPS_X);
+		return { x, x == 0 ? 1 : (groupCount + x - 1) / x, 1 };
+	}
+
+	// mirrors simulation_state_block of the compute shaders. Every dispatch and the draw read their size from here,
+	// so the alive count never has to be read back. A compaction writes its CompactResult over the first 16 bytes
+	struct SimulationState
+	{
+		VkDispatchIndirectCommand dispatch;
+		uint32_t aliveCount;
+		VkDrawIndirectCommand draw;
+		uint32_t nextParticleId;
+		// the dispatch over the alive particles for every candidate local size, see WorkGroupSizeIndex
+		VkDispatchIndirectCommand sizedDispatch[SPH_WORK_GROUP_SIZE_COUNT];
+	};
+	static_assert(offsetof(SimulationState, aliveCount) == offsetof(CompactResult, count), "compaction result must overlay the simulation state");
+
+	// mirrors active_state_block: the density, force and integrate passes run on the first activeCount entries of
+	// the active index list, force and integrate skip the particles that are not awake. The active tile schedule
+	// writes its CompactResult over the first 16 bytes, otherwise it follows the alive count. The 64-bit
+	// particle-step counters feed the skipped work report
+	struct ActiveState
+	{
+		VkDispatchIndirectCommand dispatch;
+		uint32_t activeCount;
+		uint32_t awakeCount;
+		uint32_t activeParticleStepsLow;
+		uint32_t activeParticleStepsHigh;
+		uint32_t awakeParticleStepsLow;
+		uint32_t awakeParticleStepsHigh;
+		uint32_t aliveParticleStepsLow;
+		uint32_t aliveParticleStepsHigh;
+		// the dispatch over the active list for every candidate local size
+		VkDispatchIndirectCommand sizedDispatch[SPH_WORK_GROUP_SIZE_COUNT];
+	};
+	static_assert(offsetof(ActiveState, activeCount) == offsetof(CompactResult, count), "compaction result must overlay the active state");
+
+	// mirrors adapt_state_block, the splits and merges of an adaptive run so far
+	struct AdaptState
+	{
+		uint32_t splitCount;
+		uint32_t mergeCount;
+	};
+
+	// mirrors block_state_block: the substep of the current block and the coarsest level that is due in it
+	struct BlockState
+	{
+		uint32_t substep;
+		uint32_t dueLevel;
+	};
+
+	// entry of a sizedDispatch table for a candidate local size
+	inline uint32_t WorkGroupSizeIndex(uint32_t workGroupSize)
+	{
+		uint32_t index = 0;
+		while ((SPH_MIN_WORK_GROUP_SIZE << index) < workGroupSize)
+		{
+			index++;
+		}
+		return index;
+	}
+
+	// mirrors split_state_block, lives in mapped host-visible memory. The host writes the line, the band width and
+	// the inbox counts before every split step, the gpu fills in the rest
+	struct SplitState
+	{
+		float splitX;
+		float bandWidth;
+		// the inbox holds arrivalCount migrated particles followed by the ghosts
+		uint32_t arrivalCount;
+		uint32_t inboxCount;
+		// one past the last owned slot, the ghosts follow
+		uint32_t ownedEnd;
+		uint32_t bandCount;
+		uint32_t ownedCount;
+	};
+
+	class Application : public Solver
 	{
 	public:
-		Application();
+		Application(const Settings& settings = Settings());
 		Application(const Application&) = delete;
 		~Application();
 		void Run();
 
+		// the prerecorded simulation step as a Solver, for comparisons against the cpu backend
+		const char* Name() const override;
+		// safe to call from any thread while the simulation runs, the next step submission picks the upload up
+		void Upload(const ParticleState& state) override;
+		void Step(uint32_t stepCount) override;
+		void Download(ParticleState& state) override;
+
 	private:
 		void InitializeWindow();
 		void InitializeVulkan();
@@ -45,34 +264,156 @@ namespace SPH
 		void CreateSwapchainFrameBuffers();
 		void CreatePipelineCache();
 		void CreateDescriptorPool();
+		void CreateGpuPrimitives();
 		void CreateBuffers();
+		void CreateUploadManager();
 
+		// --renderer=splat: the accumulation buffer and the descriptor sets of splat.comp and the resolve pass
+		void CreateSplatTarget();
 		void CreateGraphicsPipelineLayout();
+		// the point pipeline, or the resolve pipeline and the splat.comp pipeline
 		void CreateGraphicsPipeline();
 		void CreateGraphicsCommandPool();
 		void CreateGraphicsCommandBuffers();
 		void CreateSemaphores();
+		void CreateRenderTimestampCommandBuffers();
 		void CreateComputeDescriptorSetLayout();
 		void UpdateComputeDescriptorSets();
 		void CreateComputePipelineLayout();
 		void CreateComputePipelines();
 		void CreateComputeCommandPool();
 		void CreateComputeCommandBuffer();
+		void CreateTimestampQueryPool();
+		void CreateReorderCommandBuffer();
+		void CreateTimestampReadback();
+		void CreateEmissionCommandBuffer();
+		void CreateCompactionCommandBuffer();
+		// passTimestamps writes the per-pass timestamp queries of the telemetry in the step's first substep
+		FrameGraph::Statistics RecordSimulationStep(VkCommandBuffer commandBuffer, ForceKernel kernel, bool passTimestamps = false);
+		// the passes of the step declared to a frame graph, which orders them by the ranges of stepRanges they touch
+		void AddNeighbourGridPasses(FrameGraph& graph);
+		void AddActiveTilePasses(FrameGraph& graph);
+		void AddBlockLevelPasses(FrameGraph& graph);
+		void AddActiveCompactionPasses(FrameGraph& graph);
+		void AddParticlePasses(FrameGraph& graph, ForceKernel kernel, bool passTimestamps);
+		void AddForcePasses(FrameGraph& graph, ForceKernel kernel, bool passTimestamps);
+		std::vector<BufferAccess> ParticleReads(ForceKernel kernel) const;
+		// a graph of just the neighbour grid or the force pass, for the benchmarks and the adaptation
+		void RecordNeighbourGrid(VkCommandBuffer commandBuffer);
+		void RecordForcePass(VkCommandBuffer commandBuffer, ForceKernel kernel);
+		void RecordCompaction(VkCommandBuffer commandBuffer);
+		void CreateSplitCommandBuffers(VkQueryPool queryPool);
+		void RecordSplitStep(VkCommandBuffer commandBuffer, bool compact, VkQueryPool queryPool);
+		void CreateAdaptCommandBuffer();
+		void RecordAdaptation(VkCommandBuffer commandBuffer);
 
 		void SetInitialParticleData();
+		// copies the process' Boundary() into the boundary buffer
+		void UploadBoundary();
+		// Copy of the uploads for one piece of an edit larger than the ring, at most UploadChunkSize() bytes. Submits the
+		// pieces before it first once they fill half the ring, the caller holds the upload lock
+		void* StreamCopy(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
+		void StreamCopy(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+		VkDeviceSize UploadChunkSize() const { return uploads->RingSize() / 4 / 4 * 4; }
 		void RunSimulation();
+		// steps the simulation on its own thread until simulationRunning is cleared
+		void SimulationLoop();
+		void CreateSnapshotCommandBuffers();
+		// clears the accumulation buffer and splats the snapshot into it, before the render pass, nothing for the points
+		void RecordParticleSplat(VkCommandBuffer commandBuffer, uint32_t snapshot);
+		// viewport, pipeline, the snapshot's state and the indirect draw, or the full-screen resolve of the splats, inside
+		// a render pass of either target
+		void RecordParticleDraw(VkCommandBuffer commandBuffer, uint32_t snapshot);
+		// switches to the snapshot the simulation thread finished last, if there is a new one
+		bool ShowPendingSnapshot();
+		// a frame in flight or a capture up to retiredCaptureValue still reads the snapshot
+		bool SnapshotInFlight(uint32_t snapshot);
 		void Render();
 		void MainLoop();
+		// the offscreen image, its render pass and the readback ring of --capture
+		void CreateCaptureTarget();
+		void CreateCaptureCommandBuffers();
+		// renders the shown snapshot into a free readback slot, dropping the frame if there is none and wait is not set
+		void CaptureFrame(bool wait);
+		// --headless: steps until settings.stepCount and captures every new snapshot, without a window
+		void HeadlessLoop();
+		// the exporter, the readback slots or the unified memory mappings, and the command buffers of --export
+		void CreateStateExport();
+		// publishes the submitted exports the gpu has completed, or all of them if wait is set
+		void PublishExports(bool wait);
+		// publishes the count particles of a particle region in the current layout and precision
+		void ExportParticles(const char* particleData, const uint32_t* ids, uint32_t count, uint64_t step);
+		void CollectStepTimestamps();
+		// pairs a gpu timestamp with the tracer's clock, GpuTicksToTrace converts timestamps with it
+		void CalibrateGpuClock();
+		int64_t GpuTicksToTrace(uint64_t ticks) const;
+		void PrintReorderProfile();
+		void PrintActiveTileReport();
+		void PrintAdaptiveReport();
+		void PrintBlockStepReport();
+		ActiveState ReadActiveState();
+		void BenchmarkPrimitives();
+		void BenchmarkForceKernels();
+		void CompareWithCpu();
+		void RunSplit();
+		void BenchmarkStorage();
+		void BenchmarkLayouts();
+		void BenchmarkScaling();
+		void SetParticleStorage(ParticleLayout layout, bool half);
+		void RecreatePipelines();
+		void Autotune();
 
 		// helper functions
 		VkShaderModule CreateShaderModule(const std::vector<char>& code);
+		// a workGroupSize of 0 takes the tuned local size of the pass
+		VkPipeline CreateComputePipeline(const char* shaderFileName, uint32_t workGroupSize = 0);
+		void DestroyComputePipeline(VkPipeline& pipeline);
+		// bind the pipeline and cover invocationCount invocations, or the count behind a sizedDispatch table, with its local size
+		void RecordDispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, uint32_t invocationCount);
+		void RecordDispatchIndirect(VkCommandBuffer commandBuffer, VkPipeline pipeline, VkBuffer buffer, VkDeviceSize sizedDispatchOffset);
+		std::string StorageShader(const char* shaderName, const char* stage = "comp") const;
+		// steps between two rows of the inlet, 0 without an inlet, which also leaves out the sink of integrate.comp
+		uint32_t EmitInterval() const { return settings.inflow ? SPH_INFLOW_INTERVAL : SPH_EMIT_INTERVAL; }
+		// binds the compute descriptor set, and under --device-address pushes the particle state the shaders work on,
+		// particleStateAddresses unless given
+		void BindComputeState(VkCommandBuffer commandBuffer);
+		void BindComputeState(VkCommandBuffer commandBuffer, const ParticleStateAddresses& state);
+		// the particle state laid out like the particle buffer from particleData on, with the mass at massOffset
+		ParticleStateAddresses ParticleStateAt(VkBuffer buffer, VkDeviceSize particleDataOffset, VkDeviceSize massOffset) const;
+		VkDeviceAddress BufferAddress(VkBuffer buffer) const;
+		uint64_t ParticleFieldOffset(ParticleField field, uint32_t i) const;
+		uint32_t GatheredCopyRegions(VkBufferCopy* regions) const;
+		void CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& memory,
+			MemoryPurpose purpose);
+		// a buffer of size bytes does not fit one allocation and is created with VK_BUFFER_CREATE_SPARSE_BINDING_BIT
+		bool ChunkedBuffer(VkDeviceSize size) const { return size > maxAllocationSize; }
+		// allocates and binds the memory of buffer, the first allocation goes to memory. A chunked buffer gets allocations
+		// of at most maxAllocationSize bound through vkQueueBindSparse, the ones after the first are kept in chunkMemoryHandles
+		void AllocateBufferMemory(VkBuffer buffer, VkMemoryPropertyFlags properties, bool addressable, MemoryPurpose purpose, VkDeviceMemory& memory);
+		// vkAllocateMemory and vkFreeMemory, registered with the memory report
+		void AllocateMemory(const VkMemoryAllocateInfo& allocateInfo, MemoryPurpose purpose, VkDeviceMemory& memory);
+		void FreeMemory(VkDeviceMemory memory);
+		VkDeviceSize AlignStorageBufferOffset(VkDeviceSize offset) const;
+		VkCommandBuffer BeginSingleTimeCommands();
+		void EndSingleTimeCommands(VkCommandBuffer commandBuffer);
+		VkQueryPool CreateBenchmarkQueryPool();
+		double MeasureCommands(VkQueryPool queryPool, int iterationCount, const std::function<void(VkCommandBuffer)>& prologue,
+			const std::function<void(VkCommandBuffer)>& record);
+		
+		Settings settings;
+		// host allocations of the driver and the device memory of every buffer, printed by MemoryTracker::Print at
+		// startup, shutdown and with the M key
+		MemoryTracker memoryTracker;
+		const VkAllocationCallbacks* allocator = memoryTracker.Callbacks();
+		std::atomic_bool memoryReportRequested = false;
 		uint32_t findMemoryType(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties);
 		
 		GLFWwindow* window = NULL;
 		uint32_t windowHeight = 1000;
 		uint32_t windowWidth = 1000;
 
-		bool paused = false;
+		std::atomic_bool paused = false;
+		// rendered frames, the completed steps are the value of simulationTimelineHandle
 		std::atomic_uint64_t frameNumber = 1;
 
 		uint32_t graphicsPresentationComputeQueueFamilyIndex = UINT32_MAX;
@@ -80,16 +421,35 @@ namespace SPH
 		VkQueue presentationQueueHandle = VK_NULL_HANDLE;
 		VkQueue graphicsQueueHandle = VK_NULL_HANDLE;
 		VkQueue computeQueueHandle = VK_NULL_HANDLE;
+		// a family of transfer-only queues when the device has one, the uploads share the compute queue otherwise.
+		// The buffers uploads write to are then shared by both families, see CreateBuffer
+		uint32_t transferQueueFamilyIndex = UINT32_MAX;
+		VkQueue transferQueueHandle = VK_NULL_HANDLE;
 
 		VkSurfaceCapabilitiesKHR surfaceCapabilities;
 		VkSurfaceFormatKHR surfaceFormat;
 		std::vector<VkImage> swapchainImageHandles;
-		VkSwapchainKHR swapchainHandle;
+		VkSwapchainKHR swapchainHandle = VK_NULL_HANDLE;
 		std::vector<VkImageView> swapchainImageViewHandles;
 
 		VkRenderPass renderPassHandle = VK_NULL_HANDLE;
 		std::vector<VkFramebuffer> swapchainFrameBufferHandles;
 
+		// --capture renders into this image with a render pass compatible with renderPassHandle, which leaves it ready
+		// for the copy into slot s of the readback buffer. Command buffer s * SPH_CAPTURE_SLOTS + k draws snapshot s
+		// and copies it to slot k, and signals captureTimelineHandle with the number of captured frames
+		VkImage captureImageHandle = VK_NULL_HANDLE;
+		VkDeviceMemory captureImageMemoryHandle = VK_NULL_HANDLE;
+		VkImageView captureImageViewHandle = VK_NULL_HANDLE;
+		VkRenderPass captureRenderPassHandle = VK_NULL_HANDLE;
+		VkFramebuffer captureFramebufferHandle = VK_NULL_HANDLE;
+		VkBuffer captureReadbackBufferHandle = VK_NULL_HANDLE;
+		VkDeviceMemory captureReadbackMemoryHandle = VK_NULL_HANDLE;
+		std::vector<VkCommandBuffer> captureCommandBufferHandles;
+		VkSemaphore captureTimelineHandle = VK_NULL_HANDLE;
+		uint64_t capturedFrameValue = 0;
+		std::unique_ptr<FrameCapture> capture;
+
 		VkInstance instanceHandle = VK_NULL_HANDLE;
 		VkSurfaceKHR surfaceHandle = VK_NULL_HANDLE;
 		VkPhysicalDevice physicalDeviceHandle = VK_NULL_HANDLE;
@@ -97,6 +457,31 @@ namespace SPH
 		VkPhysicalDeviceProperties physicalDeviceProperties;
 		VkPhysicalDeviceFeatures physicalDeviceFeatures;
 		VkPhysicalDeviceMemoryProperties physicalDeviceMemoryProperties;
+		// maxMemoryAllocationSize, lowered to SPH_MAX_ALLOCATION_SIZE when that is set
+		VkDeviceSize maxAllocationSize = UINT64_MAX;
+		// sparseBinding on the compute queue, which binds the chunks of the buffers past maxAllocationSize
+		bool sparseBindingEnabled = false;
+		std::vector<VkDeviceMemory> chunkMemoryHandles;
+		// float atomics on storage buffers, needed by the symmetric force kernel
+		bool atomicFloatSupported = false;
+		// storageBuffer16BitAccess, needed by the fp16 storage shader variants
+		bool halfStorageSupported = false;
+		// velocity, density and pressure are stored as fp16, settings.halfStorage unless the device lacks 16-bit storage
+		bool halfStorage = false;
+		// arrangement of position, velocity, density and pressure in the particle buffer
+		ParticleLayout particleLayout = ParticleLayout::SoA;
+		// the particle state is reached through the addresses in particleStateAddresses, settings.deviceAddress unless
+		// the device lacks bufferDeviceAddress
+		bool deviceAddress = false;
+		ParticleStateAddresses particleStateAddresses{};
+		// the force kernel in use, settings.forceKernel unless the device lacks a feature it needs
+		ForceKernel forceKernel = ForceKernel::Gather;
+
+		// per-device results of an earlier --autotune run, read by the first CreateComputePipelines
+		Tuning tuning;
+		bool tuningLoaded = false;
+		// local size every live compute pipeline was created with
+		std::unordered_map<VkPipeline, uint32_t> pipelineWorkGroupSizes;
 
 		VkPipelineCache globalPipelineCacheHandle = VK_NULL_HANDLE;
 		VkDescriptorPool globalDescriptorPoolHandle = VK_NULL_HANDLE;
@@ -106,19 +491,221 @@ namespace SPH
 		VkPipelineLayout graphicsPipelineLayoutHandle = VK_NULL_HANDLE;
 		VkPipeline graphicsPipelineHandle = VK_NULL_HANDLE;
 		VkCommandPool graphicsCommandPoolHandle = VK_NULL_HANDLE;
+		// --renderer=splat: splat.comp adds the shown snapshot's particles into two fixed point sums per pixel of the
+		// accumulation buffer, which graphicsPipelineHandle then resolves with one full-screen triangle. Set 1 of both
+		// pipeline layouts, splat descriptor set s holds the accumulation buffer and snapshot s's simulation state
+		VkBuffer splatAccumulationBufferHandle = VK_NULL_HANDLE;
+		VkDeviceMemory splatAccumulationMemoryHandle = VK_NULL_HANDLE;
+		VkDescriptorSetLayout splatDescriptorSetLayoutHandle = VK_NULL_HANDLE;
+		VkDescriptorSet splatDescriptorSetHandles[2]{};
+		VkPipelineLayout splatPipelineLayoutHandle = VK_NULL_HANDLE;
+		VkPipeline splatPipelineHandle = VK_NULL_HANDLE;
 
 		VkCommandPool computeCommandPoolHandle = VK_NULL_HANDLE;
 
 		std::vector<VkCommandBuffer> graphicsCommandBufferHandles;
 		VkDescriptorSetLayout computeDescriptorSetLayoutHandle = VK_NULL_HANDLE;
 		VkPipeline computePipelineHandles[3] = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE };
-		// synchronization
-		VkSemaphore imageAvailableSemaphoreHandle = VK_NULL_HANDLE;
-		VkSemaphore renderFinishedSemaphoreHandle = VK_NULL_HANDLE;
+		// morton keys, gather
+		VkPipeline reorderPipelineHandles[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+		// emit particles, compaction flags, indirect arguments update
+		VkPipeline particleCountPipelineHandles[3] = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE };
+		// cell keys, cell ranges
+		VkPipeline gridPipelineHandles[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+		// density and pressure, gather force and symmetric force over the neighbour grid
+		VkPipeline neighbourPipelineHandles[3] = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE };
+		// mark moving tiles, update tile sleep counters, flag active particles, count particle-steps
+		VkPipeline tilePipelineHandles[4] = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE };
+		// drop ghosts, append inbox slots, insert inbox, extract band
+		VkPipeline splitPipelineHandles[4] = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE };
+		// mark, pair and apply the splits and merges of adaptive runs
+		VkPipeline adaptPipelineHandles[3] = { VK_NULL_HANDLE, VK_NULL_HANDLE, VK_NULL_HANDLE };
+		// advance the substep, flag the particles due of block time steps
+		VkPipeline blockPipelineHandles[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+		// scan, radix sort and compaction
+		std::unique_ptr<GpuPrimitives> gpuPrimitives;
+		// staging ring and upload queue of Upload and UploadBoundary
+		std::unique_ptr<UploadManager> uploads;
+		VkBuffer uploadRingBufferHandle = VK_NULL_HANDLE;
+		VkDeviceMemory uploadRingMemoryHandle = VK_NULL_HANDLE;
+		// latency histograms of the window run, see Telemetry
+		std::unique_ptr<Telemetry> telemetry;
+		// cpu and gpu timeline of the window run with --trace, null otherwise
+		std::unique_ptr<Tracer> tracer;
+		// VK_EXT_calibrated_timestamps, a device and a host timestamp sampled together
+		bool calibratedTimestampsSupported = false;
+		PFN_vkGetCalibratedTimestampsEXT vkGetCalibratedTimestamps = nullptr;
+		uint64_t gpuCalibrationTicks = 0;
+		int64_t gpuCalibrationTime = 0;
+		// synchronization, Render waits on a frame's fence only before it reuses the frame's semaphores and queries
+		VkSemaphore imageAvailableSemaphoreHandles[SPH_FRAMES_IN_FLIGHT]{};
+		// timeline semaphore whose value is the number of completed simulation steps
+		VkSemaphore simulationTimelineHandle = VK_NULL_HANDLE;
+		VkSemaphore renderFinishedSemaphoreHandles[SPH_FRAMES_IN_FLIGHT]{};
+		VkFence frameFenceHandles[SPH_FRAMES_IN_FLIGHT]{};
+		uint32_t currentFrame = 0;
+		// the snapshot each frame in flight draws
+		uint32_t frameSnapshots[SPH_FRAMES_IN_FLIGHT]{};
+		// reset and write the render queries of a frame before and after its graphics command buffer, only when tracing
+		VkCommandBuffer renderTimestampCommandBufferHandles[SPH_FRAMES_IN_FLIGHT][2]{};
+		bool frameTimestamped[SPH_FRAMES_IN_FLIGHT]{};
 
 		VkDescriptorSet computeDescriptorSetHandle = VK_NULL_HANDLE;
 		VkPipelineLayout computePipelineLayoutHandle = VK_NULL_HANDLE;
 		VkCommandBuffer computeCommandBufferHandle = VK_NULL_HANDLE;
+		VkCommandBuffer reorderCommandBufferHandle = VK_NULL_HANDLE;
+		VkCommandBuffer emissionCommandBufferHandle = VK_NULL_HANDLE;
+		VkCommandBuffer compactionCommandBufferHandle = VK_NULL_HANDLE;
+		// a split step without and with a compaction in front
+		VkCommandBuffer splitCommandBufferHandles[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+		VkCommandBuffer adaptCommandBufferHandle = VK_NULL_HANDLE;
+
+		// alive count and the indirect dispatch and draw arguments derived from it
+		VkBuffer simulationStateBufferHandle = VK_NULL_HANDLE;
+		VkDeviceMemory simulationStateMemoryHandle = VK_NULL_HANDLE;
+		uint32_t stepsSinceEmission = 0;
+		uint32_t stepsSinceCompaction = 0;
+
+		// first and one past the last sorted index of every grid cell
+		VkBuffer gridBufferHandle = VK_NULL_HANDLE;
+		VkDeviceMemory gridMemoryHandle = VK_NULL_HANDLE;
+		const uint64_t cellStartSsboSize = sizeof(uint32_t) * SPH_GRID_CELL_COUNT;
+		const uint64_t cellEndSsboSize = sizeof(uint32_t) * SPH_GRID_CELL_COUNT;
+		uint64_t cellStartSsboOffset = 0;
+		uint64_t cellEndSsboOffset = 0;
+		uint64_t gridBufferSize = 0;
+
+		// active state, per tile moving flag and sleep counter, per slot active and awake flags and the compacted active index list
+		VkBuffer tileBufferHandle = VK_NULL_HANDLE;
+		VkDeviceMemory tileMemoryHandle = VK_NULL_HANDLE;
+		const uint64_t tileSsboSize = 2 * sizeof(uint32_t) * SPH_TILE_COUNT;
+		const uint64_t activeFlagSsboSize = sizeof(uint32_t) * SPH_PARTICLE_CAPACITY;
+		const uint64_t activeIndexSsboSize = sizeof(uint32_t) * SPH_PARTICLE_CAPACITY;
+		const uint64_t awakeSsboSize = sizeof(uint32_t) * SPH_PARTICLE_CAPACITY;
+		uint64_t activeStateSsboOffset = 0;
+		uint64_t tileSsboOffset = 0;
+		uint64_t activeFlagSsboOffset = 0;
+		uint64_t activeIndexSsboOffset = 0;
+		uint64_t awakeSsboOffset = 0;
+		uint64_t tileBufferSize = 0;
+
+		// split state followed by the halo inbox (cpu to gpu) and outbox (gpu to cpu), persistently mapped
+		VkBuffer splitBufferHandle = VK_NULL_HANDLE;
+		VkDeviceMemory splitMemoryHandle = VK_NULL_HANDLE;
+		const uint64_t haloSsboSize = sizeof(HaloParticle) * SPH_PARTICLE_CAPACITY;
+		uint64_t splitStateSsboOffset = 0;
+		uint64_t splitInboxSsboOffset = 0;
+		uint64_t splitOutboxSsboOffset = 0;
+		uint64_t splitBufferSize = 0;
+		char* splitMapped = nullptr;
+
+		// adapt state followed by the per slot decision and merge partner of adaptive runs
+		VkBuffer adaptBufferHandle = VK_NULL_HANDLE;
+		VkDeviceMemory adaptMemoryHandle = VK_NULL_HANDLE;
+		const uint64_t adaptSsboSize = 2 * sizeof(uint32_t) * SPH_PARTICLE_CAPACITY;
+		uint64_t adaptStateSsboOffset = 0;
+		uint64_t adaptSsboOffset = 0;
+		uint64_t adaptBufferSize = 0;
+		uint32_t stepsSinceAdapt = 0;
+
+		// the simulation thread, the only one to submit to the compute queue while the window is open
+		std::thread simulationThread;
+		std::atomic_bool simulationRunning = false;
+		std::exception_ptr simulationError;
+		// timeline value the last step submission signals, only changed under the upload lock
+		uint64_t submittedStepValue = 0;
+
+		// the renderer draws a copy of the particle data, the mass and the simulation state taken between two steps, so
+		// it never sees a step in progress. The simulation thread fills the snapshot the renderer is not showing when
+		// none is pending, the renderer switches to it at its next frame and waits for its timeline value on the gpu
+		VkBuffer snapshotBufferHandles[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+		VkDeviceMemory snapshotMemoryHandles[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+		// the snapshots are drawn through a descriptor set each, or their addresses under --device-address
+		VkDescriptorSet snapshotDescriptorSetHandles[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+		ParticleStateAddresses snapshotStateAddresses[2]{};
+		VkCommandBuffer snapshotCommandBufferHandles[2] = { VK_NULL_HANDLE, VK_NULL_HANDLE };
+		uint64_t snapshotMassOffset = 0;
+		uint64_t snapshotStateOffset = 0;
+		uint64_t snapshotBufferSize = 0;
+		std::atomic_uint32_t displayedSnapshot = 0;
+		std::atomic_bool snapshotPending = false;
+		std::atomic_uint64_t snapshotValue = 0;
+		uint64_t displayedSnapshotValue = 0;
+		// the snapshot shown before the last switch is handed back to the simulation thread, by clearing snapshotPending,
+		// only once the frames in flight and the captures up to retiredCaptureValue are done drawing it
+		bool snapshotRetiring = false;
+		uint64_t retiredCaptureValue = 0;
+
+		// --export: every settings.exportInterval steps the submission ends with an export command buffer, which copies
+		// the particle data and the simulation state into a slot of the host-visible readback buffer, published once
+		// the timeline passes it. With unified memory (exportZeroCopy) the particle and simulation state buffers are
+		// host-visible themselves, the command buffer only makes the step's writes visible to the host, and the state
+		// is published straight from their mappings before the next step is submitted
+		std::unique_ptr<StateExporter> exporter;
+		bool exportZeroCopy = false;
+		VkBuffer exportReadbackBufferHandle = VK_NULL_HANDLE;
+		VkDeviceMemory exportReadbackMemoryHandle = VK_NULL_HANDLE;
+		const char* exportReadbackMapped = nullptr;
+		const char* exportParticlesMapped = nullptr;
+		const char* exportStateMapped = nullptr;
+		// a slot holds the particle region, the ids at exportIdOffset and the simulation state at exportStateOffset
+		uint64_t exportIdOffset = 0;
+		uint64_t exportStateOffset = 0;
+		uint64_t exportSlotSize = 0;
+		VkCommandBuffer exportCommandBufferHandles[SPH_EXPORT_READBACK_SLOTS]{};
+		uint32_t stepsSinceExport = 0;
+		uint32_t nextExportSlot = 0;
+		// readback slot and timeline value of the exports not published yet, in submission order
+		std::deque<std::pair<uint32_t, uint64_t>> pendingExports;
+		// the alive slots of the export being published
+		std::vector<uint32_t> exportAliveSlots;
+
+		// block state followed by the per slot time-step level of block time steps
+		VkBuffer blockBufferHandle = VK_NULL_HANDLE;
+		VkDeviceMemory blockMemoryHandle = VK_NULL_HANDLE;
+		const uint64_t levelSsboSize = sizeof(uint32_t) * SPH_PARTICLE_CAPACITY;
+		uint64_t blockStateSsboOffset = 0;
+		uint64_t particleLevelSsboOffset = 0;
+		uint64_t blockBufferSize = 0;
+		// blocks submitted so far, for the simulated time of PrintBlockStepReport
+		uint64_t submittedBlocks = 0;
+
+		// the baked walls, texels followed by the wall table like boundary_block of boundary.glsl
+		VkBuffer boundaryBufferHandle = VK_NULL_HANDLE;
+		VkDeviceMemory boundaryMemoryHandle = VK_NULL_HANDLE;
+		const uint64_t boundarySsboSize = sizeof(glm::vec4) * SPH_BOUNDARY_RESOLUTION * SPH_BOUNDARY_RESOLUTION + sizeof(glm::vec2) * SPH_BOUNDARY_TABLE_SIZE;
+
+		// reorder scratch: sort keys and values, followed by the gathered particle state
+		VkBuffer reorderBufferHandle = VK_NULL_HANDLE;
+		VkDeviceMemory reorderMemoryHandle = VK_NULL_HANDLE;
+
+		// queries 0 and 1 bracket a simulation step, 2 and 3 a reorder pass, 4 to 7 end the grid, density, force and
+		// integrate passes of the step's first substep, the next two per frame in flight bracket its render pass and
+		// SPH_CALIBRATION_QUERY calibrates the tracer
+		VkQueryPool timestampQueryPoolHandle = VK_NULL_HANDLE;
+		bool timestampsSupported = false;
+		uint32_t stepsSinceReorder = 0;
+		// every submission in flight copies its step queries into a readback slot of its own, so that the next
+		// submission can reset them while CollectStepTimestamps reads the slots the timeline has passed
+		struct PendingTimestamps
+		{
+			uint32_t slot;
+			uint64_t timelineValue;
+			uint32_t stepsSinceReorder;
+			bool reorder;
+		};
+		VkBuffer timestampReadbackBufferHandle = VK_NULL_HANDLE;
+		VkDeviceMemory timestampReadbackMemoryHandle = VK_NULL_HANDLE;
+		const uint64_t* timestampReadbackMapped = nullptr;
+		// indexed by slot and whether the submission has a reorder pass
+		VkCommandBuffer timestampCopyCommandBufferHandles[SPH_SUBMISSIONS_IN_FLIGHT][2]{};
+		std::deque<PendingTimestamps> pendingTimestamps;
+		uint32_t nextTimestampSlot = 0;
+		// accumulated gpu time in ms, indexed by steps since the last reorder
+		std::vector<double> stepTimeSums = std::vector<double>(SPH_REORDER_INTERVAL > 0 ? SPH_REORDER_INTERVAL : 1, 0.0);
+		std::vector<uint64_t> stepTimeCounts = std::vector<uint64_t>(SPH_REORDER_INTERVAL > 0 ? SPH_REORDER_INTERVAL : 1, 0);
+		double reorderTimeSum = 0.0;
+		uint64_t reorderTimeCount = 0;
 
 		VkSubmitInfo computeSubmitInfo
 		{
@@ -135,17 +722,18 @@ namespace SPH
 
 		uint32_t imageIndex;
 		VkPipelineStageFlags wait_dst_stage_mask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		// the semaphores are the current frame's, see Render
 		VkSubmitInfo graphicsSubmitInfo
 		{
 			VK_STRUCTURE_TYPE_SUBMIT_INFO,
 			NULL,
 			1,
-			&imageAvailableSemaphoreHandle,
+			&imageAvailableSemaphoreHandles[0],
 			&wait_dst_stage_mask,
 			1,
 			VK_NULL_HANDLE,
 			1,
-			& renderFinishedSemaphoreHandle
+			&renderFinishedSemaphoreHandles[0]
 		};
 
 		VkPresentInfoKHR presentInfo
@@ -153,7 +741,7 @@ namespace SPH
 			VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
 			NULL,
 			1,
-			& renderFinishedSemaphoreHandle,
+			&renderFinishedSemaphoreHandles[0],
 			1,
 			&swapchainHandle,
 			&imageIndex,
@@ -161,19 +749,66 @@ namespace SPH
 		};
 
 		// ssbo sizes
-		const uint64_t positionSsboSize = sizeof(glm::vec2) * SPH_NUM_PARTICLES;
-		const uint64_t velocitySsboSize = sizeof(glm::vec2) * SPH_NUM_PARTICLES;
-		const uint64_t forceSsboSize = sizeof(glm::vec2) * SPH_NUM_PARTICLES;
-		const uint64_t densitySsboSize = sizeof(float) * SPH_NUM_PARTICLES;
-		const uint64_t pressureSsboSize = sizeof(float) * SPH_NUM_PARTICLES;
-
-		const uint64_t packedBufferSize = positionSsboSize + velocitySsboSize + forceSsboSize + densitySsboSize + pressureSsboSize;
-		// ssbo offsets
+		const uint64_t positionSsboSize = sizeof(glm::vec2) * SPH_PARTICLE_CAPACITY;
+		const uint64_t velocitySsboSize = sizeof(glm::vec2) * SPH_PARTICLE_CAPACITY;
+		const uint64_t forceSsboSize = sizeof(glm::vec2) * SPH_PARTICLE_CAPACITY;
+		const uint64_t densitySsboSize = sizeof(float) * SPH_PARTICLE_CAPACITY;
+		const uint64_t pressureSsboSize = sizeof(float) * SPH_PARTICLE_CAPACITY;
+		// unique id of the particle now stored in each slot, SPH_DEAD_PARTICLE once the sink removed it
+		const uint64_t particleIdSsboSize = sizeof(uint32_t) * SPH_PARTICLE_CAPACITY;
+		// SPH_PARTICLE_MASS in every slot unless the run is adaptive
+		const uint64_t massSsboSize = sizeof(float) * SPH_PARTICLE_CAPACITY;
+
+		// position, velocity, density and pressure in the selected layout, sized for fp32 SoA whatever the layout
+		const uint64_t particleDataSize = SPH_PARTICLE_DATA_STRIDE * SPH_PARTICLE_CAPACITY;
+		static_assert(SPH_PARTICLE_DATA_STRIDE == 2 * sizeof(glm::vec2) + 2 * sizeof(float), "the particle data must hold the fp32 SoA regions");
+
+		const uint64_t packedBufferSize = particleDataSize + forceSsboSize + particleIdSsboSize + massSsboSize;
+		// ssbo offsets, the SoA regions of the particle data first, see ParticleSoaOffset
 		const uint64_t positionSsboOffset = 0;
-		const uint64_t velocitySsboOffset = positionSsboSize;
-		const uint64_t forceSsboOffset = velocitySsboOffset + velocitySsboSize;
-		const uint64_t densitySsboOffset = forceSsboOffset + forceSsboSize;
+		const uint64_t velocitySsboOffset = positionSsboOffset + positionSsboSize;
+		const uint64_t densitySsboOffset = velocitySsboOffset + velocitySsboSize;
 		const uint64_t pressureSsboOffset = densitySsboOffset + densitySsboSize;
-		
+		const uint64_t forceSsboOffset = pressureSsboOffset + pressureSsboSize;
+		const uint64_t particleIdSsboOffset = forceSsboOffset + forceSsboSize;
+		const uint64_t massSsboOffset = particleIdSsboOffset + particleIdSsboSize;
+
+		// reorder scratch sizes, the compaction reuses the keys for its flags and the values for the kept indices
+		const uint64_t sortKeySsboSize = sizeof(uint32_t) * SPH_PARTICLE_CAPACITY;
+		const uint64_t sortValueSsboSize = sizeof(uint32_t) * SPH_PARTICLE_CAPACITY;
+		uint64_t sortScratchSize = 0;
+		uint64_t reorderBufferSize = 0;
+		// the buffer ranges the passes of the step declare, set by CreateBuffers
+		struct StepRanges
+		{
+			VkDescriptorBufferInfo particleData;
+			VkDescriptorBufferInfo force;
+			VkDescriptorBufferInfo particleId;
+			VkDescriptorBufferInfo mass;
+			VkDescriptorBufferInfo sortKeys;
+			VkDescriptorBufferInfo sortValues;
+			VkDescriptorBufferInfo sortScratch;
+			VkDescriptorBufferInfo grid;
+			VkDescriptorBufferInfo simulationState;
+			VkDescriptorBufferInfo activeState;
+			VkDescriptorBufferInfo compactResult;
+			VkDescriptorBufferInfo activeIndex;
+			VkDescriptorBufferInfo tiles;
+			VkDescriptorBufferInfo activeFlags;
+			VkDescriptorBufferInfo awake;
+			VkDescriptorBufferInfo boundary;
+			VkDescriptorBufferInfo blockState;
+			VkDescriptorBufferInfo particleLevels;
+		} stepRanges{};
+		// reorder scratch offsets, aligned to minStorageBufferOffsetAlignment in CreateBuffers
+		uint64_t sortKeySsboOffset = 0;
+		uint64_t sortValueSsboOffset = 0;
+		// the gathered particle data in the same layout, its SoA position and velocity regions in the same place
+		uint64_t sortedParticleDataSsboOffset = 0;
+		uint64_t sortedVelocitySsboOffset = 0;
+		uint64_t sortedParticleIdSsboOffset = 0;
+		uint64_t sortedMassSsboOffset = 0;
+		uint64_t sortScratchOffset = 0;
+
 	};
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "application.h"
+#include "vkcsy.h"
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace SPH
+{
+	void Application::Autotune()
+	{
+		// let the dam break for a while so that the neighbourhoods are representative
+		const uint32_t warmupStepCount = 1000;
+		const int iterationCount = 20;
+		VkMemoryBarrier computeToComputeBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+
+		Upload(InitialDamBreak());
+		Step(warmupStepCount);
+		ParticleState settledState;
+		Download(settledState);
+
+		std::vector<uint32_t> candidates;
+		const uint32_t maxWorkGroupSize = std::min(physicalDeviceProperties.limits.maxComputeWorkGroupSize[0], physicalDeviceProperties.limits.maxComputeWorkGroupInvocations);
+		for (uint32_t k = 0; k < SPH_WORK_GROUP_SIZE_COUNT && (SPH_MIN_WORK_GROUP_SIZE << k) <= maxWorkGroupSize; k++)
+		{
+			candidates.push_back(SPH_MIN_WORK_GROUP_SIZE << k);
+		}
+
+		// every pass with a specialized local size and how it is dispatched. The split passes only have work during a
+		// split run and keep the default, emission, the indirect update and the tile counters run a single fixed group
+		struct TunedPass
+		{
+			std::string shaderFileName;
+			std::function<void(VkCommandBuffer, VkPipeline)> record;
+		};
+		auto overCapacity = [&](VkCommandBuffer commandBufferHandle, VkPipeline pipeline)
+		{
+			RecordDispatch(commandBufferHandle, pipeline, SPH_PARTICLE_CAPACITY);
+		};
+		auto overAlive = [&](VkCommandBuffer commandBufferHandle, VkPipeline pipeline)
+		{
+			RecordDispatchIndirect(commandBufferHandle, pipeline, simulationStateBufferHandle, offsetof(SimulationState, sizedDispatch));
+		};
+		auto overActive = [&](VkCommandBuffer commandBufferHandle, VkPipeline pipeline)
+		{
+			RecordDispatchIndirect(commandBufferHandle, pipeline, tileBufferHandle, activeStateSsboOffset + offsetof(ActiveState, sizedDispatch));
+		};
+		auto overTiles = [&](VkCommandBuffer commandBufferHandle, VkPipeline pipeline)
+		{
+			RecordDispatch(commandBufferHandle, pipeline, SPH_TILE_COUNT);
+		};
+		std::vector<TunedPass> passes
+		{
+			{ StorageShader("grid_hash"), overCapacity },
+			{ "grid_cell_range.comp.spv", overAlive },
+			{ StorageShader("compute_density_pressure"), overActive },
+			{ StorageShader("compute_density_pressure_grid"), overActive },
+			{ StorageShader("compute_force"), overActive },
+			{ StorageShader("compute_force_grid"), overActive },
+			{ StorageShader("integrate"), overActive },
+			{ StorageShader("reorder_morton"), overCapacity },
+			{ StorageShader("reorder_gather"), overAlive },
+			{ "compact_flags.comp.spv", overCapacity },
+			{ StorageShader("tile_mark"), overAlive },
+			{ "tile_update.comp.spv", overTiles },
+			{ StorageShader("active_flags"), overCapacity }
+		};
+		if (atomicFloatSupported)
+		{
+			passes.push_back({ StorageShader("compute_force_symmetric"), overAlive });
+		}
+
+		VkQueryPool queryPoolHandle = CreateBenchmarkQueryPool();
+		std::cout << "[INFO] autotuning on " << physicalDeviceProperties.deviceName << " (" << (halfStorage ? "fp16" : "fp32") << " storage, "
+			<< Settings::ParticleLayoutName(particleLayout) << " layout), " << settledState.Size() << " particles after " << warmupStepCount
+			<< " steps, best of " << iterationCount << " runs per local size:" << std::endl;
+		Tuning tuned;
+		for (const TunedPass& pass : passes)
+		{
+			const std::string passName = pass.shaderFileName.substr(0, pass.shaderFileName.find('.'));
+			// every pass starts from the settled scene and a fresh neighbour grid, integrate moves the particles with every run
+			Upload(settledState);
+			Step(1);
+			uint32_t bestSize = SPH_WORK_GROUP_SIZE;
+			double bestTime = std::numeric_limits<double>::max();
+			std::cout << "[INFO]     " << passName << ":";
+			for (uint32_t workGroupSize : candidates)
+			{
+				VkPipeline pipeline = CreateComputePipeline(pass.shaderFileName.c_str(), workGroupSize);
+				const double time = MeasureCommands(queryPoolHandle, iterationCount, nullptr, [&](VkCommandBuffer commandBufferHandle)
+				{
+					BindComputeState(commandBufferHandle);
+					pass.record(commandBufferHandle, pipeline);
+					vkCmdPipelineBarrier(commandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+				});
+				DestroyComputePipeline(pipeline);
+				std::cout << " " << workGroupSize << ": " << time << " ms";
+				if (time < bestTime)
+				{
+					bestTime = time;
+					bestSize = workGroupSize;
+				}
+			}
+			std::cout << ", best " << bestSize << std::endl;
+			tuned.workGroupSizes[passName] = bestSize;
+		}
+
+		// the force kernels differ in what runs around the force pass, so they are timed as whole steps with the tuned sizes
+		tuning = tuned;
+		RecreatePipelines();
+		std::vector<ForceKernel> kernels{ ForceKernel::BruteForce, ForceKernel::Gather };
+		if (atomicFloatSupported)
+		{
+			kernels.push_back(ForceKernel::Symmetric);
+		}
+		double bestTime = std::numeric_limits<double>::max();
+		for (ForceKernel kernel : kernels)
+		{
+			Upload(settledState);
+			Step(1);
+			const double time = MeasureCommands(queryPoolHandle, iterationCount, nullptr, [&](VkCommandBuffer commandBufferHandle)
+			{
+				RecordSimulationStep(commandBufferHandle, kernel);
+			});
+			std::cout << "[INFO]     step with the " << Settings::ForceKernelName(kernel) << " force kernel: " << time << " ms" << std::endl;
+			if (time < bestTime)
+			{
+				bestTime = time;
+				tuned.forceKernel = kernel;
+			}
+		}
+		tuned.hasForceKernel = true;
+		std::cout << "[INFO]     best force kernel " << Settings::ForceKernelName(tuned.forceKernel) << std::endl;
+
+		if (queryPoolHandle != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(logicalDeviceHandle, queryPoolHandle, allocator);
+		}
+		tuning = tuned;
+		tuning.Save(physicalDeviceProperties);
+	}
+}
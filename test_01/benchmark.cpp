@@ -0,0 +1,659 @@
+#include "application.h"
+#include "vkcsy.h"
+#include "cpu_solver.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace SPH
+{
+	VkQueryPool Application::CreateBenchmarkQueryPool()
+	{
+		uint32_t timestampValidBits = CsySmallVk::Query::physicalDeviceQueueFamilyProperties(physicalDeviceHandle)[graphicsPresentationComputeQueueFamilyIndex].timestampValidBits;
+		if (timestampValidBits == 0)
+		{
+			std::cout << "[INFO] no timestamp support, timing whole submissions on the host" << std::endl;
+			return VK_NULL_HANDLE;
+		}
+		VkQueryPoolCreateInfo createInfo
+		{
+			VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			NULL,
+			0,
+			VK_QUERY_TYPE_TIMESTAMP,
+			2,
+			0
+		};
+		VkQueryPool queryPoolHandle = VK_NULL_HANDLE;
+		if (vkCreateQueryPool(logicalDeviceHandle, &createInfo, allocator, &queryPoolHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("timestamp query pool creation failed");
+		}
+		return queryPoolHandle;
+	}
+
+	double Application::MeasureCommands(VkQueryPool queryPool, int iterationCount, const std::function<void(VkCommandBuffer)>& prologue,
+		const std::function<void(VkCommandBuffer)>& record)
+	{
+		// best time in ms of iterationCount runs, prologue is recorded outside the timed range
+		double bestTime = 0.0;
+		for (int iteration = 0; iteration < iterationCount; iteration++)
+		{
+			VkCommandBuffer commandBufferHandle = BeginSingleTimeCommands();
+			if (prologue)
+			{
+				prologue(commandBufferHandle);
+			}
+			if (queryPool != VK_NULL_HANDLE)
+			{
+				vkCmdResetQueryPool(commandBufferHandle, queryPool, 0, 2);
+				vkCmdWriteTimestamp(commandBufferHandle, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+			}
+			record(commandBufferHandle);
+			if (queryPool != VK_NULL_HANDLE)
+			{
+				vkCmdWriteTimestamp(commandBufferHandle, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+			}
+			auto start = std::chrono::high_resolution_clock::now();
+			EndSingleTimeCommands(commandBufferHandle);
+			double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+			if (queryPool != VK_NULL_HANDLE)
+			{
+				uint64_t timestamps[2];
+				if (vkGetQueryPoolResults(logicalDeviceHandle, queryPool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t),
+					VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) != VK_SUCCESS)
+				{
+					throw std::runtime_error("timestamp query failed");
+				}
+				time = 1e-6 * physicalDeviceProperties.limits.timestampPeriod * (timestamps[1] - timestamps[0]);
+			}
+			if (iteration == 0 || time < bestTime)
+			{
+				bestTime = time;
+			}
+		}
+		return bestTime;
+	}
+
+	void Application::BenchmarkPrimitives()
+	{
+		const uint32_t elementCounts[] = { 1u << 16, 1u << 20, 1u << 22 };
+		const uint32_t maxCount = 1u << 22;
+		const int iterationCount = 10;
+		const VkDeviceSize elementsSize = sizeof(uint32_t) * maxCount;
+
+		// every size works on the same buffers, the primitives cache one descriptor set per range
+		VkBuffer inputBufferHandle, valueBufferHandle, outputBufferHandle, resultBufferHandle, scratchBufferHandle, stagingBufferHandle;
+		VkDeviceMemory inputMemoryHandle, valueMemoryHandle, outputMemoryHandle, resultMemoryHandle, scratchMemoryHandle, stagingMemoryHandle;
+		const VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		const VkDeviceSize scratchSize = std::max({ gpuPrimitives->ScanScratchSize(maxCount), gpuPrimitives->SortScratchSize(maxCount),
+			gpuPrimitives->CompactScratchSize(maxCount) });
+		CreateBuffer(elementsSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, inputBufferHandle, inputMemoryHandle, MemoryPurpose::Benchmark);
+		CreateBuffer(elementsSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, valueBufferHandle, valueMemoryHandle, MemoryPurpose::Benchmark);
+		CreateBuffer(elementsSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, outputBufferHandle, outputMemoryHandle, MemoryPurpose::Benchmark);
+		CreateBuffer(sizeof(CompactResult), usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, resultBufferHandle, resultMemoryHandle, MemoryPurpose::Benchmark);
+		CreateBuffer(scratchSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, scratchBufferHandle, scratchMemoryHandle, MemoryPurpose::Benchmark);
+		CreateBuffer(2 * elementsSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBufferHandle, stagingMemoryHandle, MemoryPurpose::Staging);
+		uint32_t* staging = nullptr;
+		vkMapMemory(logicalDeviceHandle, stagingMemoryHandle, 0, 2 * elementsSize, 0, reinterpret_cast<void**>(&staging));
+
+		VkQueryPool queryPoolHandle = CreateBenchmarkQueryPool();
+
+		VkMemoryBarrier transferToComputeBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+
+		auto upload = [&](VkBuffer dst, VkDeviceSize stagingOffset, VkDeviceSize size)
+		{
+			VkCommandBuffer commandBufferHandle = BeginSingleTimeCommands();
+			VkBufferCopy region{ stagingOffset, 0, size };
+			vkCmdCopyBuffer(commandBufferHandle, stagingBufferHandle, dst, 1, &region);
+			EndSingleTimeCommands(commandBufferHandle);
+		};
+		auto download = [&](VkBuffer src, VkDeviceSize stagingOffset, VkDeviceSize size)
+		{
+			VkCommandBuffer commandBufferHandle = BeginSingleTimeCommands();
+			VkBufferCopy region{ 0, stagingOffset, size };
+			vkCmdCopyBuffer(commandBufferHandle, src, stagingBufferHandle, 1, &region);
+			EndSingleTimeCommands(commandBufferHandle);
+		};
+		auto measure = [&](const std::function<void(VkCommandBuffer)>& prologue, const std::function<void(VkCommandBuffer)>& record)
+		{
+			return MeasureCommands(queryPoolHandle, iterationCount, prologue, record);
+		};
+		auto report = [](const char* name, uint32_t count, double time, double bytes, bool passed)
+		{
+			std::cout << "[INFO] " << name << " " << count << " elements: " << time << " ms, "
+				<< bytes / (time * 1e6) << " GB/s, " << count / (time * 1e3) << " Mkeys/s, "
+				<< (passed ? "verified" : "MISMATCH") << std::endl;
+		};
+
+		std::mt19937 random(1234);
+		bool allPassed = true;
+		for (uint32_t count : elementCounts)
+		{
+			const VkDeviceSize size = sizeof(uint32_t) * count;
+			const VkDescriptorBufferInfo input{ inputBufferHandle, 0, size };
+			const VkDescriptorBufferInfo values{ valueBufferHandle, 0, size };
+			const VkDescriptorBufferInfo output{ outputBufferHandle, 0, size };
+			const VkDescriptorBufferInfo result{ resultBufferHandle, 0, sizeof(CompactResult) };
+
+			// exclusive scan, reads and writes every element once
+			{
+				std::vector<uint32_t> data(count);
+				std::uniform_int_distribution<uint32_t> distribution(0, 255);
+				std::generate(data.begin(), data.end(), [&]() { return distribution(random); });
+				std::memcpy(staging, data.data(), size);
+				upload(inputBufferHandle, 0, size);
+
+				const VkDescriptorBufferInfo scratch{ scratchBufferHandle, 0, gpuPrimitives->ScanScratchSize(count) };
+				double time = measure(nullptr, [&](VkCommandBuffer commandBufferHandle)
+				{
+					gpuPrimitives->RecordExclusiveScan(commandBufferHandle, input, output, count, scratch);
+				});
+				download(outputBufferHandle, 0, size);
+
+				std::vector<uint32_t> expected(count);
+				std::exclusive_scan(data.begin(), data.end(), expected.begin(), 0u);
+				bool passed = std::memcmp(staging, expected.data(), size) == 0;
+				allPassed = allPassed && passed;
+				report("scan   ", count, time, 2.0 * size, passed);
+			}
+
+			// key/value radix sort, restored from staging before every run since it sorts in place
+			{
+				std::vector<std::pair<uint32_t, uint32_t>> pairs(count);
+				for (uint32_t i = 0; i < count; i++)
+				{
+					pairs[i] = { random(), i };
+					staging[i] = pairs[i].first;
+					staging[count + i] = i;
+				}
+
+				const VkDescriptorBufferInfo scratch{ scratchBufferHandle, 0, gpuPrimitives->SortScratchSize(count) };
+				double time = measure([&](VkCommandBuffer commandBufferHandle)
+				{
+					VkBufferCopy keyRegion{ 0, 0, size };
+					VkBufferCopy valueRegion{ size, 0, size };
+					vkCmdCopyBuffer(commandBufferHandle, stagingBufferHandle, inputBufferHandle, 1, &keyRegion);
+					vkCmdCopyBuffer(commandBufferHandle, stagingBufferHandle, valueBufferHandle, 1, &valueRegion);
+					vkCmdPipelineBarrier(commandBufferHandle, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &transferToComputeBarrier, 0, NULL, 0, NULL);
+				}, [&](VkCommandBuffer commandBufferHandle)
+				{
+					gpuPrimitives->RecordSort(commandBufferHandle, input, values, count, scratch);
+				});
+				download(inputBufferHandle, 0, size);
+				download(valueBufferHandle, size, size);
+
+				std::stable_sort(pairs.begin(), pairs.end(), [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b)
+				{
+					return a.first < b.first;
+				});
+				bool passed = true;
+				for (uint32_t i = 0; i < count && passed; i++)
+				{
+					passed = staging[i] == pairs[i].first && staging[count + i] == pairs[i].second;
+				}
+				allPassed = allPassed && passed;
+				// every pass reads and writes keys and values, 8 passes for 32-bit keys
+				report("sort   ", count, time, 8 * 4.0 * size, passed);
+			}
+
+			// compaction of the indices of about half of the elements
+			{
+				std::vector<uint32_t> flags(count);
+				std::bernoulli_distribution distribution(0.5);
+				std::generate(flags.begin(), flags.end(), [&]() { return distribution(random) ? 1u : 0u; });
+				std::memcpy(staging, flags.data(), size);
+				upload(inputBufferHandle, 0, size);
+
+				const VkDescriptorBufferInfo scratch{ scratchBufferHandle, 0, gpuPrimitives->CompactScratchSize(count) };
+				double time = measure(nullptr, [&](VkCommandBuffer commandBufferHandle)
+				{
+					gpuPrimitives->RecordCompact(commandBufferHandle, input, { VK_NULL_HANDLE, 0, 0 }, output, result, count, SPH_WORK_GROUP_SIZE, scratch);
+				});
+				download(outputBufferHandle, 0, size);
+				std::vector<uint32_t> kept(staging, staging + count);
+				download(resultBufferHandle, 0, sizeof(CompactResult));
+				CompactResult compactResult;
+				std::memcpy(&compactResult, staging, sizeof(CompactResult));
+
+				std::vector<uint32_t> expected;
+				for (uint32_t i = 0; i < count; i++)
+				{
+					if (flags[i])
+					{
+						expected.push_back(i);
+					}
+				}
+				const uint32_t expectedCount = static_cast<uint32_t>(expected.size());
+				bool passed = compactResult.count == expectedCount
+					&& compactResult.dispatch.x == DispatchSize((expectedCount + SPH_WORK_GROUP_SIZE - 1) / SPH_WORK_GROUP_SIZE).x
+					&& std::equal(expected.begin(), expected.end(), kept.begin());
+				allPassed = allPassed && passed;
+				// flags are read once, the kept indices written once
+				report("compact", count, time, size + sizeof(uint32_t) * static_cast<double>(expectedCount), passed);
+			}
+		}
+		std::cout << "[INFO] gpu primitives " << (allPassed ? "passed" : "FAILED") << " verification" << std::endl;
+
+		vkUnmapMemory(logicalDeviceHandle, stagingMemoryHandle);
+		if (queryPoolHandle != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(logicalDeviceHandle, queryPoolHandle, allocator);
+		}
+		VkBuffer bufferHandles[] = { inputBufferHandle, valueBufferHandle, outputBufferHandle, resultBufferHandle, scratchBufferHandle, stagingBufferHandle };
+		VkDeviceMemory memoryHandles[] = { inputMemoryHandle, valueMemoryHandle, outputMemoryHandle, resultMemoryHandle, scratchMemoryHandle, stagingMemoryHandle };
+		for (int i = 0; i < 6; i++)
+		{
+			vkDestroyBuffer(logicalDeviceHandle, bufferHandles[i], allocator);
+			FreeMemory(memoryHandles[i]);
+		}
+	}
+
+	void Application::BenchmarkForceKernels()
+	{
+		// let the dam break for a while so that the particle distribution is representative
+		const uint32_t warmupStepCount = 2000;
+		const int iterationCount = 20;
+		for (uint32_t step = 0; step < warmupStepCount; step++)
+		{
+			RunSimulation();
+		}
+		vkQueueWaitIdle(computeQueueHandle);
+
+		VkMemoryBarrier computeToComputeBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+		VkMemoryBarrier computeToTransferBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_TRANSFER_READ_BIT
+		};
+
+		// every kernel runs on the same grid and densities
+		VkCommandBuffer setupCommandBufferHandle = BeginSingleTimeCommands();
+		RecordNeighbourGrid(setupCommandBufferHandle);
+		BindComputeState(setupCommandBufferHandle);
+		RecordDispatchIndirect(setupCommandBufferHandle, neighbourPipelineHandles[0], simulationStateBufferHandle, offsetof(SimulationState, sizedDispatch));
+		vkCmdPipelineBarrier(setupCommandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+		EndSingleTimeCommands(setupCommandBufferHandle);
+
+		// forces, particle ids and the simulation state are read back to compare the kernels
+		VkBuffer stagingBufferHandle;
+		VkDeviceMemory stagingMemoryHandle;
+		const VkDeviceSize stagingSize = forceSsboSize + particleIdSsboSize + sizeof(SimulationState);
+		CreateBuffer(stagingSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+			stagingBufferHandle, stagingMemoryHandle, MemoryPurpose::Staging);
+		char* staging = nullptr;
+		vkMapMemory(logicalDeviceHandle, stagingMemoryHandle, 0, stagingSize, 0, reinterpret_cast<void**>(&staging));
+		auto readBack = [&]()
+		{
+			VkCommandBuffer commandBufferHandle = BeginSingleTimeCommands();
+			vkCmdPipelineBarrier(commandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &computeToTransferBarrier, 0, NULL, 0, NULL);
+			VkBufferCopy particleRegions[2]
+			{
+				{ forceSsboOffset, 0, forceSsboSize },
+				{ particleIdSsboOffset, forceSsboSize, particleIdSsboSize }
+			};
+			vkCmdCopyBuffer(commandBufferHandle, packedParticlesBufferHandle, stagingBufferHandle, 2, particleRegions);
+			VkBufferCopy stateRegion{ 0, forceSsboSize + particleIdSsboSize, sizeof(SimulationState) };
+			vkCmdCopyBuffer(commandBufferHandle, simulationStateBufferHandle, stagingBufferHandle, 1, &stateRegion);
+			EndSingleTimeCommands(commandBufferHandle);
+		};
+
+		std::vector<ForceKernel> kernels{ ForceKernel::BruteForce, ForceKernel::Gather };
+		if (atomicFloatSupported)
+		{
+			kernels.push_back(ForceKernel::Symmetric);
+		}
+		else
+		{
+			std::cout << "[INFO] shaderBufferFloat32AtomicAdd is not supported, skipping the symmetric force kernel" << std::endl;
+		}
+
+		VkQueryPool queryPoolHandle = CreateBenchmarkQueryPool();
+		std::cout << "[INFO] force kernels on " << physicalDeviceProperties.deviceName << ", best of " << iterationCount << " runs:" << std::endl;
+		std::vector<glm::vec2> gatherForces;
+		for (ForceKernel kernel : kernels)
+		{
+			double time = MeasureCommands(queryPoolHandle, iterationCount, nullptr, [&](VkCommandBuffer commandBufferHandle)
+			{
+				BindComputeState(commandBufferHandle);
+				RecordForcePass(commandBufferHandle, kernel);
+			});
+			readBack();
+
+			SimulationState state;
+			std::memcpy(&state, staging + forceSsboSize + particleIdSsboSize, sizeof(state));
+			const glm::vec2* forces = reinterpret_cast<const glm::vec2*>(staging);
+			const uint32_t* particleIds = reinterpret_cast<const uint32_t*>(staging + forceSsboSize);
+			std::cout << "[INFO]     " << Settings::ForceKernelName(kernel) << ": " << time << " ms, "
+				<< state.aliveCount / (time * 1e3) << " Mparticles/s";
+			if (kernel == ForceKernel::Gather)
+			{
+				gatherForces.assign(forces, forces + state.aliveCount);
+			}
+			else if (!gatherForces.empty())
+			{
+				// largest difference to the gather kernel, relative to the largest force
+				float maxDifference = 0.f;
+				float maxForce = 0.f;
+				for (uint32_t i = 0; i < state.aliveCount; i++)
+				{
+					if (particleIds[i] != SPH_DEAD_PARTICLE)
+					{
+						maxDifference = std::max(maxDifference, glm::length(forces[i] - gatherForces[i]));
+						maxForce = std::max(maxForce, glm::length(gatherForces[i]));
+					}
+				}
+				std::cout << ", max deviation from gather: " << (maxForce > 0.f ? maxDifference / maxForce : 0.f);
+			}
+			std::cout << std::endl;
+		}
+
+		vkUnmapMemory(logicalDeviceHandle, stagingMemoryHandle);
+		if (queryPoolHandle != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(logicalDeviceHandle, queryPoolHandle, allocator);
+		}
+		vkDestroyBuffer(logicalDeviceHandle, stagingBufferHandle, allocator);
+		FreeMemory(stagingMemoryHandle);
+	}
+	void Application::CompareWithCpu()
+	{
+		CpuSolver cpuSolver(settings.threadCount);
+		const ParticleState initialState = InitialDamBreak();
+		Upload(initialState);
+		cpuSolver.Upload(initialState);
+		std::cout << "[INFO] " << Name() << " (" << Settings::ForceKernelName(forceKernel) << " force kernel) against " << cpuSolver.Name() << ":" << std::endl;
+
+		// neither backend moves particles between slots during a step, so slot i is the same particle on both. The
+		// first step compares the passes themselves, later ones how fast rounding differences grow in the flow
+		uint32_t stepsDone = 0;
+		for (uint32_t checkpoint : { 1u, 10u, 100u, 1000u })
+		{
+			Step(checkpoint - stepsDone);
+			cpuSolver.Step(checkpoint - stepsDone);
+			stepsDone = checkpoint;
+			ParticleState gpuState;
+			ParticleState cpuState;
+			Download(gpuState);
+			cpuSolver.Download(cpuState);
+			if (gpuState.Size() != cpuState.Size())
+			{
+				throw std::runtime_error("the backends disagree on the particle count");
+			}
+
+			uint32_t comparedCount = 0;
+			uint32_t idMismatchCount = 0;
+			double maxPositionError = 0.0;
+			double positionErrorSquareSum = 0.0;
+			double maxVelocityError = 0.0;
+			double maxDensityError = 0.0;
+			for (size_t i = 0; i < gpuState.Size(); i++)
+			{
+				if (gpuState.id[i] != cpuState.id[i])
+				{
+					idMismatchCount++;
+					continue;
+				}
+				if (gpuState.id[i] == SPH_DEAD_PARTICLE)
+				{
+					continue;
+				}
+				const double positionError = glm::length(gpuState.position[i] - cpuState.position[i]);
+				maxPositionError = std::max(maxPositionError, positionError);
+				positionErrorSquareSum += positionError * positionError;
+				maxVelocityError = std::max(maxVelocityError, double(glm::length(gpuState.velocity[i] - cpuState.velocity[i])));
+				maxDensityError = std::max(maxDensityError, std::abs(double(gpuState.density[i]) - cpuState.density[i]) / SPH_RESTING_DENSITY);
+				comparedCount++;
+			}
+			std::cout << "[INFO]     step " << checkpoint << ": position max " << maxPositionError << " rms "
+				<< std::sqrt(positionErrorSquareSum / std::max(comparedCount, 1u)) << " (particle radius " << SPH_PARTICLE_RADIUS << "), velocity max "
+				<< maxVelocityError << ", density max " << 100.0 * maxDensityError << "% of the resting density";
+			if (idMismatchCount > 0)
+			{
+				std::cout << ", " << idMismatchCount << " particles removed by only one backend";
+			}
+			std::cout << std::endl;
+		}
+	}
+
+	void Application::BenchmarkStorage()
+	{
+		const bool originalHalfStorage = halfStorage;
+		const uint32_t checkpoints[]{ 1u, 10u, 100u, 1000u };
+		const uint32_t timedStepCount = 500;
+		const ParticleState initialState = InitialDamBreak();
+
+		std::vector<bool> modes{ false };
+		if (halfStorageSupported)
+		{
+			modes.push_back(true);
+		}
+		else
+		{
+			std::cout << "[INFO] storageBuffer16BitAccess is not supported, timing fp32 storage only" << std::endl;
+		}
+
+		// both modes run the same steps from the same state, the fp32 snapshots are the reference
+		std::vector<ParticleState> referenceStates;
+		std::cout << "[INFO] particle storage on " << physicalDeviceProperties.deviceName << " (" << Settings::ForceKernelName(forceKernel)
+			<< " force kernel), " << initialState.Size() << " particles:" << std::endl;
+		for (bool half : modes)
+		{
+			SetParticleStorage(particleLayout, half);
+			Upload(initialState);
+			uint32_t stepsDone = 0;
+			for (size_t c = 0; c < std::size(checkpoints); c++)
+			{
+				Step(checkpoints[c] - stepsDone);
+				stepsDone = checkpoints[c];
+				ParticleState state;
+				Download(state);
+				if (!half)
+				{
+					referenceStates.push_back(std::move(state));
+					continue;
+				}
+
+				const ParticleState& reference = referenceStates[c];
+				uint32_t comparedCount = 0;
+				double maxPositionError = 0.0;
+				double positionErrorSquareSum = 0.0;
+				double maxVelocityError = 0.0;
+				double maxDensityError = 0.0;
+				for (size_t i = 0; i < std::min(state.Size(), reference.Size()); i++)
+				{
+					if (state.id[i] != reference.id[i] || state.id[i] == SPH_DEAD_PARTICLE)
+					{
+						continue;
+					}
+					const double positionError = glm::length(state.position[i] - reference.position[i]);
+					maxPositionError = std::max(maxPositionError, positionError);
+					positionErrorSquareSum += positionError * positionError;
+					maxVelocityError = std::max(maxVelocityError, double(glm::length(state.velocity[i] - reference.velocity[i])));
+					maxDensityError = std::max(maxDensityError, std::abs(double(state.density[i]) - reference.density[i]) / SPH_RESTING_DENSITY);
+					comparedCount++;
+				}
+				std::cout << "[INFO]     fp16 against fp32, step " << checkpoints[c] << ": position max " << maxPositionError << " rms "
+					<< std::sqrt(positionErrorSquareSum / std::max(comparedCount, 1u)) << " (particle radius " << SPH_PARTICLE_RADIUS << "), velocity max "
+					<< maxVelocityError << ", density max " << 100.0 * maxDensityError << "% of the resting density" << std::endl;
+			}
+
+			// the flow is developed by now, time whole submissions of the prerecorded step
+			Step(1);
+			auto start = std::chrono::high_resolution_clock::now();
+			Step(timedStepCount);
+			const double time = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / timedStepCount;
+
+			// bytes of particle state moved per particle and step, counted from the shaders: every pass reads the id,
+			// density reads position and writes density and pressure, force reads position, velocity, density and
+			// pressure and writes force, integrate reads position, velocity, force and density and writes position and
+			// velocity. Neighbour reads hit the cache mostly and are listed separately
+			const uint32_t velocityBytes = half ? 4 : 8;
+			const uint32_t scalarBytes = half ? 2 : 4;
+			const uint32_t storedBytes = 8 + velocityBytes + 8 + 2 * scalarBytes + 4;
+			const uint32_t neighbourBytes = 8 + velocityBytes + 2 * scalarBytes;
+			const uint32_t streamedBytes = 3 * 4 + 6 * 8 + 3 * velocityBytes + 5 * scalarBytes;
+			std::cout << "[INFO]     " << (half ? "fp16" : "fp32") << ": " << storedBytes << " bytes stored per particle, " << neighbourBytes
+				<< " bytes read per neighbour in the force pass, " << time << " ms/step, " << initialState.Size() / (time * 1e3) << " Mparticles/s, "
+				<< streamedBytes * double(initialState.Size()) / (time * 1e6) << " GB/s of particle state" << std::endl;
+		}
+		SetParticleStorage(particleLayout, originalHalfStorage);
+	}
+
+	void Application::BenchmarkLayouts()
+	{
+		const ParticleLayout originalLayout = particleLayout;
+		// let the dam break for a while so that the neighbourhoods are representative
+		const uint32_t warmupStepCount = 1000;
+		const int iterationCount = 20;
+		const ParticleState initialState = InitialDamBreak();
+		VkMemoryBarrier computeToComputeBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+		auto recordDispatch = [&](VkCommandBuffer commandBufferHandle, VkPipeline pipeline, VkBuffer indirectBuffer, VkDeviceSize indirectOffset)
+		{
+			BindComputeState(commandBufferHandle);
+			RecordDispatchIndirect(commandBufferHandle, pipeline, indirectBuffer, indirectOffset);
+			vkCmdPipelineBarrier(commandBufferHandle, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+		};
+
+		VkQueryPool queryPoolHandle = CreateBenchmarkQueryPool();
+		std::cout << "[INFO] particle layouts on " << physicalDeviceProperties.deviceName << " (" << (halfStorage ? "fp16" : "fp32") << " storage, "
+			<< Settings::ForceKernelName(forceKernel) << " force kernel), " << initialState.Size() << " particles after " << warmupStepCount
+			<< " steps, best of " << iterationCount << " runs per pass:" << std::endl;
+		ParticleState referenceState;
+		for (ParticleLayout layout : { ParticleLayout::SoA, ParticleLayout::AoS, ParticleLayout::AoSoA })
+		{
+			SetParticleStorage(layout, halfStorage);
+			Upload(initialState);
+			Step(warmupStepCount);
+
+			// the layouts only move the same values around, so every layout has to reproduce the SoA run
+			ParticleState state;
+			Download(state);
+			double maxPositionDifference = 0.0;
+			if (layout == ParticleLayout::SoA)
+			{
+				referenceState = state;
+			}
+			else
+			{
+				if (state.Size() != referenceState.Size())
+				{
+					throw std::runtime_error("the particle layouts disagree on the particle count");
+				}
+				for (size_t i = 0; i < state.Size(); i++)
+				{
+					if (state.id[i] != SPH_DEAD_PARTICLE)
+					{
+						maxPositionDifference = std::max(maxPositionDifference, double(glm::length(state.position[i] - referenceState.position[i])));
+					}
+				}
+			}
+
+			// every pass runs on the same grid, the integrate pass moves the particles a little further with every run
+			const double gridTime = MeasureCommands(queryPoolHandle, iterationCount, nullptr, [&](VkCommandBuffer commandBufferHandle)
+			{
+				RecordNeighbourGrid(commandBufferHandle);
+			});
+			const double densityTime = MeasureCommands(queryPoolHandle, iterationCount, nullptr, [&](VkCommandBuffer commandBufferHandle)
+			{
+				recordDispatch(commandBufferHandle, forceKernel == ForceKernel::BruteForce ? computePipelineHandles[0] : neighbourPipelineHandles[0],
+					tileBufferHandle, activeStateSsboOffset + offsetof(ActiveState, sizedDispatch));
+			});
+			const double forceTime = MeasureCommands(queryPoolHandle, iterationCount, nullptr, [&](VkCommandBuffer commandBufferHandle)
+			{
+				BindComputeState(commandBufferHandle);
+				RecordForcePass(commandBufferHandle, forceKernel);
+			});
+			const double gatherTime = MeasureCommands(queryPoolHandle, iterationCount, nullptr, [&](VkCommandBuffer commandBufferHandle)
+			{
+				recordDispatch(commandBufferHandle, reorderPipelineHandles[1], simulationStateBufferHandle, offsetof(SimulationState, sizedDispatch));
+			});
+			const double integrateTime = MeasureCommands(queryPoolHandle, iterationCount, nullptr, [&](VkCommandBuffer commandBufferHandle)
+			{
+				recordDispatch(commandBufferHandle, computePipelineHandles[2], tileBufferHandle, activeStateSsboOffset + offsetof(ActiveState, sizedDispatch));
+			});
+
+			std::cout << "[INFO]     " << Settings::ParticleLayoutName(layout) << ": grid " << gridTime << " ms, density " << densityTime
+				<< " ms, force " << forceTime << " ms, integrate " << integrateTime << " ms, reorder gather " << gatherTime << " ms";
+			if (layout != ParticleLayout::SoA)
+			{
+				std::cout << ", max position difference to soa " << maxPositionDifference;
+			}
+			std::cout << std::endl;
+		}
+
+		if (queryPoolHandle != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(logicalDeviceHandle, queryPoolHandle, allocator);
+		}
+		SetParticleStorage(originalLayout, halfStorage);
+	}
+
+	void Application::BenchmarkScaling()
+	{
+		std::cout << "[INFO] step time over the particle count on " << physicalDeviceProperties.deviceName << " (" << Settings::ForceKernelName(forceKernel)
+			<< " force kernel, capacity " << SPH_PARTICLE_CAPACITY << "), the domain filled uniformly, " << SPH_SCALING_BENCHMARK_SECONDS << " s per count:" << std::endl;
+		// the smoothing length stays fixed, so every count past the rest density of the domain is a denser fluid with
+		// more neighbours per particle rather than a finer one
+		for (uint64_t count = 10000; count <= 10000000; count *= 10)
+		{
+			if (count > SPH_PARTICLE_CAPACITY)
+			{
+				std::cout << "[INFO]     " << count << " particles: over the capacity, build the Scaling configuration, or with -DSPH_PARTICLE_CAPACITY="
+					<< count << " and the shaders with compile.py --capacity=" << count << std::endl;
+				continue;
+			}
+			if (forceKernel == ForceKernel::BruteForce && count > 100000)
+			{
+				std::cout << "[INFO]     " << count << " particles: skipped, the brute force kernel is quadratic" << std::endl;
+				continue;
+			}
+			Upload(UniformFill(static_cast<uint32_t>(count)));
+			Step(1);
+
+			// double the batch until a submission is long enough to time on the host
+			uint64_t stepCount = 0;
+			uint32_t batch = 1;
+			const auto start = std::chrono::steady_clock::now();
+			double seconds = 0.0;
+			while (seconds < SPH_SCALING_BENCHMARK_SECONDS)
+			{
+				Step(batch);
+				stepCount += batch;
+				batch = std::min(batch * 2, 1024u);
+				seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			}
+			std::cout << "[INFO]     " << count << " particles: " << stepCount / seconds << " steps/s, " << 1e3 * seconds / stepCount << " ms/step, "
+				<< 1e-6 * count * stepCount / seconds << " M particle-steps/s, " << static_cast<double>(count) / SPH_GRID_CELL_COUNT << " particles per grid cell" << std::endl;
+		}
+	}
+}
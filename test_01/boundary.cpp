@@ -0,0 +1,221 @@
+#include "boundary.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+namespace SPH
+{
+	BoundaryScene BoundaryScene::Box()
+	{
+		BoundaryScene scene;
+		scene.polygons.push_back({ glm::vec2(-1.f, -1.f), glm::vec2(1.f, -1.f), glm::vec2(1.f, 1.f), glm::vec2(-1.f, 1.f) });
+		return scene;
+	}
+
+	BoundaryScene BoundaryScene::FromFile(const std::string& path)
+	{
+		std::ifstream file(path);
+		if (!file)
+		{
+			throw std::runtime_error("failed to open scene " + path);
+		}
+		BoundaryScene scene;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream fields(line.substr(0, line.find('#')));
+			std::string key;
+			if (!(fields >> key))
+			{
+				continue;
+			}
+			if (key != "polygon")
+			{
+				throw std::runtime_error("unknown key in scene " + path + ": " + key);
+			}
+			std::vector<glm::vec2> polygon;
+			glm::vec2 vertex;
+			while (fields >> vertex.x >> vertex.y)
+			{
+				polygon.push_back(vertex);
+			}
+			if (!fields.eof() || polygon.size() < 3)
+			{
+				throw std::runtime_error("a polygon needs at least three x y pairs: " + line);
+			}
+			scene.polygons.push_back(polygon);
+		}
+		if (scene.polygons.empty())
+		{
+			throw std::runtime_error("scene " + path + " has no polygons");
+		}
+		return scene;
+	}
+
+	glm::vec3 BoundaryField::Sample(glm::vec2 position) const
+	{
+		// same arithmetic as sample_boundary in boundary.glsl
+		const float scale = (SPH_BOUNDARY_RESOLUTION - 1) / (2.f * SPH_BOUNDARY_EXTENT);
+		const float u = std::min(std::max((position.x + SPH_BOUNDARY_EXTENT) * scale, 0.f), float(SPH_BOUNDARY_RESOLUTION - 1));
+		const float v = std::min(std::max((position.y + SPH_BOUNDARY_EXTENT) * scale, 0.f), float(SPH_BOUNDARY_RESOLUTION - 1));
+		const int i = std::min(static_cast<int>(u), SPH_BOUNDARY_RESOLUTION - 2);
+		const int j = std::min(static_cast<int>(v), SPH_BOUNDARY_RESOLUTION - 2);
+		const float fu = u - i;
+		const float fv = v - j;
+		const glm::vec4* row = texels.data() + j * SPH_BOUNDARY_RESOLUTION + i;
+		const glm::vec4 texel = glm::mix(glm::mix(row[0], row[1], fu), glm::mix(row[SPH_BOUNDARY_RESOLUTION], row[SPH_BOUNDARY_RESOLUTION + 1], fu), fv);
+		glm::vec2 normal(texel.y, texel.z);
+		const float length = glm::length(normal);
+		if (length > 0.f)
+		{
+			normal /= length;
+		}
+		return glm::vec3(texel.x, normal);
+	}
+
+	glm::vec2 BoundaryField::Lookup(float distance) const
+	{
+		const float u = std::min(std::max(distance / SPH_SMOOTHING_LENGTH, 0.f), 1.f) * (SPH_BOUNDARY_TABLE_SIZE - 1);
+		const int i = std::min(static_cast<int>(u), SPH_BOUNDARY_TABLE_SIZE - 2);
+		return glm::mix(table[i], table[i + 1], u - i);
+	}
+
+	// even-odd rule, a point inside an odd number of polygons is fluid
+	static bool IsFluid(const BoundaryScene& scene, glm::vec2 p)
+	{
+		bool inside = false;
+		for (const auto& polygon : scene.polygons)
+		{
+			for (size_t e = 0, previous = polygon.size() - 1; e < polygon.size(); previous = e++)
+			{
+				const glm::vec2 a = polygon[previous];
+				const glm::vec2 b = polygon[e];
+				if ((a.y > p.y) != (b.y > p.y) && p.x < a.x + (p.y - a.y) * (b.x - a.x) / (b.y - a.y))
+				{
+					inside = !inside;
+				}
+			}
+		}
+		return inside;
+	}
+
+	BoundaryField BoundaryField::Bake(const BoundaryScene& scene)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		BoundaryField field;
+		field.texels.resize(SPH_BOUNDARY_RESOLUTION * SPH_BOUNDARY_RESOLUTION);
+		const float nodeSpacing = 2.f * SPH_BOUNDARY_EXTENT / (SPH_BOUNDARY_RESOLUTION - 1);
+		for (int j = 0; j < SPH_BOUNDARY_RESOLUTION; j++)
+		{
+			for (int i = 0; i < SPH_BOUNDARY_RESOLUTION; i++)
+			{
+				const glm::vec2 p(-SPH_BOUNDARY_EXTENT + i * nodeSpacing, -SPH_BOUNDARY_EXTENT + j * nodeSpacing);
+				// closest point on any edge
+				float closestSquare = std::numeric_limits<float>::max();
+				glm::vec2 closest(0.f);
+				glm::vec2 closestEdge(1.f, 0.f);
+				for (const auto& polygon : scene.polygons)
+				{
+					for (size_t e = 0, previous = polygon.size() - 1; e < polygon.size(); previous = e++)
+					{
+						const glm::vec2 a = polygon[previous];
+						const glm::vec2 edge = polygon[e] - a;
+						const float t = std::min(std::max(glm::dot(p - a, edge) / std::max(glm::dot(edge, edge), 1e-12f), 0.f), 1.f);
+						const glm::vec2 q = a + t * edge;
+						const float square = glm::dot(p - q, p - q);
+						if (square < closestSquare)
+						{
+							closestSquare = square;
+							closest = q;
+							closestEdge = edge;
+						}
+					}
+				}
+				const bool fluid = IsFluid(scene, p);
+				const float distance = std::sqrt(closestSquare);
+				glm::vec2 normal;
+				if (distance > 1e-6f)
+				{
+					normal = (fluid ? 1.f : -1.f) * (p - closest) / distance;
+				}
+				else
+				{
+					// on the wall, the side of the edge the fluid is on
+					normal = glm::normalize(glm::vec2(-closestEdge.y, closestEdge.x));
+					if (!IsFluid(scene, p + 1e-4f * normal))
+					{
+						normal = -normal;
+					}
+				}
+				field.texels[j * SPH_BOUNDARY_RESOLUTION + i] = glm::vec4(fluid ? distance : -distance, normal, 0.f);
+			}
+		}
+
+		// A flat wall seen from distance d stands in for rows of resting particles at the initial lattice spacing, the
+		// first half a spacing behind the wall. Their poly6 density and spiky pressure gradient are summed once per
+		// distance and averaged over where along the wall the particle sits
+		const float h = SPH_SMOOTHING_LENGTH;
+		const float spacing = 2.f * SPH_PARTICLE_RADIUS;
+		const float PI_FLOAT = 3.1415927410125732421875f;
+		const float poly6Scale = SPH_PARTICLE_MASS * 315.f / (64.f * PI_FLOAT * std::pow(h, 9.f));
+		const float spikyScale = SPH_PARTICLE_MASS * 45.f / (PI_FLOAT * std::pow(h, 6.f));
+		const int phaseCount = 16;
+		const int columnCount = static_cast<int>(h / spacing) + 1;
+		field.table.resize(SPH_BOUNDARY_TABLE_SIZE);
+		for (int t = 0; t < SPH_BOUNDARY_TABLE_SIZE; t++)
+		{
+			const float distance = h * t / (SPH_BOUNDARY_TABLE_SIZE - 1);
+			double density = 0.0;
+			double push = 0.0;
+			for (int phase = 0; phase < phaseCount; phase++)
+			{
+				for (float depth = distance + 0.5f * spacing; depth < h; depth += spacing)
+				{
+					for (int column = -columnCount; column <= columnCount; column++)
+					{
+						const float along = (column + (phase + 0.5f) / phaseCount) * spacing;
+						const float r = std::sqrt(along * along + depth * depth);
+						if (r < h)
+						{
+							density += poly6Scale * std::pow(h * h - r * r, 3.f);
+							push += spikyScale * (h - r) * (h - r) * depth / r;
+						}
+					}
+				}
+			}
+			field.table[t] = glm::vec2(float(density / phaseCount), float(push / phaseCount));
+		}
+
+		size_t edgeCount = 0;
+		for (const auto& polygon : scene.polygons)
+		{
+			edgeCount += polygon.size();
+		}
+		std::cout << "[INFO] baked " << scene.polygons.size() << " polygons with " << edgeCount << " edges into a " << SPH_BOUNDARY_RESOLUTION << "x"
+			<< SPH_BOUNDARY_RESOLUTION << " boundary field in " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count()
+			<< " ms, walls add up to " << field.table[0].x << " to the density" << std::endl;
+		return field;
+	}
+
+	static std::unique_ptr<BoundaryField> currentBoundary;
+
+	const BoundaryField& Boundary()
+	{
+		if (!currentBoundary)
+		{
+			SetBoundaryScene(BoundaryScene::Box());
+		}
+		return *currentBoundary;
+	}
+
+	void SetBoundaryScene(const BoundaryScene& scene)
+	{
+		currentBoundary.reset(new BoundaryField(BoundaryField::Bake(scene)));
+	}
+}
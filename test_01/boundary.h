@@ -0,0 +1,50 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include "solver.h"
+
+// the walls are baked into a lattice of SPH_BOUNDARY_RESOLUTION^2 nodes over [-SPH_BOUNDARY_EXTENT, SPH_BOUNDARY_EXTENT]^2,
+// a little wider than the domain so that particles that just crossed a wall still read a negative distance
+#define SPH_BOUNDARY_RESOLUTION 512
+#define SPH_BOUNDARY_EXTENT 1.0625f
+// entries of the wall density and pressure tables over distances 0 to SPH_SMOOTHING_LENGTH
+#define SPH_BOUNDARY_TABLE_SIZE 64
+
+namespace SPH
+{
+	// Closed polygons in domain coordinates. A point is fluid if it lies inside an odd number of them, so a container
+	// followed by the obstacles inside it describes a vessel with holes
+	struct BoundaryScene
+	{
+		std::vector<std::vector<glm::vec2>> polygons;
+
+		// the [-1,1] box every scene used to be
+		static BoundaryScene Box();
+		// one polygon per line, "polygon x0 y0 x1 y1 x2 y2 ...", # starts a comment
+		static BoundaryScene FromFile(const std::string& path);
+	};
+
+	// The baked walls. The density and force passes add what a wall of resting fluid beyond the nearest wall would
+	// contribute, and integration projects the particles that crossed a wall back onto it. Both cost one bilinear
+	// lookup per particle, however complex the scene. Mirrors boundary_block of boundary.glsl
+	struct BoundaryField
+	{
+		// per lattice node, x is the distance to the nearest wall, positive in the fluid, and yz the unit normal into the fluid
+		std::vector<glm::vec4> texels;
+		// per distance, x is the density the wall adds and y its pressure push per unit of pressure over resting density
+		std::vector<glm::vec2> table;
+
+		// bilinear, the normal is renormalized
+		glm::vec3 Sample(glm::vec2 position) const;
+		// linear in the distance, zero from one smoothing length on
+		glm::vec2 Lookup(float distance) const;
+
+		static BoundaryField Bake(const BoundaryScene& scene);
+	};
+
+	// the walls every backend of this process collides with, the baked box unless SetBoundaryScene was called first.
+	// Not synchronized, set the scene before any solver exists
+	const BoundaryField& Boundary();
+	void SetBoundaryScene(const BoundaryScene& scene);
+}
@@ -0,0 +1,253 @@
+#include "capture.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#define SPH_PIPE_MODE "wb"
+#else
+#define SPH_PIPE_MODE "w"
+#endif
+
+namespace SPH
+{
+	namespace
+	{
+		uint32_t Crc32(uint32_t crc, const uint8_t* data, size_t size)
+		{
+			static uint32_t table[256];
+			static const bool tableReady = []()
+			{
+				for (uint32_t n = 0; n < 256; n++)
+				{
+					uint32_t c = n;
+					for (int k = 0; k < 8; k++)
+					{
+						c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+					}
+					table[n] = c;
+				}
+				return true;
+			}();
+			(void)tableReady;
+			crc = ~crc;
+			for (size_t i = 0; i < size; i++)
+			{
+				crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+			}
+			return ~crc;
+		}
+
+		void PutBigEndian(std::vector<uint8_t>& out, uint32_t value)
+		{
+			out.push_back(static_cast<uint8_t>(value >> 24));
+			out.push_back(static_cast<uint8_t>(value >> 16));
+			out.push_back(static_cast<uint8_t>(value >> 8));
+			out.push_back(static_cast<uint8_t>(value));
+		}
+
+		void WriteChunk(FILE* file, const char* type, const std::vector<uint8_t>& data)
+		{
+			std::vector<uint8_t> chunk;
+			chunk.reserve(data.size() + 12);
+			PutBigEndian(chunk, static_cast<uint32_t>(data.size()));
+			chunk.insert(chunk.end(), type, type + 4);
+			chunk.insert(chunk.end(), data.begin(), data.end());
+			PutBigEndian(chunk, Crc32(0, chunk.data() + 4, chunk.size() - 4));
+			std::fwrite(chunk.data(), 1, chunk.size(), file);
+		}
+	}
+
+	FrameCapture::FrameCapture(VkDevice device, VkSemaphore timeline, const std::string& target, uint32_t width, uint32_t height, bool bgra, const char* ring)
+		: deviceHandle(device), timelineHandle(timeline), target(target), width(width), height(height), bgra(bgra), ring(ring)
+	{
+		if (!target.empty() && target[0] == '|')
+		{
+			stream = popen(target.c_str() + 1, SPH_PIPE_MODE);
+			pipe = true;
+		}
+		else if (target.find('%') == std::string::npos)
+		{
+			if (target.size() >= 4 && target.compare(target.size() - 4, 4, ".png") == 0)
+			{
+				throw std::runtime_error("a PNG capture writes a file per frame and needs a number pattern like %05d: " + target);
+			}
+			stream = std::fopen(target.c_str(), "wb");
+		}
+		if ((pipe || target.find('%') == std::string::npos) && !stream)
+		{
+			throw std::runtime_error("capture output creation failed: " + target);
+		}
+		for (bool& free : slotFree)
+		{
+			free = true;
+		}
+		writer = std::thread(&FrameCapture::WriterLoop, this);
+		std::cout << "[INFO] capture: " << width << "x" << height << " RGBA frames to " << target << std::endl;
+	}
+
+	FrameCapture::~FrameCapture()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		condition.notify_all();
+		writer.join();
+		if (stream)
+		{
+			pipe ? pclose(stream) : std::fclose(stream);
+		}
+		std::cout << "[INFO] capture: " << writtenCount << " frames written, " << droppedCount << " dropped while every readback slot was busy" << std::endl;
+	}
+
+	int32_t FrameCapture::AcquireSlot(bool wait)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			for (uint32_t slot = 0; slot < SPH_CAPTURE_SLOTS; slot++)
+			{
+				if (slotFree[slot])
+				{
+					slotFree[slot] = false;
+					return static_cast<int32_t>(slot);
+				}
+			}
+			if (!wait)
+			{
+				droppedCount++;
+				return -1;
+			}
+			condition.wait(lock);
+		}
+	}
+
+	void FrameCapture::Submit(uint32_t slot, uint64_t timelineValue)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending.push_back({ slot, timelineValue });
+		}
+		condition.notify_all();
+	}
+
+	void FrameCapture::WriterLoop()
+	{
+		std::vector<uint8_t> rgba(FrameSize());
+		uint64_t frame = 0;
+		for (;;)
+		{
+			std::pair<uint32_t, uint64_t> next;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [this]() { return stopping || !pending.empty(); });
+				if (pending.empty())
+				{
+					return;
+				}
+				next = pending.front();
+				pending.pop_front();
+			}
+			// the copy completes on the gpu, the readback memory is host coherent
+			VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, NULL, 0, 1, &timelineHandle, &next.second };
+			if (vkWaitSemaphores(deviceHandle, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+			{
+				std::cout << "[WARNING] capture: vkWaitSemaphores failed, frame " << frame << " skipped" << std::endl;
+				continue;
+			}
+			const uint8_t* pixels = reinterpret_cast<const uint8_t*>(ring) + next.first * FrameSize();
+			std::memcpy(rgba.data(), pixels, rgba.size());
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				slotFree[next.first] = true;
+			}
+			condition.notify_all();
+
+			if (bgra)
+			{
+				for (size_t i = 0; i < rgba.size(); i += 4)
+				{
+					std::swap(rgba[i], rgba[i + 2]);
+				}
+			}
+			Write(rgba, frame++);
+		}
+	}
+
+	void FrameCapture::Write(const std::vector<uint8_t>& rgba, uint64_t frame)
+	{
+		if (stream)
+		{
+			std::fwrite(rgba.data(), 1, rgba.size(), stream);
+		}
+		else
+		{
+			std::vector<char> name(target.size() + 32);
+			std::snprintf(name.data(), name.size(), target.c_str(), static_cast<unsigned long long>(frame));
+			FILE* file = std::fopen(name.data(), "wb");
+			if (!file)
+			{
+				std::cout << "[WARNING] capture: cannot create " << name.data() << std::endl;
+				return;
+			}
+			const std::string path = name.data();
+			if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0)
+			{
+				WritePng(file, rgba);
+			}
+			else
+			{
+				std::fwrite(rgba.data(), 1, rgba.size(), file);
+			}
+			std::fclose(file);
+		}
+		std::lock_guard<std::mutex> lock(mutex);
+		writtenCount++;
+	}
+
+	void FrameCapture::WritePng(FILE* file, const std::vector<uint8_t>& rgba)
+	{
+		// 8-bit RGBA, every row unfiltered, and the zlib stream made of stored deflate blocks: large files, but no
+		// compression time on the writer thread, pipe to an encoder for compact output
+		static const uint8_t signature[8]{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		std::fwrite(signature, 1, sizeof(signature), file);
+		std::vector<uint8_t> header;
+		PutBigEndian(header, width);
+		PutBigEndian(header, height);
+		header.insert(header.end(), { 8, 6, 0, 0, 0 });
+		WriteChunk(file, "IHDR", header);
+
+		const size_t rowSize = static_cast<size_t>(width) * 4 + 1;
+		std::vector<uint8_t> rows(rowSize * height);
+		for (uint32_t y = 0; y < height; y++)
+		{
+			rows[y * rowSize] = 0;
+			std::memcpy(&rows[y * rowSize + 1], &rgba[static_cast<size_t>(y) * width * 4], rowSize - 1);
+		}
+		std::vector<uint8_t> zlib{ 0x78, 0x01 };
+		zlib.reserve(rows.size() + rows.size() / 65535 * 5 + 16);
+		uint32_t adlerA = 1;
+		uint32_t adlerB = 0;
+		for (size_t offset = 0; offset < rows.size(); offset += 65535)
+		{
+			const uint16_t size = static_cast<uint16_t>(std::min<size_t>(65535, rows.size() - offset));
+			zlib.push_back(offset + size == rows.size() ? 1 : 0);
+			zlib.insert(zlib.end(), { static_cast<uint8_t>(size), static_cast<uint8_t>(size >> 8),
+				static_cast<uint8_t>(~size), static_cast<uint8_t>(static_cast<uint16_t>(~size) >> 8) });
+			zlib.insert(zlib.end(), rows.begin() + offset, rows.begin() + offset + size);
+			for (size_t i = offset; i < offset + size; i++)
+			{
+				adlerA = (adlerA + rows[i]) % 65521;
+				adlerB = (adlerB + adlerA) % 65521;
+			}
+		}
+		PutBigEndian(zlib, (adlerB << 16) | adlerA);
+		WriteChunk(file, "IDAT", zlib);
+		WriteChunk(file, "IEND", {});
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// readback slots of the frame capture, the most frames in flight between the gpu copy and the writer thread
+#ifndef SPH_CAPTURE_SLOTS
+#define SPH_CAPTURE_SLOTS 3
+#endif
+
+namespace SPH
+{
+	// Writes the frames the gpu copies into a ring of SPH_CAPTURE_SLOTS readback slots on its own thread. A slot is
+	// handed over with the capture timeline value that completes its copy, the writer waits for that value, takes the
+	// pixels out of the slot and frees it before encoding, so the memory stays bounded by the ring and one frame.
+	// The target decides the output:
+	//   "|command"      raw RGBA frames piped to the standard input of command, e.g. an ffmpeg rawvideo encoder
+	//   "name%05d.png"  one PNG per frame, numbered from 0
+	//   "name%05d.raw"  one raw RGBA file per frame
+	//   anything else   every frame appended to one raw RGBA file
+	class FrameCapture
+	{
+	public:
+		// ring points at the mapped readback memory, slot s starts at s * width * height * 4. bgra swaps the red and
+		// blue channels of the copied pixels, which have the layout of a B8G8R8A8 target then
+		FrameCapture(VkDevice device, VkSemaphore timeline, const std::string& target, uint32_t width, uint32_t height, bool bgra, const char* ring);
+		FrameCapture(const FrameCapture&) = delete;
+		// writes the frames handed over so far before it returns
+		~FrameCapture();
+
+		// a free slot for the next frame, or -1 if the writer still holds every slot and wait is not set
+		int32_t AcquireSlot(bool wait);
+		void Submit(uint32_t slot, uint64_t timelineValue);
+
+		VkDeviceSize FrameSize() const { return static_cast<VkDeviceSize>(width) * height * 4; }
+
+	private:
+		void WriterLoop();
+		void Write(const std::vector<uint8_t>& rgba, uint64_t frame);
+		void WritePng(FILE* file, const std::vector<uint8_t>& rgba);
+
+		VkDevice deviceHandle;
+		VkSemaphore timelineHandle;
+		std::string target;
+		uint32_t width;
+		uint32_t height;
+		bool bgra;
+		const char* ring;
+		// the pipe or the single raw file, null for the numbered files
+		FILE* stream = nullptr;
+		bool pipe = false;
+
+		std::mutex mutex;
+		std::condition_variable condition;
+		bool slotFree[SPH_CAPTURE_SLOTS];
+		// slots with their timeline values in submission order
+		std::deque<std::pair<uint32_t, uint64_t>> pending;
+		bool stopping = false;
+		uint64_t writtenCount = 0;
+		uint64_t droppedCount = 0;
+		std::thread writer;
+	};
+}
@@ -0,0 +1,79 @@
+#include "cpu_kernels.h"
+#include "solver.h"
+#include <cmath>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace SPH
+{
+	// set by cpu_kernels_avx2.cpp, false when it was built without AVX2 code generation
+	extern const bool avx2KernelsCompiled;
+
+	float DensitySumScalar(const NeighbourArrays& neighbours, uint32_t begin, uint32_t end, float x, float y)
+	{
+		const float h2 = SPH_SMOOTHING_LENGTH * SPH_SMOOTHING_LENGTH;
+		float sum = 0.f;
+		for (uint32_t j = begin; j < end; j++)
+		{
+			const float dx = x - neighbours.x[j];
+			const float dy = y - neighbours.y[j];
+			const float r2 = dx * dx + dy * dy;
+			if (r2 < h2)
+			{
+				const float d = h2 - r2;
+				sum += d * d * d;
+			}
+		}
+		return sum;
+	}
+
+	void ForceSumScalar(const NeighbourArrays& neighbours, uint32_t begin, uint32_t end, float x, float y,
+		float velocityX, float velocityY, float pressure, ForceSums& sums)
+	{
+		const float h2 = SPH_SMOOTHING_LENGTH * SPH_SMOOTHING_LENGTH;
+		for (uint32_t j = begin; j < end; j++)
+		{
+			const float dx = x - neighbours.x[j];
+			const float dy = y - neighbours.y[j];
+			const float r2 = dx * dx + dy * dy;
+			if (r2 < h2 && r2 > 0.f)
+			{
+				const float r = std::sqrt(r2);
+				const float hr = SPH_SMOOTHING_LENGTH - r;
+				const float pressureScale = (pressure + neighbours.pressure[j]) / (2.f * neighbours.density[j]) * hr * hr / r;
+				sums.pressureX += pressureScale * dx;
+				sums.pressureY += pressureScale * dy;
+				const float viscosityScale = hr / neighbours.density[j];
+				sums.viscosityX += viscosityScale * (neighbours.velocityX[j] - velocityX);
+				sums.viscosityY += viscosityScale * (neighbours.velocityY[j] - velocityY);
+			}
+		}
+	}
+
+	bool CpuSupportsAvx2()
+	{
+		if (!avx2KernelsCompiled)
+		{
+			return false;
+		}
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+		// AVX2 in leaf 7, and the os must save the ymm registers
+		int info[4];
+		__cpuid(info, 1);
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+		{
+			return false;
+		}
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		return __builtin_cpu_supports("avx2");
+#else
+		return false;
+#endif
+	}
+}
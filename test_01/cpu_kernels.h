@@ -0,0 +1,43 @@
+#pragma once
+#include <cstdint>
+
+namespace SPH
+{
+	// neighbour candidates in cell order, one array per component so that 8 of them load into one AVX register
+	struct NeighbourArrays
+	{
+		const float* x;
+		const float* y;
+		const float* velocityX;
+		const float* velocityY;
+		const float* density;
+		const float* pressure;
+	};
+
+	// pressure and viscosity sums of one particle, before the kernel constants are applied
+	struct ForceSums
+	{
+		float pressureX;
+		float pressureY;
+		float viscosityX;
+		float viscosityY;
+	};
+
+	// sum of (h^2 - r^2)^3 over the candidates [begin, end) closer than the smoothing length
+	typedef float (*DensityKernel)(const NeighbourArrays& neighbours, uint32_t begin, uint32_t end, float x, float y);
+	// adds (p_i + p_j) / (2 rho_j) (h - r)^2 / r * delta and (v_j - v_i) / rho_j (h - r) over the candidates
+	// [begin, end) closer than the smoothing length, the particle itself (r == 0) is skipped
+	typedef void (*ForceKernelFunction)(const NeighbourArrays& neighbours, uint32_t begin, uint32_t end, float x, float y,
+		float velocityX, float velocityY, float pressure, ForceSums& sums);
+
+	float DensitySumScalar(const NeighbourArrays& neighbours, uint32_t begin, uint32_t end, float x, float y);
+	void ForceSumScalar(const NeighbourArrays& neighbours, uint32_t begin, uint32_t end, float x, float y,
+		float velocityX, float velocityY, float pressure, ForceSums& sums);
+	// cpu_kernels_avx2.cpp is the only file built with AVX2 code generation, only call these if CpuSupportsAvx2()
+	float DensitySumAvx2(const NeighbourArrays& neighbours, uint32_t begin, uint32_t end, float x, float y);
+	void ForceSumAvx2(const NeighbourArrays& neighbours, uint32_t begin, uint32_t end, float x, float y,
+		float velocityX, float velocityY, float pressure, ForceSums& sums);
+
+	// true if the AVX2 kernels were compiled in and the running cpu and os support them
+	bool CpuSupportsAvx2();
+}
@@ -0,0 +1,100 @@
+// built with AVX2 code generation (/arch:AVX2, -mavx2), nothing outside this file may assume it
+#include "cpu_kernels.h"
+#include "solver.h"
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace SPH
+{
+#if defined(__AVX2__)
+	extern const bool avx2KernelsCompiled = true;
+
+	static float HorizontalSum(__m256 value)
+	{
+		__m128 sum = _mm_add_ps(_mm256_castps256_ps128(value), _mm256_extractf128_ps(value, 1));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+		return _mm_cvtss_f32(sum);
+	}
+
+	float DensitySumAvx2(const NeighbourArrays& neighbours, uint32_t begin, uint32_t end, float x, float y)
+	{
+		const __m256 h2 = _mm256_set1_ps(SPH_SMOOTHING_LENGTH * SPH_SMOOTHING_LENGTH);
+		const __m256 xi = _mm256_set1_ps(x);
+		const __m256 yi = _mm256_set1_ps(y);
+		__m256 sum = _mm256_setzero_ps();
+		uint32_t j = begin;
+		for (; j + 8 <= end; j += 8)
+		{
+			const __m256 dx = _mm256_sub_ps(xi, _mm256_loadu_ps(neighbours.x + j));
+			const __m256 dy = _mm256_sub_ps(yi, _mm256_loadu_ps(neighbours.y + j));
+			const __m256 r2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+			const __m256 inside = _mm256_cmp_ps(r2, h2, _CMP_LT_OQ);
+			const __m256 d = _mm256_sub_ps(h2, r2);
+			sum = _mm256_add_ps(sum, _mm256_and_ps(inside, _mm256_mul_ps(_mm256_mul_ps(d, d), d)));
+		}
+		return HorizontalSum(sum) + DensitySumScalar(neighbours, j, end, x, y);
+	}
+
+	void ForceSumAvx2(const NeighbourArrays& neighbours, uint32_t begin, uint32_t end, float x, float y,
+		float velocityX, float velocityY, float pressure, ForceSums& sums)
+	{
+		const __m256 h = _mm256_set1_ps(SPH_SMOOTHING_LENGTH);
+		const __m256 h2 = _mm256_set1_ps(SPH_SMOOTHING_LENGTH * SPH_SMOOTHING_LENGTH);
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 xi = _mm256_set1_ps(x);
+		const __m256 yi = _mm256_set1_ps(y);
+		const __m256 vxi = _mm256_set1_ps(velocityX);
+		const __m256 vyi = _mm256_set1_ps(velocityY);
+		const __m256 pi = _mm256_set1_ps(pressure);
+		__m256 pressureX = zero;
+		__m256 pressureY = zero;
+		__m256 viscosityX = zero;
+		__m256 viscosityY = zero;
+		uint32_t j = begin;
+		for (; j + 8 <= end; j += 8)
+		{
+			const __m256 dx = _mm256_sub_ps(xi, _mm256_loadu_ps(neighbours.x + j));
+			const __m256 dy = _mm256_sub_ps(yi, _mm256_loadu_ps(neighbours.y + j));
+			const __m256 r2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+			// lanes outside the smoothing length and the particle itself divide by zero below, the mask clears them
+			const __m256 inside = _mm256_and_ps(_mm256_cmp_ps(r2, h2, _CMP_LT_OQ), _mm256_cmp_ps(r2, zero, _CMP_GT_OQ));
+			const __m256 r = _mm256_sqrt_ps(r2);
+			const __m256 hr = _mm256_sub_ps(h, r);
+			const __m256 inverseDensity = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_loadu_ps(neighbours.density + j));
+
+			const __m256 pressureSum = _mm256_add_ps(pi, _mm256_loadu_ps(neighbours.pressure + j));
+			__m256 pressureScale = _mm256_mul_ps(_mm256_mul_ps(pressureSum, half), inverseDensity);
+			pressureScale = _mm256_div_ps(_mm256_mul_ps(pressureScale, _mm256_mul_ps(hr, hr)), r);
+			pressureScale = _mm256_and_ps(inside, pressureScale);
+			pressureX = _mm256_add_ps(pressureX, _mm256_mul_ps(pressureScale, dx));
+			pressureY = _mm256_add_ps(pressureY, _mm256_mul_ps(pressureScale, dy));
+
+			const __m256 viscosityScale = _mm256_and_ps(inside, _mm256_mul_ps(hr, inverseDensity));
+			viscosityX = _mm256_add_ps(viscosityX, _mm256_mul_ps(viscosityScale, _mm256_sub_ps(_mm256_loadu_ps(neighbours.velocityX + j), vxi)));
+			viscosityY = _mm256_add_ps(viscosityY, _mm256_mul_ps(viscosityScale, _mm256_sub_ps(_mm256_loadu_ps(neighbours.velocityY + j), vyi)));
+		}
+		sums.pressureX += HorizontalSum(pressureX);
+		sums.pressureY += HorizontalSum(pressureY);
+		sums.viscosityX += HorizontalSum(viscosityX);
+		sums.viscosityY += HorizontalSum(viscosityY);
+		ForceSumScalar(neighbours, j, end, x, y, velocityX, velocityY, pressure, sums);
+	}
+#else
+	// built without AVX2 code generation, CpuSupportsAvx2() keeps the solver on the scalar kernels
+	extern const bool avx2KernelsCompiled = false;
+
+	float DensitySumAvx2(const NeighbourArrays& neighbours, uint32_t begin, uint32_t end, float x, float y)
+	{
+		return DensitySumScalar(neighbours, begin, end, x, y);
+	}
+
+	void ForceSumAvx2(const NeighbourArrays& neighbours, uint32_t begin, uint32_t end, float x, float y,
+		float velocityX, float velocityY, float pressure, ForceSums& sums)
+	{
+		ForceSumScalar(neighbours, begin, end, x, y, velocityX, velocityY, pressure, sums);
+	}
+#endif
+}
@@ -0,0 +1,405 @@
+#include "cpu_solver.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+namespace SPH
+{
+	// cells one smoothing length wide over the [-1,1] domain, like SPH_GRID_RESOLUTION on the gpu
+	static const int gridResolution = static_cast<int>(2.f / SPH_SMOOTHING_LENGTH + 0.5f);
+	static const uint32_t cellCount = gridResolution * gridResolution;
+	// particles per chunk of the thread pool, small enough to balance, large enough to keep a chunk in cache
+	static const uint32_t particleGrainSize = 256;
+	static const uint32_t cellGrainSize = 256;
+
+	static const float PI_FLOAT = 3.1415927410125732421875f;
+	static const float poly6Scale = SPH_PARTICLE_MASS * 315.f / (64.f * PI_FLOAT * std::pow(SPH_SMOOTHING_LENGTH, 9.f));
+	static const float spikyScale = SPH_PARTICLE_MASS * 45.f / (PI_FLOAT * std::pow(SPH_SMOOTHING_LENGTH, 6.f));
+
+	static glm::ivec2 CellOf(float x, float y)
+	{
+		const int cellX = static_cast<int>((x + 1.f) * (0.5f * gridResolution));
+		const int cellY = static_cast<int>((y + 1.f) * (0.5f * gridResolution));
+		return glm::ivec2(std::min(std::max(cellX, 0), gridResolution - 1), std::min(std::max(cellY, 0), gridResolution - 1));
+	}
+
+	CpuSolver::CpuSolver(unsigned threadCount, bool useAvx2)
+		: pool(threadCount), boundary(Boundary()), cellStart(cellCount + 1), cellCursor(new std::atomic<uint32_t>[cellCount])
+	{
+		const bool avx2 = useAvx2 && CpuSupportsAvx2();
+		densityKernel = avx2 ? DensitySumAvx2 : DensitySumScalar;
+		forceKernel = avx2 ? ForceSumAvx2 : ForceSumScalar;
+		name = "cpu, " + std::to_string(pool.ThreadCount()) + (pool.ThreadCount() == 1 ? " thread, " : " threads, ") + (avx2 ? "AVX2" : "scalar") + " kernels";
+	}
+
+	void CpuSolver::Upload(const ParticleState& state)
+	{
+		// the cpu kernels assume the base resolution everywhere
+		for (size_t i = 0; i < state.Size(); i++)
+		{
+			if (state.id[i] != SPH_DEAD_PARTICLE && state.mass[i] != SPH_PARTICLE_MASS)
+			{
+				throw std::runtime_error("the cpu solver only runs particles of mass SPH_PARTICLE_MASS");
+			}
+		}
+		particles = state;
+		ownedCount = static_cast<uint32_t>(particles.Size());
+	}
+
+	void CpuSolver::ReplaceHalo(const std::vector<HaloParticle>& incoming)
+	{
+		particles.Resize(ownedCount);
+		// migrated particles join the owned slots, the ghosts go behind them
+		for (uint32_t pass = 0; pass < 2; pass++)
+		{
+			for (const HaloParticle& halo : incoming)
+			{
+				if (halo.migrated != (pass == 0 ? 1u : 0u))
+				{
+					continue;
+				}
+				particles.position.push_back(halo.position);
+				particles.velocity.push_back(halo.velocity);
+				particles.density.push_back(0.f);
+				particles.pressure.push_back(0.f);
+				particles.id.push_back(halo.id);
+				particles.mass.push_back(SPH_PARTICLE_MASS);
+			}
+			if (pass == 0)
+			{
+				ownedCount = static_cast<uint32_t>(particles.Size());
+			}
+		}
+	}
+
+	void CpuSolver::ExtractHalo(float minX, float maxX, float bandWidth, std::vector<HaloParticle>& towardsMinus, std::vector<HaloParticle>& towardsPlus)
+	{
+		uint32_t keptCount = 0;
+		for (uint32_t i = 0; i < ownedCount; i++)
+		{
+			if (particles.id[i] == SPH_DEAD_PARTICLE)
+			{
+				continue;
+			}
+			// signed distances into the slab
+			const float minusDepth = particles.position[i].x - minX;
+			const float plusDepth = maxX - particles.position[i].x;
+			if (minusDepth < bandWidth)
+			{
+				towardsMinus.push_back({ particles.position[i], particles.velocity[i], particles.id[i], minusDepth < 0.f ? 1u : 0u });
+			}
+			if (plusDepth <= bandWidth)
+			{
+				towardsPlus.push_back({ particles.position[i], particles.velocity[i], particles.id[i], plusDepth <= 0.f ? 1u : 0u });
+			}
+			if (minusDepth < 0.f || plusDepth <= 0.f)
+			{
+				continue;
+			}
+			particles.position[keptCount] = particles.position[i];
+			particles.velocity[keptCount] = particles.velocity[i];
+			particles.density[keptCount] = particles.density[i];
+			particles.pressure[keptCount] = particles.pressure[i];
+			particles.id[keptCount] = particles.id[i];
+			particles.mass[keptCount] = particles.mass[i];
+			keptCount++;
+		}
+		ownedCount = keptCount;
+		particles.Resize(ownedCount);
+	}
+
+	void CpuSolver::Download(ParticleState& state)
+	{
+		state = particles;
+	}
+
+	void CpuSolver::Step(uint32_t stepCount)
+	{
+		for (uint32_t step = 0; step < stepCount; step++)
+		{
+			BuildCellList();
+			ComputeDensityPressure();
+			ComputeForce();
+			Integrate();
+		}
+	}
+
+	void CpuSolver::BuildCellList()
+	{
+		const uint32_t count = static_cast<uint32_t>(particles.Size());
+		cellKey.resize(count);
+		sortedSlot.resize(count);
+		sortedX.resize(count);
+		sortedY.resize(count);
+		sortedVelocityX.resize(count);
+		sortedVelocityY.resize(count);
+		sortedDensity.resize(count);
+		sortedPressure.resize(count);
+		sortedForce.resize(count);
+		pool.ParallelFor(cellCount, cellGrainSize * 16, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t c = begin; c < end; c++)
+			{
+				cellCursor[c].store(0, std::memory_order_relaxed);
+			}
+		});
+
+		// count the live particles of every cell, removed ones are left out of the list
+		pool.ParallelFor(count, particleGrainSize, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				if (particles.id[i] == SPH_DEAD_PARTICLE)
+				{
+					cellKey[i] = cellCount;
+					continue;
+				}
+				const glm::ivec2 cell = CellOf(particles.position[i].x, particles.position[i].y);
+				cellKey[i] = cell.y * gridResolution + cell.x;
+				cellCursor[cellKey[i]].fetch_add(1, std::memory_order_relaxed);
+			}
+		});
+
+		cellStart[0] = 0;
+		for (uint32_t c = 0; c < cellCount; c++)
+		{
+			const uint32_t cellSize = cellCursor[c].load(std::memory_order_relaxed);
+			cellStart[c + 1] = cellStart[c] + cellSize;
+			cellCursor[c].store(cellStart[c], std::memory_order_relaxed);
+		}
+		liveCount = cellStart[cellCount];
+
+		pool.ParallelFor(count, particleGrainSize, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				if (cellKey[i] != cellCount)
+				{
+					sortedSlot[cellCursor[cellKey[i]].fetch_add(1, std::memory_order_relaxed)] = i;
+				}
+			}
+		});
+
+		// the scatter order depends on the threads, sorting every cell by slot makes the summation order and thereby
+		// the result reproducible
+		pool.ParallelFor(cellCount, cellGrainSize, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t c = begin; c < end; c++)
+			{
+				std::sort(sortedSlot.begin() + cellStart[c], sortedSlot.begin() + cellStart[c + 1]);
+				for (uint32_t s = cellStart[c]; s < cellStart[c + 1]; s++)
+				{
+					const uint32_t i = sortedSlot[s];
+					sortedX[s] = particles.position[i].x;
+					sortedY[s] = particles.position[i].y;
+					sortedVelocityX[s] = particles.velocity[i].x;
+					sortedVelocityY[s] = particles.velocity[i].y;
+				}
+			}
+		});
+	}
+
+	void CpuSolver::RowRange(int x, int y, uint32_t& begin, uint32_t& end) const
+	{
+		const int row = y * gridResolution;
+		begin = cellStart[row + std::max(x - 1, 0)];
+		end = cellStart[row + std::min(x + 1, gridResolution - 1) + 1];
+	}
+
+	void CpuSolver::ComputeDensityPressure()
+	{
+		const NeighbourArrays neighbours{ sortedX.data(), sortedY.data(), sortedVelocityX.data(), sortedVelocityY.data(), sortedDensity.data(), sortedPressure.data() };
+		pool.ParallelFor(liveCount, particleGrainSize, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t s = begin; s < end; s++)
+			{
+				const glm::ivec2 cell = CellOf(sortedX[s], sortedY[s]);
+				float sum = 0.f;
+				for (int y = std::max(cell.y - 1, 0); y <= std::min(cell.y + 1, gridResolution - 1); y++)
+				{
+					uint32_t rowBegin, rowEnd;
+					RowRange(cell.x, y, rowBegin, rowEnd);
+					sum += densityKernel(neighbours, rowBegin, rowEnd, sortedX[s], sortedY[s]);
+				}
+				// the walls stand in for the neighbours missing beyond them
+				sortedDensity[s] = poly6Scale * sum + boundary.Lookup(boundary.Sample(glm::vec2(sortedX[s], sortedY[s])).x).x;
+				sortedPressure[s] = std::max(SPH_STIFFNESS * (sortedDensity[s] - SPH_RESTING_DENSITY), 0.f);
+			}
+		});
+	}
+
+	void CpuSolver::ComputeForce()
+	{
+		const NeighbourArrays neighbours{ sortedX.data(), sortedY.data(), sortedVelocityX.data(), sortedVelocityY.data(), sortedDensity.data(), sortedPressure.data() };
+		pool.ParallelFor(liveCount, particleGrainSize, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t s = begin; s < end; s++)
+			{
+				// ghosts are only neighbours
+				if (sortedSlot[s] >= ownedCount)
+				{
+					continue;
+				}
+				const glm::ivec2 cell = CellOf(sortedX[s], sortedY[s]);
+				ForceSums sums{ 0.f, 0.f, 0.f, 0.f };
+				for (int y = std::max(cell.y - 1, 0); y <= std::min(cell.y + 1, gridResolution - 1); y++)
+				{
+					uint32_t rowBegin, rowEnd;
+					RowRange(cell.x, y, rowBegin, rowEnd);
+					forceKernel(neighbours, rowBegin, rowEnd, sortedX[s], sortedY[s], sortedVelocityX[s], sortedVelocityY[s], sortedPressure[s], sums);
+				}
+				const glm::vec2 pressureForce = spikyScale * glm::vec2(sums.pressureX, sums.pressureY);
+				const glm::vec2 viscosityForce = SPH_VISCOSITY * spikyScale * glm::vec2(sums.viscosityX, sums.viscosityY);
+				const glm::vec2 externalForce = sortedDensity[s] * glm::vec2(0.f, SPH_GRAVITY);
+				// the walls push back with the particle's own pressure
+				const glm::vec3 wall = boundary.Sample(glm::vec2(sortedX[s], sortedY[s]));
+				const glm::vec2 wallForce = sortedPressure[s] / SPH_RESTING_DENSITY * boundary.Lookup(wall.x).y * glm::vec2(wall.y, wall.z);
+				sortedForce[s] = pressureForce + viscosityForce + externalForce + wallForce;
+			}
+		});
+	}
+
+	void CpuSolver::Integrate()
+	{
+		pool.ParallelFor(liveCount, particleGrainSize, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t s = begin; s < end; s++)
+			{
+				const uint32_t i = sortedSlot[s];
+				if (i >= ownedCount)
+				{
+					continue;
+				}
+				const glm::vec2 acceleration = sortedForce[s] / sortedDensity[s];
+				glm::vec2 newVelocity = glm::vec2(sortedVelocityX[s], sortedVelocityY[s]) + SPH_TIME_STEP * acceleration;
+				glm::vec2 newPosition = glm::vec2(sortedX[s], sortedY[s]) + SPH_TIME_STEP * newVelocity;
+
+				// particles that crossed a wall go back onto it along the normal, their velocity into it is reflected and damped
+				const glm::vec3 wall = boundary.Sample(newPosition);
+				if (wall.x < 0.f)
+				{
+					const glm::vec2 normal(wall.y, wall.z);
+					newPosition -= wall.x * normal;
+					const float normalVelocity = glm::dot(newVelocity, normal);
+					if (normalVelocity < 0.f)
+					{
+						newVelocity -= (1.f + SPH_WALL_DAMPING) * normalVelocity * normal;
+					}
+				}
+
+#if SPH_SINK_ENABLED
+				const glm::vec2 sinkMin = SPH_SINK_MIN;
+				const glm::vec2 sinkMax = SPH_SINK_MAX;
+				if (newPosition.x >= sinkMin.x && newPosition.y >= sinkMin.y && newPosition.x <= sinkMax.x && newPosition.y <= sinkMax.y)
+				{
+					particles.id[i] = SPH_DEAD_PARTICLE;
+					newPosition = SPH_PARKED_POSITION;
+					newVelocity = glm::vec2(0.f);
+				}
+#endif
+
+				particles.position[i] = newPosition;
+				particles.velocity[i] = newVelocity;
+				particles.density[i] = sortedDensity[s];
+				particles.pressure[i] = sortedPressure[s];
+			}
+		});
+	}
+
+	void RunCpuSolver(const Settings& settings)
+	{
+		CpuSolver solver(settings.threadCount);
+		solver.Upload(InitialDamBreak());
+		std::cout << "[INFO] running " << settings.stepCount << " steps on " << solver.Name() << std::endl;
+
+		const uint32_t reportInterval = 1000;
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t step = 0; step < settings.stepCount; step += reportInterval)
+		{
+			const uint32_t stepCount = std::min(reportInterval, settings.stepCount - step);
+			solver.Step(stepCount);
+			const auto now = std::chrono::steady_clock::now();
+			const double seconds = std::chrono::duration<double>(now - start).count();
+			start = now;
+			std::cout << "[INFO] step " << step + stepCount << ": " << stepCount / seconds << " steps/s" << std::endl;
+		}
+
+		ParticleState state;
+		solver.Download(state);
+		uint32_t aliveCount = 0;
+		double densitySum = 0.0;
+		for (size_t i = 0; i < state.Size(); i++)
+		{
+			if (state.id[i] != SPH_DEAD_PARTICLE)
+			{
+				aliveCount++;
+				densitySum += state.density[i];
+			}
+		}
+		std::cout << "[INFO] " << aliveCount << " particles alive, mean density " << (aliveCount > 0 ? densitySum / aliveCount : 0.0) << std::endl;
+	}
+
+	void BenchmarkCpuSolver(const Settings& settings)
+	{
+		const uint32_t warmupSteps = 500;
+		const uint32_t measuredSteps = 50;
+
+		// a splashing dam-break rather than the regular initial lattice
+		ParticleState state;
+		{
+			CpuSolver warmup(settings.threadCount);
+			warmup.Upload(InitialDamBreak());
+			warmup.Step(warmupSteps);
+			warmup.Download(state);
+		}
+		size_t aliveCount = 0;
+		for (uint32_t id : state.id)
+		{
+			aliveCount += id != SPH_DEAD_PARTICLE ? 1 : 0;
+		}
+
+		const unsigned maxThreadCount = settings.threadCount > 0 ? settings.threadCount : std::max(1u, std::thread::hardware_concurrency());
+		std::vector<unsigned> threadCounts;
+		for (unsigned threadCount = 1; threadCount < maxThreadCount; threadCount *= 2)
+		{
+			threadCounts.push_back(threadCount);
+		}
+		threadCounts.push_back(maxThreadCount);
+
+		auto measure = [&](unsigned threadCount, bool useAvx2, std::string& name)
+		{
+			CpuSolver solver(threadCount, useAvx2);
+			name = solver.Name();
+			solver.Upload(state);
+			solver.Step(2);
+			const auto start = std::chrono::steady_clock::now();
+			solver.Step(measuredSteps);
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / measuredSteps;
+		};
+
+		std::cout << "[INFO] cpu solver after " << warmupSteps << " steps, " << aliveCount << " particles, average of " << measuredSteps << " steps:" << std::endl;
+		std::string name;
+		double singleThreadTime = 0.0;
+		for (unsigned threadCount : threadCounts)
+		{
+			const double time = measure(threadCount, true, name);
+			if (threadCount == 1)
+			{
+				singleThreadTime = time;
+			}
+			const double speedup = singleThreadTime / time;
+			std::cout << "[INFO]     " << name << ": " << time << " ms/step, " << aliveCount / (time * 1e3) << " Mparticles/s, speedup "
+				<< speedup << ", efficiency " << 100.0 * speedup / threadCount << "%" << std::endl;
+		}
+		if (CpuSupportsAvx2())
+		{
+			for (unsigned threadCount : { 1u, maxThreadCount })
+			{
+				const double time = measure(threadCount, false, name);
+				std::cout << "[INFO]     " << name << ": " << time << " ms/step, " << aliveCount / (time * 1e3) << " Mparticles/s" << std::endl;
+			}
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "solver.h"
+#include "settings.h"
+#include "thread_pool.h"
+#include "cpu_kernels.h"
+#include "boundary.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace SPH
+{
+	// Reference backend on the host: the shaders' density/pressure, force and integrate passes over a cell list with
+	// cells one smoothing length wide. Every step sorts the live particles by cell into SoA copies, so the three cells of
+	// a stencil row are one contiguous candidate range, and runs each pass over the sorted order on the thread pool.
+	// The particle arrays themselves keep the uploaded slot order. The walls are the process' Boundary().
+	class CpuSolver : public Solver
+	{
+	public:
+		// threadCount 0 uses every hardware thread, useAvx2 is ignored on cpus without AVX2
+		explicit CpuSolver(unsigned threadCount = 0, bool useAvx2 = true);
+
+		const char* Name() const override { return name.c_str(); }
+		void Upload(const ParticleState& state) override;
+		void Step(uint32_t stepCount) override;
+		void Download(ParticleState& state) override;
+
+		// Split and decomposed runs own the particles of the slab minX <= x < maxX and see the neighbouring slabs' bands of
+		// 2 * SPH_SMOOTHING_LENGTH as ghosts: ghosts get a density for the owned particles' force pass, but neither force
+		// nor integration. ReplaceHalo drops the old ghosts, adopts the migrated particles and adds the others as ghosts
+		void ReplaceHalo(const std::vector<HaloParticle>& incoming);
+		// removes the owned particles that left the slab and the removed ones, and appends those that left together with a
+		// copy of every owned particle within bandWidth of an edge to the outgoing list of that edge
+		void ExtractHalo(float minX, float maxX, float bandWidth, std::vector<HaloParticle>& towardsMinus, std::vector<HaloParticle>& towardsPlus);
+		uint32_t OwnedCount() const { return ownedCount; }
+
+	private:
+		void BuildCellList();
+		void ComputeDensityPressure();
+		void ComputeForce();
+		void Integrate();
+		// candidate range of the three cells of stencil row y around cell x
+		void RowRange(int x, int y, uint32_t& begin, uint32_t& end) const;
+
+		ThreadPool pool;
+		// the process' walls, fixed when the solver is created
+		const BoundaryField& boundary;
+		DensityKernel densityKernel;
+		ForceKernelFunction forceKernel;
+		std::string name;
+
+		ParticleState particles;
+		// slots past ownedCount are ghosts
+		uint32_t ownedCount = 0;
+		std::vector<uint32_t> cellKey;
+		// cellStart[c] .. cellStart[c + 1] are the sorted indices of cell c
+		std::vector<uint32_t> cellStart;
+		std::unique_ptr<std::atomic<uint32_t>[]> cellCursor;
+		// slot of every sorted index, and the sorted SoA copies the kernels read
+		std::vector<uint32_t> sortedSlot;
+		std::vector<float> sortedX;
+		std::vector<float> sortedY;
+		std::vector<float> sortedVelocityX;
+		std::vector<float> sortedVelocityY;
+		std::vector<float> sortedDensity;
+		std::vector<float> sortedPressure;
+		std::vector<glm::vec2> sortedForce;
+		uint32_t liveCount = 0;
+	};
+
+	// headless runs of the cpu backend, they need neither a window nor a vulkan device
+	void RunCpuSolver(const Settings& settings);
+	void BenchmarkCpuSolver(const Settings& settings);
+}
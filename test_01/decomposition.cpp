@@ -0,0 +1,399 @@
+#include "decomposition.h"
+#include "cpu_solver.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace SPH
+{
+	size_t ShmRing::FootprintSize(size_t capacity)
+	{
+		return sizeof(Header) + capacity;
+	}
+
+	void ShmRing::Initialize(void* memory, size_t capacity)
+	{
+		Header* header = new (memory) Header;
+		header->head.store(0);
+		header->tail.store(0);
+		header->capacity = capacity;
+	}
+
+	ShmRing::ShmRing(void* memory)
+		: header(static_cast<Header*>(memory)), data(static_cast<char*>(memory) + sizeof(Header))
+	{
+	}
+
+	void ShmRing::Send(const std::vector<HaloParticle>& particles)
+	{
+		const uint64_t count = particles.size();
+		const uint64_t size = sizeof(count) + count * sizeof(HaloParticle);
+		if (size > header->capacity)
+		{
+			throw std::runtime_error("halo message larger than the shared-memory ring");
+		}
+		const uint64_t head = header->head.load(std::memory_order_relaxed);
+		while (head + size - header->tail.load(std::memory_order_acquire) > header->capacity)
+		{
+			std::this_thread::yield();
+		}
+		Write(head, &count, sizeof(count));
+		Write(head + sizeof(count), particles.data(), count * sizeof(HaloParticle));
+		// publish the whole message at once
+		header->head.store(head + size, std::memory_order_release);
+	}
+
+	void ShmRing::Receive(std::vector<HaloParticle>& particles)
+	{
+		const uint64_t tail = header->tail.load(std::memory_order_relaxed);
+		while (header->head.load(std::memory_order_acquire) == tail)
+		{
+			std::this_thread::yield();
+		}
+		uint64_t count = 0;
+		Read(tail, &count, sizeof(count));
+		const size_t first = particles.size();
+		particles.resize(first + count);
+		Read(tail + sizeof(count), particles.data() + first, count * sizeof(HaloParticle));
+		header->tail.store(tail + sizeof(count) + count * sizeof(HaloParticle), std::memory_order_release);
+	}
+
+	void ShmRing::Write(uint64_t position, const void* source, size_t size)
+	{
+		const size_t offset = position % header->capacity;
+		const size_t firstPart = std::min(size, static_cast<size_t>(header->capacity - offset));
+		std::memcpy(data + offset, source, firstPart);
+		std::memcpy(data, static_cast<const char*>(source) + firstPart, size - firstPart);
+	}
+
+	void ShmRing::Read(uint64_t position, void* destination, size_t size) const
+	{
+		const size_t offset = position % header->capacity;
+		const size_t firstPart = std::min(size, static_cast<size_t>(header->capacity - offset));
+		std::memcpy(destination, data + offset, firstPart);
+		std::memcpy(static_cast<char*>(destination) + firstPart, data, size - firstPart);
+	}
+
+	namespace
+	{
+		// what every process reports back through the shared segment
+		struct RankResult
+		{
+			double stepTime;
+			double exchangeTime;
+			uint32_t ownedCount;
+			uint32_t aliveCount;
+			uint32_t succeeded;
+		};
+
+		struct DecompositionResult
+		{
+			// of the slowest process, in ms per step
+			double stepTime;
+			double exchangeTime;
+			uint32_t aliveCount;
+			std::vector<uint32_t> ownedCounts;
+		};
+
+		size_t AlignSharedOffset(size_t offset)
+		{
+			return (offset + 63) / 64 * 64;
+		}
+
+		// slab edges at the quantiles of x, the outer slabs are open towards the walls
+		std::vector<float> SlabEdges(const ParticleState& state, uint32_t rankCount, float bandWidth)
+		{
+			std::vector<float> x;
+			for (size_t i = 0; i < state.Size(); i++)
+			{
+				if (state.id[i] != SPH_DEAD_PARTICLE)
+				{
+					x.push_back(state.position[i].x);
+				}
+			}
+			std::sort(x.begin(), x.end());
+			std::vector<float> edges(rankCount + 1);
+			edges[0] = -std::numeric_limits<float>::infinity();
+			edges[rankCount] = std::numeric_limits<float>::infinity();
+			for (uint32_t rank = 1; rank < rankCount; rank++)
+			{
+				edges[rank] = x[x.size() * rank / rankCount];
+			}
+			// ghosts only ever come from the direct neighbours
+			for (uint32_t rank = 1; rank + 1 < rankCount; rank++)
+			{
+				if (edges[rank + 1] - edges[rank] < bandWidth)
+				{
+					throw std::runtime_error("too many processes for the scene, a slab is narrower than the ghost band");
+				}
+			}
+			return edges;
+		}
+
+		void RunRank(uint32_t rank, uint32_t rankCount, const ParticleState& initialState, const std::vector<float>& edges, float bandWidth,
+			uint32_t stepCount, unsigned threadCount, std::vector<ShmRing>& rings, std::atomic<uint32_t>& readyCount, RankResult& result)
+		{
+			CpuSolver solver(threadCount);
+			ParticleState owned;
+			for (size_t i = 0; i < initialState.Size(); i++)
+			{
+				if (initialState.id[i] != SPH_DEAD_PARTICLE && initialState.position[i].x >= edges[rank] && initialState.position[i].x < edges[rank + 1])
+				{
+					owned.PushBack(initialState, i);
+				}
+			}
+			solver.Upload(owned);
+
+			// rings[2 * e] carries edge e's traffic to the right, rings[2 * e + 1] to the left
+			ShmRing* sendMinus = rank > 0 ? &rings[2 * (rank - 1) + 1] : nullptr;
+			ShmRing* receiveMinus = rank > 0 ? &rings[2 * (rank - 1)] : nullptr;
+			ShmRing* sendPlus = rank + 1 < rankCount ? &rings[2 * rank] : nullptr;
+			ShmRing* receivePlus = rank + 1 < rankCount ? &rings[2 * rank + 1] : nullptr;
+
+			// start the clocks together
+			readyCount.fetch_add(1);
+			while (readyCount.load() < rankCount)
+			{
+				std::this_thread::yield();
+			}
+
+			std::vector<HaloParticle> towardsMinus;
+			std::vector<HaloParticle> towardsPlus;
+			std::vector<HaloParticle> incoming;
+			double exchangeTime = 0.0;
+			const auto start = std::chrono::steady_clock::now();
+			for (uint32_t step = 0; step < stepCount; step++)
+			{
+				towardsMinus.clear();
+				towardsPlus.clear();
+				incoming.clear();
+				solver.ExtractHalo(edges[rank], edges[rank + 1], bandWidth, towardsMinus, towardsPlus);
+				const auto exchangeStart = std::chrono::steady_clock::now();
+				if (sendMinus)
+				{
+					sendMinus->Send(towardsMinus);
+				}
+				if (sendPlus)
+				{
+					sendPlus->Send(towardsPlus);
+				}
+				if (receiveMinus)
+				{
+					receiveMinus->Receive(incoming);
+				}
+				if (receivePlus)
+				{
+					receivePlus->Receive(incoming);
+				}
+				exchangeTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - exchangeStart).count();
+				solver.ReplaceHalo(incoming);
+				solver.Step(1);
+			}
+			const double runTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			ParticleState state;
+			solver.Download(state);
+			uint32_t aliveCount = 0;
+			for (uint32_t i = 0; i < solver.OwnedCount(); i++)
+			{
+				aliveCount += state.id[i] != SPH_DEAD_PARTICLE ? 1 : 0;
+			}
+			result.stepTime = runTime / std::max(stepCount, 1u);
+			result.exchangeTime = exchangeTime / std::max(stepCount, 1u);
+			result.ownedCount = solver.OwnedCount();
+			result.aliveCount = aliveCount;
+			result.succeeded = 1;
+		}
+
+		DecompositionResult Decompose(const ParticleState& initialState, uint32_t rankCount, uint32_t stepCount, unsigned threadCount)
+		{
+#ifdef _WIN32
+			throw std::runtime_error("decomposed runs need POSIX shared memory and fork");
+#else
+			if (rankCount == 0)
+			{
+				throw std::runtime_error("a decomposed run needs at least one process");
+			}
+			const float bandWidth = 2 * SPH_SMOOTHING_LENGTH;
+			const std::vector<float> edges = SlabEdges(initialState, rankCount, bandWidth);
+
+			// a ring holds a message in flight and the next one, at worst every particle each
+			const size_t ringCapacity = 2 * (sizeof(uint64_t) + sizeof(HaloParticle) * initialState.Size());
+			const size_t resultsOffset = AlignSharedOffset(sizeof(std::atomic<uint32_t>));
+			const size_t ringsOffset = AlignSharedOffset(resultsOffset + sizeof(RankResult) * rankCount);
+			const size_t ringStride = AlignSharedOffset(ShmRing::FootprintSize(ringCapacity));
+			const uint32_t ringCount = 2 * (rankCount - 1);
+			const size_t sharedSize = ringsOffset + ringStride * ringCount;
+
+			// the name is only needed until the mapping exists, the children inherit the mapping
+			const std::string sharedName = "/vulkan_sph_" + std::to_string(getpid());
+			const int descriptor = shm_open(sharedName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+			if (descriptor < 0)
+			{
+				throw std::runtime_error("shm_open failed for " + sharedName);
+			}
+			shm_unlink(sharedName.c_str());
+			if (ftruncate(descriptor, static_cast<off_t>(sharedSize)) != 0)
+			{
+				close(descriptor);
+				throw std::runtime_error("shared memory resize failed");
+			}
+			void* shared = mmap(NULL, sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+			close(descriptor);
+			if (shared == MAP_FAILED)
+			{
+				throw std::runtime_error("shared memory mapping failed");
+			}
+			char* sharedBytes = static_cast<char*>(shared);
+			std::memset(sharedBytes, 0, ringsOffset);
+			std::atomic<uint32_t>* readyCount = new (sharedBytes) std::atomic<uint32_t>(0);
+			RankResult* results = reinterpret_cast<RankResult*>(sharedBytes + resultsOffset);
+			std::vector<ShmRing> rings;
+			for (uint32_t i = 0; i < ringCount; i++)
+			{
+				ShmRing::Initialize(sharedBytes + ringsOffset + ringStride * i, ringCapacity);
+				rings.emplace_back(sharedBytes + ringsOffset + ringStride * i);
+			}
+
+			std::vector<pid_t> children;
+			for (uint32_t rank = 0; rank < rankCount; rank++)
+			{
+				const pid_t pid = fork();
+				if (pid < 0)
+				{
+					break;
+				}
+				if (pid == 0)
+				{
+					int status = 1;
+					try
+					{
+						RunRank(rank, rankCount, initialState, edges, bandWidth, stepCount, threadCount, rings, *readyCount, results[rank]);
+						status = 0;
+					}
+					catch (const std::exception& exception)
+					{
+						std::cerr << "[ERROR] process " << rank << ": " << exception.what() << std::endl;
+					}
+					std::cout.flush();
+					_exit(status);
+				}
+				children.push_back(pid);
+			}
+			bool succeeded = children.size() == rankCount;
+			for (pid_t child : children)
+			{
+				int status = 0;
+				waitpid(child, &status, 0);
+				succeeded = succeeded && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+			}
+
+			DecompositionResult result{ 0.0, 0.0, 0, {} };
+			for (uint32_t rank = 0; rank < rankCount && succeeded; rank++)
+			{
+				succeeded = results[rank].succeeded != 0;
+				if (results[rank].stepTime > result.stepTime)
+				{
+					result.stepTime = results[rank].stepTime;
+					result.exchangeTime = results[rank].exchangeTime;
+				}
+				result.aliveCount += results[rank].aliveCount;
+				result.ownedCounts.push_back(results[rank].ownedCount);
+			}
+			munmap(shared, sharedSize);
+			if (!succeeded)
+			{
+				throw std::runtime_error("a process of the decomposed run failed");
+			}
+			return result;
+#endif
+		}
+
+		uint32_t CountAlive(const ParticleState& state)
+		{
+			uint32_t aliveCount = 0;
+			for (uint32_t id : state.id)
+			{
+				aliveCount += id != SPH_DEAD_PARTICLE ? 1 : 0;
+			}
+			return aliveCount;
+		}
+	}
+
+	void RunDecomposed(const Settings& settings)
+	{
+		// one thread per process unless asked otherwise, the processes are the parallelism
+		const unsigned threadCount = settings.threadCount > 0 ? settings.threadCount : 1;
+		const ParticleState initialState = InitialDamBreak();
+		std::cout << "[INFO] running " << settings.stepCount << " steps on " << settings.rankCount << " processes of " << threadCount << " threads" << std::endl;
+		const DecompositionResult result = Decompose(initialState, settings.rankCount, settings.stepCount, threadCount);
+		std::cout << "[INFO] " << 1e3 / result.stepTime << " steps/s, " << result.stepTime << " ms/step of which " << result.exchangeTime
+			<< " ms halo exchange, " << result.aliveCount << " particles alive, per process:";
+		for (uint32_t ownedCount : result.ownedCounts)
+		{
+			std::cout << " " << ownedCount;
+		}
+		std::cout << std::endl;
+	}
+
+	void BenchmarkDecomposition(const Settings& settings)
+	{
+		const uint32_t warmupSteps = 500;
+		const uint32_t measuredSteps = SPH_DECOMPOSITION_BENCHMARK_STEPS;
+		const unsigned threadCount = settings.threadCount > 0 ? settings.threadCount : 1;
+		const uint32_t particlesPerRank = SPH_NUM_PARTICLES / SPH_DECOMPOSITION_MAX_RANKS;
+
+		// a splashing dam-break rather than the regular initial lattice, warmed up in one process
+		auto warmScene = [&](uint32_t particleCount)
+		{
+			CpuSolver warmup(settings.threadCount);
+			warmup.Upload(InitialDamBreak(particleCount));
+			warmup.Step(warmupSteps);
+			ParticleState state;
+			warmup.Download(state);
+			return state;
+		};
+
+		std::cout << "[INFO] decomposed cpu solver, " << threadCount << " threads per process, " << std::thread::hardware_concurrency()
+			<< " hardware threads, average of " << measuredSteps << " steps after " << warmupSteps << ":" << std::endl;
+		const ParticleState strongScene = warmScene(SPH_NUM_PARTICLES);
+		std::cout << "[INFO]     strong scaling, " << CountAlive(strongScene) << " particles:" << std::endl;
+		double singleRankTime = 0.0;
+		for (uint32_t rankCount = 1; rankCount <= SPH_DECOMPOSITION_MAX_RANKS; rankCount *= 2)
+		{
+			const DecompositionResult result = Decompose(strongScene, rankCount, measuredSteps, threadCount);
+			if (rankCount == 1)
+			{
+				singleRankTime = result.stepTime;
+			}
+			const double speedup = singleRankTime / result.stepTime;
+			std::cout << "[INFO]         " << rankCount << " processes: " << result.stepTime << " ms/step, exchange " << result.exchangeTime
+				<< " ms, speedup " << speedup << ", efficiency " << 100.0 * speedup / rankCount << "%" << std::endl;
+		}
+
+		std::cout << "[INFO]     weak scaling, " << particlesPerRank << " particles per process at the start:" << std::endl;
+		for (uint32_t rankCount = 1; rankCount <= SPH_DECOMPOSITION_MAX_RANKS; rankCount *= 2)
+		{
+			const ParticleState weakScene = warmScene(particlesPerRank * rankCount);
+			const DecompositionResult result = Decompose(weakScene, rankCount, measuredSteps, threadCount);
+			if (rankCount == 1)
+			{
+				singleRankTime = result.stepTime;
+			}
+			std::cout << "[INFO]         " << rankCount << " processes, " << CountAlive(weakScene) << " particles: " << result.stepTime
+				<< " ms/step, exchange " << result.exchangeTime << " ms, efficiency " << 100.0 * singleRankTime / result.stepTime << "%" << std::endl;
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "solver.h"
+#include "settings.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// steps timed per process count by the decomposition benchmark, after a single-process warmup of the scene
+#ifndef SPH_DECOMPOSITION_BENCHMARK_STEPS
+#define SPH_DECOMPOSITION_BENCHMARK_STEPS 200
+#endif
+#define SPH_DECOMPOSITION_MAX_RANKS 8
+
+namespace SPH
+{
+	// Single-producer single-consumer byte ring in memory shared by two processes. A message is a particle count followed
+	// by that many HaloParticles. Send blocks while the ring lacks room for the whole message, Receive until one arrived.
+	// The positions only grow, so the ring never confuses full and empty
+	class ShmRing
+	{
+	public:
+		// bytes of shared memory a ring with capacity bytes of payload needs
+		static size_t FootprintSize(size_t capacity);
+		// sets up a ring in memory of FootprintSize(capacity) bytes, once, before either side uses it
+		static void Initialize(void* memory, size_t capacity);
+
+		explicit ShmRing(void* memory);
+		void Send(const std::vector<HaloParticle>& particles);
+		// appends the particles of the next message
+		void Receive(std::vector<HaloParticle>& particles);
+
+	private:
+		// head and tail on their own cache lines, the writer only moves the head and the reader only the tail
+		struct Header
+		{
+			alignas(64) std::atomic<uint64_t> head;
+			alignas(64) std::atomic<uint64_t> tail;
+			alignas(64) uint64_t capacity;
+		};
+
+		void Write(uint64_t position, const void* source, size_t size);
+		void Read(uint64_t position, void* destination, size_t size) const;
+
+		Header* header = nullptr;
+		char* data = nullptr;
+	};
+
+	// Domain decomposition over processes on one host: the domain is cut into vertical slabs holding equal particle counts
+	// at the start, one forked process with its own CpuSolver per slab. After every step each process sends its
+	// neighbours the particles within 2 * SPH_SMOOTHING_LENGTH of the shared edge as ghosts, together with those that
+	// crossed it, through a pair of ShmRings per edge in one POSIX shared-memory segment
+	void RunDecomposed(const Settings& settings);
+	// strong (fixed scene) and weak (fixed particles per process) scaling over 1 to SPH_DECOMPOSITION_MAX_RANKS processes
+	void BenchmarkDecomposition(const Settings& settings);
+}
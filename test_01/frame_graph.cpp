@@ -0,0 +1,199 @@
+#include "frame_graph.h"
+#include <algorithm>
+
+namespace SPH
+{
+	namespace
+	{
+		const VkAccessFlags WriteAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+		// what the command buffers recorded by hand around the graph do
+		const VkPipelineStageFlags OutsideStages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+		const VkAccessFlags OutsideWriteAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+		const VkPipelineStageFlags ExitStages = OutsideStages | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT;
+		const VkAccessFlags ExitAccess = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT
+			| VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+
+		VkDeviceSize RangeEnd(const VkDescriptorBufferInfo& range)
+		{
+			return range.range == VK_WHOLE_SIZE ? UINT64_MAX : range.offset + range.range;
+		}
+
+		VkDescriptorBufferInfo Span(VkBuffer buffer, VkDeviceSize begin, VkDeviceSize end)
+		{
+			return { buffer, begin, end == UINT64_MAX ? VK_WHOLE_SIZE : end - begin };
+		}
+
+		// one buffer memory barrier per buffer and access pair, covering every range it is needed for
+		void AddBufferBarrier(std::vector<VkBufferMemoryBarrier>& barriers, const VkDescriptorBufferInfo& range, VkAccessFlags srcAccess, VkAccessFlags dstAccess)
+		{
+			for (VkBufferMemoryBarrier& barrier : barriers)
+			{
+				if (barrier.buffer == range.buffer && barrier.srcAccessMask == srcAccess && barrier.dstAccessMask == dstAccess)
+				{
+					const VkDeviceSize end = std::max(RangeEnd({ barrier.buffer, barrier.offset, barrier.size }), RangeEnd(range));
+					barrier.offset = std::min(barrier.offset, range.offset);
+					barrier.size = Span(range.buffer, barrier.offset, end).range;
+					return;
+				}
+			}
+			barriers.push_back({ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER, NULL, srcAccess, dstAccess, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+				range.buffer, range.offset, range.range });
+		}
+	}
+
+	void FrameGraph::AddPass(const char* name, std::vector<BufferAccess> accesses, std::function<void(VkCommandBuffer)> record)
+	{
+		passes.push_back({ name, std::move(accesses), std::move(record), 0 });
+	}
+
+	bool FrameGraph::Overlaps(const VkDescriptorBufferInfo& a, const VkDescriptorBufferInfo& b)
+	{
+		return a.buffer == b.buffer && a.offset < RangeEnd(b) && b.offset < RangeEnd(a);
+	}
+
+	bool FrameGraph::Conflicts(const Pass& earlier, const Pass& later)
+	{
+		for (const BufferAccess& first : earlier.accesses)
+		{
+			for (const BufferAccess& second : later.accesses)
+			{
+				if (((first.access | second.access) & WriteAccess) && Overlaps(first.range, second.range))
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	FrameGraph::RangeState& FrameGraph::StateOf(std::vector<RangeState>& states, const VkDescriptorBufferInfo& range) const
+	{
+		for (RangeState& state : states)
+		{
+			if (state.range.buffer == range.buffer && state.range.offset == range.offset && state.range.range == range.range)
+			{
+				return state;
+			}
+		}
+		// a range first seen may still be in use by the work before the command buffer
+		states.push_back({ range, OutsideStages, OutsideWriteAccess, OutsideStages, 0, 0, 0 });
+		return states.back();
+	}
+
+	FrameGraph::Statistics FrameGraph::Record(VkCommandBuffer commandBuffer)
+	{
+		Statistics statistics;
+		statistics.passCount = static_cast<uint32_t>(passes.size());
+		for (size_t later = 0; later < passes.size(); later++)
+		{
+			passes[later].level = 0;
+			for (size_t earlier = 0; earlier < later; earlier++)
+			{
+				if (passes[earlier].level + 1 > passes[later].level && Conflicts(passes[earlier], passes[later]))
+				{
+					passes[later].level = passes[earlier].level + 1;
+				}
+			}
+			statistics.levelCount = std::max(statistics.levelCount, passes[later].level + 1);
+		}
+
+		std::vector<RangeState> states;
+		std::vector<VkBufferMemoryBarrier> barriers;
+		auto emitBarrier = [&](VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages)
+		{
+			if (srcStages != 0)
+			{
+				vkCmdPipelineBarrier(commandBuffer, srcStages, dstStages, 0, 0, NULL, static_cast<uint32_t>(barriers.size()), barriers.data(), 0, NULL);
+				statistics.barrierCount++;
+				statistics.bufferBarrierCount += static_cast<uint32_t>(barriers.size());
+			}
+			barriers.clear();
+		};
+		for (uint32_t level = 0; level < statistics.levelCount; level++)
+		{
+			// what the level waits for, checked against the levels before it only
+			VkPipelineStageFlags srcStages = 0;
+			VkPipelineStageFlags dstStages = 0;
+			for (const Pass& pass : passes)
+			{
+				if (pass.level != level)
+				{
+					continue;
+				}
+				for (const BufferAccess& access : pass.accesses)
+				{
+					StateOf(states, access.range);
+					for (RangeState& state : states)
+					{
+						if (!Overlaps(state.range, access.range))
+						{
+							continue;
+						}
+						if (state.writeAccess != 0 && ((access.stages & ~state.visibleStages) != 0 || (access.access & ~state.visibleAccess) != 0))
+						{
+							srcStages |= state.writeStages;
+							dstStages |= access.stages;
+							AddBufferBarrier(barriers, Span(access.range.buffer, std::max(state.range.offset, access.range.offset),
+								std::min(RangeEnd(state.range), RangeEnd(access.range))), state.writeAccess, access.access);
+							state.visibleStages |= access.stages;
+							state.visibleAccess |= access.access;
+						}
+						if ((access.access & WriteAccess) != 0 && state.readStages != 0 && (access.stages & ~state.readOrderedStages) != 0)
+						{
+							// overwriting what was only read needs the reads done, not made visible
+							srcStages |= state.readStages;
+							dstStages |= access.stages;
+							state.readOrderedStages |= access.stages;
+						}
+					}
+				}
+			}
+			emitBarrier(srcStages, dstStages);
+
+			statistics.schedule += level == 0 ? "" : " | ";
+			bool firstInLevel = true;
+			for (const Pass& pass : passes)
+			{
+				if (pass.level == level)
+				{
+					pass.record(commandBuffer);
+					statistics.schedule += firstInLevel ? pass.name : std::string(" + ") + pass.name;
+					firstInLevel = false;
+				}
+			}
+			for (const Pass& pass : passes)
+			{
+				if (pass.level != level)
+				{
+					continue;
+				}
+				for (const BufferAccess& access : pass.accesses)
+				{
+					RangeState& state = StateOf(states, access.range);
+					if (access.access & WriteAccess)
+					{
+						state = { access.range, access.stages, access.access & WriteAccess, (access.access & ~WriteAccess) ? access.stages : 0u, 0, 0, 0 };
+					}
+					else
+					{
+						state.readStages |= access.stages;
+					}
+				}
+			}
+		}
+
+		// hand the writes over to the work after the command buffer
+		VkPipelineStageFlags srcStages = 0;
+		for (const RangeState& state : states)
+		{
+			if (state.writeAccess != 0 && ((ExitStages & ~state.visibleStages) != 0 || (ExitAccess & ~state.visibleAccess) != 0))
+			{
+				srcStages |= state.writeStages;
+				AddBufferBarrier(barriers, state.range, state.writeAccess, ExitAccess);
+			}
+			srcStages |= state.readStages;
+		}
+		emitBarrier(srcStages, ExitStages);
+		return statistics;
+	}
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace SPH
+{
+	// how a pass touches a buffer range, the range is given like the descriptors that bind it
+	struct BufferAccess
+	{
+		VkDescriptorBufferInfo range;
+		VkPipelineStageFlags stages;
+		VkAccessFlags access;
+
+		static BufferAccess ShaderRead(const VkDescriptorBufferInfo& range) { return { range, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT }; }
+		static BufferAccess ShaderWrite(const VkDescriptorBufferInfo& range) { return { range, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT }; }
+		static BufferAccess ShaderReadWrite(const VkDescriptorBufferInfo& range) { return { range, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT }; }
+		static BufferAccess IndirectRead(const VkDescriptorBufferInfo& range) { return { range, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT }; }
+		static BufferAccess TransferRead(const VkDescriptorBufferInfo& range) { return { range, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT }; }
+		static BufferAccess TransferWrite(const VkDescriptorBufferInfo& range) { return { range, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT }; }
+	};
+
+	// Orders the passes of one command buffer by the buffer ranges they declare instead of by global barriers. A pass
+	// runs one level after the latest earlier pass it conflicts with (read after write, write after read or write after
+	// write on overlapping ranges), the passes of a level share no hazard and run without a barrier between them. The
+	// barrier in front of a level only carries buffer memory barriers for the ranges its passes wait for, merged per
+	// buffer, or no more than an execution dependency when a pass only overwrites what an earlier one read.
+	// Work submitted before the command buffer is taken to have read and written every range from the compute and
+	// transfer stages, and the writes of the last levels are made visible to the compute, transfer and indirect
+	// stages at the end, so the recorded graph drops in between the hand-written command buffers
+	class FrameGraph
+	{
+	public:
+		struct Statistics
+		{
+			uint32_t passCount = 0;
+			uint32_t levelCount = 0;
+			uint32_t barrierCount = 0;
+			uint32_t bufferBarrierCount = 0;
+			// the pass names level by level, "a + b | c" runs a and b together and c after them
+			std::string schedule;
+		};
+
+		// the record function binds its own pipelines and descriptor sets, passes may be reordered within their level
+		void AddPass(const char* name, std::vector<BufferAccess> accesses, std::function<void(VkCommandBuffer)> record);
+		Statistics Record(VkCommandBuffer commandBuffer);
+
+	private:
+		struct Pass
+		{
+			const char* name;
+			std::vector<BufferAccess> accesses;
+			std::function<void(VkCommandBuffer)> record;
+			uint32_t level;
+		};
+		// what has happened to a range since it was last written, and which later stages were already ordered after that
+		struct RangeState
+		{
+			VkDescriptorBufferInfo range;
+			VkPipelineStageFlags writeStages;
+			VkAccessFlags writeAccess;
+			VkPipelineStageFlags readStages;
+			// stages and accesses a barrier already made the write visible to, and stages ordered after the reads
+			VkPipelineStageFlags visibleStages;
+			VkAccessFlags visibleAccess;
+			VkPipelineStageFlags readOrderedStages;
+		};
+
+		static bool Overlaps(const VkDescriptorBufferInfo& a, const VkDescriptorBufferInfo& b);
+		static bool Conflicts(const Pass& earlier, const Pass& later);
+		RangeState& StateOf(std::vector<RangeState>& states, const VkDescriptorBufferInfo& range) const;
+
+		std::vector<Pass> passes;
+	};
+}
@@ -0,0 +1,301 @@
+#include "gpu_primitives.h"
+#include "vkcsy.h"
+#include <stdexcept>
+#include <iostream>
+
+namespace SPH
+{
+	GpuPrimitives::GpuPrimitives(VkDevice device, VkPipelineCache pipelineCache, const std::string& shaderPath, VkDeviceSize storageBufferOffsetAlignment)
+		: device(device), pipelineCache(pipelineCache), shaderPath(shaderPath), offsetAlignment(storageBufferOffsetAlignment > 0 ? storageBufferOffsetAlignment : 1)
+	{
+		VkDescriptorSetLayoutBinding descriptorSetLayoutBindings[PRIMITIVES_NUM_BINDINGS];
+		for (uint32_t index = 0; index < PRIMITIVES_NUM_BINDINGS; index++)
+		{
+			descriptorSetLayoutBindings[index].binding = index;
+			descriptorSetLayoutBindings[index].descriptorCount = 1;
+			descriptorSetLayoutBindings[index].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorSetLayoutBindings[index].pImmutableSamplers = nullptr;
+			descriptorSetLayoutBindings[index].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		}
+		VkDescriptorSetLayoutCreateInfo descriptorSetLayoutCreateInfo = CsySmallVk::descriptorSetLayoutCreateInfo();
+		descriptorSetLayoutCreateInfo.bindingCount = PRIMITIVES_NUM_BINDINGS;
+		descriptorSetLayoutCreateInfo.pBindings = descriptorSetLayoutBindings;
+		if (vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, NULL, &descriptorSetLayoutHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("primitives descriptor layout creation failed");
+		}
+
+		VkPushConstantRange pushConstantRange
+		{
+			VK_SHADER_STAGE_COMPUTE_BIT,
+			0,
+			sizeof(PushConstants)
+		};
+		VkPipelineLayoutCreateInfo layoutCreateInfo = CsySmallVk::pipelineLayoutCreateInfo();
+		layoutCreateInfo.setLayoutCount = 1;
+		layoutCreateInfo.pSetLayouts = &descriptorSetLayoutHandle;
+		layoutCreateInfo.pushConstantRangeCount = 1;
+		layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+		if (vkCreatePipelineLayout(device, &layoutCreateInfo, NULL, &pipelineLayoutHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("primitives pipeline layout creation failed");
+		}
+
+		// one set per distinct buffer combination, see GetDescriptorSet
+		const uint32_t maxDescriptorSets = 256;
+		VkDescriptorPoolSize descriptorPoolSize
+		{
+			VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			maxDescriptorSets * PRIMITIVES_NUM_BINDINGS
+		};
+		VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = CsySmallVk::descriptorPoolCreateInfo();
+		descriptorPoolCreateInfo.maxSets = maxDescriptorSets;
+		descriptorPoolCreateInfo.poolSizeCount = 1;
+		descriptorPoolCreateInfo.pPoolSizes = &descriptorPoolSize;
+		if (vkCreateDescriptorPool(device, &descriptorPoolCreateInfo, NULL, &descriptorPoolHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("primitives descriptor pool creation failed");
+		}
+
+		scanBlockPipelineHandle = CreatePipeline("scan_block.comp.spv");
+		scanAddPipelineHandle = CreatePipeline("scan_add.comp.spv");
+		radixHistogramPipelineHandle = CreatePipeline("radix_histogram.comp.spv");
+		radixScatterPipelineHandle = CreatePipeline("radix_scatter.comp.spv");
+		compactScatterPipelineHandle = CreatePipeline("compact_scatter.comp.spv");
+		std::cout << "Successfully create gpu primitives" << std::endl;
+	}
+
+	GpuPrimitives::~GpuPrimitives()
+	{
+		vkDestroyPipeline(device, scanBlockPipelineHandle, NULL);
+		vkDestroyPipeline(device, scanAddPipelineHandle, NULL);
+		vkDestroyPipeline(device, radixHistogramPipelineHandle, NULL);
+		vkDestroyPipeline(device, radixScatterPipelineHandle, NULL);
+		vkDestroyPipeline(device, compactScatterPipelineHandle, NULL);
+		vkDestroyDescriptorPool(device, descriptorPoolHandle, NULL);
+		vkDestroyPipelineLayout(device, pipelineLayoutHandle, NULL);
+		vkDestroyDescriptorSetLayout(device, descriptorSetLayoutHandle, NULL);
+	}
+
+	VkPipeline GpuPrimitives::CreatePipeline(const std::string& shaderFileName)
+	{
+		auto shaderCode = CsySmallVk::readFile(shaderPath + shaderFileName);
+		VkShaderModuleCreateInfo shaderModuleCreateInfo = CsySmallVk::shaderModuleCreateInfo();
+		shaderModuleCreateInfo.codeSize = shaderCode.size();
+		shaderModuleCreateInfo.pCode = reinterpret_cast<const uint32_t*>(shaderCode.data());
+		VkShaderModule shaderModule = VK_NULL_HANDLE;
+		if (vkCreateShaderModule(device, &shaderModuleCreateInfo, NULL, &shaderModule) != VK_SUCCESS)
+		{
+			throw std::runtime_error("fail to create shader module");
+		}
+
+		VkPipelineShaderStageCreateInfo shaderStageCreateInfo = CsySmallVk::pipelineShaderStageCreateInfo();
+		shaderStageCreateInfo.module = shaderModule;
+		shaderStageCreateInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+		shaderStageCreateInfo.pName = "main";
+
+		VkComputePipelineCreateInfo createInfo = CsySmallVk::computePipelineCreateInfo();
+		createInfo.basePipelineHandle = VK_NULL_HANDLE;
+		createInfo.basePipelineIndex = 0;
+		createInfo.stage = shaderStageCreateInfo;
+		createInfo.layout = pipelineLayoutHandle;
+		VkPipeline pipelineHandle = VK_NULL_HANDLE;
+		if (vkCreateComputePipelines(device, pipelineCache, 1, &createInfo, NULL, &pipelineHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("primitives compute pipeline creation failed: " + shaderFileName);
+		}
+		vkDestroyShaderModule(device, shaderModule, NULL);
+		return pipelineHandle;
+	}
+
+	VkDescriptorSet GpuPrimitives::GetDescriptorSet(const Bindings& bindings)
+	{
+		std::array<uint64_t, 3 * PRIMITIVES_NUM_BINDINGS> key;
+		for (uint32_t index = 0; index < PRIMITIVES_NUM_BINDINGS; index++)
+		{
+			key[3 * index] = (uint64_t)(bindings[index].buffer);
+			key[3 * index + 1] = bindings[index].offset;
+			key[3 * index + 2] = bindings[index].range;
+		}
+		auto cached = descriptorSetCache.find(key);
+		if (cached != descriptorSetCache.end())
+		{
+			return cached->second;
+		}
+
+		VkDescriptorSet descriptorSetHandle = VK_NULL_HANDLE;
+		VkDescriptorSetAllocateInfo allocInfo = CsySmallVk::descriptorSetAllocateInfo();
+		allocInfo.descriptorPool = descriptorPoolHandle;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &descriptorSetLayoutHandle;
+		if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSetHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("primitives descriptor set allocation failed");
+		}
+		VkWriteDescriptorSet writeDescriptorSets[PRIMITIVES_NUM_BINDINGS];
+		for (uint32_t index = 0; index < PRIMITIVES_NUM_BINDINGS; index++)
+		{
+			VkWriteDescriptorSet write = CsySmallVk::writeDescriptorSet();
+			write.descriptorCount = 1;
+			write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.dstBinding = index;
+			write.dstArrayElement = 0;
+			write.dstSet = descriptorSetHandle;
+			write.pBufferInfo = &bindings[index];
+			writeDescriptorSets[index] = write;
+		}
+		vkUpdateDescriptorSets(device, PRIMITIVES_NUM_BINDINGS, writeDescriptorSets, 0, NULL);
+		descriptorSetCache[key] = descriptorSetHandle;
+		return descriptorSetHandle;
+	}
+
+	void GpuPrimitives::Dispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, const Bindings& bindings, const PushConstants& pushConstants, uint32_t groupCount)
+	{
+		VkDescriptorSet descriptorSetHandle = GetDescriptorSet(bindings);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayoutHandle, 0, 1, &descriptorSetHandle, 0, NULL);
+		vkCmdPushConstants(commandBuffer, pipelineLayoutHandle, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, groupCount, 1, 1);
+	}
+
+	void GpuPrimitives::Barrier(VkCommandBuffer commandBuffer)
+	{
+		VkMemoryBarrier memoryBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+	}
+
+	VkDeviceSize GpuPrimitives::Align(VkDeviceSize size) const
+	{
+		return (size + offsetAlignment - 1) / offsetAlignment * offsetAlignment;
+	}
+
+	VkDescriptorBufferInfo GpuPrimitives::SubRange(const VkDescriptorBufferInfo& range, VkDeviceSize offset, VkDeviceSize size) const
+	{
+		if (range.range != VK_WHOLE_SIZE && offset + (size == VK_WHOLE_SIZE ? 0 : size) > range.range)
+		{
+			throw std::runtime_error("primitives scratch range too small");
+		}
+		if (size == VK_WHOLE_SIZE && range.range != VK_WHOLE_SIZE)
+		{
+			size = range.range - offset;
+		}
+		return { range.buffer, range.offset + offset, size };
+	}
+
+	uint32_t GpuPrimitives::BlockCount(uint32_t count)
+	{
+		return count == 0 ? 1 : (count + PRIMITIVES_BLOCK_SIZE - 1) / PRIMITIVES_BLOCK_SIZE;
+	}
+
+	VkDeviceSize GpuPrimitives::ScanScratchSize(uint32_t count) const
+	{
+		// one block sum array per level of the scan hierarchy
+		VkDeviceSize size = 0;
+		uint32_t levelCount = count;
+		do
+		{
+			uint32_t blockCount = BlockCount(levelCount);
+			size += Align(sizeof(uint32_t) * blockCount);
+			levelCount = blockCount;
+		} while (levelCount > 1);
+		return size;
+	}
+
+	VkDeviceSize GpuPrimitives::SortScratchSize(uint32_t count) const
+	{
+		// ping-pong keys and values, per block digit histogram and the scratch of its scan
+		const uint32_t histogramCount = PRIMITIVES_RADIX_DIGITS * BlockCount(count);
+		return 2 * Align(sizeof(uint32_t) * count) + Align(sizeof(uint32_t) * histogramCount) + ScanScratchSize(histogramCount);
+	}
+
+	VkDeviceSize GpuPrimitives::CompactScratchSize(uint32_t count) const
+	{
+		// output offsets of the kept elements and the scratch of the scan producing them
+		return Align(sizeof(uint32_t) * count) + ScanScratchSize(count);
+	}
+
+	void GpuPrimitives::RecordWorkgroupScan(VkCommandBuffer commandBuffer, const VkDescriptorBufferInfo& input, const VkDescriptorBufferInfo& output,
+		const VkDescriptorBufferInfo& blockSums, uint32_t count)
+	{
+		PushConstants pushConstants{ count, 0, BlockCount(count), 0, 0 };
+		Dispatch(commandBuffer, scanBlockPipelineHandle, { input, output, blockSums, output, output }, pushConstants, BlockCount(count));
+	}
+
+	void GpuPrimitives::RecordExclusiveScan(VkCommandBuffer commandBuffer, const VkDescriptorBufferInfo& input, const VkDescriptorBufferInfo& output,
+		uint32_t count, const VkDescriptorBufferInfo& scratch)
+	{
+		// scan every block, scan the block totals recursively, then add each block's offset to its elements
+		const uint32_t blockCount = BlockCount(count);
+		const VkDeviceSize blockSumsSize = Align(sizeof(uint32_t) * blockCount);
+		VkDescriptorBufferInfo blockSums = SubRange(scratch, 0, blockSumsSize);
+		RecordWorkgroupScan(commandBuffer, input, output, blockSums, count);
+		if (blockCount > 1)
+		{
+			Barrier(commandBuffer);
+			RecordExclusiveScan(commandBuffer, blockSums, blockSums, blockCount, SubRange(scratch, blockSumsSize, VK_WHOLE_SIZE));
+			Barrier(commandBuffer);
+			PushConstants pushConstants{ count, 0, blockCount, 0, 0 };
+			Dispatch(commandBuffer, scanAddPipelineHandle, { output, output, blockSums, output, output }, pushConstants, blockCount);
+		}
+	}
+
+	void GpuPrimitives::RecordSort(VkCommandBuffer commandBuffer, const VkDescriptorBufferInfo& keys, const VkDescriptorBufferInfo& values,
+		uint32_t count, const VkDescriptorBufferInfo& scratch, uint32_t keyBits)
+	{
+		const uint32_t blockCount = BlockCount(count);
+		const uint32_t histogramCount = PRIMITIVES_RADIX_DIGITS * blockCount;
+		const VkDeviceSize elementsSize = Align(sizeof(uint32_t) * count);
+		const VkDeviceSize histogramSize = Align(sizeof(uint32_t) * histogramCount);
+		VkDescriptorBufferInfo scratchKeys = SubRange(scratch, 0, elementsSize);
+		VkDescriptorBufferInfo scratchValues = SubRange(scratch, elementsSize, elementsSize);
+		VkDescriptorBufferInfo histogram = SubRange(scratch, 2 * elementsSize, histogramSize);
+		VkDescriptorBufferInfo scanScratch = SubRange(scratch, 2 * elementsSize + histogramSize, VK_WHOLE_SIZE);
+
+		uint32_t passCount = (keyBits + PRIMITIVES_RADIX_BITS - 1) / PRIMITIVES_RADIX_BITS;
+		passCount += passCount % 2;
+		for (uint32_t pass = 0; pass < passCount; pass++)
+		{
+			const bool fromInput = pass % 2 == 0;
+			const VkDescriptorBufferInfo& sourceKeys = fromInput ? keys : scratchKeys;
+			const VkDescriptorBufferInfo& sourceValues = fromInput ? values : scratchValues;
+			const VkDescriptorBufferInfo& destinationKeys = fromInput ? scratchKeys : keys;
+			const VkDescriptorBufferInfo& destinationValues = fromInput ? scratchValues : values;
+			PushConstants pushConstants{ count, pass * PRIMITIVES_RADIX_BITS, blockCount, 0, 0 };
+
+			if (pass > 0)
+			{
+				Barrier(commandBuffer);
+			}
+			// digit count of every block, stored digit-major so that one scan yields every block's output offset per digit
+			Dispatch(commandBuffer, radixHistogramPipelineHandle, { sourceKeys, sourceKeys, histogram, sourceKeys, sourceKeys }, pushConstants, blockCount);
+			Barrier(commandBuffer);
+			RecordExclusiveScan(commandBuffer, histogram, histogram, histogramCount, scanScratch);
+			Barrier(commandBuffer);
+			Dispatch(commandBuffer, radixScatterPipelineHandle, { sourceKeys, destinationKeys, histogram, sourceValues, destinationValues }, pushConstants, blockCount);
+		}
+	}
+
+	void GpuPrimitives::RecordCompact(VkCommandBuffer commandBuffer, const VkDescriptorBufferInfo& flags, const VkDescriptorBufferInfo& values,
+		const VkDescriptorBufferInfo& output, const VkDescriptorBufferInfo& result, uint32_t count, uint32_t dispatchGroupSize,
+		const VkDescriptorBufferInfo& scratch)
+	{
+		if (count == 0 || dispatchGroupSize == 0)
+		{
+			throw std::runtime_error("compaction needs at least one element and a non-zero dispatch group size");
+		}
+		const VkDeviceSize offsetsSize = Align(sizeof(uint32_t) * count);
+		VkDescriptorBufferInfo offsets = SubRange(scratch, 0, offsetsSize);
+		RecordExclusiveScan(commandBuffer, flags, offsets, count, SubRange(scratch, offsetsSize, VK_WHOLE_SIZE));
+		Barrier(commandBuffer);
+
+		const bool hasValues = values.buffer != VK_NULL_HANDLE;
+		PushConstants pushConstants{ count, 0, BlockCount(count), dispatchGroupSize, hasValues ? 1u : 0u };
+		Dispatch(commandBuffer, compactScatterPipelineHandle, { flags, offsets, hasValues ? values : flags, output, result }, pushConstants, BlockCount(count));
+	}
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <map>
+#include <array>
+#include <string>
+
+// every primitive works on blocks of PRIMITIVES_BLOCK_SIZE elements, one per workgroup of 128 threads with 4 elements each
+#define PRIMITIVES_WORK_GROUP_SIZE 128
+#define PRIMITIVES_ITEMS_PER_THREAD 4
+#define PRIMITIVES_BLOCK_SIZE (PRIMITIVES_WORK_GROUP_SIZE * PRIMITIVES_ITEMS_PER_THREAD)
+// the radix sort consumes 4 bits per pass, 8 passes for 32-bit keys
+#define PRIMITIVES_RADIX_BITS 4
+#define PRIMITIVES_RADIX_DIGITS (1 << PRIMITIVES_RADIX_BITS)
+// storage buffer bindings shared by all primitive pipelines
+#define PRIMITIVES_NUM_BINDINGS 5
+
+namespace SPH
+{
+	// result of a compaction, the first three members can be passed straight to vkCmdDispatchIndirect
+	struct CompactResult
+	{
+		VkDispatchIndirectCommand dispatch;
+		uint32_t count;
+	};
+
+	// Compute building blocks on 32-bit unsigned elements: exclusive scan, key/value radix sort and stream compaction.
+	// Every Record* call only records into the caller's command buffer. The caller orders the inputs before the call
+	// and the outputs after it with its own barriers. Scratch ranges must be at least the size reported by the
+	// matching *ScratchSize function, and every buffer range offset must respect minStorageBufferOffsetAlignment.
+	// Descriptor sets are cached per buffer combination and live as long as this object, so command buffers can be
+	// recorded once and submitted many times like the rest of the application.
+	class GpuPrimitives
+	{
+	public:
+		GpuPrimitives(VkDevice device, VkPipelineCache pipelineCache, const std::string& shaderPath, VkDeviceSize storageBufferOffsetAlignment);
+		GpuPrimitives(const GpuPrimitives&) = delete;
+		~GpuPrimitives();
+
+		VkDeviceSize ScanScratchSize(uint32_t count) const;
+		VkDeviceSize SortScratchSize(uint32_t count) const;
+		VkDeviceSize CompactScratchSize(uint32_t count) const;
+
+		// exclusive scan of every block of PRIMITIVES_BLOCK_SIZE elements on its own, the block totals go to blockSums
+		void RecordWorkgroupScan(VkCommandBuffer commandBuffer, const VkDescriptorBufferInfo& input, const VkDescriptorBufferInfo& output,
+			const VkDescriptorBufferInfo& blockSums, uint32_t count);
+		// exclusive scan over all count elements, input and output may be the same range
+		void RecordExclusiveScan(VkCommandBuffer commandBuffer, const VkDescriptorBufferInfo& input, const VkDescriptorBufferInfo& output,
+			uint32_t count, const VkDescriptorBufferInfo& scratch);
+		// stable ascending sort of keys on their lowest keyBits bits, values are moved along with them, both are sorted in place.
+		// keyBits is rounded up to an even number of passes so that the result ends in the input ranges
+		void RecordSort(VkCommandBuffer commandBuffer, const VkDescriptorBufferInfo& keys, const VkDescriptorBufferInfo& values,
+			uint32_t count, const VkDescriptorBufferInfo& scratch, uint32_t keyBits = 32);
+		// writes the values (or the indices, if values.buffer is VK_NULL_HANDLE) of the elements whose flag is 1 to output,
+		// flags must be 0 or 1 and count must be greater than 0. result receives a CompactResult, whose dispatch size is
+		// the number of dispatchGroupSize-wide workgroups covering the kept elements
+		void RecordCompact(VkCommandBuffer commandBuffer, const VkDescriptorBufferInfo& flags, const VkDescriptorBufferInfo& values,
+			const VkDescriptorBufferInfo& output, const VkDescriptorBufferInfo& result, uint32_t count, uint32_t dispatchGroupSize,
+			const VkDescriptorBufferInfo& scratch);
+
+	private:
+		// mirrors parameters_block of the primitive shaders
+		struct PushConstants
+		{
+			uint32_t count;
+			uint32_t shift;
+			uint32_t blockCount;
+			uint32_t groupSize;
+			uint32_t hasValues;
+		};
+		typedef std::array<VkDescriptorBufferInfo, PRIMITIVES_NUM_BINDINGS> Bindings;
+
+		VkPipeline CreatePipeline(const std::string& shaderFileName);
+		VkDescriptorSet GetDescriptorSet(const Bindings& bindings);
+		void Dispatch(VkCommandBuffer commandBuffer, VkPipeline pipeline, const Bindings& bindings, const PushConstants& pushConstants, uint32_t groupCount);
+		void Barrier(VkCommandBuffer commandBuffer);
+		VkDeviceSize Align(VkDeviceSize size) const;
+		VkDescriptorBufferInfo SubRange(const VkDescriptorBufferInfo& range, VkDeviceSize offset, VkDeviceSize size) const;
+		static uint32_t BlockCount(uint32_t count);
+
+		VkDevice device = VK_NULL_HANDLE;
+		VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+		std::string shaderPath;
+		VkDeviceSize offsetAlignment = 1;
+
+		VkDescriptorSetLayout descriptorSetLayoutHandle = VK_NULL_HANDLE;
+		VkPipelineLayout pipelineLayoutHandle = VK_NULL_HANDLE;
+		VkDescriptorPool descriptorPoolHandle = VK_NULL_HANDLE;
+		VkPipeline scanBlockPipelineHandle = VK_NULL_HANDLE;
+		VkPipeline scanAddPipelineHandle = VK_NULL_HANDLE;
+		VkPipeline radixHistogramPipelineHandle = VK_NULL_HANDLE;
+		VkPipeline radixScatterPipelineHandle = VK_NULL_HANDLE;
+		VkPipeline compactScatterPipelineHandle = VK_NULL_HANDLE;
+
+		std::map<std::array<uint64_t, 3 * PRIMITIVES_NUM_BINDINGS>, VkDescriptorSet> descriptorSetCache;
+	};
+}
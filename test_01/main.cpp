@@ -1,9 +1,46 @@
 #include "application.h"
+#include "cpu_solver.h"
+#include "decomposition.h"
+#include "state_export.h"
 #include<iostream>
 
-int main()
+int main(int argc, char** argv)
 {
-    SPH::Application app;
+    const SPH::Settings settings = SPH::Settings::FromCommandLine(argc, argv);
+    // every backend and every forked process collides with the same baked walls
+    if (!settings.scenePath.empty())
+    {
+        SPH::SetBoundaryScene(SPH::BoundaryScene::FromFile(settings.scenePath));
+    }
+    // the cpu backend runs without a window or a vulkan device
+    if (settings.benchmarkCpu)
+    {
+        SPH::BenchmarkCpuSolver(settings);
+        return 0;
+    }
+    // so do the decomposed runs, whose processes are forked before any device exists
+    if (settings.benchmarkDecomposition)
+    {
+        SPH::BenchmarkDecomposition(settings);
+        return 0;
+    }
+    // the export benchmark publishes a cpu-side state
+    if (settings.benchmarkExport)
+    {
+        SPH::BenchmarkStateExport(settings);
+        return 0;
+    }
+    if (settings.rankCount > 0)
+    {
+        SPH::RunDecomposed(settings);
+        return 0;
+    }
+    if (settings.backend == SPH::Backend::Cpu)
+    {
+        SPH::RunCpuSolver(settings);
+        return 0;
+    }
+    SPH::Application app(settings);
     app.Run();
     return 0;
 }
\ No newline at end of file
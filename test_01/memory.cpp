@@ -0,0 +1,252 @@
+#include "memory.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+
+namespace SPH
+{
+	namespace
+	{
+		// sits right in front of every block handed to the driver
+		struct BlockHeader
+		{
+			void* base;
+			size_t size;
+			VkSystemAllocationScope scope;
+		};
+		const size_t HeaderSize = (sizeof(BlockHeader) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+		BlockHeader* HeaderOf(void* memory)
+		{
+			return reinterpret_cast<BlockHeader*>(static_cast<char*>(memory) - HeaderSize);
+		}
+
+		void* AlignedAllocate(size_t size, size_t alignment, VkSystemAllocationScope scope)
+		{
+			alignment = std::max(alignment, alignof(std::max_align_t));
+			void* base = std::malloc(size + HeaderSize + alignment - 1);
+			if (!base)
+			{
+				return nullptr;
+			}
+			const uintptr_t first = reinterpret_cast<uintptr_t>(base) + HeaderSize;
+			void* memory = reinterpret_cast<void*>((first + alignment - 1) / alignment * alignment);
+			*HeaderOf(memory) = { base, size, scope };
+			return memory;
+		}
+
+		const char* ScopeName(uint32_t scope)
+		{
+			const char* names[SPH_MEMORY_SCOPES]{ "command", "object", "cache", "device", "instance" };
+			return names[scope];
+		}
+	}
+
+	MemoryTracker::MemoryTracker()
+	{
+		callbacks.pUserData = this;
+		callbacks.pfnAllocation = &MemoryTracker::Allocate;
+		callbacks.pfnReallocation = &MemoryTracker::Reallocate;
+		callbacks.pfnFree = &MemoryTracker::Free;
+		callbacks.pfnInternalAllocation = &MemoryTracker::InternalAllocated;
+		callbacks.pfnInternalFree = &MemoryTracker::InternalFreed;
+	}
+
+	uint32_t MemoryTracker::SizeClass(size_t size)
+	{
+		const size_t limits[SPH_MEMORY_SIZE_CLASSES - 1]{ 64, 256, 1024, 4096, 65536 };
+		return static_cast<uint32_t>(std::upper_bound(limits, limits + SPH_MEMORY_SIZE_CLASSES - 1, size - (size > 0)) - limits);
+	}
+
+	void MemoryTracker::Counted(VkSystemAllocationScope scope, int64_t bytes)
+	{
+		ScopeCounters& counters = scopes[scope];
+		const int64_t live = counters.liveBytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+		int64_t peak = counters.peakBytes.load(std::memory_order_relaxed);
+		while (live > peak && !counters.peakBytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+		{
+		}
+	}
+
+	void* VKAPI_PTR MemoryTracker::Allocate(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope)
+	{
+		MemoryTracker* tracker = static_cast<MemoryTracker*>(userData);
+		void* memory = AlignedAllocate(size, alignment, scope);
+		if (memory)
+		{
+			tracker->scopes[scope].allocations.fetch_add(1, std::memory_order_relaxed);
+			tracker->scopes[scope].sizeClasses[SizeClass(size)].fetch_add(1, std::memory_order_relaxed);
+			tracker->Counted(scope, static_cast<int64_t>(size));
+		}
+		return memory;
+	}
+
+	void* VKAPI_PTR MemoryTracker::Reallocate(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope)
+	{
+		MemoryTracker* tracker = static_cast<MemoryTracker*>(userData);
+		if (!original)
+		{
+			return Allocate(userData, size, alignment, scope);
+		}
+		if (size == 0)
+		{
+			Free(userData, original);
+			return nullptr;
+		}
+		// the block keeps the scope of its first allocation
+		const BlockHeader header = *HeaderOf(original);
+		void* memory = AlignedAllocate(size, alignment, header.scope);
+		if (!memory)
+		{
+			return nullptr;
+		}
+		std::memcpy(memory, original, std::min(size, header.size));
+		std::free(header.base);
+		tracker->scopes[header.scope].reallocations.fetch_add(1, std::memory_order_relaxed);
+		tracker->scopes[header.scope].sizeClasses[SizeClass(size)].fetch_add(1, std::memory_order_relaxed);
+		tracker->Counted(header.scope, static_cast<int64_t>(size) - static_cast<int64_t>(header.size));
+		return memory;
+	}
+
+	void VKAPI_PTR MemoryTracker::Free(void* userData, void* memory)
+	{
+		if (!memory)
+		{
+			return;
+		}
+		MemoryTracker* tracker = static_cast<MemoryTracker*>(userData);
+		const BlockHeader header = *HeaderOf(memory);
+		std::free(header.base);
+		tracker->scopes[header.scope].frees.fetch_add(1, std::memory_order_relaxed);
+		tracker->Counted(header.scope, -static_cast<int64_t>(header.size));
+	}
+
+	void VKAPI_PTR MemoryTracker::InternalAllocated(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope)
+	{
+		static_cast<MemoryTracker*>(userData)->scopes[scope].internalBytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed);
+	}
+
+	void VKAPI_PTR MemoryTracker::InternalFreed(void* userData, size_t size, VkInternalAllocationType, VkSystemAllocationScope scope)
+	{
+		static_cast<MemoryTracker*>(userData)->scopes[scope].internalBytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
+	}
+
+	void MemoryTracker::SetPhysicalDevice(VkPhysicalDevice physicalDevice, bool budgetSupported)
+	{
+		physicalDeviceHandle = physicalDevice;
+		memoryBudgetSupported = budgetSupported;
+		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+	}
+
+	void MemoryTracker::DeviceAllocated(VkDeviceMemory memory, MemoryPurpose purpose, const VkMemoryAllocateInfo& allocateInfo)
+	{
+		std::lock_guard<std::mutex> lock(deviceMutex);
+		deviceAllocations[memory] = { purpose, allocateInfo.allocationSize, memoryProperties.memoryTypes[allocateInfo.memoryTypeIndex].heapIndex };
+	}
+
+	void MemoryTracker::DeviceFreed(VkDeviceMemory memory)
+	{
+		std::lock_guard<std::mutex> lock(deviceMutex);
+		deviceAllocations.erase(memory);
+	}
+
+	const char* MemoryTracker::PurposeName(MemoryPurpose purpose)
+	{
+		switch (purpose)
+		{
+		case MemoryPurpose::Particles: return "particles";
+		case MemoryPurpose::Simulation: return "simulation";
+		case MemoryPurpose::Boundary: return "boundary";
+		case MemoryPurpose::Snapshots: return "snapshots";
+		case MemoryPurpose::Staging: return "staging";
+		case MemoryPurpose::Render: return "render";
+		case MemoryPurpose::Capture: return "capture";
+		case MemoryPurpose::Export: return "export";
+		case MemoryPurpose::Benchmark: return "benchmark";
+		default: return "unknown";
+		}
+	}
+
+	void MemoryTracker::Print(const char* when)
+	{
+		const double mebibyte = 1.0 / (1024.0 * 1024.0);
+		std::cout << "[INFO] memory report (" << when << ")" << std::endl;
+		std::cout << std::fixed << std::setprecision(1);
+
+		std::cout << "  host allocations of the driver, by scope (live KiB, peak KiB, internal KiB, allocations, since last report, reallocations, frees)" << std::endl;
+		for (uint32_t scope = 0; scope < SPH_MEMORY_SCOPES; scope++)
+		{
+			const ScopeCounters& counters = scopes[scope];
+			const uint64_t allocations = counters.allocations.load(std::memory_order_relaxed);
+			std::cout << "    " << std::setw(8) << std::left << ScopeName(scope) << std::right
+				<< std::setw(10) << counters.liveBytes.load(std::memory_order_relaxed) / 1024.0
+				<< std::setw(10) << counters.peakBytes.load(std::memory_order_relaxed) / 1024.0
+				<< std::setw(10) << counters.internalBytes.load(std::memory_order_relaxed) / 1024.0
+				<< std::setw(10) << allocations
+				<< std::setw(10) << allocations - reportedAllocations[scope]
+				<< std::setw(10) << counters.reallocations.load(std::memory_order_relaxed)
+				<< std::setw(10) << counters.frees.load(std::memory_order_relaxed) << std::endl;
+			reportedAllocations[scope] = allocations;
+		}
+		std::cout << "  host allocations by size class (<=64 B, <=256 B, <=1 KiB, <=4 KiB, <=64 KiB, larger):";
+		for (uint32_t sizeClass = 0; sizeClass < SPH_MEMORY_SIZE_CLASSES; sizeClass++)
+		{
+			uint64_t count = 0;
+			for (const ScopeCounters& counters : scopes)
+			{
+				count += counters.sizeClasses[sizeClass].load(std::memory_order_relaxed);
+			}
+			std::cout << " " << count;
+		}
+		std::cout << std::endl;
+
+		// live device memory per heap and purpose
+		VkDeviceSize purposeBytes[VK_MAX_MEMORY_HEAPS][static_cast<uint32_t>(MemoryPurpose::Count)] = {};
+		uint32_t purposeCounts[VK_MAX_MEMORY_HEAPS][static_cast<uint32_t>(MemoryPurpose::Count)] = {};
+		VkDeviceSize heapBytes[VK_MAX_MEMORY_HEAPS] = {};
+		{
+			std::lock_guard<std::mutex> lock(deviceMutex);
+			for (const auto& allocation : deviceAllocations)
+			{
+				purposeBytes[allocation.second.heapIndex][static_cast<uint32_t>(allocation.second.purpose)] += allocation.second.size;
+				purposeCounts[allocation.second.heapIndex][static_cast<uint32_t>(allocation.second.purpose)]++;
+				heapBytes[allocation.second.heapIndex] += allocation.second.size;
+			}
+		}
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+		budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+		if (memoryBudgetSupported)
+		{
+			VkPhysicalDeviceMemoryProperties2 properties2{};
+			properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+			properties2.pNext = &budget;
+			vkGetPhysicalDeviceMemoryProperties2(physicalDeviceHandle, &properties2);
+		}
+		for (uint32_t heap = 0; heap < memoryProperties.memoryHeapCount; heap++)
+		{
+			const bool deviceLocal = memoryProperties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+			std::cout << "  heap " << heap << (deviceLocal ? " (device local)" : " (host)") << ": "
+				<< memoryProperties.memoryHeaps[heap].size * mebibyte << " MiB, ours " << heapBytes[heap] * mebibyte << " MiB";
+			if (memoryBudgetSupported)
+			{
+				std::cout << ", process usage " << budget.heapUsage[heap] * mebibyte << " MiB of a " << budget.heapBudget[heap] * mebibyte << " MiB budget";
+			}
+			std::cout << std::endl;
+			for (uint32_t purpose = 0; purpose < static_cast<uint32_t>(MemoryPurpose::Count); purpose++)
+			{
+				if (purposeCounts[heap][purpose] > 0)
+				{
+					std::cout << "    " << std::setw(12) << std::left << PurposeName(static_cast<MemoryPurpose>(purpose)) << std::right
+						<< std::setw(10) << purposeBytes[heap][purpose] * mebibyte << " MiB in " << purposeCounts[heap][purpose] << " allocations" << std::endl;
+				}
+			}
+		}
+		if (!memoryBudgetSupported)
+		{
+			std::cout << "  [WARNING] VK_EXT_memory_budget is not available, the heap budgets are unknown" << std::endl;
+		}
+		std::cout << std::defaultfloat << std::setprecision(6);
+	}
+}
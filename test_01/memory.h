@@ -0,0 +1,86 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+// host allocations of the driver are counted in these size classes, up to 64 B, 256 B, 1 KiB, 4 KiB, 64 KiB and above
+#define SPH_MEMORY_SIZE_CLASSES 6
+// VkSystemAllocationScope runs from COMMAND to INSTANCE
+#define SPH_MEMORY_SCOPES 5
+
+namespace SPH
+{
+	// what a device memory allocation holds, the report sums the allocations per purpose and heap
+	enum class MemoryPurpose : uint32_t
+	{
+		Particles,
+		Simulation,
+		Boundary,
+		Snapshots,
+		Staging,
+		Render,
+		Capture,
+		Export,
+		Benchmark,
+		Count
+	};
+
+	// Accounts for the memory the program has Vulkan spend. Callbacks() is the VkAllocationCallbacks that every create
+	// and destroy call passes, it counts the driver's host allocations by scope and size class. Device memory is
+	// registered with DeviceAllocated and DeviceFreed, and Print lines it up with the heap budgets of
+	// VK_EXT_memory_budget when the device has it
+	class MemoryTracker
+	{
+	public:
+		MemoryTracker();
+		MemoryTracker(const MemoryTracker&) = delete;
+
+		const VkAllocationCallbacks* Callbacks() const { return &callbacks; }
+		// call once the physical device is picked, before any device memory is registered
+		void SetPhysicalDevice(VkPhysicalDevice physicalDevice, bool budgetSupported);
+		void DeviceAllocated(VkDeviceMemory memory, MemoryPurpose purpose, const VkMemoryAllocateInfo& allocateInfo);
+		void DeviceFreed(VkDeviceMemory memory);
+		// host allocations are also counted since the previous report, which shows the churn of the frame loop
+		void Print(const char* when);
+
+		static const char* PurposeName(MemoryPurpose purpose);
+
+	private:
+		struct ScopeCounters
+		{
+			std::atomic<uint64_t> allocations{ 0 };
+			std::atomic<uint64_t> reallocations{ 0 };
+			std::atomic<uint64_t> frees{ 0 };
+			std::atomic<int64_t> liveBytes{ 0 };
+			std::atomic<int64_t> peakBytes{ 0 };
+			std::atomic<int64_t> internalBytes{ 0 };
+			std::atomic<uint64_t> sizeClasses[SPH_MEMORY_SIZE_CLASSES] = {};
+		};
+		struct DeviceAllocation
+		{
+			MemoryPurpose purpose;
+			VkDeviceSize size;
+			uint32_t heapIndex;
+		};
+
+		static void* VKAPI_PTR Allocate(void* userData, size_t size, size_t alignment, VkSystemAllocationScope scope);
+		static void* VKAPI_PTR Reallocate(void* userData, void* original, size_t size, size_t alignment, VkSystemAllocationScope scope);
+		static void VKAPI_PTR Free(void* userData, void* memory);
+		static void VKAPI_PTR InternalAllocated(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+		static void VKAPI_PTR InternalFreed(void* userData, size_t size, VkInternalAllocationType type, VkSystemAllocationScope scope);
+		static uint32_t SizeClass(size_t size);
+		void Counted(VkSystemAllocationScope scope, int64_t bytes);
+
+		VkAllocationCallbacks callbacks;
+		ScopeCounters scopes[SPH_MEMORY_SCOPES];
+		uint64_t reportedAllocations[SPH_MEMORY_SCOPES] = {};
+
+		VkPhysicalDevice physicalDeviceHandle = VK_NULL_HANDLE;
+		VkPhysicalDeviceMemoryProperties memoryProperties{};
+		bool memoryBudgetSupported = false;
+		std::mutex deviceMutex;
+		std::unordered_map<VkDeviceMemory, DeviceAllocation> deviceAllocations;
+	};
+}
@@ -0,0 +1,87 @@
+#pragma once
+// generated by shader/particle_layout.py from its field description, do not edit
+#include <cstdint>
+
+// particles per AoSoA block, the particle capacity must be a multiple of it
+#define SPH_PARTICLE_BLOCK_SIZE 32
+// bytes per particle of the layout-selected region, sized for fp32 SoA whatever the layout and precision
+#define SPH_PARTICLE_DATA_STRIDE 24
+
+namespace SPH
+{
+	// how the particle fields are arranged at the front of the particle buffer, force and particle id stay SoA
+	enum class ParticleLayout
+	{
+		// one array per field
+		SoA,
+		// one record of every field per particle, a neighbour read touches one cache line
+		AoS,
+		// records of SPH_PARTICLE_BLOCK_SIZE particles with one array per field
+		AoSoA
+	};
+
+	enum class ParticleField
+	{
+		Position,
+		Velocity,
+		Density,
+		Pressure
+	};
+
+	// [0] fp32 storage, [1] fp16 storage
+	constexpr uint32_t ParticleFieldSize[2][4]{ { 8, 8, 4, 4 }, { 8, 4, 2, 2 } };
+	// bytes before field f of the SoA region, per particle of capacity
+	constexpr uint32_t ParticleSoaOffset[4]{ 0, 8, 16, 20 };
+	// std430 offsets of the fields in particle_record and its size
+	constexpr uint32_t ParticleRecordOffset[2][4]{ { 0, 8, 16, 20 }, { 0, 8, 12, 14 } };
+	constexpr uint32_t ParticleRecordSize[2]{ 24, 16 };
+	// std430 offsets of the field arrays in particle_block_record and its size
+	constexpr uint32_t ParticleBlockOffset[2][4]{ { 0, 256, 512, 640 }, { 0, 256, 384, 448 } };
+	constexpr uint32_t ParticleBlockSize[2]{ 768, 512 };
+	// the fields the reorder gather carries to the sorted copy
+	constexpr ParticleField ParticleSortedField[2]{ ParticleField::Position, ParticleField::Velocity };
+
+	// mirrors particle_state_block of the DEVICE_ADDRESS shader variants. fields holds the SoA field arrays in
+	// ParticleField order or the records of the AoS and AoSoA layouts in fields[0], sortedFields the same for the
+	// sorted copy in ParticleSortedField order
+	struct ParticleStateAddresses
+	{
+		uint64_t fields[4];
+		uint64_t force;
+		uint64_t particleId;
+		uint64_t mass;
+		uint64_t sortedFields[2];
+		uint64_t sortedParticleId;
+		uint64_t sortedMass;
+	};
+
+	// byte offset of field of particle i in the particle region
+	inline uint64_t ParticleFieldOffset(ParticleLayout layout, bool half, ParticleField field, uint64_t capacity, uint64_t i)
+	{
+		const uint32_t f = static_cast<uint32_t>(field);
+		switch (layout)
+		{
+		case ParticleLayout::AoS:
+			return i * ParticleRecordSize[half] + ParticleRecordOffset[half][f];
+		case ParticleLayout::AoSoA:
+			return i / SPH_PARTICLE_BLOCK_SIZE * ParticleBlockSize[half] + ParticleBlockOffset[half][f] + i % SPH_PARTICLE_BLOCK_SIZE * ParticleFieldSize[half][f];
+		default:
+			return capacity * ParticleSoaOffset[f] + i * ParticleFieldSize[half][f];
+		}
+	}
+
+	// file name part of a layout's shader variants, x.comp.spv is SoA
+	inline const char* ParticleLayoutSuffix(ParticleLayout layout)
+	{
+		switch (layout)
+		{
+		case ParticleLayout::SoA:
+			return "";
+		case ParticleLayout::AoS:
+			return ".aos";
+		case ParticleLayout::AoSoA:
+			return ".aosoa";
+		}
+		return "";
+	}
+}
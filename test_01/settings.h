@@ -0,0 +1,443 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+#include "particle_layout.h"
+#include "state_reader.h"
+
+namespace SPH
+{
+	// how the force pass finds the neighbours of a particle
+	enum class ForceKernel
+	{
+		// every particle against every other, no neighbour grid
+		BruteForce,
+		// every particle gathers from the full 3x3 cell stencil of the neighbour grid
+		Gather,
+		// every unordered pair is evaluated once over half the stencil and scattered to both particles,
+		// needs shaderBufferFloat32AtomicAdd
+		Symmetric
+	};
+
+	// which solver runs the simulation
+	enum class Backend
+	{
+		// the compute shaders, with a window
+		Vulkan,
+		// CpuSolver, headless, no vulkan device needed
+		Cpu
+	};
+
+	// how the window and the capture draw the particles
+	enum class Renderer
+	{
+		// a gl_PointSize point per particle, rasterizer cost grows with the particle count
+		Points,
+		// splat.comp adds the particles into a screen-sized buffer, a full-screen pass resolves it
+		Splat
+	};
+
+	// startup options, parsed from the command line
+	struct Settings
+	{
+		// run the scan, sort and compaction microbenchmark on the selected device instead of the simulation
+		bool benchmarkPrimitives = false;
+		// time every available force kernel on a settled scene instead of running the simulation
+		bool benchmarkForce = false;
+		ForceKernel forceKernel = ForceKernel::Gather;
+		// forceKernel was given on the command line, otherwise the tuning file may pick another one
+		bool forceKernelGiven = false;
+		// time every tunable compute pass over the candidate local sizes and every force kernel, and save the fastest
+		// to the device's tuning file instead of running the simulation
+		bool autotune = false;
+		// store velocity, density and pressure as fp16 on the gpu, positions and forces stay fp32
+		bool halfStorage = false;
+		// run the same steps with fp32 and fp16 storage and report their drift, step time and particle-state traffic
+		bool benchmarkStorage = false;
+		// arrangement of position, velocity, density and pressure in the particle buffer
+		ParticleLayout particleLayout = ParticleLayout::SoA;
+		// time the passes once per particle layout on the same scene and check that the layouts agree
+		bool benchmarkLayout = false;
+		// time the step from 10^4 particles up to the particle capacity in powers of ten
+		bool benchmarkScaling = false;
+		// the shaders reach the particle state through buffer device addresses in push constants instead of descriptor
+		// bindings, so another state buffer is a push constant change instead of a descriptor set
+		bool deviceAddress = false;
+		// only simulate particles in or next to tiles that are still moving, at-rest particles stay frozen until woken
+		bool activeTiles = false;
+		// index into the physical devices reported by the instance
+		uint32_t deviceIndex = 0;
+		Backend backend = Backend::Vulkan;
+		// worker threads of the cpu backend, 0 uses every hardware thread
+		uint32_t threadCount = 0;
+		// length of a headless run, of the cpu backend or with --headless
+		uint32_t stepCount = 10000;
+		// time the cpu backend over 1 to all threads, with and without AVX2, instead of running the simulation
+		bool benchmarkCpu = false;
+		// run the same steps on the gpu and the cpu backend and report how far the results drift apart
+		bool compareCpu = false;
+		// run headless with the domain split between the gpu (x < splitX) and the cpu backend, exchanging the particles
+		// near the line every step and moving the line until both halves take equally long per step
+		bool split = false;
+		// starting position of the split line
+		float splitX = 0.f;
+		// run headless on this many processes of the cpu backend, each owning a slab of the domain, 0 runs in this process
+		uint32_t rankCount = 0;
+		// time decomposed runs over 1 to 8 processes, for a fixed scene and for a fixed share per process
+		bool benchmarkDecomposition = false;
+		// polygon scene file the walls are baked from, see BoundaryScene::FromFile, empty keeps the [-1,1] box
+		std::string scenePath;
+		// coarsen the calm interior to particles of up to four times the mass and split them back near the surface and
+		// in vortices, see adapt_mark.comp
+		bool adaptive = false;
+		// emit a row of particles at the inlet every SPH_INFLOW_INTERVAL steps and remove the ones entering the sink in the
+		// bottom right corner, otherwise the particle count stays fixed
+		bool inflow = false;
+		// step every particle with the coarsest power-of-two multiple of the time step its velocity and acceleration
+		// allow, see block_substep.comp
+		bool blockSteps = false;
+		// frames per second the window is drawn at while the simulation thread steps as fast as it can, 0 draws as
+		// fast as presentation allows
+		uint32_t targetFps = 60;
+		// serve the telemetry histograms on http://127.0.0.1:telemetryPort/metrics, 0 serves nothing
+		uint32_t telemetryPort = 0;
+		// write the telemetry histograms here every telemetryInterval seconds, CSV rows for a .csv file and the
+		// Prometheus text format otherwise, empty writes nothing
+		std::string telemetryDumpPath;
+		uint32_t telemetryInterval = 10;
+		// write a Chrome trace JSON of the window run's cpu spans and gpu passes here on exit, empty traces nothing
+		std::string tracePath;
+		// render every shown frame once more into an offscreen image and write it here, see FrameCapture for the
+		// targets, empty captures nothing
+		std::string capturePath;
+		// run without a window, surface or swapchain until stepCount steps are done, rendering only for the capture
+		bool headless = false;
+		Renderer renderer = Renderer::Points;
+		// publish the vulkan simulation's state every exportInterval steps into the POSIX shared-memory segment of this
+		// name for StateReader, empty exports nothing
+		std::string exportName;
+		uint32_t exportInterval = 10;
+		// the ExportField mask of what is published
+		uint32_t exportFields = ExportPosition;
+		// time publishing and reading an exported state across two processes, without a vulkan device
+		bool benchmarkExport = false;
+
+		static Settings FromCommandLine(int argc, char** argv)
+		{
+			Settings settings;
+			for (int i = 1; i < argc; i++)
+			{
+				const std::string argument = argv[i];
+				if (argument == "--benchmark-primitives")
+				{
+					settings.benchmarkPrimitives = true;
+				}
+				else if (argument == "--benchmark-force")
+				{
+					settings.benchmarkForce = true;
+				}
+				else if (argument == "--half-storage")
+				{
+					settings.halfStorage = true;
+				}
+				else if (argument == "--benchmark-storage")
+				{
+					settings.benchmarkStorage = true;
+				}
+				else if (argument.rfind("--particle-layout=", 0) == 0)
+				{
+					settings.particleLayout = ParseParticleLayout(argument.substr(std::string("--particle-layout=").size()));
+				}
+				else if (argument == "--device-address")
+				{
+					settings.deviceAddress = true;
+				}
+				else if (argument == "--benchmark-layout")
+				{
+					settings.benchmarkLayout = true;
+				}
+				else if (argument == "--benchmark-scaling")
+				{
+					settings.benchmarkScaling = true;
+				}
+				else if (argument == "--active-tiles")
+				{
+					settings.activeTiles = true;
+				}
+				else if (argument.rfind("--force-kernel=", 0) == 0)
+				{
+					settings.forceKernel = ParseForceKernel(argument.substr(std::string("--force-kernel=").size()));
+					settings.forceKernelGiven = true;
+				}
+				else if (argument == "--autotune")
+				{
+					settings.autotune = true;
+				}
+				else if (argument.rfind("--device=", 0) == 0)
+				{
+					settings.deviceIndex = static_cast<uint32_t>(std::stoul(argument.substr(std::string("--device=").size())));
+				}
+				else if (argument.rfind("--backend=", 0) == 0)
+				{
+					settings.backend = ParseBackend(argument.substr(std::string("--backend=").size()));
+				}
+				else if (argument.rfind("--threads=", 0) == 0)
+				{
+					settings.threadCount = static_cast<uint32_t>(std::stoul(argument.substr(std::string("--threads=").size())));
+				}
+				else if (argument.rfind("--steps=", 0) == 0)
+				{
+					settings.stepCount = static_cast<uint32_t>(std::stoul(argument.substr(std::string("--steps=").size())));
+				}
+				else if (argument == "--benchmark-cpu")
+				{
+					settings.benchmarkCpu = true;
+				}
+				else if (argument == "--compare-cpu")
+				{
+					settings.compareCpu = true;
+				}
+				else if (argument == "--split")
+				{
+					settings.split = true;
+				}
+				else if (argument.rfind("--split-x=", 0) == 0)
+				{
+					settings.splitX = std::stof(argument.substr(std::string("--split-x=").size()));
+				}
+				else if (argument.rfind("--ranks=", 0) == 0)
+				{
+					settings.rankCount = static_cast<uint32_t>(std::stoul(argument.substr(std::string("--ranks=").size())));
+				}
+				else if (argument == "--benchmark-decomposition")
+				{
+					settings.benchmarkDecomposition = true;
+				}
+				else if (argument.rfind("--scene=", 0) == 0)
+				{
+					settings.scenePath = argument.substr(std::string("--scene=").size());
+				}
+				else if (argument == "--adaptive")
+				{
+					settings.adaptive = true;
+				}
+				else if (argument == "--inflow")
+				{
+					settings.inflow = true;
+				}
+				else if (argument == "--block-steps")
+				{
+					settings.blockSteps = true;
+				}
+				else if (argument.rfind("--fps=", 0) == 0)
+				{
+					settings.targetFps = static_cast<uint32_t>(std::stoul(argument.substr(std::string("--fps=").size())));
+				}
+				else if (argument.rfind("--telemetry-port=", 0) == 0)
+				{
+					settings.telemetryPort = static_cast<uint32_t>(std::stoul(argument.substr(std::string("--telemetry-port=").size())));
+					if (settings.telemetryPort > 65535)
+					{
+						throw std::runtime_error("--telemetry-port must be below 65536");
+					}
+				}
+				else if (argument.rfind("--telemetry-dump=", 0) == 0)
+				{
+					settings.telemetryDumpPath = argument.substr(std::string("--telemetry-dump=").size());
+				}
+				else if (argument.rfind("--telemetry-interval=", 0) == 0)
+				{
+					settings.telemetryInterval = static_cast<uint32_t>(std::stoul(argument.substr(std::string("--telemetry-interval=").size())));
+				}
+				else if (argument.rfind("--trace=", 0) == 0)
+				{
+					settings.tracePath = argument.substr(std::string("--trace=").size());
+				}
+				else if (argument.rfind("--capture=", 0) == 0)
+				{
+					settings.capturePath = argument.substr(std::string("--capture=").size());
+				}
+				else if (argument == "--headless")
+				{
+					settings.headless = true;
+				}
+				else if (argument.rfind("--export=", 0) == 0)
+				{
+					settings.exportName = argument.substr(std::string("--export=").size());
+				}
+				else if (argument.rfind("--export-interval=", 0) == 0)
+				{
+					settings.exportInterval = std::max(1u, static_cast<uint32_t>(std::stoul(argument.substr(std::string("--export-interval=").size()))));
+				}
+				else if (argument.rfind("--export-fields=", 0) == 0)
+				{
+					settings.exportFields = ParseExportFields(argument.substr(std::string("--export-fields=").size()));
+				}
+				else if (argument == "--benchmark-export")
+				{
+					settings.benchmarkExport = true;
+				}
+				else if (argument.rfind("--renderer=", 0) == 0)
+				{
+					settings.renderer = ParseRenderer(argument.substr(std::string("--renderer=").size()));
+				}
+				else
+				{
+					throw std::runtime_error("unknown command line argument: " + argument);
+				}
+			}
+			// the cpu kernels, the halo exchange and the tile stencil all assume the base resolution
+			if (settings.adaptive && (settings.backend != Backend::Vulkan || settings.split || settings.rankCount > 0 || settings.activeTiles
+				|| settings.benchmarkCpu || settings.benchmarkDecomposition))
+			{
+				throw std::runtime_error("--adaptive runs on the vulkan backend alone, without --active-tiles, --split or --ranks");
+			}
+			// block time steps own the active list, and the benchmarks and comparisons count steps, not blocks
+			if (settings.blockSteps && (settings.backend != Backend::Vulkan || settings.adaptive || settings.activeTiles || settings.split
+				|| settings.rankCount > 0 || settings.compareCpu || settings.autotune || settings.benchmarkForce || settings.benchmarkStorage
+				|| settings.benchmarkLayout || settings.benchmarkScaling || settings.benchmarkCpu || settings.benchmarkDecomposition))
+			{
+				throw std::runtime_error("--block-steps runs the windowed vulkan simulation alone, without --adaptive, --active-tiles or a benchmark");
+			}
+			// the cpu backend has no inlet, and the comparisons and benchmarks expect a fixed particle count
+			if (settings.inflow && (settings.backend != Backend::Vulkan || settings.split || settings.rankCount > 0 || settings.compareCpu
+				|| settings.autotune || settings.benchmarkForce || settings.benchmarkStorage || settings.benchmarkLayout || settings.benchmarkScaling
+				|| settings.benchmarkCpu || settings.benchmarkDecomposition))
+			{
+				throw std::runtime_error("--inflow runs the vulkan simulation alone, without --split, --ranks or a benchmark");
+			}
+			if (!settings.exportName.empty() && (settings.backend != Backend::Vulkan || settings.rankCount > 0))
+			{
+				throw std::runtime_error("--export publishes the vulkan simulation, without --backend=cpu or --ranks");
+			}
+			if (settings.headless && settings.backend != Backend::Vulkan)
+			{
+				throw std::runtime_error("--headless runs the vulkan backend, the cpu backend is headless already");
+			}
+			return settings;
+		}
+
+		static ForceKernel ParseForceKernel(const std::string& name)
+		{
+			if (name == "brute-force")
+			{
+				return ForceKernel::BruteForce;
+			}
+			if (name == "gather")
+			{
+				return ForceKernel::Gather;
+			}
+			if (name == "symmetric")
+			{
+				return ForceKernel::Symmetric;
+			}
+			throw std::runtime_error("unknown force kernel: " + name);
+		}
+
+		static ParticleLayout ParseParticleLayout(const std::string& name)
+		{
+			if (name == "soa")
+			{
+				return ParticleLayout::SoA;
+			}
+			if (name == "aos")
+			{
+				return ParticleLayout::AoS;
+			}
+			if (name == "aosoa")
+			{
+				return ParticleLayout::AoSoA;
+			}
+			throw std::runtime_error("unknown particle layout: " + name);
+		}
+
+		static Backend ParseBackend(const std::string& name)
+		{
+			if (name == "vulkan")
+			{
+				return Backend::Vulkan;
+			}
+			if (name == "cpu")
+			{
+				return Backend::Cpu;
+			}
+			throw std::runtime_error("unknown backend: " + name);
+		}
+
+		// a comma separated list of position, velocity, density and pressure
+		static uint32_t ParseExportFields(const std::string& list)
+		{
+			uint32_t fields = 0;
+			size_t start = 0;
+			while (start <= list.size())
+			{
+				const size_t end = std::min(list.find(',', start), list.size());
+				const std::string name = list.substr(start, end - start);
+				if (name == "position")
+				{
+					fields |= ExportPosition;
+				}
+				else if (name == "velocity")
+				{
+					fields |= ExportVelocity;
+				}
+				else if (name == "density")
+				{
+					fields |= ExportDensity;
+				}
+				else if (name == "pressure")
+				{
+					fields |= ExportPressure;
+				}
+				else
+				{
+					throw std::runtime_error("unknown export field: " + name);
+				}
+				start = end + 1;
+			}
+			return fields;
+		}
+
+		static Renderer ParseRenderer(const std::string& name)
+		{
+			if (name == "points")
+			{
+				return Renderer::Points;
+			}
+			if (name == "splat")
+			{
+				return Renderer::Splat;
+			}
+			throw std::runtime_error("unknown renderer: " + name);
+		}
+
+		static const char* ParticleLayoutName(ParticleLayout particleLayout)
+		{
+			switch (particleLayout)
+			{
+			case ParticleLayout::SoA:
+				return "soa";
+			case ParticleLayout::AoS:
+				return "aos";
+			case ParticleLayout::AoSoA:
+				return "aosoa";
+			}
+			return "unknown";
+		}
+
+		static const char* ForceKernelName(ForceKernel forceKernel)
+		{
+			switch (forceKernel)
+			{
+			case ForceKernel::BruteForce:
+				return "brute-force";
+			case ForceKernel::Gather:
+				return "gather";
+			case ForceKernel::Symmetric:
+				return "symmetric";
+			}
+			return "unknown";
+		}
+	};
+}
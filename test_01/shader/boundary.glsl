@@ -0,0 +1,38 @@
+// The baked walls, see BoundaryField in boundary.h. sample_boundary and lookup_boundary follow the host's Sample and
+// Lookup step by step, so both backends see the same walls
+
+// must match SPH_BOUNDARY_RESOLUTION, SPH_BOUNDARY_EXTENT and SPH_BOUNDARY_TABLE_SIZE
+#define BOUNDARY_RESOLUTION 512
+#define BOUNDARY_EXTENT 1.0625f
+#define BOUNDARY_TABLE_SIZE 64
+// must match SPH_SMOOTHING_LENGTH
+#define BOUNDARY_SMOOTHING_LENGTH 0.02f
+
+layout(std430, binding = 22) readonly buffer boundary_block
+{
+    // x distance to the nearest wall, positive in the fluid, yz unit normal into the fluid
+    vec4 boundary_texel[BOUNDARY_RESOLUTION * BOUNDARY_RESOLUTION];
+    // x density the wall adds, y its pressure push per unit of pressure over resting density
+    vec2 boundary_table[BOUNDARY_TABLE_SIZE];
+};
+
+// x distance, yz normal
+vec3 sample_boundary(vec2 position)
+{
+    const float scale = (BOUNDARY_RESOLUTION - 1) / (2.f * BOUNDARY_EXTENT);
+    vec2 uv = clamp((position + BOUNDARY_EXTENT) * scale, 0.f, float(BOUNDARY_RESOLUTION - 1));
+    ivec2 node = min(ivec2(uv), ivec2(BOUNDARY_RESOLUTION - 2));
+    vec2 f = uv - vec2(node);
+    uint base = node.y * BOUNDARY_RESOLUTION + node.x;
+    vec4 texel = mix(mix(boundary_texel[base], boundary_texel[base + 1], f.x),
+        mix(boundary_texel[base + BOUNDARY_RESOLUTION], boundary_texel[base + BOUNDARY_RESOLUTION + 1], f.x), f.y);
+    float normal_length = length(texel.yz);
+    return vec3(texel.x, normal_length > 0.f ? texel.yz / normal_length : texel.yz);
+}
+
+vec2 lookup_boundary(float distance)
+{
+    float u = clamp(distance / BOUNDARY_SMOOTHING_LENGTH, 0.f, 1.f) * (BOUNDARY_TABLE_SIZE - 1);
+    int t = min(int(u), BOUNDARY_TABLE_SIZE - 2);
+    return mix(boundary_table[t], boundary_table[t + 1], u - t);
+}
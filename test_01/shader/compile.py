@@ -1,17 +1,85 @@
 import sys
 import os
 import glob
+import shutil
 import subprocess
 
+# the project's pre-build step runs this from anywhere, the shaders and their outputs are next to it
+os.chdir(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, os.getcwd())
+
+import particle_layout
+
+# compile.py --capacity=N builds the shaders for an SPH_PARTICLE_CAPACITY of N instead of the default their CAPACITY has,
+# into capacity_N, where a build with that capacity looks for them (SPH_SHADER_PATH), so builds of several capacities
+# keep their own shaders
+capacity_define = ""
+output_directory = "."
+for argument in sys.argv[1:]:
+    if argument.startswith("--capacity="):
+        capacity = int(argument[len("--capacity="):])
+        capacity_define = "-DCAPACITY=%d" % capacity
+        output_directory = "capacity_%d" % capacity
+os.makedirs(output_directory, exist_ok=True)
+
+# regenerate the particle accessors and the host offsets from the field description
+particle_layout.generate()
+
+# glslangValidator of the Vulkan SDK, or the first one on the path
+compiler = None
+for candidate in (os.path.join(os.environ.get("VULKAN_SDK", ""), "Bin", "glslangValidator"), "glslangValidator", "glslangvalidator"):
+    compiler = shutil.which(candidate)
+    if compiler:
+        break
+if not compiler:
+    print("glslangValidator not found, install the Vulkan SDK or put it on the path")
+    sys.exit(1)
+compiler = '"%s"' % compiler
+
+# an output is rebuilt when it is older than its shader, any include or this script, or the capacity changed
+capacity_stamp = os.path.join(output_directory, "capacity.stamp")
+capacity_changed = not os.path.exists(capacity_stamp) or open(capacity_stamp).read() != capacity_define
+dependency_time = max(os.path.getmtime(path) for path in glob.glob("*.glsl") + ["compile.py", "particle_layout.py"])
+
+
+def up_to_date(shader_file, output):
+    return not capacity_changed and os.path.exists(output) and os.path.getmtime(output) >= max(os.path.getmtime(shader_file), dependency_time)
+
 shader_files = []
 for exts in ('*.vert', '*.frag', '*.comp', '*.geom', '*.tesc', '*.tese'):
     shader_files.extend(glob.glob(os.path.join("./", exts)))
 
 failed_files = []
 for shader_file in shader_files:
-    print("compiling %s\n" % shader_file)
-    if subprocess.call("glslangvalidator -V %s -o ./%s.spv" % (shader_file, shader_file), shell=True) != 0:
-        failed_files.append(shader_file)
+    with open(shader_file) as source:
+        uses_particles = "particle_layout.glsl" in source.read()
+    if not uses_particles:
+        output = os.path.join(output_directory, "%s.spv" % shader_file)
+        if up_to_date(shader_file, output):
+            continue
+        print("compiling %s\n" % shader_file)
+        if subprocess.call("%s -V %s %s -o %s" % (compiler, capacity_define, shader_file, output), shell=True) != 0:
+            failed_files.append(shader_file)
+        continue
+    # shaders including the particle accessors get a variant per layout, storage precision and particle state binding,
+    # x.comp -> x.comp.spv, x.half.comp.spv, x.aos.comp.spv, x.aos.half.comp.spv, x.aosoa.comp.spv, x.aosoa.half.comp.spv
+    # and the same with .address in front of the stage for the buffer device address variants (--device-address)
+    base, ext = os.path.splitext(shader_file)
+    for layout_suffix, layout_define in particle_layout.VARIANTS:
+        for half_suffix, half_define in (("", ""), (".half", "-DHALF_STORAGE")):
+            for address_suffix, address_define in (("", ""), (".address", "-DDEVICE_ADDRESS --target-env vulkan1.2")):
+                output = os.path.join(output_directory, "%s%s%s%s%s.spv" % (base, layout_suffix, half_suffix, address_suffix, ext))
+                if up_to_date(shader_file, output):
+                    continue
+                print("compiling %s\n" % output)
+                if subprocess.call("%s -V %s %s %s %s %s -o %s" % (compiler, capacity_define, layout_define, half_define, address_define, shader_file, output),
+                                   shell=True) != 0:
+                    failed_files.append(output)
 
 for failed_file in failed_files:
     print("Failed to compile " + failed_file + "\n")
+# a failed shader fails the build, and the capacity is only recorded once everything was built for it
+if failed_files:
+    sys.exit(1)
+with open(capacity_stamp, "w") as stamp:
+    stamp.write(capacity_define)
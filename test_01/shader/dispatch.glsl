@@ -0,0 +1,18 @@
+// Dispatches of more than MAX_WORK_GROUPS_X work groups are spread over y, rows of MAX_WORK_GROUPS_X work groups each,
+// see RecordDispatch and DispatchSize. Must match SPH_MAX_WORK_GROUPS_X, the smallest maxComputeWorkGroupCount[0] a
+// device may have
+#define MAX_WORK_GROUPS_X 65535u
+
+// the index of the invocation in a 1-D or 2-D dispatch, the last row of a 2-D dispatch runs past the end the way the
+// last work group of a 1-D one does
+uint invocation_index()
+{
+    return gl_GlobalInvocationID.x + gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x;
+}
+
+// x and y of the indirect dispatch of group_count work groups
+uvec2 dispatch_size(uint group_count)
+{
+    uint x = min(group_count, MAX_WORK_GROUPS_X);
+    return uvec2(x, x == 0 ? 1 : (group_count + x - 1) / x);
+}
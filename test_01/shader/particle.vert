@@ -1,6 +1,11 @@
 #version 460
+#extension GL_GOOGLE_include_directive : require
 
-layout (location = 0) in vec2 position;
+// the positions are read straight from the particle buffer, whatever its layout
+#define PARTICLE_READONLY
+#include "particle_layout.glsl"
+// per-particle mass of the adaptive runs
+#include "resolution.glsl"
 
 out gl_PerVertex
 {
@@ -10,6 +15,8 @@ out gl_PerVertex
 
 void main ()
 {
+    vec2 position = load_position(gl_VertexIndex);
     gl_Position = vec4(position.x, position.y, 0, 1);
-    gl_PointSize = 5;
+    // adaptive runs draw the heavier particles larger, so that the fluid stays closed
+    gl_PointSize = 5 * sqrt(particle_mass[gl_VertexIndex] / BASE_PARTICLE_MASS);
 }
\ No newline at end of file
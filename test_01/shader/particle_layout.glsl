@@ -0,0 +1,385 @@
+// generated by particle_layout.py from its field description, do not edit
+//
+// Declares the particle fields and their load_x and store_x accessors in the layout picked by PARTICLE_LAYOUT_AOS
+// or PARTICLE_LAYOUT_AOSOA, SoA otherwise. HALF_STORAGE stores velocity, density and pressure as fp16, density and
+// pressure relative to SPH_HALF_DENSITY_SCALE and SPH_HALF_PRESSURE_SCALE, the accessors always return fp32.
+// PARTICLE_READONLY declares the particle buffers readonly, PARTICLE_GATHER adds the sorted copy and gather_particle.
+// DEVICE_ADDRESS reaches the particle state through the buffer device addresses of particle_state instead of
+// descriptor bindings, the shaders declare force, particle id and mass on top of particle_state the same way
+
+#ifdef HALF_STORAGE
+#extension GL_EXT_shader_16bit_storage : require
+#define DENSITY_SCALE (1.f / 1000.f)
+#define PRESSURE_SCALE (1.f / (2000.f * 1000.f))
+#define POSITION_STORAGE vec2
+#define VELOCITY_STORAGE f16vec2
+#define DENSITY_STORAGE float16_t
+#define PRESSURE_STORAGE float16_t
+#else
+#define DENSITY_SCALE 1.f
+#define PRESSURE_SCALE 1.f
+#define POSITION_STORAGE vec2
+#define VELOCITY_STORAGE vec2
+#define DENSITY_STORAGE float
+#define PRESSURE_STORAGE float
+#endif
+
+#ifdef PARTICLE_READONLY
+#define PARTICLE_ACCESS readonly
+#else
+#define PARTICLE_ACCESS
+#endif
+
+#define PARTICLE_BLOCK_SIZE 32
+
+#ifdef DEVICE_ADDRESS
+#extension GL_EXT_buffer_reference : require
+
+// an address of particle_state, cast to the array type of what it points to
+layout(buffer_reference, std430, buffer_reference_align = 4) buffer particle_address
+{
+    uint values[];
+};
+
+layout(push_constant) uniform particle_state_block
+{
+    // the SoA field arrays, or the records of the AoS and AoSoA layouts in the first
+    particle_address field_address[4];
+    particle_address force_address;
+    particle_address particle_id_address;
+    particle_address mass_address;
+    // the sorted copy gather_particle writes, the SoA fields carried by it or the records
+    particle_address sorted_field_address[2];
+    particle_address sorted_particle_id_address;
+    particle_address sorted_mass_address;
+} particle_state;
+
+layout(buffer_reference, std430, buffer_reference_align = 4) buffer float_array
+{
+    float values[];
+};
+
+layout(buffer_reference, std430, buffer_reference_align = 4) buffer vec2_array
+{
+    vec2 values[];
+};
+#endif
+
+#if defined(PARTICLE_LAYOUT_AOS)
+
+struct particle_record
+{
+    POSITION_STORAGE position;
+    VELOCITY_STORAGE velocity;
+    DENSITY_STORAGE density;
+    PRESSURE_STORAGE pressure;
+};
+
+#ifdef DEVICE_ADDRESS
+layout(buffer_reference, std430, buffer_reference_align = 4) PARTICLE_ACCESS buffer particle_array
+{
+    particle_record values[];
+};
+#define PARTICLE_RECORDS particle_array(particle_state.field_address[0]).values
+#else
+layout(std430, binding = 0) PARTICLE_ACCESS buffer particle_block
+{
+    particle_record particles[];
+};
+#define PARTICLE_RECORDS particles
+#endif
+
+#ifdef PARTICLE_GATHER
+#ifdef DEVICE_ADDRESS
+layout(buffer_reference, std430, buffer_reference_align = 4) PARTICLE_ACCESS buffer sorted_particle_array
+{
+    particle_record values[];
+};
+#define SORTED_PARTICLE_RECORDS sorted_particle_array(particle_state.sorted_field_address[0]).values
+#else
+layout(std430, binding = 8) PARTICLE_ACCESS buffer sorted_particle_block
+{
+    particle_record sorted_particles[];
+};
+#define SORTED_PARTICLE_RECORDS sorted_particles
+#endif
+#endif
+
+vec2 load_position(uint i)
+{
+    return vec2(PARTICLE_RECORDS[i].position);
+}
+
+void store_position(uint i, vec2 value)
+{
+    PARTICLE_RECORDS[i].position = POSITION_STORAGE(value);
+}
+
+vec2 load_velocity(uint i)
+{
+    return vec2(PARTICLE_RECORDS[i].velocity);
+}
+
+void store_velocity(uint i, vec2 value)
+{
+    PARTICLE_RECORDS[i].velocity = VELOCITY_STORAGE(value);
+}
+
+float load_density(uint i)
+{
+    return float(PARTICLE_RECORDS[i].density) / DENSITY_SCALE;
+}
+
+void store_density(uint i, float value)
+{
+    PARTICLE_RECORDS[i].density = DENSITY_STORAGE(value * DENSITY_SCALE);
+}
+
+float load_pressure(uint i)
+{
+    return float(PARTICLE_RECORDS[i].pressure) / PRESSURE_SCALE;
+}
+
+void store_pressure(uint i, float value)
+{
+    PARTICLE_RECORDS[i].pressure = PRESSURE_STORAGE(value * PRESSURE_SCALE);
+}
+
+#ifdef PARTICLE_GATHER
+void gather_particle(uint destination, uint source)
+{
+    SORTED_PARTICLE_RECORDS[destination] = PARTICLE_RECORDS[source];
+}
+#endif
+
+#elif defined(PARTICLE_LAYOUT_AOSOA)
+
+struct particle_block_record
+{
+    POSITION_STORAGE position[PARTICLE_BLOCK_SIZE];
+    VELOCITY_STORAGE velocity[PARTICLE_BLOCK_SIZE];
+    DENSITY_STORAGE density[PARTICLE_BLOCK_SIZE];
+    PRESSURE_STORAGE pressure[PARTICLE_BLOCK_SIZE];
+};
+
+#ifdef DEVICE_ADDRESS
+layout(buffer_reference, std430, buffer_reference_align = 4) PARTICLE_ACCESS buffer particle_array
+{
+    particle_block_record values[];
+};
+#define PARTICLE_BLOCKS particle_array(particle_state.field_address[0]).values
+#else
+layout(std430, binding = 0) PARTICLE_ACCESS buffer particle_block
+{
+    particle_block_record particle_blocks[];
+};
+#define PARTICLE_BLOCKS particle_blocks
+#endif
+
+#ifdef PARTICLE_GATHER
+#ifdef DEVICE_ADDRESS
+layout(buffer_reference, std430, buffer_reference_align = 4) PARTICLE_ACCESS buffer sorted_particle_array
+{
+    particle_block_record values[];
+};
+#define SORTED_PARTICLE_BLOCKS sorted_particle_array(particle_state.sorted_field_address[0]).values
+#else
+layout(std430, binding = 8) PARTICLE_ACCESS buffer sorted_particle_block
+{
+    particle_block_record sorted_particle_blocks[];
+};
+#define SORTED_PARTICLE_BLOCKS sorted_particle_blocks
+#endif
+#endif
+
+vec2 load_position(uint i)
+{
+    return vec2(PARTICLE_BLOCKS[i / PARTICLE_BLOCK_SIZE].position[i % PARTICLE_BLOCK_SIZE]);
+}
+
+void store_position(uint i, vec2 value)
+{
+    PARTICLE_BLOCKS[i / PARTICLE_BLOCK_SIZE].position[i % PARTICLE_BLOCK_SIZE] = POSITION_STORAGE(value);
+}
+
+vec2 load_velocity(uint i)
+{
+    return vec2(PARTICLE_BLOCKS[i / PARTICLE_BLOCK_SIZE].velocity[i % PARTICLE_BLOCK_SIZE]);
+}
+
+void store_velocity(uint i, vec2 value)
+{
+    PARTICLE_BLOCKS[i / PARTICLE_BLOCK_SIZE].velocity[i % PARTICLE_BLOCK_SIZE] = VELOCITY_STORAGE(value);
+}
+
+float load_density(uint i)
+{
+    return float(PARTICLE_BLOCKS[i / PARTICLE_BLOCK_SIZE].density[i % PARTICLE_BLOCK_SIZE]) / DENSITY_SCALE;
+}
+
+void store_density(uint i, float value)
+{
+    PARTICLE_BLOCKS[i / PARTICLE_BLOCK_SIZE].density[i % PARTICLE_BLOCK_SIZE] = DENSITY_STORAGE(value * DENSITY_SCALE);
+}
+
+float load_pressure(uint i)
+{
+    return float(PARTICLE_BLOCKS[i / PARTICLE_BLOCK_SIZE].pressure[i % PARTICLE_BLOCK_SIZE]) / PRESSURE_SCALE;
+}
+
+void store_pressure(uint i, float value)
+{
+    PARTICLE_BLOCKS[i / PARTICLE_BLOCK_SIZE].pressure[i % PARTICLE_BLOCK_SIZE] = PRESSURE_STORAGE(value * PRESSURE_SCALE);
+}
+
+#ifdef PARTICLE_GATHER
+void gather_particle(uint destination, uint source)
+{
+    SORTED_PARTICLE_BLOCKS[destination / PARTICLE_BLOCK_SIZE].position[destination % PARTICLE_BLOCK_SIZE] =
+        PARTICLE_BLOCKS[source / PARTICLE_BLOCK_SIZE].position[source % PARTICLE_BLOCK_SIZE];
+    SORTED_PARTICLE_BLOCKS[destination / PARTICLE_BLOCK_SIZE].velocity[destination % PARTICLE_BLOCK_SIZE] =
+        PARTICLE_BLOCKS[source / PARTICLE_BLOCK_SIZE].velocity[source % PARTICLE_BLOCK_SIZE];
+    SORTED_PARTICLE_BLOCKS[destination / PARTICLE_BLOCK_SIZE].density[destination % PARTICLE_BLOCK_SIZE] =
+        PARTICLE_BLOCKS[source / PARTICLE_BLOCK_SIZE].density[source % PARTICLE_BLOCK_SIZE];
+    SORTED_PARTICLE_BLOCKS[destination / PARTICLE_BLOCK_SIZE].pressure[destination % PARTICLE_BLOCK_SIZE] =
+        PARTICLE_BLOCKS[source / PARTICLE_BLOCK_SIZE].pressure[source % PARTICLE_BLOCK_SIZE];
+}
+#endif
+
+#else
+
+#ifdef DEVICE_ADDRESS
+layout(buffer_reference, std430, buffer_reference_align = 4) PARTICLE_ACCESS buffer position_array
+{
+    POSITION_STORAGE values[];
+};
+#define POSITION_ARRAY position_array(particle_state.field_address[0]).values
+#else
+layout(std430, binding = 0) PARTICLE_ACCESS buffer position_block
+{
+    POSITION_STORAGE position[];
+};
+#define POSITION_ARRAY position
+#endif
+
+#ifdef DEVICE_ADDRESS
+layout(buffer_reference, std430, buffer_reference_align = 4) PARTICLE_ACCESS buffer velocity_array
+{
+    VELOCITY_STORAGE values[];
+};
+#define VELOCITY_ARRAY velocity_array(particle_state.field_address[1]).values
+#else
+layout(std430, binding = 1) PARTICLE_ACCESS buffer velocity_block
+{
+    VELOCITY_STORAGE velocity[];
+};
+#define VELOCITY_ARRAY velocity
+#endif
+
+#ifdef DEVICE_ADDRESS
+layout(buffer_reference, std430, buffer_reference_align = 4) PARTICLE_ACCESS buffer density_array
+{
+    DENSITY_STORAGE values[];
+};
+#define DENSITY_ARRAY density_array(particle_state.field_address[2]).values
+#else
+layout(std430, binding = 3) PARTICLE_ACCESS buffer density_block
+{
+    DENSITY_STORAGE density[];
+};
+#define DENSITY_ARRAY density
+#endif
+
+#ifdef DEVICE_ADDRESS
+layout(buffer_reference, std430, buffer_reference_align = 4) PARTICLE_ACCESS buffer pressure_array
+{
+    PRESSURE_STORAGE values[];
+};
+#define PRESSURE_ARRAY pressure_array(particle_state.field_address[3]).values
+#else
+layout(std430, binding = 4) PARTICLE_ACCESS buffer pressure_block
+{
+    PRESSURE_STORAGE pressure[];
+};
+#define PRESSURE_ARRAY pressure
+#endif
+
+#ifdef PARTICLE_GATHER
+#ifdef DEVICE_ADDRESS
+layout(buffer_reference, std430, buffer_reference_align = 4) PARTICLE_ACCESS buffer sorted_position_array
+{
+    POSITION_STORAGE values[];
+};
+#define SORTED_POSITION_ARRAY sorted_position_array(particle_state.sorted_field_address[0]).values
+#else
+layout(std430, binding = 8) PARTICLE_ACCESS buffer sorted_position_block
+{
+    POSITION_STORAGE sorted_position[];
+};
+#define SORTED_POSITION_ARRAY sorted_position
+#endif
+
+#ifdef DEVICE_ADDRESS
+layout(buffer_reference, std430, buffer_reference_align = 4) PARTICLE_ACCESS buffer sorted_velocity_array
+{
+    VELOCITY_STORAGE values[];
+};
+#define SORTED_VELOCITY_ARRAY sorted_velocity_array(particle_state.sorted_field_address[1]).values
+#else
+layout(std430, binding = 9) PARTICLE_ACCESS buffer sorted_velocity_block
+{
+    VELOCITY_STORAGE sorted_velocity[];
+};
+#define SORTED_VELOCITY_ARRAY sorted_velocity
+#endif
+#endif
+
+vec2 load_position(uint i)
+{
+    return vec2(POSITION_ARRAY[i]);
+}
+
+void store_position(uint i, vec2 value)
+{
+    POSITION_ARRAY[i] = POSITION_STORAGE(value);
+}
+
+vec2 load_velocity(uint i)
+{
+    return vec2(VELOCITY_ARRAY[i]);
+}
+
+void store_velocity(uint i, vec2 value)
+{
+    VELOCITY_ARRAY[i] = VELOCITY_STORAGE(value);
+}
+
+float load_density(uint i)
+{
+    return float(DENSITY_ARRAY[i]) / DENSITY_SCALE;
+}
+
+void store_density(uint i, float value)
+{
+    DENSITY_ARRAY[i] = DENSITY_STORAGE(value * DENSITY_SCALE);
+}
+
+float load_pressure(uint i)
+{
+    return float(PRESSURE_ARRAY[i]) / PRESSURE_SCALE;
+}
+
+void store_pressure(uint i, float value)
+{
+    PRESSURE_ARRAY[i] = PRESSURE_STORAGE(value * PRESSURE_SCALE);
+}
+
+#ifdef PARTICLE_GATHER
+void gather_particle(uint destination, uint source)
+{
+    SORTED_POSITION_ARRAY[destination] = POSITION_ARRAY[source];
+    SORTED_VELOCITY_ARRAY[destination] = VELOCITY_ARRAY[source];
+}
+#endif
+
+#endif
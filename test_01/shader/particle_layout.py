@@ -0,0 +1,368 @@
+import os
+
+# The particle fields every layout stores at the front of the particle buffer, in order. particle_layout.glsl (the
+# accessors the shaders include) and ../particle_layout.h (the host side offsets) are generated from this description,
+# run by compile.py before compiling or on its own after editing it
+#   name, fp32 type, fp16 storage type, fp16 scale, SoA binding, sorted SoA binding (carried by reorder_gather in SoA)
+FIELDS = [
+    ("position", "vec2", "vec2", None, 0, 8),
+    ("velocity", "vec2", "f16vec2", None, 1, 9),
+    ("density", "float", "float16_t", "DENSITY_SCALE", 3, None),
+    ("pressure", "float", "float16_t", "PRESSURE_SCALE", 4, None),
+]
+# particle_record (AoS) and particle_block_record (AoSoA) bindings, the SoA regions share the same ranges
+RECORD_BINDING = 0
+SORTED_RECORD_BINDING = 8
+# particles per AoSoA block, must divide SPH_PARTICLE_CAPACITY
+BLOCK_SIZE = 32
+# must match SPH_HALF_DENSITY_SCALE and SPH_HALF_PRESSURE_SCALE
+DENSITY_SCALE = "(1.f / 1000.f)"
+PRESSURE_SCALE = "(1.f / (2000.f * 1000.f))"
+
+# std430 size and alignment of the storage types
+TYPE_SIZE = {"vec2": 8, "f16vec2": 4, "float": 4, "float16_t": 2}
+TYPE_ALIGNMENT = {"vec2": 8, "f16vec2": 4, "float": 4, "float16_t": 2}
+LAYOUTS = [("SOA", "SoA"), ("AOS", "AoS"), ("AOSOA", "AoSoA")]
+
+
+def storage_macro(name):
+    return name.upper() + "_STORAGE"
+
+
+def align(offset, alignment):
+    return (offset + alignment - 1) // alignment * alignment
+
+
+def struct_offsets(types, count):
+    # member offsets and size of a std430 struct of count-element arrays (count 1 is a plain member)
+    offsets = []
+    offset = 0
+    struct_alignment = 1
+    for type_name in types:
+        offset = align(offset, TYPE_ALIGNMENT[type_name])
+        offsets.append(offset)
+        offset += TYPE_SIZE[type_name] * count
+        struct_alignment = max(struct_alignment, TYPE_ALIGNMENT[type_name])
+    return offsets, align(offset, struct_alignment)
+
+
+def accessors(location):
+    # load and store of every field, location(field, index) is the storage expression
+    lines = []
+    for name, fp32_type, _, scale, _, _ in FIELDS:
+        unscale = " / %s" % scale if scale else ""
+        rescale = " * %s" % scale if scale else ""
+        lines.append("%s load_%s(uint i)" % (fp32_type, name))
+        lines.append("{")
+        lines.append("    return %s(%s)%s;" % (fp32_type, location(name, "i"), unscale))
+        lines.append("}")
+        lines.append("")
+        lines.append("void store_%s(uint i, %s value)" % (name, fp32_type))
+        lines.append("{")
+        lines.append("    %s = %s(value%s);" % (location(name, "i"), storage_macro(name), rescale))
+        lines.append("}")
+        lines.append("")
+    return lines
+
+
+def sorted_fields():
+    return [field for field in FIELDS if field[5] is not None]
+
+
+def declare_array(lines, binding, type_name, array, macro, block, address):
+    # a runtime array of the particle state, bound to a descriptor or reached through an address of the push constants.
+    # The accessors use macro either way
+    lines.append("#ifdef DEVICE_ADDRESS")
+    lines.append("layout(buffer_reference, std430, buffer_reference_align = 4) PARTICLE_ACCESS buffer %s_array" % block)
+    lines.append("{")
+    lines.append("    %s values[];" % type_name)
+    lines.append("};")
+    lines.append("#define %s %s_array(particle_state.%s).values" % (macro, block, address))
+    lines.append("#else")
+    lines.append("layout(std430, binding = %d) PARTICLE_ACCESS buffer %s_block" % (binding, block))
+    lines.append("{")
+    lines.append("    %s %s[];" % (type_name, array))
+    lines.append("};")
+    lines.append("#define %s %s" % (macro, array))
+    lines.append("#endif")
+    lines.append("")
+
+
+def generate_glsl():
+    lines = [
+        "// generated by particle_layout.py from its field description, do not edit",
+        "//",
+        "// Declares the particle fields and their load_x and store_x accessors in the layout picked by PARTICLE_LAYOUT_AOS",
+        "// or PARTICLE_LAYOUT_AOSOA, SoA otherwise. HALF_STORAGE stores velocity, density and pressure as fp16, density and",
+        "// pressure relative to SPH_HALF_DENSITY_SCALE and SPH_HALF_PRESSURE_SCALE, the accessors always return fp32.",
+        "// PARTICLE_READONLY declares the particle buffers readonly, PARTICLE_GATHER adds the sorted copy and gather_particle.",
+        "// DEVICE_ADDRESS reaches the particle state through the buffer device addresses of particle_state instead of",
+        "// descriptor bindings, the shaders declare force, particle id and mass on top of particle_state the same way",
+        "",
+        "#ifdef HALF_STORAGE",
+        "#extension GL_EXT_shader_16bit_storage : require",
+        "#define DENSITY_SCALE %s" % DENSITY_SCALE,
+        "#define PRESSURE_SCALE %s" % PRESSURE_SCALE,
+    ]
+    for name, _, fp16_type, _, _, _ in FIELDS:
+        lines.append("#define %s %s" % (storage_macro(name), fp16_type))
+    lines.append("#else")
+    lines.append("#define DENSITY_SCALE 1.f")
+    lines.append("#define PRESSURE_SCALE 1.f")
+    for name, fp32_type, _, _, _, _ in FIELDS:
+        lines.append("#define %s %s" % (storage_macro(name), fp32_type))
+    lines.append("#endif")
+    lines.append("")
+    lines.append("#ifdef PARTICLE_READONLY")
+    lines.append("#define PARTICLE_ACCESS readonly")
+    lines.append("#else")
+    lines.append("#define PARTICLE_ACCESS")
+    lines.append("#endif")
+    lines.append("")
+    lines.append("#define PARTICLE_BLOCK_SIZE %d" % BLOCK_SIZE)
+    lines.append("")
+
+    # the push constants of the address variants, mirrored by ParticleStateAddresses
+    lines.append("#ifdef DEVICE_ADDRESS")
+    lines.append("#extension GL_EXT_buffer_reference : require")
+    lines.append("")
+    lines.append("// an address of particle_state, cast to the array type of what it points to")
+    lines.append("layout(buffer_reference, std430, buffer_reference_align = 4) buffer particle_address")
+    lines.append("{")
+    lines.append("    uint values[];")
+    lines.append("};")
+    lines.append("")
+    lines.append("layout(push_constant) uniform particle_state_block")
+    lines.append("{")
+    lines.append("    // the SoA field arrays, or the records of the AoS and AoSoA layouts in the first")
+    lines.append("    particle_address field_address[%d];" % len(FIELDS))
+    lines.append("    particle_address force_address;")
+    lines.append("    particle_address particle_id_address;")
+    lines.append("    particle_address mass_address;")
+    lines.append("    // the sorted copy gather_particle writes, the SoA fields carried by it or the records")
+    lines.append("    particle_address sorted_field_address[%d];" % len(sorted_fields()))
+    lines.append("    particle_address sorted_particle_id_address;")
+    lines.append("    particle_address sorted_mass_address;")
+    lines.append("} particle_state;")
+    lines.append("")
+    lines.append("layout(buffer_reference, std430, buffer_reference_align = 4) buffer float_array")
+    lines.append("{")
+    lines.append("    float values[];")
+    lines.append("};")
+    lines.append("")
+    lines.append("layout(buffer_reference, std430, buffer_reference_align = 4) buffer vec2_array")
+    lines.append("{")
+    lines.append("    vec2 values[];")
+    lines.append("};")
+    lines.append("#endif")
+    lines.append("")
+
+    # AoS, one record per particle
+    lines.append("#if defined(PARTICLE_LAYOUT_AOS)")
+    lines.append("")
+    lines.append("struct particle_record")
+    lines.append("{")
+    for name, _, _, _, _, _ in FIELDS:
+        lines.append("    %s %s;" % (storage_macro(name), name))
+    lines.append("};")
+    lines.append("")
+    declare_array(lines, RECORD_BINDING, "particle_record", "particles", "PARTICLE_RECORDS", "particle", "field_address[0]")
+    lines.append("#ifdef PARTICLE_GATHER")
+    declare_array(lines, SORTED_RECORD_BINDING, "particle_record", "sorted_particles", "SORTED_PARTICLE_RECORDS", "sorted_particle",
+        "sorted_field_address[0]")
+    lines.pop()
+    lines.append("#endif")
+    lines.append("")
+    lines.extend(accessors(lambda name, i: "PARTICLE_RECORDS[%s].%s" % (i, name)))
+    lines.append("#ifdef PARTICLE_GATHER")
+    lines.append("void gather_particle(uint destination, uint source)")
+    lines.append("{")
+    lines.append("    SORTED_PARTICLE_RECORDS[destination] = PARTICLE_RECORDS[source];")
+    lines.append("}")
+    lines.append("#endif")
+    lines.append("")
+
+    # AoSoA, PARTICLE_BLOCK_SIZE particles per record, every field an array in it
+    lines.append("#elif defined(PARTICLE_LAYOUT_AOSOA)")
+    lines.append("")
+    lines.append("struct particle_block_record")
+    lines.append("{")
+    for name, _, _, _, _, _ in FIELDS:
+        lines.append("    %s %s[PARTICLE_BLOCK_SIZE];" % (storage_macro(name), name))
+    lines.append("};")
+    lines.append("")
+    declare_array(lines, RECORD_BINDING, "particle_block_record", "particle_blocks", "PARTICLE_BLOCKS", "particle", "field_address[0]")
+    lines.append("#ifdef PARTICLE_GATHER")
+    declare_array(lines, SORTED_RECORD_BINDING, "particle_block_record", "sorted_particle_blocks", "SORTED_PARTICLE_BLOCKS", "sorted_particle",
+        "sorted_field_address[0]")
+    lines.pop()
+    lines.append("#endif")
+    lines.append("")
+    lines.extend(accessors(lambda name, i: "PARTICLE_BLOCKS[%s / PARTICLE_BLOCK_SIZE].%s[%s %% PARTICLE_BLOCK_SIZE]" % (i, name, i)))
+    lines.append("#ifdef PARTICLE_GATHER")
+    lines.append("void gather_particle(uint destination, uint source)")
+    lines.append("{")
+    for name, _, _, _, _, _ in FIELDS:
+        lines.append("    SORTED_PARTICLE_BLOCKS[destination / PARTICLE_BLOCK_SIZE].%s[destination %% PARTICLE_BLOCK_SIZE] =" % name)
+        lines.append("        PARTICLE_BLOCKS[source / PARTICLE_BLOCK_SIZE].%s[source %% PARTICLE_BLOCK_SIZE];" % name)
+    lines.append("}")
+    lines.append("#endif")
+    lines.append("")
+
+    # SoA, one array per field. Density and pressure are recomputed every step, so the gather only carries the rest
+    lines.append("#else")
+    lines.append("")
+    for index, (name, _, _, _, binding, _) in enumerate(FIELDS):
+        declare_array(lines, binding, storage_macro(name), name, name.upper() + "_ARRAY", name, "field_address[%d]" % index)
+    lines.append("#ifdef PARTICLE_GATHER")
+    for index, (name, _, _, _, _, sorted_binding) in enumerate(sorted_fields()):
+        declare_array(lines, sorted_binding, storage_macro(name), "sorted_" + name, "SORTED_" + name.upper() + "_ARRAY", "sorted_" + name,
+            "sorted_field_address[%d]" % index)
+    lines.pop()
+    lines.append("#endif")
+    lines.append("")
+    lines.extend(accessors(lambda name, i: "%s_ARRAY[%s]" % (name.upper(), i)))
+    lines.append("#ifdef PARTICLE_GATHER")
+    lines.append("void gather_particle(uint destination, uint source)")
+    lines.append("{")
+    for name, _, _, _, _, _ in sorted_fields():
+        lines.append("    SORTED_%s_ARRAY[destination] = %s_ARRAY[source];" % (name.upper(), name.upper()))
+    lines.append("}")
+    lines.append("#endif")
+    lines.append("")
+    lines.append("#endif")
+    return "\n".join(lines) + "\n"
+
+
+def cpp_array(values):
+    return "{ " + ", ".join(str(value) for value in values) + " }"
+
+
+def generate_header():
+    fp32_types = [fp32_type for _, fp32_type, _, _, _, _ in FIELDS]
+    fp16_types = [fp16_type for _, _, fp16_type, _, _, _ in FIELDS]
+    record_offsets = [struct_offsets(fp32_types, 1), struct_offsets(fp16_types, 1)]
+    block_offsets = [struct_offsets(fp32_types, BLOCK_SIZE), struct_offsets(fp16_types, BLOCK_SIZE)]
+    soa_offsets = []
+    offset = 0
+    for type_name in fp32_types:
+        soa_offsets.append(offset)
+        offset += TYPE_SIZE[type_name]
+
+    lines = [
+        "#pragma once",
+        "// generated by shader/particle_layout.py from its field description, do not edit",
+        "#include <cstdint>",
+        "",
+        "// particles per AoSoA block, the particle capacity must be a multiple of it",
+        "#define SPH_PARTICLE_BLOCK_SIZE %d" % BLOCK_SIZE,
+        "// bytes per particle of the layout-selected region, sized for fp32 SoA whatever the layout and precision",
+        "#define SPH_PARTICLE_DATA_STRIDE %d" % offset,
+        "",
+        "namespace SPH",
+        "{",
+        "\t// how the particle fields are arranged at the front of the particle buffer, force and particle id stay SoA",
+        "\tenum class ParticleLayout",
+        "\t{",
+        "\t\t// one array per field",
+        "\t\tSoA,",
+        "\t\t// one record of every field per particle, a neighbour read touches one cache line",
+        "\t\tAoS,",
+        "\t\t// records of SPH_PARTICLE_BLOCK_SIZE particles with one array per field",
+        "\t\tAoSoA",
+        "\t};",
+        "",
+        "\tenum class ParticleField",
+        "\t{",
+    ]
+    for name, _, _, _, _, _ in FIELDS:
+        lines.append("\t\t%s," % name.capitalize())
+    lines[-1] = lines[-1].rstrip(",")
+    lines += [
+        "\t};",
+        "",
+        "\t// [0] fp32 storage, [1] fp16 storage",
+        "\tconstexpr uint32_t ParticleFieldSize[2][%d]{ %s, %s };" % (len(FIELDS),
+            cpp_array(TYPE_SIZE[t] for t in fp32_types), cpp_array(TYPE_SIZE[t] for t in fp16_types)),
+        "\t// bytes before field f of the SoA region, per particle of capacity",
+        "\tconstexpr uint32_t ParticleSoaOffset[%d]%s;" % (len(FIELDS), cpp_array(soa_offsets)),
+        "\t// std430 offsets of the fields in particle_record and its size",
+        "\tconstexpr uint32_t ParticleRecordOffset[2][%d]{ %s, %s };" % (len(FIELDS),
+            cpp_array(record_offsets[0][0]), cpp_array(record_offsets[1][0])),
+        "\tconstexpr uint32_t ParticleRecordSize[2]{ %d, %d };" % (record_offsets[0][1], record_offsets[1][1]),
+        "\t// std430 offsets of the field arrays in particle_block_record and its size",
+        "\tconstexpr uint32_t ParticleBlockOffset[2][%d]{ %s, %s };" % (len(FIELDS),
+            cpp_array(block_offsets[0][0]), cpp_array(block_offsets[1][0])),
+        "\tconstexpr uint32_t ParticleBlockSize[2]{ %d, %d };" % (block_offsets[0][1], block_offsets[1][1]),
+        "\t// the fields the reorder gather carries to the sorted copy",
+        "\tconstexpr ParticleField ParticleSortedField[%d]{ %s };" % (len(sorted_fields()),
+            ", ".join("ParticleField::" + name.capitalize() for name, _, _, _, _, _ in sorted_fields())),
+        "",
+        "\t// mirrors particle_state_block of the DEVICE_ADDRESS shader variants. fields holds the SoA field arrays in",
+        "\t// ParticleField order or the records of the AoS and AoSoA layouts in fields[0], sortedFields the same for the",
+        "\t// sorted copy in ParticleSortedField order",
+        "\tstruct ParticleStateAddresses",
+        "\t{",
+        "\t\tuint64_t fields[%d];" % len(FIELDS),
+        "\t\tuint64_t force;",
+        "\t\tuint64_t particleId;",
+        "\t\tuint64_t mass;",
+        "\t\tuint64_t sortedFields[%d];" % len(sorted_fields()),
+        "\t\tuint64_t sortedParticleId;",
+        "\t\tuint64_t sortedMass;",
+        "\t};",
+        "",
+        "\t// byte offset of field of particle i in the particle region",
+        "\tinline uint64_t ParticleFieldOffset(ParticleLayout layout, bool half, ParticleField field, uint64_t capacity, uint64_t i)",
+        "\t{",
+        "\t\tconst uint32_t f = static_cast<uint32_t>(field);",
+        "\t\tswitch (layout)",
+        "\t\t{",
+        "\t\tcase ParticleLayout::AoS:",
+        "\t\t\treturn i * ParticleRecordSize[half] + ParticleRecordOffset[half][f];",
+        "\t\tcase ParticleLayout::AoSoA:",
+        "\t\t\treturn i / SPH_PARTICLE_BLOCK_SIZE * ParticleBlockSize[half] + ParticleBlockOffset[half][f] + i % SPH_PARTICLE_BLOCK_SIZE * ParticleFieldSize[half][f];",
+        "\t\tdefault:",
+        "\t\t\treturn capacity * ParticleSoaOffset[f] + i * ParticleFieldSize[half][f];",
+        "\t\t}",
+        "\t}",
+        "",
+        "\t// file name part of a layout's shader variants, x.comp.spv is SoA",
+        "\tinline const char* ParticleLayoutSuffix(ParticleLayout layout)",
+        "\t{",
+        "\t\tswitch (layout)",
+        "\t\t{",
+    ]
+    for macro, name in LAYOUTS:
+        lines.append("\t\tcase ParticleLayout::%s:" % name)
+        lines.append("\t\t\treturn \"%s\";" % ("" if macro == "SOA" else "." + macro.lower()))
+    lines += [
+        "\t\t}",
+        "\t\treturn \"\";",
+        "\t}",
+        "}",
+    ]
+    return "\n".join(lines) + "\n"
+
+
+# shader variants per layout, x.comp.spv, x.aos.comp.spv and x.aosoa.comp.spv, with the PARTICLE_LAYOUT_ define
+VARIANTS = [("", "")] + [("." + macro.lower(), "-DPARTICLE_LAYOUT_" + macro) for macro, _ in LAYOUTS if macro != "SOA"]
+
+
+def write_if_changed(path, text):
+    if os.path.exists(path):
+        with open(path) as existing:
+            if existing.read() == text:
+                return
+    with open(path, "w", newline="\n") as output:
+        output.write(text)
+
+
+def generate():
+    directory = os.path.dirname(os.path.abspath(__file__))
+    write_if_changed(os.path.join(directory, "particle_layout.glsl"), generate_glsl())
+    write_if_changed(os.path.join(directory, "..", "particle_layout.h"), generate_header())
+
+
+if __name__ == "__main__":
+    generate()
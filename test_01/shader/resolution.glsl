@@ -0,0 +1,59 @@
+// Per-particle resolution of the adaptive runs (--adaptive), see adapt_mark.comp. A particle's smoothing length follows
+// its mass, so that it overlaps as many neighbours of its own size as a base particle does, and a pair uses the mean of
+// the two so that both sides see the same kernel. The kernels are scaled by h / BASE_SMOOTHING_LENGTH, which keeps
+// their area integral the same at every resolution. Uniform runs specialize ADAPTIVE_RESOLUTION to false and fold
+// back to the kernels of the base smoothing length
+
+// must match SPH_PARTICLE_MASS and SPH_SMOOTHING_LENGTH, adapt_mark.comp merges up to MAX_PARTICLE_MASS
+#define BASE_PARTICLE_MASS 0.02f
+#define BASE_SMOOTHING_LENGTH 0.02f
+#define MAX_PARTICLE_MASS (4 * BASE_PARTICLE_MASS)
+#define RESOLUTION_PI 3.1415927410125732421875f
+
+layout (constant_id = 1) const bool ADAPTIVE_RESOLUTION = false;
+// cells of the neighbour stencil on each side of the own cell, the heaviest particles reach two cells
+const int NEIGHBOUR_RADIUS = ADAPTIVE_RESOLUTION ? 2 : 1;
+
+#ifdef DEVICE_ADDRESS
+#define particle_mass float_array(particle_state.mass_address).values
+#else
+layout(std430, binding = 23) PARTICLE_ACCESS buffer particle_mass_block
+{
+    float particle_mass[];
+};
+#endif
+
+float load_mass(uint i)
+{
+    return ADAPTIVE_RESOLUTION ? particle_mass[i] : BASE_PARTICLE_MASS;
+}
+
+float smoothing_length(float mass)
+{
+    return ADAPTIVE_RESOLUTION ? BASE_SMOOTHING_LENGTH * sqrt(mass / BASE_PARTICLE_MASS) : BASE_SMOOTHING_LENGTH;
+}
+
+float pair_smoothing_length(float h_i, float h_j)
+{
+    return 0.5f * (h_i + h_j);
+}
+
+float poly6_kernel(float r, float h)
+{
+    float h2 = h * h;
+    float q = h2 - r * r;
+    return 315.f * q * q * q / (64.f * RESOLUTION_PI * h2 * h2 * h2 * h2 * BASE_SMOOTHING_LENGTH);
+}
+
+// gradient of the spiky kernel, delta points from the neighbour to the particle
+vec2 spiky_gradient(vec2 delta, float r, float h)
+{
+    float h2 = h * h;
+    return -45.f * (h - r) * (h - r) / (RESOLUTION_PI * h2 * h2 * h * BASE_SMOOTHING_LENGTH) * normalize(delta);
+}
+
+float viscosity_laplacian(float r, float h)
+{
+    float h2 = h * h;
+    return 45.f * (h - r) / (RESOLUTION_PI * h2 * h2 * h * BASE_SMOOTHING_LENGTH);
+}
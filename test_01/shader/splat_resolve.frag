@@ -0,0 +1,33 @@
+#version 460
+
+// must match splat.comp
+#define WEIGHT_SCALE 256.f
+// the summed weight at which a pixel is covered to 1 - 1/e, about one particle centred on it
+#define COVERAGE_WEIGHT 1.f
+#define BACKGROUND vec3(0.92f)
+
+layout (constant_id = 3) const uint TARGET_WIDTH = 1000;
+
+// written by splat.comp, cleared before it
+layout(std430, set = 1, binding = 0) readonly buffer splat_accumulation_block
+{
+    uint accumulation[];
+};
+
+layout(location = 0) out vec4 color;
+
+void main ()
+{
+    uvec2 position = uvec2(gl_FragCoord.xy);
+    uint pixel = 2 * (position.y * TARGET_WIDTH + position.x);
+    float weight = accumulation[pixel] / WEIGHT_SCALE;
+    // the weighted mean of the relative density of the particles covering the pixel
+    float density = accumulation[pixel] > 0 ? float(accumulation[pixel + 1]) / float(accumulation[pixel]) : 1.f;
+    // the purple of the points at the resting density, blue where the fluid thins out, orange where it is compressed
+    vec3 fluid = density < 1.f
+        ? mix(vec3(0.2f, 0.3f, 0.8f), vec3(0.5f, 0.f, 0.5f), density)
+        : mix(vec3(0.5f, 0.f, 0.5f), vec3(1.f, 0.6f, 0.1f), clamp(density - 1.f, 0.f, 1.f));
+    // no depth, the coverage blends the fluid over the background
+    float coverage = 1.f - exp(-weight / COVERAGE_WEIGHT);
+    color = vec4(mix(BACKGROUND, fluid, coverage), 1);
+}
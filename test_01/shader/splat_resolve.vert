@@ -0,0 +1,13 @@
+#version 460
+
+out gl_PerVertex
+{
+    vec4 gl_Position;
+};
+
+// one triangle covering the screen, drawn with vkCmdDraw(3)
+void main ()
+{
+    vec2 corner = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(corner * 2 - 1, 0, 1);
+}
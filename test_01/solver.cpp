@@ -0,0 +1,151 @@
+#include "solver.h"
+#include <cmath>
+#include <cstring>
+#include <random>
+
+namespace SPH
+{
+	void ParticleState::Resize(size_t count)
+	{
+		position.resize(count);
+		velocity.resize(count);
+		density.resize(count);
+		pressure.resize(count);
+		id.resize(count);
+		mass.resize(count, SPH_PARTICLE_MASS);
+	}
+
+	void ParticleState::PushBack(const ParticleState& source, size_t i)
+	{
+		position.push_back(source.position[i]);
+		velocity.push_back(source.velocity[i]);
+		density.push_back(source.density[i]);
+		pressure.push_back(source.pressure[i]);
+		id.push_back(source.id[i]);
+		mass.push_back(source.mass[i]);
+	}
+
+	uint16_t FloatToHalf(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+		const uint32_t magnitude = bits & 0x7FFFFFFFu;
+		// nan stays nan, everything from the largest half up rounds to infinity
+		if (magnitude > 0x7F800000u)
+		{
+			return sign | 0x7E00u;
+		}
+		if (magnitude >= 0x477FF000u)
+		{
+			return sign | 0x7C00u;
+		}
+		// subnormal halves: shift the implicit one into place and round on the dropped bits
+		if (magnitude < 0x38800000u)
+		{
+			if (magnitude < 0x33000000u)
+			{
+				return sign;
+			}
+			const uint32_t exponent = magnitude >> 23;
+			const uint32_t mantissa = (magnitude & 0x7FFFFFu) | 0x800000u;
+			const uint32_t shift = 126 - exponent;
+			uint32_t half = mantissa >> shift;
+			const uint32_t remainder = mantissa & ((1u << shift) - 1);
+			const uint32_t halfway = 1u << (shift - 1);
+			if (remainder > halfway || (remainder == halfway && (half & 1u)))
+			{
+				half++;
+			}
+			return sign | static_cast<uint16_t>(half);
+		}
+		// normal halves: rebias the exponent, the carry of the rounding may bump it
+		uint32_t half = (magnitude - 0x38000000u) >> 13;
+		const uint32_t remainder = magnitude & 0x1FFFu;
+		if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))
+		{
+			half++;
+		}
+		return sign | static_cast<uint16_t>(half);
+	}
+
+	float HalfToFloat(uint16_t value)
+	{
+		const uint32_t sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+		const uint32_t exponent = (value >> 10) & 0x1Fu;
+		uint32_t mantissa = value & 0x3FFu;
+		uint32_t bits;
+		if (exponent == 0x1Fu)
+		{
+			bits = sign | 0x7F800000u | (mantissa << 13);
+		}
+		else if (exponent != 0)
+		{
+			bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		}
+		else if (mantissa == 0)
+		{
+			bits = sign;
+		}
+		else
+		{
+			// subnormal half, normalize
+			uint32_t normalizedExponent = 113;
+			while ((mantissa & 0x400u) == 0)
+			{
+				mantissa <<= 1;
+				normalizedExponent--;
+			}
+			bits = sign | (normalizedExponent << 23) | ((mantissa & 0x3FFu) << 13);
+		}
+		float result;
+		std::memcpy(&result, &bits, sizeof(result));
+		return result;
+	}
+
+	ParticleState InitialDamBreak(uint32_t particleCount)
+	{
+		ParticleState state;
+		state.Resize(particleCount);
+		for (uint32_t i = 0, x = 0, y = 0; i < particleCount; i++)
+		{
+			state.position[i].x = -0.625f + SPH_PARTICLE_RADIUS * 2 * x;
+			state.position[i].y = -1 + SPH_PARTICLE_RADIUS * 2 * y;
+			state.velocity[i] = glm::vec2(0.f);
+			state.density[i] = 0.f;
+			state.pressure[i] = 0.f;
+			state.id[i] = i;
+			state.mass[i] = SPH_PARTICLE_MASS;
+			x++;
+			if (x >= 125)
+			{
+				x = 0;
+				y++;
+			}
+		}
+		return state;
+	}
+
+	ParticleState UniformFill(uint32_t particleCount)
+	{
+		ParticleState state;
+		state.Resize(particleCount);
+		// a particle radius off the walls, which the integrate pass would push the particles back from
+		const float margin = SPH_PARTICLE_RADIUS;
+		const uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(particleCount))));
+		const float spacing = (2 - 2 * margin) / side;
+		std::mt19937 random(2024);
+		std::uniform_real_distribution<float> jitter(-0.25f * spacing, 0.25f * spacing);
+		for (uint32_t i = 0; i < particleCount; i++)
+		{
+			state.position[i].x = -1 + margin + spacing * (i % side + 0.5f) + jitter(random);
+			state.position[i].y = -1 + margin + spacing * (i / side + 0.5f) + jitter(random);
+			state.velocity[i] = glm::vec2(0.f);
+			state.density[i] = 0.f;
+			state.pressure[i] = 0.f;
+			state.id[i] = i;
+			state.mass[i] = SPH_PARTICLE_MASS;
+		}
+		return state;
+	}
+}
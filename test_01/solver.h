@@ -0,0 +1,84 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// scene and physics constants shared by every backend, the shaders keep their own copies of them
+#define SPH_NUM_PARTICLES 20000
+#define SPH_PARTICLE_RADIUS 0.005f
+#define SPH_SMOOTHING_LENGTH (4 * SPH_PARTICLE_RADIUS)
+#define SPH_PARTICLE_MASS 0.02f
+#define SPH_RESTING_DENSITY 1000.f
+#define SPH_STIFFNESS 2000.f
+#define SPH_VISCOSITY 3000.f
+// y points down in Vulkan, so gravity is positive
+#define SPH_GRAVITY 9806.65f
+#define SPH_TIME_STEP 0.0001f
+#define SPH_WALL_DAMPING 0.3f
+// the bottom right corner removes the particles entering it, see integrate.comp. Off like the inlet, which only the
+// vulkan backend has
+#ifndef SPH_SINK_ENABLED
+#define SPH_SINK_ENABLED 0
+#endif
+#define SPH_SINK_MIN glm::vec2(0.75f, 0.9f)
+#define SPH_SINK_MAX glm::vec2(1.f, 1.f)
+#define SPH_PARKED_POSITION glm::vec2(1000.f, 1000.f)
+// particle id of a slot removed by the sink, dropped from the buffers by the next compaction
+#define SPH_DEAD_PARTICLE 0xFFFFFFFFu
+
+namespace SPH
+{
+	// particle state in structure-of-arrays form, index i of every array is the same slot
+	struct ParticleState
+	{
+		std::vector<glm::vec2> position;
+		std::vector<glm::vec2> velocity;
+		std::vector<float> density;
+		std::vector<float> pressure;
+		std::vector<uint32_t> id;
+		// SPH_PARTICLE_MASS unless an adaptive run (--adaptive) split or merged the particle
+		std::vector<float> mass;
+
+		size_t Size() const { return position.size(); }
+		void Resize(size_t count);
+		// appends particle i of source
+		void PushBack(const ParticleState& source, size_t i);
+	};
+
+	// one particle crossing between the two halves of a split run (--split), either for good (migrated is 1) or as a
+	// read-only copy for the other half's neighbour search. Mirrors halo_particle in the split shaders
+	struct HaloParticle
+	{
+		glm::vec2 position;
+		glm::vec2 velocity;
+		uint32_t id;
+		uint32_t migrated;
+	};
+	static_assert(sizeof(HaloParticle) == 24, "HaloParticle must match the std430 layout of halo_particle");
+
+	// IEEE binary16 conversions of the fp16 storage mode, rounding to nearest even
+	uint16_t FloatToHalf(float value);
+	float HalfToFloat(uint16_t value);
+
+	// the dam-break column every backend starts from, filled in rows of 125 from the floor, slot i holds particle i
+	ParticleState InitialDamBreak(uint32_t particleCount = SPH_NUM_PARTICLES);
+	// particleCount particles on a square lattice over the whole domain, jittered by a fixed seed so that the runs
+	// are repeatable, for measuring the step at counts the dam-break column does not fit
+	ParticleState UniformFill(uint32_t particleCount);
+
+	// A backend running the three SPH passes, density and pressure, force and integrate, with the constants above.
+	// Emission, reordering and compaction are not part of a step, so two backends fed the same state stay comparable
+	// particle by particle
+	class Solver
+	{
+	public:
+		virtual ~Solver() = default;
+		virtual const char* Name() const = 0;
+		// replaces every particle, density and pressure are recomputed by the next step
+		virtual void Upload(const ParticleState& state) = 0;
+		virtual void Step(uint32_t stepCount) = 0;
+		// every occupied slot in the backend's own order, removed particles carry SPH_DEAD_PARTICLE
+		virtual void Download(ParticleState& state) = 0;
+	};
+}
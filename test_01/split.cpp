@@ -0,0 +1,287 @@
+#include "application.h"
+#include "vkcsy.h"
+#include "cpu_solver.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace SPH
+{
+	void Application::CreateSplitCommandBuffers(VkQueryPool queryPool)
+	{
+		VkCommandBufferAllocateInfo allocInfo = CsySmallVk::commandBufferAllocateInfo();
+		allocInfo.commandBufferCount = 2;
+		allocInfo.commandPool = computeCommandPoolHandle;
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		if (vkAllocateCommandBuffers(logicalDeviceHandle, &allocInfo, splitCommandBufferHandles) != VK_SUCCESS)
+		{
+			throw std::runtime_error("buffer allocation failed");
+		}
+		for (uint32_t i = 0; i < 2; i++)
+		{
+			VkCommandBufferBeginInfo beginInfo = CsySmallVk::commandBufferBeginInfo();
+			beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+			if (vkBeginCommandBuffer(splitCommandBufferHandles[i], &beginInfo) != VK_SUCCESS)
+			{
+				throw std::runtime_error("command buffer begin failed");
+			}
+			RecordSplitStep(splitCommandBufferHandles[i], i == 1, queryPool);
+			if (vkEndCommandBuffer(splitCommandBufferHandles[i]) != VK_SUCCESS)
+			{
+				throw std::runtime_error("command buffer end failed");
+			}
+		}
+		std::cout << "Successfully create split command buffers" << std::endl;
+	}
+
+	void Application::RecordSplitStep(VkCommandBuffer commandBuffer, bool compact, VkQueryPool queryPool)
+	{
+		VkMemoryBarrier computeToComputeBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+		VkMemoryBarrier computeToIndirectBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+		VkMemoryBarrier computeToTransferBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT
+		};
+		VkMemoryBarrier transferToComputeBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_TRANSFER_WRITE_BIT,
+			VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+		};
+		VkMemoryBarrier computeToHostBarrier
+		{
+			VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			NULL,
+			VK_ACCESS_SHADER_WRITE_BIT,
+			VK_ACCESS_HOST_READ_BIT
+		};
+
+		if (queryPool != VK_NULL_HANDLE)
+		{
+			vkCmdResetQueryPool(commandBuffer, queryPool, 0, 2);
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, 0);
+		}
+		// the host's split state and inbox writes are visible to the submission, the previous step's passes are not
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &computeToTransferBarrier, 0, NULL, 0, NULL);
+		vkCmdFillBuffer(commandBuffer, tileBufferHandle, awakeSsboOffset, awakeSsboSize, 1);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &transferToComputeBarrier, 0, NULL, 0, NULL);
+		BindComputeState(commandBuffer);
+
+		// drop the last step's ghosts, the particles that left in the last band pass are dead slots until compacted
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, splitPipelineHandles[0]);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+		if (compact)
+		{
+			RecordCompaction(commandBuffer);
+			BindComputeState(commandBuffer);
+		}
+
+		// arrivals and ghosts from the cpu go behind the owned particles
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, splitPipelineHandles[1]);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, particleCountPipelineHandles[2]);
+		vkCmdDispatch(commandBuffer, 1, 1, 1);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToIndirectBarrier, 0, NULL, 0, NULL);
+		RecordDispatch(commandBuffer, splitPipelineHandles[2], SPH_PARTICLE_CAPACITY);
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeToComputeBarrier, 0, NULL, 0, NULL);
+
+		// ghosts only get a density, they are not awake
+		RecordSimulationStep(commandBuffer, forceKernel);
+
+		// hand the band and the particles that crossed the line to the cpu
+		BindComputeState(commandBuffer);
+		RecordDispatchIndirect(commandBuffer, splitPipelineHandles[3], simulationStateBufferHandle, offsetof(SimulationState, sizedDispatch));
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &computeToHostBarrier, 0, NULL, 0, NULL);
+		if (queryPool != VK_NULL_HANDLE)
+		{
+			vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, 1);
+		}
+	}
+
+	void Application::RunSplit()
+	{
+		if (settings.activeTiles)
+		{
+			throw std::runtime_error("--split cannot be combined with --active-tiles");
+		}
+		// an owned particle's force needs the densities of its neighbours, which need their own neighbours
+		const float bandWidth = 2 * SPH_SMOOTHING_LENGTH;
+		float splitX = std::clamp(settings.splitX, -1 + SPH_SPLIT_MARGIN, 1 - SPH_SPLIT_MARGIN);
+		CpuSolver cpuSolver(settings.threadCount);
+
+		// the initial partition, the gpu's first band is taken on the host
+		const ParticleState initialState = InitialDamBreak();
+		ParticleState gpuState;
+		ParticleState cpuState;
+		std::vector<HaloParticle> gpuOutgoing;
+		for (size_t i = 0; i < initialState.Size(); i++)
+		{
+			(initialState.position[i].x < splitX ? gpuState : cpuState).PushBack(initialState, i);
+			if (initialState.position[i].x < splitX && splitX - initialState.position[i].x < bandWidth)
+			{
+				gpuOutgoing.push_back({ initialState.position[i], initialState.velocity[i], initialState.id[i], 0 });
+			}
+		}
+		if (gpuState.Size() == 0 || cpuState.Size() == 0)
+		{
+			throw std::runtime_error("the split line must leave particles on both sides");
+		}
+		Upload(gpuState);
+		cpuSolver.Upload(cpuState);
+		// the cpu's slab is open to the right
+		const float openEdge = std::numeric_limits<float>::infinity();
+		std::vector<HaloParticle> cpuOutgoing;
+		std::vector<HaloParticle> unused;
+		cpuSolver.ExtractHalo(splitX, openEdge, bandWidth, cpuOutgoing, unused);
+
+		SplitState* splitState = reinterpret_cast<SplitState*>(splitMapped + splitStateSsboOffset);
+		HaloParticle* inbox = reinterpret_cast<HaloParticle*>(splitMapped + splitInboxSsboOffset);
+		const HaloParticle* outbox = reinterpret_cast<const HaloParticle*>(splitMapped + splitOutboxSsboOffset);
+		splitState->ownedEnd = static_cast<uint32_t>(gpuState.Size());
+		splitState->ownedCount = static_cast<uint32_t>(gpuState.Size());
+
+		VkQueryPool queryPoolHandle = CreateBenchmarkQueryPool();
+		CreateSplitCommandBuffers(queryPoolHandle);
+		VkFenceCreateInfo fenceCreateInfo
+		{
+			VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
+			NULL,
+			0
+		};
+		VkFence fenceHandle = VK_NULL_HANDLE;
+		if (vkCreateFence(logicalDeviceHandle, &fenceCreateInfo, allocator, &fenceHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("fence creation failed");
+		}
+		std::cout << "[INFO] split run of " << settings.stepCount << " steps: " << Name() << " (" << Settings::ForceKernelName(forceKernel)
+			<< " force kernel) left of x = " << splitX << ", " << cpuSolver.Name() << " right of it" << std::endl;
+
+		// both halves step at once, each on the other's band from the previous step
+		const double nanosecondsPerTick = physicalDeviceProperties.limits.timestampPeriod;
+		double gpuTimeAverage = 0.0;
+		double cpuTimeAverage = 0.0;
+		double gpuTimeSum = 0.0;
+		double cpuTimeSum = 0.0;
+		uint32_t stepsSinceSplitCompaction = 0;
+		const auto runStart = std::chrono::steady_clock::now();
+		for (uint32_t step = 0; step < settings.stepCount; step++)
+		{
+			// the gpu wants the arrivals in front of the ghosts
+			uint32_t arrivalCount = 0;
+			for (const HaloParticle& halo : cpuOutgoing)
+			{
+				if (halo.migrated)
+				{
+					inbox[arrivalCount++] = halo;
+				}
+			}
+			uint32_t inboxCount = arrivalCount;
+			for (const HaloParticle& halo : cpuOutgoing)
+			{
+				if (!halo.migrated)
+				{
+					inbox[inboxCount++] = halo;
+				}
+			}
+			// dead slots left by migrations and the sink are reclaimed every SPH_COMPACT_INTERVAL steps, or early if the inbox needs them
+			bool compact = SPH_COMPACT_INTERVAL > 0 && ++stepsSinceSplitCompaction >= SPH_COMPACT_INTERVAL;
+			if (splitState->ownedEnd + inboxCount > SPH_PARTICLE_CAPACITY)
+			{
+				compact = true;
+			}
+			if (splitState->ownedCount + inboxCount > SPH_PARTICLE_CAPACITY)
+			{
+				throw std::runtime_error("the gpu half of the split run exceeds SPH_PARTICLE_CAPACITY");
+			}
+			if (compact)
+			{
+				stepsSinceSplitCompaction = 0;
+			}
+			splitState->splitX = splitX;
+			splitState->bandWidth = bandWidth;
+			splitState->arrivalCount = arrivalCount;
+			splitState->inboxCount = inboxCount;
+			splitState->bandCount = 0;
+			splitState->ownedCount = 0;
+
+			VkSubmitInfo submitInfo = CsySmallVk::submitInfo();
+			submitInfo.commandBufferCount = 1;
+			submitInfo.pCommandBuffers = &splitCommandBufferHandles[compact ? 1 : 0];
+			const auto gpuStart = std::chrono::steady_clock::now();
+			if (vkQueueSubmit(computeQueueHandle, 1, &submitInfo, fenceHandle) != VK_SUCCESS)
+			{
+				throw std::runtime_error("command buffer submission failed");
+			}
+
+			const auto cpuStart = std::chrono::steady_clock::now();
+			cpuSolver.ReplaceHalo(gpuOutgoing);
+			cpuSolver.Step(1);
+			cpuOutgoing.clear();
+			cpuSolver.ExtractHalo(splitX, openEdge, bandWidth, cpuOutgoing, unused);
+			const double cpuTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpuStart).count();
+
+			if (vkWaitForFences(logicalDeviceHandle, 1, &fenceHandle, VK_TRUE, UINT64_MAX) != VK_SUCCESS)
+			{
+				throw std::runtime_error("vkWaitForFences failed");
+			}
+			// without timestamps the host only sees the fence after its own half, which overstates a faster gpu
+			double gpuTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - gpuStart).count();
+			uint64_t timestamps[2];
+			if (queryPoolHandle != VK_NULL_HANDLE && vkGetQueryPoolResults(logicalDeviceHandle, queryPoolHandle, 0, 2, sizeof(timestamps), timestamps,
+				sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT) == VK_SUCCESS)
+			{
+				gpuTime = 1e-6 * nanosecondsPerTick * (timestamps[1] - timestamps[0]);
+			}
+			vkResetFences(logicalDeviceHandle, 1, &fenceHandle);
+			gpuOutgoing.assign(outbox, outbox + splitState->bandCount);
+
+			gpuTimeSum += gpuTime;
+			cpuTimeSum += cpuTime;
+			gpuTimeAverage = step == 0 ? gpuTime : 0.9 * gpuTimeAverage + 0.1 * gpuTime;
+			cpuTimeAverage = step == 0 ? cpuTime : 0.9 * cpuTimeAverage + 0.1 * cpuTime;
+			// the gpu owns the left side, a slower cpu moves the line to the right
+			if ((step + 1) % SPH_SPLIT_BALANCE_INTERVAL == 0 && gpuTimeAverage + cpuTimeAverage > 0.0)
+			{
+				const double imbalance = (cpuTimeAverage - gpuTimeAverage) / (cpuTimeAverage + gpuTimeAverage);
+				splitX = std::clamp(splitX + SPH_SMOOTHING_LENGTH * static_cast<float>(imbalance), -1 + SPH_SPLIT_MARGIN, 1 - SPH_SPLIT_MARGIN);
+			}
+			if ((step + 1) % 1000 == 0 || step + 1 == settings.stepCount)
+			{
+				std::cout << "[INFO]     step " << step + 1 << ": split x " << splitX << ", gpu " << splitState->ownedCount << " particles "
+					<< gpuTimeAverage << " ms, cpu " << cpuSolver.OwnedCount() << " particles " << cpuTimeAverage << " ms, band "
+					<< splitState->bandCount << " + " << cpuOutgoing.size() << " particles" << std::endl;
+			}
+		}
+		const double runTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+		std::cout << "[INFO] split run: " << settings.stepCount / runTime << " steps/s, average step gpu " << gpuTimeSum / std::max(settings.stepCount, 1u)
+			<< " ms, cpu " << cpuTimeSum / std::max(settings.stepCount, 1u) << " ms" << std::endl;
+
+		vkDestroyFence(logicalDeviceHandle, fenceHandle, allocator);
+		vkFreeCommandBuffers(logicalDeviceHandle, computeCommandPoolHandle, 2, splitCommandBufferHandles);
+		if (queryPoolHandle != VK_NULL_HANDLE)
+		{
+			vkDestroyQueryPool(logicalDeviceHandle, queryPoolHandle, allocator);
+		}
+	}
+}
@@ -0,0 +1,244 @@
+#include "state_export.h"
+#include "solver.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace SPH
+{
+	namespace
+	{
+		size_t AlignSharedOffset(size_t offset)
+		{
+			return (offset + 63) / 64 * 64;
+		}
+
+		int64_t SteadyNanoseconds()
+		{
+			return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+	}
+
+	StateExporter::StateExporter(const std::string& name, uint32_t capacity, uint32_t fields)
+		: name(name[0] == '/' ? name : "/" + name)
+	{
+		fields |= ExportId;
+#ifdef _WIN32
+		throw std::runtime_error("the state export needs POSIX shared memory");
+#else
+		size_t slotSize = sizeof(ExportSlotHeader);
+		for (uint32_t bit = ExportPosition; bit <= ExportId; bit <<= 1)
+		{
+			slotSize += (fields & bit) ? sizeof(float) * ExportFieldWidth(static_cast<ExportField>(bit)) * capacity : 0;
+		}
+		slotSize = AlignSharedOffset(slotSize);
+		const size_t slotsOffset = AlignSharedOffset(sizeof(ExportHeader));
+		segmentSize = slotsOffset + SPH_EXPORT_SLOTS * slotSize;
+
+		// readers of other users may attach, only this process writes
+		const int descriptor = shm_open(this->name.c_str(), O_CREAT | O_RDWR, 0644);
+		if (descriptor < 0)
+		{
+			throw std::runtime_error("shm_open failed for " + this->name);
+		}
+		if (ftruncate(descriptor, static_cast<off_t>(segmentSize)) != 0)
+		{
+			close(descriptor);
+			shm_unlink(this->name.c_str());
+			throw std::runtime_error("shared memory resize failed");
+		}
+		void* shared = mmap(NULL, segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+		close(descriptor);
+		if (shared == MAP_FAILED)
+		{
+			shm_unlink(this->name.c_str());
+			throw std::runtime_error("shared memory mapping failed");
+		}
+		char* sharedBytes = static_cast<char*>(shared);
+		std::memset(sharedBytes, 0, slotsOffset);
+		header = new (sharedBytes) ExportHeader;
+		header->capacity = capacity;
+		header->fields = fields;
+		header->segmentSize = segmentSize;
+		for (uint32_t slot = 0; slot < SPH_EXPORT_SLOTS; slot++)
+		{
+			header->slotOffset[slot] = slotsOffset + slot * slotSize;
+			new (sharedBytes + header->slotOffset[slot]) ExportSlotHeader{};
+		}
+		header->latest.store(UINT32_MAX, std::memory_order_relaxed);
+		header->closed.store(0, std::memory_order_relaxed);
+		header->version = SPH_EXPORT_VERSION;
+		// readers check the magic last
+		std::atomic_thread_fence(std::memory_order_release);
+		header->magic = SPH_EXPORT_MAGIC;
+		std::cout << "[INFO] exporting " << capacity << " particles into shared memory " << this->name << ", " << segmentSize / 1024 << " KiB" << std::endl;
+#endif
+	}
+
+	StateExporter::~StateExporter()
+	{
+#ifndef _WIN32
+		header->closed.store(1, std::memory_order_release);
+		munmap(header, segmentSize);
+		shm_unlink(name.c_str());
+#endif
+	}
+
+	void StateExporter::Begin(uint64_t step, uint32_t count)
+	{
+		// never the newest slot, which the readers copy
+		const uint32_t latest = header->latest.load(std::memory_order_relaxed);
+		writingSlot = latest >= SPH_EXPORT_SLOTS ? 0 : (latest + 1) % SPH_EXPORT_SLOTS;
+		ExportSlotHeader* slotHeader = reinterpret_cast<ExportSlotHeader*>(reinterpret_cast<char*>(header) + header->slotOffset[writingSlot]);
+		slotHeader->sequence.store(slotHeader->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slotHeader->step = step;
+		slotHeader->count = std::min(count, header->capacity);
+	}
+
+	float* StateExporter::Field(ExportField field)
+	{
+		if (!(header->fields & field))
+		{
+			return nullptr;
+		}
+		char* data = reinterpret_cast<char*>(header) + header->slotOffset[writingSlot] + sizeof(ExportSlotHeader);
+		return reinterpret_cast<float*>(data + ExportFieldOffset(header->fields, header->capacity, field));
+	}
+
+	uint32_t* StateExporter::Ids()
+	{
+		char* data = reinterpret_cast<char*>(header) + header->slotOffset[writingSlot] + sizeof(ExportSlotHeader);
+		return reinterpret_cast<uint32_t*>(data + ExportFieldOffset(header->fields, header->capacity, ExportId));
+	}
+
+	void StateExporter::Publish()
+	{
+		ExportSlotHeader* slotHeader = reinterpret_cast<ExportSlotHeader*>(reinterpret_cast<char*>(header) + header->slotOffset[writingSlot]);
+		slotHeader->publishTime = SteadyNanoseconds();
+		slotHeader->sequence.store(slotHeader->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		header->latest.store(writingSlot, std::memory_order_release);
+		publishedCount++;
+	}
+
+	void BenchmarkStateExport(const Settings& settings)
+	{
+#ifdef _WIN32
+		throw std::runtime_error("the state export benchmark needs POSIX shared memory and fork");
+#else
+		const ParticleState state = InitialDamBreak();
+		const uint32_t count = static_cast<uint32_t>(state.Size());
+		const uint32_t fields = settings.exportFields;
+		const std::string name = "/vulkan_sph_export_" + std::to_string(getpid());
+		std::cout << "[INFO] state export of " << count << " particles, " << SPH_EXPORT_BENCHMARK_SECONDS << " s per rate, reader in another process:" << std::endl;
+
+		// 0 publishes as fast as possible
+		for (uint32_t rate : { 0u, 1000u })
+		{
+			std::vector<int64_t> publishTimes;
+			pid_t reader = -1;
+			{
+				StateExporter exporter(name, count, fields);
+				reader = fork();
+				if (reader < 0)
+				{
+					throw std::runtime_error("fork failed");
+				}
+				if (reader == 0)
+				{
+					int status = 1;
+					try
+					{
+						StateReader stateReader(name);
+						ExportSnapshot snapshot;
+						std::vector<int64_t> latencies;
+						uint64_t bytes = 0;
+						int64_t firstRead = 0;
+						int64_t lastRead = 0;
+						for (;;)
+						{
+							// closed is checked first, so that the last snapshot is still read
+							const bool closed = stateReader.Closed();
+							if (stateReader.Read(snapshot))
+							{
+								lastRead = SteadyNanoseconds();
+								firstRead = firstRead == 0 ? lastRead : firstRead;
+								latencies.push_back(lastRead - snapshot.publishTime);
+								bytes += sizeof(float) * (snapshot.position.size() + snapshot.velocity.size() + snapshot.density.size() + snapshot.pressure.size() + snapshot.id.size());
+							}
+							else if (closed)
+							{
+								break;
+							}
+						}
+						std::sort(latencies.begin(), latencies.end());
+						const double seconds = std::max(1e-9 * (lastRead - firstRead), 1e-9);
+						const auto percentile = [&](double p) { return latencies.empty() ? 0.0 : 1e-3 * latencies[static_cast<size_t>(p * (latencies.size() - 1))]; };
+						std::cout << "[INFO]     reader: " << latencies.size() << " snapshots, " << latencies.size() / seconds << " /s, " << 1e-9 * bytes / seconds
+							<< " GB/s, latency median " << percentile(0.5) << " us, p99 " << percentile(0.99) << " us, " << stateReader.Retries() << " retried copies" << std::endl;
+						status = 0;
+					}
+					catch (const std::exception& exception)
+					{
+						std::cerr << "[ERROR] export reader: " << exception.what() << std::endl;
+					}
+					std::cout.flush();
+					_exit(status);
+				}
+
+				const auto start = std::chrono::steady_clock::now();
+				const auto end = start + std::chrono::seconds(SPH_EXPORT_BENCHMARK_SECONDS);
+				for (uint64_t step = 1; std::chrono::steady_clock::now() < end; step++)
+				{
+					const int64_t publishStart = SteadyNanoseconds();
+					exporter.Begin(step, count);
+					float* field = nullptr;
+					if ((field = exporter.Field(ExportPosition)) != nullptr)
+					{
+						std::memcpy(field, state.position.data(), sizeof(glm::vec2) * count);
+					}
+					if ((field = exporter.Field(ExportVelocity)) != nullptr)
+					{
+						std::memcpy(field, state.velocity.data(), sizeof(glm::vec2) * count);
+					}
+					if ((field = exporter.Field(ExportDensity)) != nullptr)
+					{
+						std::memcpy(field, state.density.data(), sizeof(float) * count);
+					}
+					if ((field = exporter.Field(ExportPressure)) != nullptr)
+					{
+						std::memcpy(field, state.pressure.data(), sizeof(float) * count);
+					}
+					std::memcpy(exporter.Ids(), state.id.data(), sizeof(uint32_t) * count);
+					exporter.Publish();
+					publishTimes.push_back(SteadyNanoseconds() - publishStart);
+					if (rate > 0)
+					{
+						std::this_thread::sleep_until(start + std::chrono::nanoseconds(1000000000ull * step / rate));
+					}
+				}
+			}
+			int status = 0;
+			waitpid(reader, &status, 0);
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			{
+				throw std::runtime_error("export reader process failed");
+			}
+			std::sort(publishTimes.begin(), publishTimes.end());
+			std::cout << "[INFO]     writer" << (rate > 0 ? " at " + std::to_string(rate) + " /s" : std::string(" unpaced")) << ": " << publishTimes.size()
+				<< " snapshots, publish median " << 1e-3 * publishTimes[publishTimes.size() / 2] << " us" << std::endl;
+		}
+#endif
+	}
+}
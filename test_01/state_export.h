@@ -0,0 +1,50 @@
+#pragma once
+#include "state_reader.h"
+#include "settings.h"
+#include <cstdint>
+#include <string>
+
+// how long each publishing rate of --benchmark-export runs
+#ifndef SPH_EXPORT_BENCHMARK_SECONDS
+#define SPH_EXPORT_BENCHMARK_SECONDS 2
+#endif
+
+namespace SPH
+{
+	// Publishes particle state into the POSIX shared-memory segment of StateReader. Begin picks the slot after the
+	// newest and marks it as being written, the caller fills the arrays of Field in place, and Publish makes it the
+	// newest. Readers never block the writer, they retry a copy the writer overlapped instead
+	class StateExporter
+	{
+	public:
+		// creates or replaces the segment name, laid out for capacity particles of the fields in the ExportField mask
+		// and the ids
+		StateExporter(const std::string& name, uint32_t capacity, uint32_t fields);
+		StateExporter(const StateExporter&) = delete;
+		// marks the segment closed for the attached readers and removes its name
+		~StateExporter();
+
+		void Begin(uint64_t step, uint32_t count);
+		// capacity entries of the field in the slot being written, null if the segment does not carry it
+		float* Field(ExportField field);
+		// capacity ids in the slot being written
+		uint32_t* Ids();
+		void Publish();
+
+		uint32_t Capacity() const { return header->capacity; }
+		uint32_t Fields() const { return header->fields; }
+		uint64_t PublishedCount() const { return publishedCount; }
+
+	private:
+		std::string name;
+		ExportHeader* header = nullptr;
+		size_t segmentSize = 0;
+		uint32_t writingSlot = 0;
+		uint64_t publishedCount = 0;
+	};
+
+	// one process publishes a dam-break state while a forked reader copies every snapshot it can get, as fast as
+	// possible and paced at a fixed rate, and reports the publish cost, the read throughput and the latency from
+	// Publish to a consistent copy on the reader's side
+	void BenchmarkStateExport(const Settings& settings);
+}
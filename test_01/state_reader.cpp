@@ -0,0 +1,108 @@
+#include "state_reader.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace SPH
+{
+	StateReader::StateReader(const std::string& name)
+	{
+#ifdef _WIN32
+		throw std::runtime_error("the state export needs POSIX shared memory");
+#else
+		const std::string sharedName = name[0] == '/' ? name : "/" + name;
+		const int descriptor = shm_open(sharedName.c_str(), O_RDONLY, 0);
+		if (descriptor < 0)
+		{
+			throw std::runtime_error("no exported state named " + sharedName);
+		}
+		struct stat status;
+		if (fstat(descriptor, &status) != 0 || static_cast<size_t>(status.st_size) < sizeof(ExportHeader))
+		{
+			close(descriptor);
+			throw std::runtime_error("exported state segment too small: " + sharedName);
+		}
+		mappedSize = static_cast<size_t>(status.st_size);
+		void* shared = mmap(NULL, mappedSize, PROT_READ, MAP_SHARED, descriptor, 0);
+		close(descriptor);
+		if (shared == MAP_FAILED)
+		{
+			throw std::runtime_error("exported state mapping failed: " + sharedName);
+		}
+		header = static_cast<const ExportHeader*>(shared);
+		if (header->magic != SPH_EXPORT_MAGIC || header->version != SPH_EXPORT_VERSION || header->segmentSize > mappedSize)
+		{
+			munmap(shared, mappedSize);
+			throw std::runtime_error("exported state segment has another format: " + sharedName);
+		}
+#endif
+	}
+
+	StateReader::~StateReader()
+	{
+#ifndef _WIN32
+		munmap(const_cast<ExportHeader*>(header), mappedSize);
+#endif
+	}
+
+	bool StateReader::Read(ExportSnapshot& snapshot)
+	{
+		const char* base = reinterpret_cast<const char*>(header);
+		const uint32_t capacity = header->capacity;
+		const uint32_t fields = header->fields;
+		for (;;)
+		{
+			const uint32_t slot = header->latest.load(std::memory_order_acquire);
+			if (slot >= SPH_EXPORT_SLOTS)
+			{
+				return false;
+			}
+			const ExportSlotHeader* slotHeader = reinterpret_cast<const ExportSlotHeader*>(base + header->slotOffset[slot]);
+			const uint64_t sequence = slotHeader->sequence.load(std::memory_order_acquire);
+			if (sequence & 1)
+			{
+				// the writer lapped the readers and is refilling the newest slot, latest moves on shortly
+				retries++;
+				continue;
+			}
+			const uint64_t step = slotHeader->step;
+			if (anyRead && step == lastStep)
+			{
+				return false;
+			}
+			const uint32_t count = std::min(slotHeader->count, capacity);
+			const char* data = reinterpret_cast<const char*>(slotHeader + 1);
+			std::vector<float>* arrays[4]{ &snapshot.position, &snapshot.velocity, &snapshot.density, &snapshot.pressure };
+			for (uint32_t f = 0; f < 4; f++)
+			{
+				const ExportField field = static_cast<ExportField>(1u << f);
+				const size_t size = (fields & field) ? static_cast<size_t>(ExportFieldWidth(field)) * count : 0;
+				arrays[f]->resize(size);
+				if (size > 0)
+				{
+					std::memcpy(arrays[f]->data(), data + ExportFieldOffset(fields, capacity, field), sizeof(float) * size);
+				}
+			}
+			snapshot.id.resize(count);
+			std::memcpy(snapshot.id.data(), data + ExportFieldOffset(fields, capacity, ExportId), sizeof(uint32_t) * count);
+			snapshot.step = step;
+			snapshot.publishTime = slotHeader->publishTime;
+			snapshot.count = count;
+			// the copy only counts if the writer did not touch the slot meanwhile
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slotHeader->sequence.load(std::memory_order_relaxed) == sequence)
+			{
+				lastStep = step;
+				anyRead = true;
+				return true;
+			}
+			retries++;
+		}
+	}
+}
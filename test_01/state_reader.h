@@ -0,0 +1,114 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The format of the shared-memory segment --export publishes the particle state into, and the reader for it. This
+// header and state_reader.cpp only need the standard library and POSIX shared memory, an analysis tool builds them
+// on their own and attaches with StateReader(name).
+#define SPH_EXPORT_MAGIC 0x58454853u
+#define SPH_EXPORT_VERSION 2u
+// snapshots in the segment, the writer fills the one after the newest while readers copy the newest
+#define SPH_EXPORT_SLOTS 3
+
+namespace SPH
+{
+	// the fields a segment carries, each as an array over the capacity, in this order. Every segment carries the
+	// ids, as uint32_t, to follow a particle across snapshots, the reorders move the particles between slots
+	enum ExportField : uint32_t
+	{
+		ExportPosition = 1u << 0,
+		ExportVelocity = 1u << 1,
+		ExportDensity = 1u << 2,
+		ExportPressure = 1u << 3,
+		ExportId = 1u << 4
+	};
+
+	// floats or ids per particle of a field
+	inline uint32_t ExportFieldWidth(ExportField field)
+	{
+		return field == ExportPosition || field == ExportVelocity ? 2 : 1;
+	}
+
+	// at the start of the segment, written once by the writer before it publishes anything
+	struct ExportHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t capacity;
+		uint32_t fields;
+		uint64_t slotOffset[SPH_EXPORT_SLOTS];
+		uint64_t segmentSize;
+		// the slot of the newest snapshot, UINT32_MAX before the first
+		alignas(64) std::atomic<uint32_t> latest;
+		// set when the writer is gone
+		std::atomic<uint32_t> closed;
+	};
+
+	// A seqlock per slot: sequence is odd while the writer fills the slot, a reader that saw the same even sequence
+	// before and after its copy has a consistent snapshot. The writer never waits for readers
+	struct ExportSlotHeader
+	{
+		alignas(64) std::atomic<uint64_t> sequence;
+		uint64_t step;
+		// steady clock nanoseconds when the snapshot was published, CLOCK_MONOTONIC on POSIX
+		int64_t publishTime;
+		uint32_t count;
+		uint32_t reserved;
+	};
+	static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+		"the seqlock needs address-free atomics to work across processes");
+
+	// byte offset of a field's array from the start of a slot's data, which follows the ExportSlotHeader
+	inline uint64_t ExportFieldOffset(uint32_t fields, uint32_t capacity, ExportField field)
+	{
+		uint64_t offset = 0;
+		for (uint32_t bit = ExportPosition; bit < static_cast<uint32_t>(field); bit <<= 1)
+		{
+			offset += (fields & bit) ? sizeof(float) * ExportFieldWidth(static_cast<ExportField>(bit)) * capacity : 0;
+		}
+		return offset;
+	}
+
+	// a consistent copy of one published step, the arrays of the fields the segment does not carry stay empty. Only
+	// the alive particles are published, entry i of every array belongs to particle id[i]
+	struct ExportSnapshot
+	{
+		uint64_t step = 0;
+		int64_t publishTime = 0;
+		uint32_t count = 0;
+		// x, y pairs
+		std::vector<float> position;
+		std::vector<float> velocity;
+		std::vector<float> density;
+		std::vector<float> pressure;
+		std::vector<uint32_t> id;
+	};
+
+	// Attaches to the segment of a running --export, read-only
+	class StateReader
+	{
+	public:
+		// the name as given to --export, throws if there is no such segment or it has another format
+		explicit StateReader(const std::string& name);
+		StateReader(const StateReader&) = delete;
+		~StateReader();
+
+		// copies the newest snapshot if it is newer than the last one read, false if there is none yet
+		bool Read(ExportSnapshot& snapshot);
+		bool Closed() const { return header->closed.load(std::memory_order_acquire) != 0; }
+		uint32_t Capacity() const { return header->capacity; }
+		uint32_t Fields() const { return header->fields; }
+		// copies thrown away because the writer came back to the slot meanwhile
+		uint64_t Retries() const { return retries; }
+
+	private:
+		const ExportHeader* header = nullptr;
+		size_t mappedSize = 0;
+		uint64_t lastStep = 0;
+		bool anyRead = false;
+		uint64_t retries = 0;
+	};
+}
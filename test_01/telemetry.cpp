@@ -0,0 +1,366 @@
+#include "telemetry.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#ifdef _WIN32
+// keeps std::min and std::max usable
+#define NOMINMAX
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "Ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace SPH
+{
+	namespace
+	{
+#ifdef _WIN32
+		typedef SOCKET SocketHandle;
+		const SocketHandle InvalidSocket = INVALID_SOCKET;
+		void CloseSocket(SocketHandle socketHandle) { closesocket(socketHandle); }
+		int PollSocket(SocketHandle socketHandle, int timeoutMilliseconds)
+		{
+			WSAPOLLFD descriptor{ socketHandle, POLLIN, 0 };
+			return WSAPoll(&descriptor, 1, timeoutMilliseconds);
+		}
+#else
+		typedef int SocketHandle;
+		const SocketHandle InvalidSocket = -1;
+		void CloseSocket(SocketHandle socketHandle) { close(socketHandle); }
+		int PollSocket(SocketHandle socketHandle, int timeoutMilliseconds)
+		{
+			pollfd descriptor{ socketHandle, POLLIN, 0 };
+			return poll(&descriptor, 1, timeoutMilliseconds);
+		}
+#endif
+
+		void SendAll(SocketHandle socketHandle, const std::string& data)
+		{
+			size_t sent = 0;
+			while (sent < data.size())
+			{
+				const int result = static_cast<int>(send(socketHandle, data.data() + sent, static_cast<int>(data.size() - sent), 0));
+				if (result <= 0)
+				{
+					return;
+				}
+				sent += static_cast<size_t>(result);
+			}
+		}
+	}
+
+	uint32_t Histogram::BucketIndex(uint64_t thousandths)
+	{
+		// values below SPH_TELEMETRY_SUB_BUCKETS get a bucket each, above that every power of two splits into
+		// SPH_TELEMETRY_SUB_BUCKETS buckets by the bits after the leading one
+		if (thousandths < SPH_TELEMETRY_SUB_BUCKETS)
+		{
+			return static_cast<uint32_t>(thousandths);
+		}
+		uint32_t leadingBit = 0;
+		while ((thousandths >> (leadingBit + 1)) != 0)
+		{
+			leadingBit++;
+		}
+		const uint32_t shift = leadingBit - 3;
+		static_assert(SPH_TELEMETRY_SUB_BUCKETS == 8, "the sub-bucket bits below assume 8 sub-buckets");
+		const uint32_t index = (shift + 1) * SPH_TELEMETRY_SUB_BUCKETS + static_cast<uint32_t>((thousandths >> shift) & (SPH_TELEMETRY_SUB_BUCKETS - 1));
+		return std::min(index, BucketCount - 1);
+	}
+
+	uint64_t Histogram::BucketEnd(uint32_t index)
+	{
+		if (index < SPH_TELEMETRY_SUB_BUCKETS)
+		{
+			return index + 1;
+		}
+		const uint32_t shift = index / SPH_TELEMETRY_SUB_BUCKETS - 1;
+		const uint64_t mantissa = SPH_TELEMETRY_SUB_BUCKETS + index % SPH_TELEMETRY_SUB_BUCKETS;
+		return (mantissa + 1) << shift;
+	}
+
+	void Histogram::Record(double value)
+	{
+		const uint64_t thousandths = static_cast<uint64_t>(std::max(0.0, std::round(1000.0 * value)));
+		std::atomic<uint64_t>& bucket = buckets[BucketIndex(thousandths)];
+		// the only writer, a load and a store are enough
+		bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		sum.store(sum.load(std::memory_order_relaxed) + thousandths, std::memory_order_relaxed);
+		if (thousandths > max.load(std::memory_order_relaxed))
+		{
+			max.store(thousandths, std::memory_order_relaxed);
+		}
+		count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	Histogram::Summary Histogram::Summarize() const
+	{
+		Summary summary;
+		uint64_t counts[BucketCount];
+		uint64_t total = 0;
+		for (uint32_t index = 0; index < BucketCount; index++)
+		{
+			counts[index] = buckets[index].load(std::memory_order_relaxed);
+			total += counts[index];
+		}
+		if (total == 0)
+		{
+			return summary;
+		}
+		const double maxValue = 1e-3 * max.load(std::memory_order_relaxed);
+		// a percentile reports the end of its bucket, but never more than the largest value seen
+		auto percentile = [&](double fraction)
+		{
+			const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * total)));
+			uint64_t seen = 0;
+			for (uint32_t index = 0; index < BucketCount; index++)
+			{
+				seen += counts[index];
+				if (seen >= rank)
+				{
+					return std::min(1e-3 * BucketEnd(index), maxValue);
+				}
+			}
+			return maxValue;
+		};
+		summary.count = total;
+		summary.mean = 1e-3 * sum.load(std::memory_order_relaxed) / total;
+		summary.p50 = percentile(0.5);
+		summary.p99 = percentile(0.99);
+		summary.max = maxValue;
+		return summary;
+	}
+
+	Telemetry::Telemetry(const Settings& settings)
+	{
+		if (settings.telemetryPort > 0)
+		{
+			serverThread = std::thread(&Telemetry::ServeLoop, this, static_cast<uint16_t>(settings.telemetryPort));
+		}
+		if (!settings.telemetryDumpPath.empty())
+		{
+			dumpThread = std::thread(&Telemetry::DumpLoop, this, settings.telemetryDumpPath, std::max(1u, settings.telemetryInterval));
+		}
+	}
+
+	Telemetry::~Telemetry()
+	{
+		{
+			std::lock_guard<std::mutex> lock(stopMutex);
+			stopping = true;
+		}
+		stopCondition.notify_all();
+		if (serverThread.joinable())
+		{
+			serverThread.join();
+		}
+		if (dumpThread.joinable())
+		{
+			dumpThread.join();
+		}
+	}
+
+	const char* Telemetry::MetricName(TelemetryMetric metric)
+	{
+		switch (metric)
+		{
+		case TelemetryMetric::FrameTime: return "sph_frame_time_ms";
+		case TelemetryMetric::AcquireWait: return "sph_acquire_wait_ms";
+		case TelemetryMetric::PresentWait: return "sph_present_wait_ms";
+		case TelemetryMetric::StepsPerSecond: return "sph_steps_per_second";
+		case TelemetryMetric::SubmitTime: return "sph_submit_time_ms";
+		case TelemetryMetric::StepGpuTime: return "sph_step_gpu_time_ms";
+		case TelemetryMetric::GridGpuTime: return "sph_grid_gpu_time_ms";
+		case TelemetryMetric::DensityGpuTime: return "sph_density_gpu_time_ms";
+		case TelemetryMetric::ForceGpuTime: return "sph_force_gpu_time_ms";
+		case TelemetryMetric::IntegrateGpuTime: return "sph_integrate_gpu_time_ms";
+		case TelemetryMetric::ReorderGpuTime: return "sph_reorder_gpu_time_ms";
+		default: return "sph_unknown";
+		}
+	}
+
+	const char* Telemetry::MetricHelp(TelemetryMetric metric)
+	{
+		switch (metric)
+		{
+		case TelemetryMetric::FrameTime: return "CPU time of a window frame";
+		case TelemetryMetric::AcquireWait: return "Wait for the next swapchain image";
+		case TelemetryMetric::PresentWait: return "Wait for the frame in flight that used the same semaphores, and present";
+		case TelemetryMetric::StepsPerSecond: return "Completed simulation steps per second over about half a second";
+		case TelemetryMetric::SubmitTime: return "CPU time of a step's queue submissions";
+		case TelemetryMetric::StepGpuTime: return "GPU time of a step submission";
+		case TelemetryMetric::GridGpuTime: return "GPU time of the neighbour grid and active list passes";
+		case TelemetryMetric::DensityGpuTime: return "GPU time of the density pass";
+		case TelemetryMetric::ForceGpuTime: return "GPU time of the force pass";
+		case TelemetryMetric::IntegrateGpuTime: return "GPU time of the integrate pass";
+		case TelemetryMetric::ReorderGpuTime: return "GPU time of the Morton reorder";
+		default: return "";
+		}
+	}
+
+	std::string Telemetry::Prometheus() const
+	{
+		std::ostringstream text;
+		for (uint32_t index = 0; index < static_cast<uint32_t>(TelemetryMetric::Count); index++)
+		{
+			const TelemetryMetric metric = static_cast<TelemetryMetric>(index);
+			const std::string name = MetricName(metric);
+			const Histogram::Summary summary = histograms[index].Summarize();
+			text << "# HELP " << name << " " << MetricHelp(metric) << "\n"
+				<< "# TYPE " << name << " summary\n"
+				<< name << "{quantile=\"0.5\"} " << summary.p50 << "\n"
+				<< name << "{quantile=\"0.99\"} " << summary.p99 << "\n"
+				<< name << "_sum " << summary.mean * summary.count << "\n"
+				<< name << "_count " << summary.count << "\n"
+				<< "# TYPE " << name << "_max gauge\n"
+				<< name << "_max " << summary.max << "\n";
+		}
+		return text.str();
+	}
+
+	std::string Telemetry::Csv(bool header) const
+	{
+		const double seconds = 1e-9 * std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - startTime).count();
+		std::ostringstream text;
+		if (header)
+		{
+			text << "seconds,metric,count,mean,p50,p99,max\n";
+		}
+		for (uint32_t index = 0; index < static_cast<uint32_t>(TelemetryMetric::Count); index++)
+		{
+			const Histogram::Summary summary = histograms[index].Summarize();
+			text << seconds << "," << MetricName(static_cast<TelemetryMetric>(index)) << "," << summary.count << ","
+				<< summary.mean << "," << summary.p50 << "," << summary.p99 << "," << summary.max << "\n";
+		}
+		return text.str();
+	}
+
+	bool Telemetry::WaitForStop(std::chrono::milliseconds timeout)
+	{
+		std::unique_lock<std::mutex> lock(stopMutex);
+		return stopCondition.wait_for(lock, timeout, [this]() { return stopping; });
+	}
+
+	void Telemetry::ServeLoop(uint16_t port)
+	{
+#ifdef _WIN32
+		WSADATA wsaData;
+		if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+		{
+			std::cout << "[WARNING] telemetry endpoint: WSAStartup failed" << std::endl;
+			return;
+		}
+#endif
+		const SocketHandle listener = socket(AF_INET, SOCK_STREAM, 0);
+		sockaddr_in address{};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		const int reuse = 1;
+		setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+		if (listener == InvalidSocket || bind(listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 4) != 0)
+		{
+			// a busy port must not take the simulation down
+			std::cout << "[WARNING] telemetry endpoint: cannot listen on 127.0.0.1:" << port << std::endl;
+			if (listener != InvalidSocket)
+			{
+				CloseSocket(listener);
+			}
+			return;
+		}
+		std::cout << "[INFO] telemetry endpoint: http://127.0.0.1:" << port << "/metrics" << std::endl;
+
+		// one request per connection, polled so that the destructor is noticed within a fraction of a second
+		while (!WaitForStop(std::chrono::milliseconds(0)))
+		{
+			if (PollSocket(listener, 200) <= 0)
+			{
+				continue;
+			}
+			const SocketHandle client = accept(listener, NULL, NULL);
+			if (client == InvalidSocket)
+			{
+				continue;
+			}
+			char request[1024];
+			const int received = PollSocket(client, 1000) > 0 ? static_cast<int>(recv(client, request, sizeof(request) - 1, 0)) : 0;
+			std::string path;
+			if (received > 0)
+			{
+				request[received] = '\0';
+				std::istringstream requestLine(request);
+				std::string method;
+				requestLine >> method >> path;
+				if (method != "GET")
+				{
+					path.clear();
+				}
+			}
+			std::string status = "200 OK";
+			std::string contentType = "text/plain; version=0.0.4";
+			std::string body;
+			if (path == "/metrics")
+			{
+				body = Prometheus();
+			}
+			else if (path == "/metrics.csv")
+			{
+				contentType = "text/csv";
+				body = Csv(true);
+			}
+			else
+			{
+				status = "404 Not Found";
+				contentType = "text/plain";
+				body = "try /metrics or /metrics.csv\n";
+			}
+			SendAll(client, "HTTP/1.0 " + status + "\r\nContent-Type: " + contentType + "\r\nContent-Length: " + std::to_string(body.size())
+				+ "\r\nConnection: close\r\n\r\n" + body);
+			CloseSocket(client);
+		}
+		CloseSocket(listener);
+#ifdef _WIN32
+		WSACleanup();
+#endif
+	}
+
+	void Telemetry::DumpLoop(std::string path, uint32_t intervalSeconds)
+	{
+		const bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+		bool header = true;
+		bool stop = false;
+		while (!stop)
+		{
+			stop = WaitForStop(std::chrono::seconds(intervalSeconds));
+			if (csv)
+			{
+				std::ofstream file(path, header ? std::ios::trunc : std::ios::app);
+				file << Csv(header);
+				header = false;
+			}
+			else
+			{
+				// scrapers of the text file never see it half written, the rename replaces it atomically on POSIX
+				const std::string temporaryPath = path + ".tmp";
+				{
+					std::ofstream file(temporaryPath, std::ios::trunc);
+					file << Prometheus();
+				}
+#ifdef _WIN32
+				// rename does not replace an existing file there, which leaves the file missing for a moment
+				std::remove(path.c_str());
+#endif
+				std::rename(temporaryPath.c_str(), path.c_str());
+			}
+		}
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "settings.h"
+
+// a histogram keeps SPH_TELEMETRY_SUB_BUCKETS buckets per power of two, so a percentile is off by at most
+// 1 / SPH_TELEMETRY_SUB_BUCKETS of its value. Values are stored in thousandths and go up to 2^SPH_TELEMETRY_OCTAVES
+#define SPH_TELEMETRY_SUB_BUCKETS 8
+#define SPH_TELEMETRY_OCTAVES 34
+
+namespace SPH
+{
+	// what the window run measures, every metric has exactly one writing thread
+	enum class TelemetryMetric : uint32_t
+	{
+		// main thread: cpu time of a frame, waiting for the next swapchain image, presenting and waiting for it,
+		// completed steps per second over about half a second
+		FrameTime,
+		AcquireWait,
+		PresentWait,
+		StepsPerSecond,
+		// simulation thread: cpu time of a step's queue submissions and the gpu time of the step and its passes
+		SubmitTime,
+		StepGpuTime,
+		GridGpuTime,
+		DensityGpuTime,
+		ForceGpuTime,
+		IntegrateGpuTime,
+		ReorderGpuTime,
+		Count
+	};
+
+	// Histogram of one metric with a single writing thread. Record only does relaxed atomic loads and stores, so the
+	// writer never waits for a reader, and a reader summarizing at the same time misses at most the record in flight
+	class Histogram
+	{
+	public:
+		struct Summary
+		{
+			uint64_t count = 0;
+			double mean = 0.0;
+			double p50 = 0.0;
+			double p99 = 0.0;
+			double max = 0.0;
+		};
+
+		void Record(double value);
+		Summary Summarize() const;
+
+	private:
+		static constexpr uint32_t BucketCount = SPH_TELEMETRY_SUB_BUCKETS * SPH_TELEMETRY_OCTAVES;
+		static uint32_t BucketIndex(uint64_t thousandths);
+		// exclusive upper end of a bucket in thousandths
+		static uint64_t BucketEnd(uint32_t index);
+
+		std::atomic<uint64_t> buckets[BucketCount] = {};
+		std::atomic<uint64_t> count{ 0 };
+		std::atomic<uint64_t> sum{ 0 };
+		std::atomic<uint64_t> max{ 0 };
+	};
+
+	// Latency and throughput histograms of the window run. With --telemetry-port=N they are served over HTTP on
+	// 127.0.0.1, /metrics in the Prometheus text format and /metrics.csv as CSV. With --telemetry-dump=path they are
+	// written every --telemetry-interval seconds, appended as CSV rows to a .csv path and replacing the Prometheus
+	// text file otherwise
+	class Telemetry
+	{
+	public:
+		explicit Telemetry(const Settings& settings);
+		Telemetry(const Telemetry&) = delete;
+		~Telemetry();
+
+		void Record(TelemetryMetric metric, double value) { histograms[static_cast<uint32_t>(metric)].Record(value); }
+		std::string Prometheus() const;
+		// one row per metric, seconds since the telemetry started in the first column
+		std::string Csv(bool header) const;
+
+		static const char* MetricName(TelemetryMetric metric);
+		static const char* MetricHelp(TelemetryMetric metric);
+
+	private:
+		void ServeLoop(uint16_t port);
+		void DumpLoop(std::string path, uint32_t intervalSeconds);
+		// true once Stop was asked for, waits up to the given time otherwise
+		bool WaitForStop(std::chrono::milliseconds timeout);
+
+		Histogram histograms[static_cast<uint32_t>(TelemetryMetric::Count)];
+		std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+		std::thread serverThread;
+		std::thread dumpThread;
+		std::mutex stopMutex;
+		std::condition_variable stopCondition;
+		bool stopping = false;
+	};
+}
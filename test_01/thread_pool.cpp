@@ -0,0 +1,143 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+namespace SPH
+{
+	ThreadPool::ThreadPool(unsigned threadCount)
+	{
+		if (threadCount == 0)
+		{
+			threadCount = std::max(1u, std::thread::hardware_concurrency());
+		}
+		for (unsigned i = 0; i < threadCount; i++)
+		{
+			queues.emplace_back(new Queue());
+		}
+		for (unsigned i = 1; i < threadCount; i++)
+		{
+			workers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			stopping = true;
+		}
+		wakeCondition.notify_all();
+		for (std::thread& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::ParallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& body)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+		grainSize = std::max(grainSize, 1u);
+		const unsigned threadCount = ThreadCount();
+		if (threadCount == 1 || count <= grainSize)
+		{
+			body(0, count);
+			return;
+		}
+
+		// contiguous partitions keep neighbouring particles on one core, the chunks are the unit of stealing
+		uint32_t chunkCount = 0;
+		std::vector<std::deque<Chunk>> partitions(threadCount);
+		for (unsigned thread = 0; thread < threadCount; thread++)
+		{
+			const uint32_t partitionBegin = static_cast<uint32_t>(uint64_t(count) * thread / threadCount);
+			const uint32_t partitionEnd = static_cast<uint32_t>(uint64_t(count) * (thread + 1) / threadCount);
+			for (uint32_t begin = partitionBegin; begin < partitionEnd; begin += grainSize)
+			{
+				partitions[thread].push_back({ begin, std::min(begin + grainSize, partitionEnd), &body });
+				chunkCount++;
+			}
+		}
+		pendingChunks.store(chunkCount);
+		for (unsigned thread = 0; thread < threadCount; thread++)
+		{
+			std::lock_guard<std::mutex> lock(queues[thread]->mutex);
+			queues[thread]->chunks = std::move(partitions[thread]);
+		}
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			generation++;
+		}
+		wakeCondition.notify_all();
+
+		while (pendingChunks.load() > 0)
+		{
+			if (!RunChunk(0))
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+
+	void ThreadPool::WorkerLoop(unsigned index)
+	{
+		uint64_t seenGeneration = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(wakeMutex);
+				wakeCondition.wait(lock, [&]() { return stopping || generation != seenGeneration; });
+				if (stopping)
+				{
+					return;
+				}
+				seenGeneration = generation;
+			}
+			while (pendingChunks.load() > 0)
+			{
+				if (!RunChunk(index))
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+	}
+
+	bool ThreadPool::RunChunk(unsigned index)
+	{
+		Chunk chunk;
+		bool found = false;
+		{
+			// own work first, in order
+			Queue& own = *queues[index];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.chunks.empty())
+			{
+				chunk = own.chunks.front();
+				own.chunks.pop_front();
+				found = true;
+			}
+		}
+		// then steal from the far end of the others, starting with the next thread
+		const unsigned threadCount = ThreadCount();
+		for (unsigned offset = 1; !found && offset < threadCount; offset++)
+		{
+			Queue& victim = *queues[(index + offset) % threadCount];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.chunks.empty())
+			{
+				chunk = victim.chunks.back();
+				victim.chunks.pop_back();
+				found = true;
+			}
+		}
+		if (!found)
+		{
+			return false;
+		}
+		(*chunk.body)(chunk.begin, chunk.end);
+		pendingChunks.fetch_sub(1);
+		return true;
+	}
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SPH
+{
+	// Fork-join pool for data-parallel loops. Every ParallelFor splits its range into one contiguous partition per
+	// thread, each cut into grain-sized chunks on that thread's own deque. A thread works its partition front to back
+	// and, once it runs dry, steals chunks from the back of the others, so an uneven load still spreads over every
+	// core. The calling thread takes part as thread 0.
+	class ThreadPool
+	{
+	public:
+		// 0 uses every hardware thread
+		explicit ThreadPool(unsigned threadCount = 0);
+		ThreadPool(const ThreadPool&) = delete;
+		~ThreadPool();
+
+		unsigned ThreadCount() const { return static_cast<unsigned>(queues.size()); }
+		// calls body(begin, end) over chunks of at most grainSize elements covering [0, count) and returns once all are done
+		void ParallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& body);
+
+	private:
+		struct Chunk
+		{
+			uint32_t begin;
+			uint32_t end;
+			const std::function<void(uint32_t, uint32_t)>* body;
+		};
+		struct Queue
+		{
+			std::mutex mutex;
+			std::deque<Chunk> chunks;
+		};
+
+		void WorkerLoop(unsigned index);
+		bool RunChunk(unsigned index);
+
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> workers;
+		std::atomic<uint32_t> pendingChunks{ 0 };
+		std::mutex wakeMutex;
+		std::condition_variable wakeCondition;
+		uint64_t generation = 0;
+		bool stopping = false;
+	};
+}
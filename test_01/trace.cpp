@@ -0,0 +1,116 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <stdexcept>
+#ifdef _WIN32
+// keeps std::min and std::max usable
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace SPH
+{
+	int64_t Tracer::Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	int64_t Tracer::HostCounterToNow(uint64_t counter)
+	{
+#ifdef _WIN32
+		// QueryPerformanceCounter ticks, scaled the way the steady clock scales them
+		LARGE_INTEGER frequency;
+		QueryPerformanceFrequency(&frequency);
+		const int64_t ticks = static_cast<int64_t>(counter);
+		return (ticks / frequency.QuadPart) * 1000000000 + (ticks % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+#else
+		// CLOCK_MONOTONIC nanoseconds, which the steady clock reads as well
+		return static_cast<int64_t>(counter);
+#endif
+	}
+
+	Tracer::ThreadBuffer& Tracer::LocalBuffer()
+	{
+		// a thread registers its buffer with the first span it records for this tracer
+		thread_local const Tracer* owner = nullptr;
+		thread_local ThreadBuffer* buffer = nullptr;
+		if (owner != this)
+		{
+			std::lock_guard<std::mutex> lock(buffersMutex);
+			buffers.emplace_back(new ThreadBuffer());
+			buffer = buffers.back().get();
+			buffer->threadIndex = static_cast<uint32_t>(buffers.size());
+			buffer->events.reserve(4096);
+			owner = this;
+		}
+		return *buffer;
+	}
+
+	void Tracer::Span(const char* name, TraceTrack track, int64_t start, int64_t end)
+	{
+		ThreadBuffer& buffer = LocalBuffer();
+		if (buffer.events.size() >= SPH_TRACE_MAX_EVENTS)
+		{
+			buffer.droppedCount++;
+			return;
+		}
+		buffer.events.push_back({ name, start, end - start, track });
+	}
+
+	void Tracer::NameThread(const char* name)
+	{
+		LocalBuffer().name = name;
+	}
+
+	void Tracer::Write(const std::string& path) const
+	{
+		std::lock_guard<std::mutex> lock(buffersMutex);
+		FILE* file = std::fopen(path.c_str(), "w");
+		if (!file)
+		{
+			throw std::runtime_error("trace file creation failed: " + path);
+		}
+		// the cpu threads are process 1, the queues process 2, timestamps in microseconds from the first span
+		int64_t origin = INT64_MAX;
+		uint64_t eventCount = 0;
+		uint64_t droppedCount = 0;
+		for (const auto& buffer : buffers)
+		{
+			for (const Event& event : buffer->events)
+			{
+				origin = std::min(origin, event.start);
+			}
+			eventCount += buffer->events.size();
+			droppedCount += buffer->droppedCount;
+		}
+		std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		std::fprintf(file, "{\"ph\":\"M\",\"pid\":1,\"name\":\"process_name\",\"args\":{\"name\":\"CPU\"}},\n");
+		std::fprintf(file, "{\"ph\":\"M\",\"pid\":2,\"name\":\"process_name\",\"args\":{\"name\":\"GPU\"}},\n");
+		std::fprintf(file, "{\"ph\":\"M\",\"pid\":2,\"tid\":1,\"name\":\"thread_name\",\"args\":{\"name\":\"compute queue\"}},\n");
+		std::fprintf(file, "{\"ph\":\"M\",\"pid\":2,\"tid\":2,\"name\":\"thread_name\",\"args\":{\"name\":\"graphics queue\"}}");
+		for (const auto& buffer : buffers)
+		{
+			if (!buffer->name.empty())
+			{
+				std::fprintf(file, ",\n{\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"name\":\"thread_name\",\"args\":{\"name\":\"%s\"}}", buffer->threadIndex, buffer->name.c_str());
+			}
+			for (const Event& event : buffer->events)
+			{
+				const uint32_t pid = event.track == TraceTrack::Cpu ? 1 : 2;
+				const uint32_t tid = event.track == TraceTrack::Cpu ? buffer->threadIndex : (event.track == TraceTrack::ComputeQueue ? 1 : 2);
+				std::fprintf(file, ",\n{\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"name\":\"%s\",\"ts\":%.3f,\"dur\":%.3f}", pid, tid, event.name,
+					1e-3 * (event.start - origin), 1e-3 * event.duration);
+			}
+		}
+		std::fprintf(file, "\n]}\n");
+		std::fclose(file);
+		std::cout << "[INFO] trace: " << eventCount << " spans written to " << path;
+		if (droppedCount > 0)
+		{
+			std::cout << ", " << droppedCount << " dropped past SPH_TRACE_MAX_EVENTS per thread";
+		}
+		std::cout << std::endl;
+	}
+}
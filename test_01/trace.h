@@ -0,0 +1,90 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// every thread buffers up to this many spans, later ones are counted and dropped
+#ifndef SPH_TRACE_MAX_EVENTS
+#define SPH_TRACE_MAX_EVENTS (1u << 20)
+#endif
+// the host time domain of VK_EXT_calibrated_timestamps that the steady clock counts in
+#ifdef _WIN32
+#define SPH_TRACE_HOST_TIME_DOMAIN VK_TIME_DOMAIN_QUERY_PERFORMANCE_COUNTER_EXT
+#else
+#define SPH_TRACE_HOST_TIME_DOMAIN VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT
+#endif
+
+namespace SPH
+{
+	// the rows of the trace, cpu spans go to the row of the recording thread
+	enum class TraceTrack : uint32_t
+	{
+		Cpu,
+		ComputeQueue,
+		GraphicsQueue
+	};
+
+	// Timeline of scoped cpu spans and gpu spans already converted to the cpu clock, written as Chrome trace JSON
+	// that chrome://tracing and Perfetto open. Every thread appends to a buffer of its own, only its first span
+	// takes a lock, so a span costs two clock reads and a push_back
+	class Tracer
+	{
+	public:
+		Tracer() = default;
+		Tracer(const Tracer&) = delete;
+
+		// nanoseconds on the steady clock, the clock the gpu timestamps are calibrated against
+		static int64_t Now();
+		// a reading of SPH_TRACE_HOST_TIME_DOMAIN, as returned by vkGetCalibratedTimestampsEXT, on the Now clock
+		static int64_t HostCounterToNow(uint64_t counter);
+		// name must outlive the tracer, string literals do
+		void Span(const char* name, TraceTrack track, int64_t start, int64_t end);
+		// names the calling thread's row
+		void NameThread(const char* name);
+		// call once every recording thread is done
+		void Write(const std::string& path) const;
+
+	private:
+		struct Event
+		{
+			const char* name;
+			int64_t start;
+			int64_t duration;
+			TraceTrack track;
+		};
+		struct ThreadBuffer
+		{
+			uint32_t threadIndex = 0;
+			std::string name;
+			std::vector<Event> events;
+			uint64_t droppedCount = 0;
+		};
+
+		ThreadBuffer& LocalBuffer();
+
+		mutable std::mutex buffersMutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	};
+
+	// records the lifetime of the scope as a cpu span, a null tracer records nothing
+	class TraceScope
+	{
+	public:
+		TraceScope(Tracer* tracer, const char* name) : tracer(tracer), name(name), start(tracer ? Tracer::Now() : 0) {}
+		TraceScope(const TraceScope&) = delete;
+		~TraceScope()
+		{
+			if (tracer)
+			{
+				tracer->Span(name, TraceTrack::Cpu, start, Tracer::Now());
+			}
+		}
+
+	private:
+		Tracer* tracer;
+		const char* name;
+		int64_t start;
+	};
+}
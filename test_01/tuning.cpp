@@ -0,0 +1,100 @@
+#include "tuning.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+namespace SPH
+{
+	uint32_t Tuning::WorkGroupSize(const std::string& passName) const
+	{
+		auto entry = workGroupSizes.find(passName);
+		return entry == workGroupSizes.end() ? 0 : entry->second;
+	}
+
+	std::string Tuning::FileName(const VkPhysicalDeviceProperties& properties)
+	{
+		char name[64];
+		std::snprintf(name, sizeof(name), "tuning_%04x_%04x.txt", properties.vendorID, properties.deviceID);
+		return std::string(SPH_TUNING_PATH) + name;
+	}
+
+	bool Tuning::Load(const VkPhysicalDeviceProperties& properties)
+	{
+		const std::string fileName = FileName(properties);
+		std::ifstream file(fileName);
+		if (!file)
+		{
+			return false;
+		}
+		Tuning loaded;
+		bool driverMatches = false;
+		std::string line;
+		while (std::getline(file, line))
+		{
+			std::istringstream fields(line);
+			std::string key;
+			if (!(fields >> key) || key[0] == '#')
+			{
+				continue;
+			}
+			if (key == "driver")
+			{
+				uint32_t driverVersion = 0;
+				fields >> driverVersion;
+				driverMatches = driverVersion == properties.driverVersion;
+			}
+			else if (key == "force_kernel")
+			{
+				std::string name;
+				fields >> name;
+				loaded.forceKernel = Settings::ParseForceKernel(name);
+				loaded.hasForceKernel = true;
+			}
+			else if (key == "work_group_size")
+			{
+				std::string passName;
+				uint32_t size = 0;
+				if (!(fields >> passName >> size) || size == 0)
+				{
+					throw std::runtime_error("malformed line in " + fileName + ": " + line);
+				}
+				loaded.workGroupSizes[passName] = size;
+			}
+			else
+			{
+				throw std::runtime_error("unknown key in " + fileName + ": " + key);
+			}
+		}
+		if (!driverMatches)
+		{
+			std::cout << "[WARNING] " << fileName << " was tuned with another driver version, run --autotune again" << std::endl;
+			return false;
+		}
+		*this = loaded;
+		std::cout << "[INFO] tuning loaded from " << fileName << std::endl;
+		return true;
+	}
+
+	void Tuning::Save(const VkPhysicalDeviceProperties& properties) const
+	{
+		const std::string fileName = FileName(properties);
+		std::ofstream file(fileName);
+		if (!file)
+		{
+			throw std::runtime_error("failed to write " + fileName);
+		}
+		file << "# written by --autotune for " << properties.deviceName << std::endl;
+		file << "driver " << properties.driverVersion << std::endl;
+		if (hasForceKernel)
+		{
+			file << "force_kernel " << Settings::ForceKernelName(forceKernel) << std::endl;
+		}
+		for (const auto& entry : workGroupSizes)
+		{
+			file << "work_group_size " << entry.first << " " << entry.second << std::endl;
+		}
+		std::cout << "[INFO] tuning saved to " << fileName << std::endl;
+	}
+}
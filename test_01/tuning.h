@@ -0,0 +1,32 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <map>
+#include <string>
+#include "settings.h"
+
+// directory of the tuning files, the working directory by default
+#ifndef SPH_TUNING_PATH
+#define SPH_TUNING_PATH ""
+#endif
+
+namespace SPH
+{
+	// The fastest settings --autotune found on one device, kept in a text file per vendor and device id. A file written
+	// by another driver version is ignored, its timings may no longer hold
+	struct Tuning
+	{
+		// local size of every tuned compute pass, by shader name without the layout and precision suffixes
+		std::map<std::string, uint32_t> workGroupSizes;
+		// the fastest force kernel, used unless --force-kernel is given
+		bool hasForceKernel = false;
+		ForceKernel forceKernel = ForceKernel::Gather;
+
+		// 0 if the pass has not been tuned
+		uint32_t WorkGroupSize(const std::string& passName) const;
+		// false if there is no usable file for the device
+		bool Load(const VkPhysicalDeviceProperties& properties);
+		void Save(const VkPhysicalDeviceProperties& properties) const;
+		static std::string FileName(const VkPhysicalDeviceProperties& properties);
+	};
+}
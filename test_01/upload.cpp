@@ -0,0 +1,187 @@
+#include "upload.h"
+#include "vkcsy.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace SPH
+{
+	UploadManager::UploadManager(VkDevice device, const VkAllocationCallbacks* allocator, uint32_t queueFamilyIndex, VkQueue queue, VkBuffer ringBuffer,
+		void* ringMemory, VkDeviceSize ringSize, VkDeviceSize alignment)
+		: deviceHandle(device), allocator(allocator), queueFamilyIndex(queueFamilyIndex), queueHandle(queue), ringBufferHandle(ringBuffer),
+		ring(static_cast<char*>(ringMemory)), ringSize(ringSize), alignment(alignment > 0 ? alignment : 1)
+	{
+		VkCommandPoolCreateInfo commandPoolCreateInfo = CsySmallVk::commandPoolCreateInfo();
+		commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+		commandPoolCreateInfo.queueFamilyIndex = queueFamilyIndex;
+		if (vkCreateCommandPool(device, &commandPoolCreateInfo, allocator, &commandPoolHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("upload command pool creation failed");
+		}
+		VkCommandBufferAllocateInfo commandBufferAllocateInfo = CsySmallVk::commandBufferAllocateInfo();
+		commandBufferAllocateInfo.commandPool = commandPoolHandle;
+		commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		commandBufferAllocateInfo.commandBufferCount = SPH_UPLOAD_BATCHES_IN_FLIGHT;
+		if (vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, commandBufferHandles) != VK_SUCCESS)
+		{
+			throw std::runtime_error("upload command buffer allocation failed");
+		}
+
+		VkSemaphoreTypeCreateInfo timelineCreateInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO, NULL, VK_SEMAPHORE_TYPE_TIMELINE, 0 };
+		VkSemaphoreCreateInfo semaphoreCreateInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, &timelineCreateInfo, 0 };
+		if (vkCreateSemaphore(device, &semaphoreCreateInfo, allocator, &timelineHandle) != VK_SUCCESS)
+		{
+			throw std::runtime_error("upload timeline semaphore creation failed");
+		}
+	}
+
+	UploadManager::~UploadManager()
+	{
+		Wait(submittedValue);
+		vkDestroySemaphore(deviceHandle, timelineHandle, allocator);
+		vkDestroyCommandPool(deviceHandle, commandPoolHandle, allocator);
+	}
+
+	VkDeviceSize UploadManager::Allocate(VkDeviceSize size)
+	{
+		size = (size + alignment - 1) / alignment * alignment;
+		if (size > ringSize)
+		{
+			throw std::runtime_error("upload larger than the staging ring");
+		}
+		for (;;)
+		{
+			if (usedSize == 0)
+			{
+				head = tail = 0;
+			}
+			// an allocation never wraps, the bytes left at the end of the ring are skipped instead
+			VkDeviceSize offset = head;
+			VkDeviceSize skipped = 0;
+			if (offset + size > ringSize)
+			{
+				skipped = ringSize - offset;
+				offset = 0;
+			}
+			if (usedSize + skipped + size <= ringSize)
+			{
+				head = offset + size;
+				usedSize += skipped + size;
+				pendingSize += skipped + size;
+				return offset;
+			}
+			if (batches.empty())
+			{
+				throw std::runtime_error("pending uploads fill the staging ring, submit them first");
+			}
+			Reclaim(true);
+		}
+	}
+
+	void UploadManager::Reclaim(bool wait)
+	{
+		if (wait)
+		{
+			Wait(batches.front().value);
+		}
+		uint64_t completedValue = 0;
+		vkGetSemaphoreCounterValue(deviceHandle, timelineHandle, &completedValue);
+		while (!batches.empty() && batches.front().value <= completedValue)
+		{
+			tail = (tail + batches.front().size) % ringSize;
+			usedSize -= batches.front().size;
+			batches.pop_front();
+		}
+	}
+
+	void* UploadManager::Copy(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size)
+	{
+		const VkDeviceSize ringOffset = Allocate(size);
+		pendingCommands.push_back({ buffer, { ringOffset, offset, size }, false, 0 });
+		return ring + ringOffset;
+	}
+
+	void UploadManager::Copy(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size)
+	{
+		std::memcpy(Copy(buffer, offset, size), data, size);
+	}
+
+	void UploadManager::Fill(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, uint32_t value)
+	{
+		pendingCommands.push_back({ buffer, { 0, offset, size }, true, value });
+	}
+
+	uint64_t UploadManager::Submit(VkSemaphore waitSemaphore, uint64_t waitValue)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return Flush(waitSemaphore, waitValue);
+	}
+
+	uint64_t UploadManager::Flush(VkSemaphore waitSemaphore, uint64_t waitValue)
+	{
+		if (pendingCommands.empty())
+		{
+			return submittedValue;
+		}
+		// the command buffer is free again once the batch that used it last has completed
+		const uint64_t value = submittedValue + 1;
+		if (value > SPH_UPLOAD_BATCHES_IN_FLIGHT)
+		{
+			Wait(value - SPH_UPLOAD_BATCHES_IN_FLIGHT);
+		}
+		VkCommandBuffer commandBuffer = commandBufferHandles[value % SPH_UPLOAD_BATCHES_IN_FLIGHT];
+		vkResetCommandBuffer(commandBuffer, 0);
+		VkCommandBufferBeginInfo beginInfo = CsySmallVk::commandBufferBeginInfo();
+		beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+		if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+		{
+			throw std::runtime_error("upload command buffer begin failed");
+		}
+		for (const PendingCommand& command : pendingCommands)
+		{
+			if (command.fill)
+			{
+				vkCmdFillBuffer(commandBuffer, command.buffer, command.region.dstOffset, command.region.size, command.value);
+			}
+			else
+			{
+				vkCmdCopyBuffer(commandBuffer, ringBufferHandle, command.buffer, 1, &command.region);
+			}
+		}
+		if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+		{
+			throw std::runtime_error("upload command buffer end failed");
+		}
+
+		const VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+		VkTimelineSemaphoreSubmitInfo timelineSubmitInfo{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO, NULL, 1, &waitValue, 1, &value };
+		VkSubmitInfo submitInfo = CsySmallVk::submitInfo();
+		submitInfo.pNext = &timelineSubmitInfo;
+		submitInfo.waitSemaphoreCount = waitSemaphore != VK_NULL_HANDLE ? 1 : 0;
+		submitInfo.pWaitSemaphores = &waitSemaphore;
+		submitInfo.pWaitDstStageMask = &waitStage;
+		timelineSubmitInfo.waitSemaphoreValueCount = submitInfo.waitSemaphoreCount;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		submitInfo.signalSemaphoreCount = 1;
+		submitInfo.pSignalSemaphores = &timelineHandle;
+		if (vkQueueSubmit(queueHandle, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+		{
+			throw std::runtime_error("upload queue submission failed");
+		}
+		submittedValue = value;
+		batches.push_back({ pendingSize, value });
+		pendingSize = 0;
+		pendingCommands.clear();
+		Reclaim(false);
+		return value;
+	}
+
+	void UploadManager::Wait(uint64_t value)
+	{
+		VkSemaphoreWaitInfo waitInfo{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO, NULL, 0, 1, &timelineHandle, &value };
+		if (value > 0 && vkWaitSemaphores(deviceHandle, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+		{
+			throw std::runtime_error("vkWaitSemaphores failed");
+		}
+	}
+}
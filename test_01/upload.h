@@ -0,0 +1,94 @@
+#pragma once
+#include <vulkan/vulkan.h>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// command buffers the uploads cycle through, a batch waits for the one recorded UPLOAD_BATCHES_IN_FLIGHT batches before it
+#ifndef SPH_UPLOAD_BATCHES_IN_FLIGHT
+#define SPH_UPLOAD_BATCHES_IN_FLIGHT 4
+#endif
+
+namespace SPH
+{
+	// Moves host data into device buffers without stalling the queue that steps the simulation. Copies are written
+	// into a persistently mapped staging ring and collected into a batch, Submit records the batch into one command
+	// buffer and submits it on the upload queue (a dedicated transfer queue family when the device has one). A batch
+	// waits on the gpu for the timeline value the caller passes, so it never overwrites what submitted steps still use,
+	// and signals its own timeline value, which the next simulation submission waits for. Ring space is reclaimed once
+	// the upload timeline passes the batch that used it.
+	// The buffers written must be shared with the upload queue family, see Application::CreateBuffer
+	class UploadManager
+	{
+	public:
+		UploadManager(VkDevice device, const VkAllocationCallbacks* allocator, uint32_t queueFamilyIndex, VkQueue queue, VkBuffer ringBuffer,
+			void* ringMemory, VkDeviceSize ringSize, VkDeviceSize alignment);
+		UploadManager(const UploadManager&) = delete;
+		~UploadManager();
+
+		// held across the Copy and Fill calls of one edit, so that a concurrent Submit sends them in the same batch
+		std::unique_lock<std::mutex> Lock() { return std::unique_lock<std::mutex>(mutex); }
+		// returns where to write size bytes that land at offset of buffer, valid until the next Submit
+		void* Copy(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
+		void Copy(VkBuffer buffer, VkDeviceSize offset, const void* data, VkDeviceSize size);
+		void Fill(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size, uint32_t value);
+
+		// submits the pending copies after waitSemaphore reaches waitValue, returns the upload timeline value that
+		// marks their completion, the value of the last batch if nothing is pending
+		uint64_t Submit(VkSemaphore waitSemaphore, uint64_t waitValue);
+		// Submit for a caller that holds Lock(), an edit larger than the ring goes out in several batches this way
+		uint64_t Flush(VkSemaphore waitSemaphore, uint64_t waitValue);
+		// blocks the host until the upload timeline reaches value
+		void Wait(uint64_t value);
+
+		VkSemaphore Timeline() const { return timelineHandle; }
+		uint32_t QueueFamilyIndex() const { return queueFamilyIndex; }
+		VkDeviceSize RingSize() const { return ringSize; }
+		// ring bytes the pending batch holds, alignment and skipped bytes included
+		VkDeviceSize PendingSize() const { return pendingSize; }
+
+	private:
+		// a copy from the ring, or a fill when fill is set, recorded in the order they were asked for
+		struct PendingCommand
+		{
+			VkBuffer buffer;
+			VkBufferCopy region;
+			bool fill;
+			uint32_t value;
+		};
+		// the ring bytes a submitted batch holds until the timeline reaches its value
+		struct Batch
+		{
+			VkDeviceSize size;
+			uint64_t value;
+		};
+
+		VkDeviceSize Allocate(VkDeviceSize size);
+		// frees the ring space of the completed batches, waiting for the oldest one if wait is set and none is
+		void Reclaim(bool wait);
+
+		VkDevice deviceHandle;
+		const VkAllocationCallbacks* allocator;
+		uint32_t queueFamilyIndex;
+		VkQueue queueHandle;
+		VkBuffer ringBufferHandle;
+		char* ring;
+		VkDeviceSize ringSize;
+		VkDeviceSize alignment;
+		// usedSize bytes from tail on, modulo the ring size, are in use, pendingSize of them by the pending batch
+		VkDeviceSize head = 0;
+		VkDeviceSize tail = 0;
+		VkDeviceSize usedSize = 0;
+		VkDeviceSize pendingSize = 0;
+		std::deque<Batch> batches;
+
+		VkCommandPool commandPoolHandle = VK_NULL_HANDLE;
+		VkCommandBuffer commandBufferHandles[SPH_UPLOAD_BATCHES_IN_FLIGHT]{};
+		VkSemaphore timelineHandle = VK_NULL_HANDLE;
+		uint64_t submittedValue = 0;
+
+		std::mutex mutex;
+		std::vector<PendingCommand> pendingCommands;
+	};
+}